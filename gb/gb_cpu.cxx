@@ -1868,7 +1868,7 @@ namespace hydra::Gameboy
         PC &= 0xFFFF;
         if (i <= 0xFF)
         {
-            (this->*CBInstructions[i].op)();
+            CBInstructions[i].op(this);
         }
     }
 
@@ -3386,7 +3386,7 @@ namespace hydra::Gameboy
         PC -= halt_bug_;
         halt_bug_ = false;
         last_instr_ = bus_.Read(old_pc);
-        (this->*Instructions[last_instr_].op)();
+        Instructions[last_instr_].op(this);
         TClock += tTemp;
         if (tTemp >= tRemove)
         {
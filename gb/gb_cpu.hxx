@@ -121,51 +121,59 @@ namespace hydra::Gameboy
         bool ime_ = false;
         bool skip_next_ = false;
 
+        // Handlers are called through plain function pointers, a pointer to member function
+        // costs an extra check on every call and keeps the handler from being inlined
+        template <void (CPU::*Func)()>
+        static void Opcode(CPU* cpu)
+        {
+            (cpu->*Func)();
+        }
+
         struct Instruction
         {
             std::string name;
-            void (CPU::*op)() = nullptr;
+            void (*op)(CPU*) = nullptr;
             // TODO: remove instr times, use the ones in gb_addresses instead
             int skip = 0;
         };
 
         // clang-format off
         std::array<Instruction, 0x100> Instructions = { {
-            { "NOP", &CPU::NOP }, { "LDBC16", &CPU::LDBC16, 2 }, { "LDBCA", &CPU::LDBCA }, { "INCBC", &CPU::INCBC }, { "INCB", &CPU::INCB }, { "DECB", &CPU::DECB }, { "LDB8", &CPU::LDB8, 1 }, { "RLCA", &CPU::RLCA }, { "LD16SP", &CPU::LD16SP, 2 }, { "ADDHLBC", &CPU::ADDHLBC }, { "LDABC", &CPU::LDABC }, { "DECBC", &CPU::DECBC }, { "INCC", &CPU::INCC }, { "DECC", &CPU::DECC }, { "LDC8", &CPU::LDC8, 1 }, { "RRCA", &CPU::RRCA },
-            { "STOP", &CPU::STOP }, { "LDDE16", &CPU::LDDE16, 2 }, { "LDDEA", &CPU::LDDEA }, { "INCDE", &CPU::INCDE }, { "INCD", &CPU::INCD }, { "DECD", &CPU::DECD }, { "LDD8", &CPU::LDD8, 1 }, { "RLA", &CPU::RLA }, { "JR8", &CPU::JR8, 1 }, { "ADDHLDE", &CPU::ADDHLDE }, { "LDADE", &CPU::LDADE }, { "DECDE", &CPU::DECDE }, { "INCE", &CPU::INCE }, { "DECE", &CPU::DECE }, { "LDE8", &CPU::LDE8, 1 }, { "RRA", &CPU::RRA },
-            { "JRNZ8", &CPU::JRNZ8, 1 }, { "LDHL16", &CPU::LDHL16, 2 }, { "LDIHLA", &CPU::LDIHLA }, { "INCHL", &CPU::INCHL }, { "INCH", &CPU::INCH }, { "DECH", &CPU::DECH }, { "LDH8", &CPU::LDH8, 1 }, { "DAA", &CPU::DAA }, { "JRZ8", &CPU::JRZ8, 1 }, { "ADDHLHL", &CPU::ADDHLHL }, { "LDIAHL", &CPU::LDIAHL }, { "DECHL", &CPU::DECHL }, { "INCL", &CPU::INCL }, { "DECL", &CPU::DECL }, { "LDL8", &CPU::LDL8, 1 }, { "CPL", &CPU::CPL },
-            { "JRNC8", &CPU::JRNC8, 1 }, { "LDSP16", &CPU::LDSP16, 2 }, { "LDDHLA", &CPU::LDDHLA }, { "INCSP", &CPU::INCSP }, { "INCHLR", &CPU::INCHLR }, { "DECHLR", &CPU::DECHLR }, { "LDHL8", &CPU::LDHL8, 1 }, { "SCF", &CPU::SCF }, { "JRC8", &CPU::JRC8, 1 }, { "ADDHLSP", &CPU::ADDHLSP }, { "LDDAHL", &CPU::LDDAHL }, { "DECSP", &CPU::DECSP }, { "INCA", &CPU::INCA }, { "DECA", &CPU::DECA }, { "LDA8", &CPU::LDA8, 1 }, { "CCF", &CPU::CCF },
-            { "LDBB", &CPU::LDBB }, { "LDBC", &CPU::LDBC }, { "LDBD", &CPU::LDBD }, { "LDBE", &CPU::LDBE }, { "LDBH", &CPU::LDBH }, { "LDBL", &CPU::LDBL }, { "LDBHL", &CPU::LDBHL }, { "LDBA", &CPU::LDBA }, { "LDCB", &CPU::LDCB }, { "LDCC", &CPU::LDCC }, { "LDCD", &CPU::LDCD }, { "LDCE", &CPU::LDCE }, { "LDCH", &CPU::LDCH }, { "LDCL", &CPU::LDCL }, { "LDCHL", &CPU::LDCHL }, { "LDCA", &CPU::LDCA },
-            { "LDDB", &CPU::LDDB }, { "LDDC", &CPU::LDDC }, { "LDDD", &CPU::LDDD }, { "LDDE", &CPU::LDDE }, { "LDDH", &CPU::LDDH }, { "LDDL", &CPU::LDDL }, { "LDDHL", &CPU::LDDHL }, { "LDDA", &CPU::LDDA }, { "LDEB", &CPU::LDEB }, { "LDEC", &CPU::LDEC }, { "LDED", &CPU::LDED }, { "LDEE", &CPU::LDEE }, { "LDEH", &CPU::LDEH }, { "LDEL", &CPU::LDEL }, { "LDEHL", &CPU::LDEHL }, { "LDEA", &CPU::LDEA },
-            { "LDHB", &CPU::LDHB }, { "LDHC", &CPU::LDHC }, { "LDHD", &CPU::LDHD }, { "LDHE", &CPU::LDHE }, { "LDHH", &CPU::LDHH }, { "LDHL", &CPU::LDHL }, { "LDHHL", &CPU::LDHHL }, { "LDHA", &CPU::LDHA }, { "LDLB", &CPU::LDLB }, { "LDLC", &CPU::LDLC }, { "LDLD", &CPU::LDLD }, { "LDLE", &CPU::LDLE }, { "LDLH", &CPU::LDLH }, { "LDLL", &CPU::LDLL }, { "LDLHL", &CPU::LDLHL }, { "LDLA", &CPU::LDLA },
-            { "LDHLB", &CPU::LDHLB }, { "LDHLC", &CPU::LDHLC }, { "LDHLD", &CPU::LDHLD }, { "LDHLE", &CPU::LDHLE }, { "LDHLH", &CPU::LDHLH }, { "LDHLL", &CPU::LDHLL }, { "HALT", &CPU::HALT }, { "LDHLA", &CPU::LDHLA }, { "LDAB", &CPU::LDAB }, { "LDAC", &CPU::LDAC }, { "LDAD", &CPU::LDAD }, { "LDAE", &CPU::LDAE }, { "LDAH", &CPU::LDAH }, { "LDAL", &CPU::LDAL }, { "LDAHL", &CPU::LDAHL }, { "LDAA", &CPU::LDAA },
-            { "ADDAB", &CPU::ADDAB }, { "ADDAC", &CPU::ADDAC }, { "ADDAD", &CPU::ADDAD }, { "ADDAE", &CPU::ADDAE }, { "ADDAH", &CPU::ADDAH }, { "ADDAL", &CPU::ADDAL }, { "ADDAHL", &CPU::ADDAHL }, { "ADDAA", &CPU::ADDAA }, { "ADCAB", &CPU::ADCAB }, { "ADCAC", &CPU::ADCAC }, { "ADCAD", &CPU::ADCAD }, { "ADCAE", &CPU::ADCAE }, { "ADCAH", &CPU::ADCAH }, { "ADCAL", &CPU::ADCAL }, { "ADCAHL", &CPU::ADCAHL }, { "ADCAA", &CPU::ADCAA },
-            { "SUBAB", &CPU::SUBAB }, { "SUBAC", &CPU::SUBAC }, { "SUBAD", &CPU::SUBAD }, { "SUBAE", &CPU::SUBAE }, { "SUBAH", &CPU::SUBAH }, { "SUBAL", &CPU::SUBAL }, { "SUBAHL", &CPU::SUBAHL }, { "SUBAA", &CPU::SUBAA }, { "SBCAB", &CPU::SBCAB }, { "SBCAC", &CPU::SBCAC }, { "SBCAD", &CPU::SBCAD }, { "SBCAE", &CPU::SBCAE }, { "SBCAH", &CPU::SBCAH }, { "SBCAL", &CPU::SBCAL }, { "SBCAHL", &CPU::SBCAHL }, { "SBCAA", &CPU::SBCAA },
-            { "ANDB", &CPU::ANDB }, { "ANDC", &CPU::ANDC }, { "ANDD", &CPU::ANDD }, { "ANDE", &CPU::ANDE }, { "ANDH", &CPU::ANDH }, { "ANDL", &CPU::ANDL }, { "ANDHL", &CPU::ANDHL }, { "ANDA", &CPU::ANDA }, { "XORB", &CPU::XORB }, { "XORC", &CPU::XORC }, { "XORD", &CPU::XORD }, { "XORE", &CPU::XORE }, { "XORH", &CPU::XORH }, { "XORL", &CPU::XORL }, { "XORHL", &CPU::XORHL }, { "XORA", &CPU::XORA },
-            { "ORB", &CPU::ORB }, { "ORC", &CPU::ORC }, { "ORD", &CPU::ORD }, { "ORE", &CPU::ORE }, { "ORH", &CPU::ORH }, { "ORL", &CPU::ORL }, { "ORHL", &CPU::ORHL }, { "ORA", &CPU::ORA }, { "CPAB", &CPU::CPAB }, { "CPAC", &CPU::CPAC }, { "CPAD", &CPU::CPAD }, { "CPAE", &CPU::CPAE }, { "CPAH", &CPU::CPAH }, { "CPAL", &CPU::CPAL }, { "CPAHL", &CPU::CPAHL }, { "CPAA", &CPU::CPAA },
-            { "RETNZ", &CPU::RETNZ }, { "POPBC", &CPU::POPBC }, { "JPNZ16", &CPU::JPNZ16, 2 }, { "JP16", &CPU::JP16, 2 }, { "CALLNZ16", &CPU::CALLNZ16, 2 }, { "PUSHBC", &CPU::PUSHBC }, { "ADDA8", &CPU::ADDA8, 1 }, { "RST0", &CPU::RST0 }, { "RETZ", &CPU::RETZ }, { "RET", &CPU::RET }, { "JPZ16", &CPU::JPZ16, 2 }, { "EXT", &CPU::EXT, 1 }, { "CALLZ16", &CPU::CALLZ16, 2 }, { "CALL16", &CPU::CALL16, 2 }, { "ADCA8", &CPU::ADCA8, 2 }, { "RST8", &CPU::RST8 },
-            { "RETNC", &CPU::RETNC }, { "POPDE", &CPU::POPDE }, { "JPNC16", &CPU::JPNC16, 2 }, { "???", &CPU::XXX }, { "CALLNC16", &CPU::CALLNC16, 2 }, { "PUSHDE", &CPU::PUSHDE }, { "SUBA8", &CPU::SUBA8, 1 }, { "RST10", &CPU::RST10 }, { "RETC", &CPU::RETC }, { "RETI", &CPU::RETI }, { "JPC16", &CPU::JPC16, 2 }, { "???", &CPU::XXX }, { "CALLC16", &CPU::CALLC16, 2 }, { "???", &CPU::XXX }, { "SBCA8", &CPU::SBCA8, 1 }, { "RST18", &CPU::RST18 },
-            { "LDH8A", &CPU::LDH8A }, { "POPHL", &CPU::POPHL }, { "LDHCA", &CPU::LDHCA }, { "???", &CPU::XXX }, { "???", &CPU::XXX }, { "PUSHHL", &CPU::PUSHHL }, { "AND8", &CPU::AND8, 1 }, { "RST20", &CPU::RST20 }, { "ADDSPD", &CPU::ADDSPD, 1 }, { "JPHL", &CPU::JPHL }, { "LD16A", &CPU::LD16A }, { "???", &CPU::XXX }, { "???", &CPU::XXX }, { "???", &CPU::XXX }, { "XOR8", &CPU::XOR8, 1 }, { "RST28", &CPU::RST28 },
-            { "LDHA8", &CPU::LDHA8, 1 }, { "POPAF", &CPU::POPAF }, { "LDAMC", &CPU::LDAMC }, { "DI", &CPU::DI }, { "???", &CPU::XXX }, { "PUSHAF", &CPU::PUSHAF }, { "OR8", &CPU::OR8, 1 }, { "RST30", &CPU::RST30 }, { "LDHLSPD", &CPU::LDHLSPD, 1 }, { "LDSPHL", &CPU::LDSPHL }, { "LDA16", &CPU::LDA16, 2 }, { "EI", &CPU::EI }, { "???", &CPU::XXX }, { "???", &CPU::XXX }, { "CP8", &CPU::CP8, 1 }, { "RST38", &CPU::RST38 }
+            { "NOP", &Opcode<&CPU::NOP> }, { "LDBC16", &Opcode<&CPU::LDBC16>, 2 }, { "LDBCA", &Opcode<&CPU::LDBCA> }, { "INCBC", &Opcode<&CPU::INCBC> }, { "INCB", &Opcode<&CPU::INCB> }, { "DECB", &Opcode<&CPU::DECB> }, { "LDB8", &Opcode<&CPU::LDB8>, 1 }, { "RLCA", &Opcode<&CPU::RLCA> }, { "LD16SP", &Opcode<&CPU::LD16SP>, 2 }, { "ADDHLBC", &Opcode<&CPU::ADDHLBC> }, { "LDABC", &Opcode<&CPU::LDABC> }, { "DECBC", &Opcode<&CPU::DECBC> }, { "INCC", &Opcode<&CPU::INCC> }, { "DECC", &Opcode<&CPU::DECC> }, { "LDC8", &Opcode<&CPU::LDC8>, 1 }, { "RRCA", &Opcode<&CPU::RRCA> },
+            { "STOP", &Opcode<&CPU::STOP> }, { "LDDE16", &Opcode<&CPU::LDDE16>, 2 }, { "LDDEA", &Opcode<&CPU::LDDEA> }, { "INCDE", &Opcode<&CPU::INCDE> }, { "INCD", &Opcode<&CPU::INCD> }, { "DECD", &Opcode<&CPU::DECD> }, { "LDD8", &Opcode<&CPU::LDD8>, 1 }, { "RLA", &Opcode<&CPU::RLA> }, { "JR8", &Opcode<&CPU::JR8>, 1 }, { "ADDHLDE", &Opcode<&CPU::ADDHLDE> }, { "LDADE", &Opcode<&CPU::LDADE> }, { "DECDE", &Opcode<&CPU::DECDE> }, { "INCE", &Opcode<&CPU::INCE> }, { "DECE", &Opcode<&CPU::DECE> }, { "LDE8", &Opcode<&CPU::LDE8>, 1 }, { "RRA", &Opcode<&CPU::RRA> },
+            { "JRNZ8", &Opcode<&CPU::JRNZ8>, 1 }, { "LDHL16", &Opcode<&CPU::LDHL16>, 2 }, { "LDIHLA", &Opcode<&CPU::LDIHLA> }, { "INCHL", &Opcode<&CPU::INCHL> }, { "INCH", &Opcode<&CPU::INCH> }, { "DECH", &Opcode<&CPU::DECH> }, { "LDH8", &Opcode<&CPU::LDH8>, 1 }, { "DAA", &Opcode<&CPU::DAA> }, { "JRZ8", &Opcode<&CPU::JRZ8>, 1 }, { "ADDHLHL", &Opcode<&CPU::ADDHLHL> }, { "LDIAHL", &Opcode<&CPU::LDIAHL> }, { "DECHL", &Opcode<&CPU::DECHL> }, { "INCL", &Opcode<&CPU::INCL> }, { "DECL", &Opcode<&CPU::DECL> }, { "LDL8", &Opcode<&CPU::LDL8>, 1 }, { "CPL", &Opcode<&CPU::CPL> },
+            { "JRNC8", &Opcode<&CPU::JRNC8>, 1 }, { "LDSP16", &Opcode<&CPU::LDSP16>, 2 }, { "LDDHLA", &Opcode<&CPU::LDDHLA> }, { "INCSP", &Opcode<&CPU::INCSP> }, { "INCHLR", &Opcode<&CPU::INCHLR> }, { "DECHLR", &Opcode<&CPU::DECHLR> }, { "LDHL8", &Opcode<&CPU::LDHL8>, 1 }, { "SCF", &Opcode<&CPU::SCF> }, { "JRC8", &Opcode<&CPU::JRC8>, 1 }, { "ADDHLSP", &Opcode<&CPU::ADDHLSP> }, { "LDDAHL", &Opcode<&CPU::LDDAHL> }, { "DECSP", &Opcode<&CPU::DECSP> }, { "INCA", &Opcode<&CPU::INCA> }, { "DECA", &Opcode<&CPU::DECA> }, { "LDA8", &Opcode<&CPU::LDA8>, 1 }, { "CCF", &Opcode<&CPU::CCF> },
+            { "LDBB", &Opcode<&CPU::LDBB> }, { "LDBC", &Opcode<&CPU::LDBC> }, { "LDBD", &Opcode<&CPU::LDBD> }, { "LDBE", &Opcode<&CPU::LDBE> }, { "LDBH", &Opcode<&CPU::LDBH> }, { "LDBL", &Opcode<&CPU::LDBL> }, { "LDBHL", &Opcode<&CPU::LDBHL> }, { "LDBA", &Opcode<&CPU::LDBA> }, { "LDCB", &Opcode<&CPU::LDCB> }, { "LDCC", &Opcode<&CPU::LDCC> }, { "LDCD", &Opcode<&CPU::LDCD> }, { "LDCE", &Opcode<&CPU::LDCE> }, { "LDCH", &Opcode<&CPU::LDCH> }, { "LDCL", &Opcode<&CPU::LDCL> }, { "LDCHL", &Opcode<&CPU::LDCHL> }, { "LDCA", &Opcode<&CPU::LDCA> },
+            { "LDDB", &Opcode<&CPU::LDDB> }, { "LDDC", &Opcode<&CPU::LDDC> }, { "LDDD", &Opcode<&CPU::LDDD> }, { "LDDE", &Opcode<&CPU::LDDE> }, { "LDDH", &Opcode<&CPU::LDDH> }, { "LDDL", &Opcode<&CPU::LDDL> }, { "LDDHL", &Opcode<&CPU::LDDHL> }, { "LDDA", &Opcode<&CPU::LDDA> }, { "LDEB", &Opcode<&CPU::LDEB> }, { "LDEC", &Opcode<&CPU::LDEC> }, { "LDED", &Opcode<&CPU::LDED> }, { "LDEE", &Opcode<&CPU::LDEE> }, { "LDEH", &Opcode<&CPU::LDEH> }, { "LDEL", &Opcode<&CPU::LDEL> }, { "LDEHL", &Opcode<&CPU::LDEHL> }, { "LDEA", &Opcode<&CPU::LDEA> },
+            { "LDHB", &Opcode<&CPU::LDHB> }, { "LDHC", &Opcode<&CPU::LDHC> }, { "LDHD", &Opcode<&CPU::LDHD> }, { "LDHE", &Opcode<&CPU::LDHE> }, { "LDHH", &Opcode<&CPU::LDHH> }, { "LDHL", &Opcode<&CPU::LDHL> }, { "LDHHL", &Opcode<&CPU::LDHHL> }, { "LDHA", &Opcode<&CPU::LDHA> }, { "LDLB", &Opcode<&CPU::LDLB> }, { "LDLC", &Opcode<&CPU::LDLC> }, { "LDLD", &Opcode<&CPU::LDLD> }, { "LDLE", &Opcode<&CPU::LDLE> }, { "LDLH", &Opcode<&CPU::LDLH> }, { "LDLL", &Opcode<&CPU::LDLL> }, { "LDLHL", &Opcode<&CPU::LDLHL> }, { "LDLA", &Opcode<&CPU::LDLA> },
+            { "LDHLB", &Opcode<&CPU::LDHLB> }, { "LDHLC", &Opcode<&CPU::LDHLC> }, { "LDHLD", &Opcode<&CPU::LDHLD> }, { "LDHLE", &Opcode<&CPU::LDHLE> }, { "LDHLH", &Opcode<&CPU::LDHLH> }, { "LDHLL", &Opcode<&CPU::LDHLL> }, { "HALT", &Opcode<&CPU::HALT> }, { "LDHLA", &Opcode<&CPU::LDHLA> }, { "LDAB", &Opcode<&CPU::LDAB> }, { "LDAC", &Opcode<&CPU::LDAC> }, { "LDAD", &Opcode<&CPU::LDAD> }, { "LDAE", &Opcode<&CPU::LDAE> }, { "LDAH", &Opcode<&CPU::LDAH> }, { "LDAL", &Opcode<&CPU::LDAL> }, { "LDAHL", &Opcode<&CPU::LDAHL> }, { "LDAA", &Opcode<&CPU::LDAA> },
+            { "ADDAB", &Opcode<&CPU::ADDAB> }, { "ADDAC", &Opcode<&CPU::ADDAC> }, { "ADDAD", &Opcode<&CPU::ADDAD> }, { "ADDAE", &Opcode<&CPU::ADDAE> }, { "ADDAH", &Opcode<&CPU::ADDAH> }, { "ADDAL", &Opcode<&CPU::ADDAL> }, { "ADDAHL", &Opcode<&CPU::ADDAHL> }, { "ADDAA", &Opcode<&CPU::ADDAA> }, { "ADCAB", &Opcode<&CPU::ADCAB> }, { "ADCAC", &Opcode<&CPU::ADCAC> }, { "ADCAD", &Opcode<&CPU::ADCAD> }, { "ADCAE", &Opcode<&CPU::ADCAE> }, { "ADCAH", &Opcode<&CPU::ADCAH> }, { "ADCAL", &Opcode<&CPU::ADCAL> }, { "ADCAHL", &Opcode<&CPU::ADCAHL> }, { "ADCAA", &Opcode<&CPU::ADCAA> },
+            { "SUBAB", &Opcode<&CPU::SUBAB> }, { "SUBAC", &Opcode<&CPU::SUBAC> }, { "SUBAD", &Opcode<&CPU::SUBAD> }, { "SUBAE", &Opcode<&CPU::SUBAE> }, { "SUBAH", &Opcode<&CPU::SUBAH> }, { "SUBAL", &Opcode<&CPU::SUBAL> }, { "SUBAHL", &Opcode<&CPU::SUBAHL> }, { "SUBAA", &Opcode<&CPU::SUBAA> }, { "SBCAB", &Opcode<&CPU::SBCAB> }, { "SBCAC", &Opcode<&CPU::SBCAC> }, { "SBCAD", &Opcode<&CPU::SBCAD> }, { "SBCAE", &Opcode<&CPU::SBCAE> }, { "SBCAH", &Opcode<&CPU::SBCAH> }, { "SBCAL", &Opcode<&CPU::SBCAL> }, { "SBCAHL", &Opcode<&CPU::SBCAHL> }, { "SBCAA", &Opcode<&CPU::SBCAA> },
+            { "ANDB", &Opcode<&CPU::ANDB> }, { "ANDC", &Opcode<&CPU::ANDC> }, { "ANDD", &Opcode<&CPU::ANDD> }, { "ANDE", &Opcode<&CPU::ANDE> }, { "ANDH", &Opcode<&CPU::ANDH> }, { "ANDL", &Opcode<&CPU::ANDL> }, { "ANDHL", &Opcode<&CPU::ANDHL> }, { "ANDA", &Opcode<&CPU::ANDA> }, { "XORB", &Opcode<&CPU::XORB> }, { "XORC", &Opcode<&CPU::XORC> }, { "XORD", &Opcode<&CPU::XORD> }, { "XORE", &Opcode<&CPU::XORE> }, { "XORH", &Opcode<&CPU::XORH> }, { "XORL", &Opcode<&CPU::XORL> }, { "XORHL", &Opcode<&CPU::XORHL> }, { "XORA", &Opcode<&CPU::XORA> },
+            { "ORB", &Opcode<&CPU::ORB> }, { "ORC", &Opcode<&CPU::ORC> }, { "ORD", &Opcode<&CPU::ORD> }, { "ORE", &Opcode<&CPU::ORE> }, { "ORH", &Opcode<&CPU::ORH> }, { "ORL", &Opcode<&CPU::ORL> }, { "ORHL", &Opcode<&CPU::ORHL> }, { "ORA", &Opcode<&CPU::ORA> }, { "CPAB", &Opcode<&CPU::CPAB> }, { "CPAC", &Opcode<&CPU::CPAC> }, { "CPAD", &Opcode<&CPU::CPAD> }, { "CPAE", &Opcode<&CPU::CPAE> }, { "CPAH", &Opcode<&CPU::CPAH> }, { "CPAL", &Opcode<&CPU::CPAL> }, { "CPAHL", &Opcode<&CPU::CPAHL> }, { "CPAA", &Opcode<&CPU::CPAA> },
+            { "RETNZ", &Opcode<&CPU::RETNZ> }, { "POPBC", &Opcode<&CPU::POPBC> }, { "JPNZ16", &Opcode<&CPU::JPNZ16>, 2 }, { "JP16", &Opcode<&CPU::JP16>, 2 }, { "CALLNZ16", &Opcode<&CPU::CALLNZ16>, 2 }, { "PUSHBC", &Opcode<&CPU::PUSHBC> }, { "ADDA8", &Opcode<&CPU::ADDA8>, 1 }, { "RST0", &Opcode<&CPU::RST0> }, { "RETZ", &Opcode<&CPU::RETZ> }, { "RET", &Opcode<&CPU::RET> }, { "JPZ16", &Opcode<&CPU::JPZ16>, 2 }, { "EXT", &Opcode<&CPU::EXT>, 1 }, { "CALLZ16", &Opcode<&CPU::CALLZ16>, 2 }, { "CALL16", &Opcode<&CPU::CALL16>, 2 }, { "ADCA8", &Opcode<&CPU::ADCA8>, 2 }, { "RST8", &Opcode<&CPU::RST8> },
+            { "RETNC", &Opcode<&CPU::RETNC> }, { "POPDE", &Opcode<&CPU::POPDE> }, { "JPNC16", &Opcode<&CPU::JPNC16>, 2 }, { "???", &Opcode<&CPU::XXX> }, { "CALLNC16", &Opcode<&CPU::CALLNC16>, 2 }, { "PUSHDE", &Opcode<&CPU::PUSHDE> }, { "SUBA8", &Opcode<&CPU::SUBA8>, 1 }, { "RST10", &Opcode<&CPU::RST10> }, { "RETC", &Opcode<&CPU::RETC> }, { "RETI", &Opcode<&CPU::RETI> }, { "JPC16", &Opcode<&CPU::JPC16>, 2 }, { "???", &Opcode<&CPU::XXX> }, { "CALLC16", &Opcode<&CPU::CALLC16>, 2 }, { "???", &Opcode<&CPU::XXX> }, { "SBCA8", &Opcode<&CPU::SBCA8>, 1 }, { "RST18", &Opcode<&CPU::RST18> },
+            { "LDH8A", &Opcode<&CPU::LDH8A> }, { "POPHL", &Opcode<&CPU::POPHL> }, { "LDHCA", &Opcode<&CPU::LDHCA> }, { "???", &Opcode<&CPU::XXX> }, { "???", &Opcode<&CPU::XXX> }, { "PUSHHL", &Opcode<&CPU::PUSHHL> }, { "AND8", &Opcode<&CPU::AND8>, 1 }, { "RST20", &Opcode<&CPU::RST20> }, { "ADDSPD", &Opcode<&CPU::ADDSPD>, 1 }, { "JPHL", &Opcode<&CPU::JPHL> }, { "LD16A", &Opcode<&CPU::LD16A> }, { "???", &Opcode<&CPU::XXX> }, { "???", &Opcode<&CPU::XXX> }, { "???", &Opcode<&CPU::XXX> }, { "XOR8", &Opcode<&CPU::XOR8>, 1 }, { "RST28", &Opcode<&CPU::RST28> },
+            { "LDHA8", &Opcode<&CPU::LDHA8>, 1 }, { "POPAF", &Opcode<&CPU::POPAF> }, { "LDAMC", &Opcode<&CPU::LDAMC> }, { "DI", &Opcode<&CPU::DI> }, { "???", &Opcode<&CPU::XXX> }, { "PUSHAF", &Opcode<&CPU::PUSHAF> }, { "OR8", &Opcode<&CPU::OR8>, 1 }, { "RST30", &Opcode<&CPU::RST30> }, { "LDHLSPD", &Opcode<&CPU::LDHLSPD>, 1 }, { "LDSPHL", &Opcode<&CPU::LDSPHL> }, { "LDA16", &Opcode<&CPU::LDA16>, 2 }, { "EI", &Opcode<&CPU::EI> }, { "???", &Opcode<&CPU::XXX> }, { "???", &Opcode<&CPU::XXX> }, { "CP8", &Opcode<&CPU::CP8>, 1 }, { "RST38", &Opcode<&CPU::RST38> }
         } };
 
         std::array<Instruction, 0x100> CBInstructions = { {
-            { "RLCB", &CPU::RLCB }, { "RLCC", &CPU::RLCC }, { "RLCD", &CPU::RLCD }, { "RLCE", &CPU::RLCE }, { "RLCH", &CPU::RLCH }, { "RLCL", &CPU::RLCL }, { "RLCHL", &CPU::RLCHL }, { "RLCAr", &CPU::RLCAr },  { "RRCB", &CPU::RRCB }, { "RRCC", &CPU::RRCC }, { "RRCD", &CPU::RRCD }, { "RRCE", &CPU::RRCE }, { "RRCH", &CPU::RRCH }, { "RRCL", &CPU::RRCL }, { "RRCHL", &CPU::RRCHL }, { "RRCAr", &CPU::RRCAr },
-            { "RLB", &CPU::RLB }, { "RLC", &CPU::RLC }, { "RLD", &CPU::RLD }, { "RLE", &CPU::RLE }, { "RLH", &CPU::RLH }, { "RLL", &CPU::RLL }, { "RLHL", &CPU::RLHL }, { "RLAr", &CPU::RLAr }, { "RRB", &CPU::RRB }, { "RRC", &CPU::RRC },  { "RRD", &CPU::RRD },  { "RRE", &CPU::RRE },  { "RRH", &CPU::RRH },  { "RRL", &CPU::RRL },  { "RRHL", &CPU::RRHL },  { "RRAr", &CPU::RRAr },
-            { "SLAB", &CPU::SLAB }, { "SLAC", &CPU::SLAC }, { "SLAD", &CPU::SLAD }, { "SLAE", &CPU::SLAE }, { "SLAH", &CPU::SLAH }, { "SLAL", &CPU::SLAL }, { "SLAHL", &CPU::SLAHL }, { "SLAA", &CPU::SLAA }, { "SRAB", &CPU::SRAB }, { "SRAC", &CPU::SRAC }, { "SRAD", &CPU::SRAD }, { "SRAE", &CPU::SRAE }, { "SRAH", &CPU::SRAH }, { "SRAL", &CPU::SRAL }, { "SRAHL", &CPU::SRAHL }, { "SRAA", &CPU::SRAA },
-            { "SWAPB", &CPU::SWAPB }, { "SWAPC", &CPU::SWAPC }, { "SWAPD", &CPU::SWAPD }, { "SWAPE", &CPU::SWAPE }, { "SWAPH", &CPU::SWAPH }, { "SWAPL", &CPU::SWAPL }, { "SWAPHL", &CPU::SWAPHL }, { "SWAPA", &CPU::SWAPA }, { "SRLB", &CPU::SRLB }, { "SRLC", &CPU::SRLC }, { "SRLD", &CPU::SRLD }, { "SRLE", &CPU::SRLE }, { "SRLH", &CPU::SRLH }, { "SRLL", &CPU::SRLL }, { "SRLHL", &CPU::SRLHL }, { "SRLA", &CPU::SRLA },
-            { "BIT0B", &CPU::BIT0B }, { "BIT0C", &CPU::BIT0C }, { "BIT0D", &CPU::BIT0D }, { "BIT0E", &CPU::BIT0E }, { "BIT0H", &CPU::BIT0H }, { "BIT0L", &CPU::BIT0L }, { "BIT0M", &CPU::BIT0M }, { "BIT0A", &CPU::BIT0A }, { "BIT1B", &CPU::BIT1B }, { "BIT1C", &CPU::BIT1C }, { "BIT1D", &CPU::BIT1D }, { "BIT1E", &CPU::BIT1E }, { "BIT1H", &CPU::BIT1H }, { "BIT1L", &CPU::BIT1L }, { "BIT1M", &CPU::BIT1M }, { "BIT1A", &CPU::BIT1A },
-            { "BIT2B", &CPU::BIT2B }, { "BIT2C", &CPU::BIT2C }, { "BIT2D", &CPU::BIT2D }, { "BIT2E", &CPU::BIT2E }, { "BIT2H", &CPU::BIT2H }, { "BIT2L", &CPU::BIT2L }, { "BIT2M", &CPU::BIT2M }, { "BIT2A", &CPU::BIT2A }, { "BIT3B", &CPU::BIT3B }, { "BIT3C", &CPU::BIT3C }, { "BIT3D", &CPU::BIT3D }, { "BIT3E", &CPU::BIT3E }, { "BIT3H", &CPU::BIT3H }, { "BIT3L", &CPU::BIT3L }, { "BIT3M", &CPU::BIT3M }, { "BIT3A", &CPU::BIT3A },
-            { "BIT4B", &CPU::BIT4B }, { "BIT4C", &CPU::BIT4C }, { "BIT4D", &CPU::BIT4D }, { "BIT4E", &CPU::BIT4E }, { "BIT4H", &CPU::BIT4H }, { "BIT4L", &CPU::BIT4L }, { "BIT4M", &CPU::BIT4M }, { "BIT4A", &CPU::BIT4A }, { "BIT5B", &CPU::BIT5B }, { "BIT5C", &CPU::BIT5C }, { "BIT5D", &CPU::BIT5D }, { "BIT5E", &CPU::BIT5E }, { "BIT5H", &CPU::BIT5H }, { "BIT5L", &CPU::BIT5L }, { "BIT5M", &CPU::BIT5M }, { "BIT5A", &CPU::BIT5A },
-            { "BIT6B", &CPU::BIT6B }, { "BIT6C", &CPU::BIT6C }, { "BIT6D", &CPU::BIT6D }, { "BIT6E", &CPU::BIT6E }, { "BIT6H", &CPU::BIT6H }, { "BIT6L", &CPU::BIT6L }, { "BIT6M", &CPU::BIT6M }, { "BIT6A", &CPU::BIT6A }, { "BIT7B", &CPU::BIT7B }, { "BIT7C", &CPU::BIT7C }, { "BIT7D", &CPU::BIT7D }, { "BIT7E", &CPU::BIT7E }, { "BIT7H", &CPU::BIT7H }, { "BIT7L", &CPU::BIT7L }, { "BIT7M", &CPU::BIT7M }, { "BIT7A", &CPU::BIT7A },
-            { "RES0B", &CPU::RES0B }, { "RES0C", &CPU::RES0C }, { "RES0D", &CPU::RES0D }, { "RES0E", &CPU::RES0E }, { "RES0H", &CPU::RES0H }, { "RES0L", &CPU::RES0L }, { "RES0HL", &CPU::RES0HL }, { "RES0A", &CPU::RES0A }, { "RES1B", &CPU::RES1B }, { "RES1C", &CPU::RES1C }, { "RES1D", &CPU::RES1D }, { "RES1E", &CPU::RES1E }, { "RES1H", &CPU::RES1H }, { "RES1L", &CPU::RES1L }, { "RES1HL", &CPU::RES1HL }, { "RES1A", &CPU::RES1A },
-            { "RES2B", &CPU::RES2B }, { "RES2C", &CPU::RES2C }, { "RES2D", &CPU::RES2D }, { "RES2E", &CPU::RES2E }, { "RES2H", &CPU::RES2H }, { "RES2L", &CPU::RES2L }, { "RES2HL", &CPU::RES2HL }, { "RES2A", &CPU::RES2A }, { "RES3B", &CPU::RES3B }, { "RES3C", &CPU::RES3C }, { "RES3D", &CPU::RES3D }, { "RES3E", &CPU::RES3E }, { "RES3H", &CPU::RES3H }, { "RES3L", &CPU::RES3L }, { "RES3HL", &CPU::RES3HL }, { "RES3A", &CPU::RES3A },
-            { "RES4B", &CPU::RES4B }, { "RES4C", &CPU::RES4C }, { "RES4D", &CPU::RES4D }, { "RES4E", &CPU::RES4E }, { "RES4H", &CPU::RES4H }, { "RES4L", &CPU::RES4L }, { "RES4HL", &CPU::RES4HL }, { "RES4A", &CPU::RES4A }, { "RES5B", &CPU::RES5B }, { "RES5C", &CPU::RES5C }, { "RES5D", &CPU::RES5D }, { "RES5E", &CPU::RES5E }, { "RES5H", &CPU::RES5H }, { "RES5L", &CPU::RES5L }, { "RES5HL", &CPU::RES5HL }, { "RES5A", &CPU::RES5A },
-            { "RES6B", &CPU::RES6B }, { "RES6C", &CPU::RES6C }, { "RES6D", &CPU::RES6D }, { "RES6E", &CPU::RES6E }, { "RES6H", &CPU::RES6H }, { "RES6L", &CPU::RES6L }, { "RES6HL", &CPU::RES6HL }, { "RES6A", &CPU::RES6A }, { "RES7B", &CPU::RES7B }, { "RES7C", &CPU::RES7C }, { "RES7D", &CPU::RES7D }, { "RES7E", &CPU::RES7E }, { "RES7H", &CPU::RES7H }, { "RES7L", &CPU::RES7L }, { "RES7HL", &CPU::RES7HL }, { "RES7A", &CPU::RES7A },
-            { "SET0B", &CPU::SET0B }, { "SET0C", &CPU::SET0C }, { "SET0D", &CPU::SET0D }, { "SET0E", &CPU::SET0E }, { "SET0H", &CPU::SET0H }, { "SET0L", &CPU::SET0L }, { "SET0HL", &CPU::SET0HL }, { "SET0A", &CPU::SET0A }, { "SET1B", &CPU::SET1B }, { "SET1C", &CPU::SET1C }, { "SET1D", &CPU::SET1D }, { "SET1E", &CPU::SET1E }, { "SET1H", &CPU::SET1H }, { "SET1L", &CPU::SET1L }, { "SET1HL", &CPU::SET1HL }, { "SET1A", &CPU::SET1A },
-            { "SET2B", &CPU::SET2B }, { "SET2C", &CPU::SET2C }, { "SET2D", &CPU::SET2D }, { "SET2E", &CPU::SET2E }, { "SET2H", &CPU::SET2H }, { "SET2L", &CPU::SET2L }, { "SET2HL", &CPU::SET2HL }, { "SET2A", &CPU::SET2A }, { "SET3B", &CPU::SET3B }, { "SET3C", &CPU::SET3C }, { "SET3D", &CPU::SET3D }, { "SET3E", &CPU::SET3E }, { "SET3H", &CPU::SET3H }, { "SET3L", &CPU::SET3L }, { "SET3HL", &CPU::SET3HL }, { "SET3A", &CPU::SET3A },
-            { "SET4B", &CPU::SET4B }, { "SET4C", &CPU::SET4C }, { "SET4D", &CPU::SET4D }, { "SET4E", &CPU::SET4E }, { "SET4H", &CPU::SET4H }, { "SET4L", &CPU::SET4L }, { "SET4HL", &CPU::SET4HL }, { "SET4A", &CPU::SET4A }, { "SET5B", &CPU::SET5B }, { "SET5C", &CPU::SET5C }, { "SET5D", &CPU::SET5D }, { "SET5E", &CPU::SET5E }, { "SET5H", &CPU::SET5H }, { "SET5L", &CPU::SET5L }, { "SET5HL", &CPU::SET5HL }, { "SET5A", &CPU::SET5A },
-            { "SET6B", &CPU::SET6B }, { "SET6C", &CPU::SET6C }, { "SET6D", &CPU::SET6D }, { "SET6E", &CPU::SET6E }, { "SET6H", &CPU::SET6H }, { "SET6L", &CPU::SET6L }, { "SET6HL", &CPU::SET6HL }, { "SET6A", &CPU::SET6A }, { "SET7B", &CPU::SET7B }, { "SET7C", &CPU::SET7C }, { "SET7D", &CPU::SET7D }, { "SET7E", &CPU::SET7E }, { "SET7H", &CPU::SET7H }, { "SET7L", &CPU::SET7L }, { "SET7HL", &CPU::SET7HL }, { "SET7A", &CPU::SET7A }
+            { "RLCB", &Opcode<&CPU::RLCB> }, { "RLCC", &Opcode<&CPU::RLCC> }, { "RLCD", &Opcode<&CPU::RLCD> }, { "RLCE", &Opcode<&CPU::RLCE> }, { "RLCH", &Opcode<&CPU::RLCH> }, { "RLCL", &Opcode<&CPU::RLCL> }, { "RLCHL", &Opcode<&CPU::RLCHL> }, { "RLCAr", &Opcode<&CPU::RLCAr> },  { "RRCB", &Opcode<&CPU::RRCB> }, { "RRCC", &Opcode<&CPU::RRCC> }, { "RRCD", &Opcode<&CPU::RRCD> }, { "RRCE", &Opcode<&CPU::RRCE> }, { "RRCH", &Opcode<&CPU::RRCH> }, { "RRCL", &Opcode<&CPU::RRCL> }, { "RRCHL", &Opcode<&CPU::RRCHL> }, { "RRCAr", &Opcode<&CPU::RRCAr> },
+            { "RLB", &Opcode<&CPU::RLB> }, { "RLC", &Opcode<&CPU::RLC> }, { "RLD", &Opcode<&CPU::RLD> }, { "RLE", &Opcode<&CPU::RLE> }, { "RLH", &Opcode<&CPU::RLH> }, { "RLL", &Opcode<&CPU::RLL> }, { "RLHL", &Opcode<&CPU::RLHL> }, { "RLAr", &Opcode<&CPU::RLAr> }, { "RRB", &Opcode<&CPU::RRB> }, { "RRC", &Opcode<&CPU::RRC> },  { "RRD", &Opcode<&CPU::RRD> },  { "RRE", &Opcode<&CPU::RRE> },  { "RRH", &Opcode<&CPU::RRH> },  { "RRL", &Opcode<&CPU::RRL> },  { "RRHL", &Opcode<&CPU::RRHL> },  { "RRAr", &Opcode<&CPU::RRAr> },
+            { "SLAB", &Opcode<&CPU::SLAB> }, { "SLAC", &Opcode<&CPU::SLAC> }, { "SLAD", &Opcode<&CPU::SLAD> }, { "SLAE", &Opcode<&CPU::SLAE> }, { "SLAH", &Opcode<&CPU::SLAH> }, { "SLAL", &Opcode<&CPU::SLAL> }, { "SLAHL", &Opcode<&CPU::SLAHL> }, { "SLAA", &Opcode<&CPU::SLAA> }, { "SRAB", &Opcode<&CPU::SRAB> }, { "SRAC", &Opcode<&CPU::SRAC> }, { "SRAD", &Opcode<&CPU::SRAD> }, { "SRAE", &Opcode<&CPU::SRAE> }, { "SRAH", &Opcode<&CPU::SRAH> }, { "SRAL", &Opcode<&CPU::SRAL> }, { "SRAHL", &Opcode<&CPU::SRAHL> }, { "SRAA", &Opcode<&CPU::SRAA> },
+            { "SWAPB", &Opcode<&CPU::SWAPB> }, { "SWAPC", &Opcode<&CPU::SWAPC> }, { "SWAPD", &Opcode<&CPU::SWAPD> }, { "SWAPE", &Opcode<&CPU::SWAPE> }, { "SWAPH", &Opcode<&CPU::SWAPH> }, { "SWAPL", &Opcode<&CPU::SWAPL> }, { "SWAPHL", &Opcode<&CPU::SWAPHL> }, { "SWAPA", &Opcode<&CPU::SWAPA> }, { "SRLB", &Opcode<&CPU::SRLB> }, { "SRLC", &Opcode<&CPU::SRLC> }, { "SRLD", &Opcode<&CPU::SRLD> }, { "SRLE", &Opcode<&CPU::SRLE> }, { "SRLH", &Opcode<&CPU::SRLH> }, { "SRLL", &Opcode<&CPU::SRLL> }, { "SRLHL", &Opcode<&CPU::SRLHL> }, { "SRLA", &Opcode<&CPU::SRLA> },
+            { "BIT0B", &Opcode<&CPU::BIT0B> }, { "BIT0C", &Opcode<&CPU::BIT0C> }, { "BIT0D", &Opcode<&CPU::BIT0D> }, { "BIT0E", &Opcode<&CPU::BIT0E> }, { "BIT0H", &Opcode<&CPU::BIT0H> }, { "BIT0L", &Opcode<&CPU::BIT0L> }, { "BIT0M", &Opcode<&CPU::BIT0M> }, { "BIT0A", &Opcode<&CPU::BIT0A> }, { "BIT1B", &Opcode<&CPU::BIT1B> }, { "BIT1C", &Opcode<&CPU::BIT1C> }, { "BIT1D", &Opcode<&CPU::BIT1D> }, { "BIT1E", &Opcode<&CPU::BIT1E> }, { "BIT1H", &Opcode<&CPU::BIT1H> }, { "BIT1L", &Opcode<&CPU::BIT1L> }, { "BIT1M", &Opcode<&CPU::BIT1M> }, { "BIT1A", &Opcode<&CPU::BIT1A> },
+            { "BIT2B", &Opcode<&CPU::BIT2B> }, { "BIT2C", &Opcode<&CPU::BIT2C> }, { "BIT2D", &Opcode<&CPU::BIT2D> }, { "BIT2E", &Opcode<&CPU::BIT2E> }, { "BIT2H", &Opcode<&CPU::BIT2H> }, { "BIT2L", &Opcode<&CPU::BIT2L> }, { "BIT2M", &Opcode<&CPU::BIT2M> }, { "BIT2A", &Opcode<&CPU::BIT2A> }, { "BIT3B", &Opcode<&CPU::BIT3B> }, { "BIT3C", &Opcode<&CPU::BIT3C> }, { "BIT3D", &Opcode<&CPU::BIT3D> }, { "BIT3E", &Opcode<&CPU::BIT3E> }, { "BIT3H", &Opcode<&CPU::BIT3H> }, { "BIT3L", &Opcode<&CPU::BIT3L> }, { "BIT3M", &Opcode<&CPU::BIT3M> }, { "BIT3A", &Opcode<&CPU::BIT3A> },
+            { "BIT4B", &Opcode<&CPU::BIT4B> }, { "BIT4C", &Opcode<&CPU::BIT4C> }, { "BIT4D", &Opcode<&CPU::BIT4D> }, { "BIT4E", &Opcode<&CPU::BIT4E> }, { "BIT4H", &Opcode<&CPU::BIT4H> }, { "BIT4L", &Opcode<&CPU::BIT4L> }, { "BIT4M", &Opcode<&CPU::BIT4M> }, { "BIT4A", &Opcode<&CPU::BIT4A> }, { "BIT5B", &Opcode<&CPU::BIT5B> }, { "BIT5C", &Opcode<&CPU::BIT5C> }, { "BIT5D", &Opcode<&CPU::BIT5D> }, { "BIT5E", &Opcode<&CPU::BIT5E> }, { "BIT5H", &Opcode<&CPU::BIT5H> }, { "BIT5L", &Opcode<&CPU::BIT5L> }, { "BIT5M", &Opcode<&CPU::BIT5M> }, { "BIT5A", &Opcode<&CPU::BIT5A> },
+            { "BIT6B", &Opcode<&CPU::BIT6B> }, { "BIT6C", &Opcode<&CPU::BIT6C> }, { "BIT6D", &Opcode<&CPU::BIT6D> }, { "BIT6E", &Opcode<&CPU::BIT6E> }, { "BIT6H", &Opcode<&CPU::BIT6H> }, { "BIT6L", &Opcode<&CPU::BIT6L> }, { "BIT6M", &Opcode<&CPU::BIT6M> }, { "BIT6A", &Opcode<&CPU::BIT6A> }, { "BIT7B", &Opcode<&CPU::BIT7B> }, { "BIT7C", &Opcode<&CPU::BIT7C> }, { "BIT7D", &Opcode<&CPU::BIT7D> }, { "BIT7E", &Opcode<&CPU::BIT7E> }, { "BIT7H", &Opcode<&CPU::BIT7H> }, { "BIT7L", &Opcode<&CPU::BIT7L> }, { "BIT7M", &Opcode<&CPU::BIT7M> }, { "BIT7A", &Opcode<&CPU::BIT7A> },
+            { "RES0B", &Opcode<&CPU::RES0B> }, { "RES0C", &Opcode<&CPU::RES0C> }, { "RES0D", &Opcode<&CPU::RES0D> }, { "RES0E", &Opcode<&CPU::RES0E> }, { "RES0H", &Opcode<&CPU::RES0H> }, { "RES0L", &Opcode<&CPU::RES0L> }, { "RES0HL", &Opcode<&CPU::RES0HL> }, { "RES0A", &Opcode<&CPU::RES0A> }, { "RES1B", &Opcode<&CPU::RES1B> }, { "RES1C", &Opcode<&CPU::RES1C> }, { "RES1D", &Opcode<&CPU::RES1D> }, { "RES1E", &Opcode<&CPU::RES1E> }, { "RES1H", &Opcode<&CPU::RES1H> }, { "RES1L", &Opcode<&CPU::RES1L> }, { "RES1HL", &Opcode<&CPU::RES1HL> }, { "RES1A", &Opcode<&CPU::RES1A> },
+            { "RES2B", &Opcode<&CPU::RES2B> }, { "RES2C", &Opcode<&CPU::RES2C> }, { "RES2D", &Opcode<&CPU::RES2D> }, { "RES2E", &Opcode<&CPU::RES2E> }, { "RES2H", &Opcode<&CPU::RES2H> }, { "RES2L", &Opcode<&CPU::RES2L> }, { "RES2HL", &Opcode<&CPU::RES2HL> }, { "RES2A", &Opcode<&CPU::RES2A> }, { "RES3B", &Opcode<&CPU::RES3B> }, { "RES3C", &Opcode<&CPU::RES3C> }, { "RES3D", &Opcode<&CPU::RES3D> }, { "RES3E", &Opcode<&CPU::RES3E> }, { "RES3H", &Opcode<&CPU::RES3H> }, { "RES3L", &Opcode<&CPU::RES3L> }, { "RES3HL", &Opcode<&CPU::RES3HL> }, { "RES3A", &Opcode<&CPU::RES3A> },
+            { "RES4B", &Opcode<&CPU::RES4B> }, { "RES4C", &Opcode<&CPU::RES4C> }, { "RES4D", &Opcode<&CPU::RES4D> }, { "RES4E", &Opcode<&CPU::RES4E> }, { "RES4H", &Opcode<&CPU::RES4H> }, { "RES4L", &Opcode<&CPU::RES4L> }, { "RES4HL", &Opcode<&CPU::RES4HL> }, { "RES4A", &Opcode<&CPU::RES4A> }, { "RES5B", &Opcode<&CPU::RES5B> }, { "RES5C", &Opcode<&CPU::RES5C> }, { "RES5D", &Opcode<&CPU::RES5D> }, { "RES5E", &Opcode<&CPU::RES5E> }, { "RES5H", &Opcode<&CPU::RES5H> }, { "RES5L", &Opcode<&CPU::RES5L> }, { "RES5HL", &Opcode<&CPU::RES5HL> }, { "RES5A", &Opcode<&CPU::RES5A> },
+            { "RES6B", &Opcode<&CPU::RES6B> }, { "RES6C", &Opcode<&CPU::RES6C> }, { "RES6D", &Opcode<&CPU::RES6D> }, { "RES6E", &Opcode<&CPU::RES6E> }, { "RES6H", &Opcode<&CPU::RES6H> }, { "RES6L", &Opcode<&CPU::RES6L> }, { "RES6HL", &Opcode<&CPU::RES6HL> }, { "RES6A", &Opcode<&CPU::RES6A> }, { "RES7B", &Opcode<&CPU::RES7B> }, { "RES7C", &Opcode<&CPU::RES7C> }, { "RES7D", &Opcode<&CPU::RES7D> }, { "RES7E", &Opcode<&CPU::RES7E> }, { "RES7H", &Opcode<&CPU::RES7H> }, { "RES7L", &Opcode<&CPU::RES7L> }, { "RES7HL", &Opcode<&CPU::RES7HL> }, { "RES7A", &Opcode<&CPU::RES7A> },
+            { "SET0B", &Opcode<&CPU::SET0B> }, { "SET0C", &Opcode<&CPU::SET0C> }, { "SET0D", &Opcode<&CPU::SET0D> }, { "SET0E", &Opcode<&CPU::SET0E> }, { "SET0H", &Opcode<&CPU::SET0H> }, { "SET0L", &Opcode<&CPU::SET0L> }, { "SET0HL", &Opcode<&CPU::SET0HL> }, { "SET0A", &Opcode<&CPU::SET0A> }, { "SET1B", &Opcode<&CPU::SET1B> }, { "SET1C", &Opcode<&CPU::SET1C> }, { "SET1D", &Opcode<&CPU::SET1D> }, { "SET1E", &Opcode<&CPU::SET1E> }, { "SET1H", &Opcode<&CPU::SET1H> }, { "SET1L", &Opcode<&CPU::SET1L> }, { "SET1HL", &Opcode<&CPU::SET1HL> }, { "SET1A", &Opcode<&CPU::SET1A> },
+            { "SET2B", &Opcode<&CPU::SET2B> }, { "SET2C", &Opcode<&CPU::SET2C> }, { "SET2D", &Opcode<&CPU::SET2D> }, { "SET2E", &Opcode<&CPU::SET2E> }, { "SET2H", &Opcode<&CPU::SET2H> }, { "SET2L", &Opcode<&CPU::SET2L> }, { "SET2HL", &Opcode<&CPU::SET2HL> }, { "SET2A", &Opcode<&CPU::SET2A> }, { "SET3B", &Opcode<&CPU::SET3B> }, { "SET3C", &Opcode<&CPU::SET3C> }, { "SET3D", &Opcode<&CPU::SET3D> }, { "SET3E", &Opcode<&CPU::SET3E> }, { "SET3H", &Opcode<&CPU::SET3H> }, { "SET3L", &Opcode<&CPU::SET3L> }, { "SET3HL", &Opcode<&CPU::SET3HL> }, { "SET3A", &Opcode<&CPU::SET3A> },
+            { "SET4B", &Opcode<&CPU::SET4B> }, { "SET4C", &Opcode<&CPU::SET4C> }, { "SET4D", &Opcode<&CPU::SET4D> }, { "SET4E", &Opcode<&CPU::SET4E> }, { "SET4H", &Opcode<&CPU::SET4H> }, { "SET4L", &Opcode<&CPU::SET4L> }, { "SET4HL", &Opcode<&CPU::SET4HL> }, { "SET4A", &Opcode<&CPU::SET4A> }, { "SET5B", &Opcode<&CPU::SET5B> }, { "SET5C", &Opcode<&CPU::SET5C> }, { "SET5D", &Opcode<&CPU::SET5D> }, { "SET5E", &Opcode<&CPU::SET5E> }, { "SET5H", &Opcode<&CPU::SET5H> }, { "SET5L", &Opcode<&CPU::SET5L> }, { "SET5HL", &Opcode<&CPU::SET5HL> }, { "SET5A", &Opcode<&CPU::SET5A> },
+            { "SET6B", &Opcode<&CPU::SET6B> }, { "SET6C", &Opcode<&CPU::SET6C> }, { "SET6D", &Opcode<&CPU::SET6D> }, { "SET6E", &Opcode<&CPU::SET6E> }, { "SET6H", &Opcode<&CPU::SET6H> }, { "SET6L", &Opcode<&CPU::SET6L> }, { "SET6HL", &Opcode<&CPU::SET6HL> }, { "SET6A", &Opcode<&CPU::SET6A> }, { "SET7B", &Opcode<&CPU::SET7B> }, { "SET7C", &Opcode<&CPU::SET7C> }, { "SET7D", &Opcode<&CPU::SET7D> }, { "SET7E", &Opcode<&CPU::SET7E> }, { "SET7H", &Opcode<&CPU::SET7H> }, { "SET7L", &Opcode<&CPU::SET7L> }, { "SET7HL", &Opcode<&CPU::SET7HL> }, { "SET7A", &Opcode<&CPU::SET7A> }
         } };
         // clang-format on
 
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <gb/gb_addresses.hxx>
+#include <gb/gb_apu.hxx>
+#include <gb/gb_bus.hxx>
+#include <gb/gb_cpu.hxx>
+#include <gb/gb_ppu.hxx>
+#include <gb/gb_timer.hxx>
+#include <memory>
+#include <vector>
+
+// Instructions per second of the Game Boy interpreter, on a small loop of ALU, memory and
+// branch instructions run from a ROM built in memory. Only the CPU is stepped, the PPU, APU
+// and timer are left out as they cost the same however instructions are dispatched. Best of
+// a few runs, as the numbers are noisy
+
+namespace
+{
+    constexpr uint64_t INSTRUCTIONS = 50'000'000;
+    constexpr int RUNS = 3;
+
+    // clang-format off
+    constexpr std::array<uint8_t, 19> program = {
+        0x21, 0x00, 0xC0, // ld hl, 0xC000
+        0x3C,             // inc a
+        0x47,             // ld b, a
+        0x80,             // add a, b
+        0x22,             // ld [hl+], a
+        0x7E,             // ld a, [hl]
+        0xCB, 0x37,       // swap a
+        0xA8,             // xor b
+        0x0E, 0x04,       // ld c, 4
+        0x0D,             // dec c
+        0x20, 0xFD,       // jr nz, -3
+        0xC3, 0x50, 0x01, // jp 0x150
+    };
+    // clang-format on
+
+    double bench()
+    {
+        using namespace hydra::Gameboy;
+        auto channel_array_ptr = std::make_shared<ChannelArray>();
+        Bus bus(channel_array_ptr);
+        APU apu(channel_array_ptr, bus.GetReference(addr_NR52));
+        PPU ppu(bus);
+        Timer timer(channel_array_ptr, bus);
+        CPU cpu(bus, ppu, apu, timer);
+
+        // A 32KiB ROM only cartridge that jumps from the entry point to the program
+        std::vector<uint8_t> rom(0x8000, 0x00);
+        rom[0x100] = 0xC3;
+        rom[0x101] = 0x50;
+        rom[0x102] = 0x01;
+        std::copy(program.begin(), program.end(), rom.begin() + 0x150);
+        bus.LoadCartridge(rom.data());
+        cpu.Reset(true);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < INSTRUCTIONS; i++)
+        {
+            cpu.Update();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return INSTRUCTIONS / elapsed.count();
+    }
+} // namespace
+
+int main()
+{
+    double best = 0;
+    for (int i = 0; i < RUNS; i++)
+    {
+        best = std::max(best, bench());
+    }
+    printf("gb cpu %8.2f MIPS\n", best / 1e6);
+    return 0;
+}
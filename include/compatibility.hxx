@@ -21,6 +21,16 @@
 #endif
 #endif
 
+// The SIMD kernels (RSP vector unit, RDP span walker, VI row conversion) work on 128-bit vectors
+// and need SSE4.1, their scalar versions are the reference and are used everywhere else. MSVC
+// never defines __SSE4_1__, /arch:AVX and above are the lowest flags it has that imply it
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && defined(__AVX__))
+#define HYDRA_SIMD_AVAILABLE 1
+#include <smmintrin.h>
+#else
+#define HYDRA_SIMD_AVAILABLE 0
+#endif
+
 #ifdef __clang__
 #define hydra_inline [[clang::always_inline]] inline
 #elif defined(__GNUC__)
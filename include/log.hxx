@@ -4,6 +4,8 @@
 #include <fmt/core.h>
 #include <fmt/format.h>
 #include <global.hxx>
+#include <iterator>
+#include <mutex>
 #include <str_hash.hxx>
 #include <unordered_map>
 
@@ -12,6 +14,8 @@
 #define ENABLE_DEBUG 0
 #define RSP_LOGGING false
 #define CPU_LOGGING false
+#define RSP_PROFILING false
+#define CPU_PROFILING false
 
 struct Logger
 {
@@ -34,13 +38,18 @@ struct Logger
     static void WarnOnce(fmt::format_string<T...> fmt, T&&... args)
     {
         static std::unordered_map<uint32_t, bool> warnings = get_warnings();
-
-        std::string msg = fmt::format(fmt, std::forward<T>(args)...);
-        uint32_t hash = str_hash(msg);
+        // The RDP workers warn too
+        static std::mutex mutex;
+
+        // Formatted on the stack, so warnings that were already shown don't allocate
+        fmt::memory_buffer msg;
+        fmt::format_to(std::back_inserter(msg), fmt, std::forward<T>(args)...);
+        uint32_t hash = str_hash(std::string_view(msg.data(), msg.size()));
+        std::lock_guard<std::mutex> lock(mutex);
         if (warnings[hash])
             return;
 
-        Logger::Warn("{}", msg);
+        Logger::Warn("{}", fmt::to_string(msg));
         warnings[hash] = true;
     }
 
@@ -183,36 +183,31 @@ namespace hydra::N64
 
     void Ai::Step()
     {
-        ai_cycles_++;
-        while (ai_cycles_ > ai_period_)
+        if (ai_dma_count_ == 0)
         {
-            ai_cycles_ -= ai_period_;
-            if (ai_dma_count_ == 0)
-            {
-                return;
-            }
-            uint32_t address = ai_dma_addresses_[0];
-            address &= 0x7ff'ffff;
-            uint32_t data = *reinterpret_cast<uint32_t*>(rdram_ptr_ + address);
-            int16_t left = (static_cast<int16_t>(data >> 16));
-            int16_t right = (static_cast<int16_t>(data & 0xffff));
-            ai_buffer_.push_back(bswap16(left));
-            ai_buffer_.push_back(bswap16(right));
-            if (ai_buffer_.size() > 200000)
-            {
-                Logger::Fatal("AI buffer overflow");
-            }
-            ai_dma_addresses_[0] += 4;
-            ai_dma_lengths_[0] -= 4;
-            if (ai_dma_lengths_[0] == 0)
+            return;
+        }
+        uint32_t address = ai_dma_addresses_[0];
+        address &= 0x7ff'ffff;
+        uint32_t data = *reinterpret_cast<uint32_t*>(rdram_ptr_ + address);
+        int16_t left = (static_cast<int16_t>(data >> 16));
+        int16_t right = (static_cast<int16_t>(data & 0xffff));
+        ai_buffer_.push_back(bswap16(left));
+        ai_buffer_.push_back(bswap16(right));
+        if (ai_buffer_.size() > 200000)
+        {
+            Logger::Fatal("AI buffer overflow");
+        }
+        ai_dma_addresses_[0] += 4;
+        ai_dma_lengths_[0] -= 4;
+        if (ai_dma_lengths_[0] == 0)
+        {
+            mi_interrupt_->AI = true;
+            ai_dma_count_--;
+            if (ai_dma_count_ > 0)
             {
-                mi_interrupt_->AI = true;
-                ai_dma_count_--;
-                if (ai_dma_count_ > 0)
-                {
-                    ai_dma_addresses_[0] = ai_dma_addresses_[1];
-                    ai_dma_lengths_[0] = ai_dma_lengths_[1];
-                }
+                ai_dma_addresses_[0] = ai_dma_addresses_[1];
+                ai_dma_lengths_[0] = ai_dma_lengths_[1];
             }
         }
     }
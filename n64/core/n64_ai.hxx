@@ -34,6 +34,7 @@ namespace hydra::N64
             mi_interrupt_ = mi_interrupt;
         }
 
+        // Plays one sample, called every Period() cycles
         void Step();
         uint32_t ReadWord(uint32_t addr);
         void WriteWord(uint32_t addr, uint32_t data);
@@ -43,6 +44,22 @@ namespace hydra::N64
             return hungry_;
         }
 
+        uint32_t Period() const
+        {
+            return ai_period_;
+        }
+
+        bool IsPlaying() const
+        {
+            return ai_dma_count_ != 0;
+        }
+
+        // Where Step() reads the next sample from
+        uint32_t DMAAddress() const
+        {
+            return ai_dma_addresses_[0] & 0x7FF'FFFF;
+        }
+
     private:
         uint32_t ai_control_ = 0;
         uint32_t ai_bitrate_ = 0;
@@ -50,7 +67,6 @@ namespace hydra::N64
         uint32_t ai_period_ = 93750000 / 44100;
         bool ai_enabled_ = false;
         uint8_t ai_dma_count_ = 0;
-        uint32_t ai_cycles_ = 0;
         bool hungry_ = true;
 
         std::array<uint32_t, 2> ai_dma_addresses_{};
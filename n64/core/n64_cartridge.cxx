@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <functional>
+#include <log.hxx>
+#include <n64/core/n64_cartridge.hxx>
+#include <utility>
+
+#if N64_MAPPED_ROM_AVAILABLE
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    enum class ByteOrder
+    {
+        Native,
+        ByteSwapped,
+        WordSwapped,
+    };
+
+    // Every image starts with the PI configuration word 0x80371240, which gives the order away
+    ByteOrder detect_byte_order(const uint8_t* header)
+    {
+        if (header[0] == 0x37 && header[1] == 0x80)
+        {
+            return ByteOrder::ByteSwapped;
+        }
+        if (header[0] == 0x40 && header[1] == 0x12)
+        {
+            return ByteOrder::WordSwapped;
+        }
+        return ByteOrder::Native;
+    }
+
+    void to_native(uint8_t* data, size_t size, ByteOrder order)
+    {
+        switch (order)
+        {
+            case ByteOrder::Native:
+                break;
+            case ByteOrder::ByteSwapped:
+            {
+                for (size_t i = 0; i + 1 < size; i += 2)
+                {
+                    std::swap(data[i], data[i + 1]);
+                }
+                break;
+            }
+            case ByteOrder::WordSwapped:
+            {
+                for (size_t i = 0; i + 3 < size; i += 4)
+                {
+                    std::reverse(data + i, data + i + 4);
+                }
+                break;
+            }
+        }
+    }
+} // namespace
+
+namespace hydra::N64
+{
+#if N64_MAPPED_ROM_AVAILABLE
+    CartridgeRom::CartridgeRom()
+    {
+        // Untouched pages of an anonymous mapping cost nothing
+        void* data = mmap(nullptr, CART_ROM_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            Logger::Fatal("Failed to reserve the cartridge ROM: {}", strerror(errno));
+        }
+        data_ = static_cast<uint8_t*>(data);
+    }
+
+    CartridgeRom::~CartridgeRom()
+    {
+        munmap(data_, CART_ROM_SIZE);
+    }
+
+    bool CartridgeRom::Load(const std::string& path)
+    {
+        std::string image = native_image(path);
+        if (image.empty())
+        {
+            return false;
+        }
+        int fd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return false;
+        }
+        struct stat info
+        {};
+        if (fstat(fd, &info) == -1 || info.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        size_t size = std::min<size_t>(info.st_size, CART_ROM_SIZE);
+        // Start over from zeroes so nothing of a previously loaded image is left behind
+        void* cleared = mmap(data_, CART_ROM_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+        void* mapped = mmap(data_, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        close(fd);
+        if (cleared == MAP_FAILED || mapped == MAP_FAILED)
+        {
+            Logger::Fatal("Failed to map cartridge ROM {}: {}", image, strerror(errno));
+        }
+        image_path_ = image;
+        image_size_ = size;
+        return true;
+    }
+
+    bool CartridgeRom::MapReadOnly(uint8_t* address) const
+    {
+        if (image_path_.empty())
+        {
+            return false;
+        }
+        int fd = open(image_path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return false;
+        }
+        void* cleared = mmap(address, CART_ROM_SIZE, PROT_READ,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+        void* mapped = mmap(address, image_size_, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        close(fd);
+        return cleared != MAP_FAILED && mapped != MAP_FAILED;
+    }
+
+    std::string CartridgeRom::native_image(const std::string& path)
+    {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        if (!ifs.is_open())
+        {
+            return {};
+        }
+        std::array<uint8_t, 4> header{};
+        ifs.read(reinterpret_cast<char*>(header.data()), header.size());
+        ByteOrder order = detect_byte_order(header.data());
+        if (order == ByteOrder::Native)
+        {
+            return path;
+        }
+
+        // Converted images are kept around, keyed on the path, size and modification time of
+        // the original so a changed dump gets converted again
+        namespace fs = std::filesystem;
+        std::error_code error;
+        uintmax_t size = fs::file_size(path, error);
+        auto modified = fs::last_write_time(path, error).time_since_epoch().count();
+        size_t path_hash = std::hash<std::string>{}(fs::absolute(path, error).string());
+        fs::path directory = fs::temp_directory_path(error) / "hydra";
+        fs::create_directories(directory, error);
+        fs::path cached = directory / fmt::format("{}-{:x}-{:x}-{:x}.z64",
+                                                  fs::path(path).filename().string(), path_hash,
+                                                  size, static_cast<uint64_t>(modified));
+        if (fs::exists(cached, error) && fs::file_size(cached, error) == size)
+        {
+            return cached.string();
+        }
+
+        // Written under another name first, so an interrupted conversion is never picked up
+        fs::path partial = cached;
+        partial += ".part";
+        std::ofstream ofs(partial, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open())
+        {
+            Logger::Warn("Could not create {} to convert {}", partial.string(), path);
+            return {};
+        }
+        ifs.seekg(0, std::ios::beg);
+        std::vector<uint8_t> chunk(0x10'0000);
+        while (ifs)
+        {
+            ifs.read(reinterpret_cast<char*>(chunk.data()), chunk.size());
+            std::streamsize count = ifs.gcount();
+            to_native(chunk.data(), count, order);
+            ofs.write(reinterpret_cast<const char*>(chunk.data()), count);
+        }
+        ofs.close();
+        fs::rename(partial, cached, error);
+        if (error || !ofs)
+        {
+            Logger::Warn("Could not convert {} to native byte order", path);
+            return {};
+        }
+        Logger::Info("Converted {} to native byte order at {}", path, cached.string());
+        return cached.string();
+    }
+#else
+    CartridgeRom::CartridgeRom()
+    {
+        storage_.resize(CART_ROM_SIZE);
+        data_ = storage_.data();
+    }
+
+    CartridgeRom::~CartridgeRom() = default;
+
+    bool CartridgeRom::Load(const std::string& path)
+    {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        if (!ifs.is_open())
+        {
+            return false;
+        }
+        ifs.read(reinterpret_cast<char*>(data_), CART_ROM_SIZE);
+        size_t size = ifs.gcount();
+        std::fill(data_ + size, data_ + CART_ROM_SIZE, 0);
+        to_native(data_, size, detect_byte_order(data_));
+        image_path_ = path;
+        image_size_ = size;
+        return size != 0;
+    }
+
+    bool CartridgeRom::MapReadOnly(uint8_t*) const
+    {
+        return false;
+    }
+#endif
+} // namespace hydra::N64
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Needs mmap to page the image in on demand
+#if defined(__unix__) || defined(__APPLE__)
+#define N64_MAPPED_ROM_AVAILABLE 1
+#else
+#define N64_MAPPED_ROM_AVAILABLE 0
+#endif
+
+namespace hydra::N64
+{
+    // The cartridge domain spans 0x1000'0000 to 0x1FBF'FFFF
+    constexpr size_t CART_ROM_SIZE = 0xFC0'0000;
+
+    /**
+        Cartridge ROM, mapped from the file so only the parts that get touched take up memory
+
+        The whole cartridge domain is reserved up front and reads as zero past the end of the
+        image. Byte swapped (.v64) and word swapped (.n64) dumps are converted to a native copy
+        once, which later loads map directly. Writes stay private to the running instance.
+    */
+    class CartridgeRom final
+    {
+    public:
+        CartridgeRom();
+        ~CartridgeRom();
+        CartridgeRom(const CartridgeRom&) = delete;
+        CartridgeRom& operator=(const CartridgeRom&) = delete;
+
+        bool Load(const std::string& path);
+        // Maps the image again, read only, at a fixed address. Used to put it in the fastmem
+        // region without copying it
+        bool MapReadOnly(uint8_t* address) const;
+
+        uint8_t* Data()
+        {
+            return data_;
+        }
+
+        size_t ImageSize() const
+        {
+            return image_size_;
+        }
+
+    private:
+        uint8_t* data_ = nullptr;
+        std::string image_path_;
+        size_t image_size_ = 0;
+#if !N64_MAPPED_ROM_AVAILABLE
+        std::vector<uint8_t> storage_;
+#endif
+
+        static std::string native_image(const std::string& path);
+    };
+} // namespace hydra::N64
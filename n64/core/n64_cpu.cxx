@@ -9,11 +9,19 @@
 #include <iostream>
 #include <limits>
 #include <n64/core/n64_cpu.hxx>
+#include <n64/core/n64_dma.hxx>
 #include <random>
 #include <sstream>
 
 namespace hydra::N64
 {
+    // Rough estimate of how long a 64 byte PIF RAM transfer keeps the SI busy
+    constexpr uint64_t SI_DMA_CYCLES = 65536 * 2;
+    // RDRAM moves 8 bytes per RCP cycle, the CPU runs 3 cycles for every 2 of the RCP
+    constexpr uint64_t SP_DMA_SETUP_CYCLES = 16;
+    // Longest loop body, delay slot included, that is considered for idle loop detection
+    constexpr int IDLE_LOOP_MAX_INSTRUCTIONS = 16;
+
     template <>
     void CPU::log_cpu_state<false>(bool, uint64_t, uint64_t)
     {
@@ -63,8 +71,24 @@ namespace hydra::N64
         printf("\n");
     }
 
+    template <>
+    void CPU::profile_instruction<false>()
+    {
+    }
+
+    template <>
+    void CPU::profile_instruction<true>()
+    {
+        profiler_.Tick(pc_, instruction_.full);
+    }
+
     void CPU::write_hwio(uint32_t addr, uint32_t data)
     {
+        // The SP and DP registers belong to the RSP thread while it runs a slice
+        if (addr >= RSP_AREA_START && addr <= RDP_AREA_END)
+        {
+            rcp_.rsp_.Sync();
+        }
         // TODO: remove switch, turn into if chain
         switch (addr)
         {
@@ -97,8 +121,8 @@ namespace hydra::N64
             case PI_WR_LEN:
             {
                 auto cart_addr = cpubus_.pi_cart_addr_ & 0xFFFFFFFE;
-                auto dram_addr = cpubus_.pi_dram_addr_ & 0x007FFFFE;
-                uint64_t length = data + 1;
+                auto dram_addr = cpubus_.pi_dram_addr_ & (RDRAM_EXPANSION_SIZE - 2);
+                uint64_t length = std::min<uint64_t>(data + 1, RDRAM_EXPANSION_SIZE - dram_addr);
                 if (cart_addr >= 0x8000000 && cart_addr < 0x10000000)
                 {
                     Logger::Warn("DMA to SRAM is unimplemented!");
@@ -106,23 +130,20 @@ namespace hydra::N64
                     cpubus_.mi_interrupt_.PI = true;
                     return;
                 }
+                cpubus_.wait_for_rcp(dram_addr, length, true);
                 std::memcpy(&cpubus_.rdram_[dram_addr], cpubus_.redirect_paddress(cart_addr),
                             length);
+                invalidate_code(dram_addr, length);
                 cpubus_.dma_busy_ = true;
-                // uint8_t domain = 0;
-                // if ((cart_addr >= 0x0800'0000 && cart_addr < 0x1000'0000) ||
-                //     (cart_addr >= 0x0500'0000 && cart_addr < 0x0600'0000))
-                // {
-                //     domain = 2;
-                // } else if ((cart_addr >= 0x0600'0000 && cart_addr < 0x0800'0000) ||
-                //            (cart_addr >= 0x1000'0000 && cart_addr < 0x1FC0'0000))
-                // {
-                //     domain = 1;
-                // }
-                // auto cycles = timing_pi_access(domain, length);
-                cpubus_.dma_busy_ = false;
-                cpubus_.mi_interrupt_.PI = true;
-                Logger::Debug("Raising PI interrupt");
+                uint8_t domain = 1;
+                if ((cart_addr >= 0x0800'0000 && cart_addr < 0x1000'0000) ||
+                    (cart_addr >= 0x0500'0000 && cart_addr < 0x0600'0000))
+                {
+                    domain = 2;
+                }
+                // The data is copied right away, the interrupt is raised once the transfer
+                // would have finished
+                cpubus_.scheduler_.Schedule(EventType::PIDMA, timing_pi_access(domain, length));
                 return;
             }
             case PI_BSD_DOM1_PWD:
@@ -203,20 +224,27 @@ namespace hydra::N64
             }
             case SI_PIF_AD_WR64B:
             {
-                std::memcpy(cpubus_.pif_ram_.data(),
-                            &cpubus_.rdram_[cpubus_.si_dram_addr_ & 0xff'ffff], 64);
+                cpubus_.wait_for_rcp(cpubus_.si_dram_addr_, 64, false);
+                DMARegion pif{cpubus_.pif_ram_.data(), 0, 63};
+                DMARegion rdram{cpubus_.rdram_.data(), cpubus_.si_dram_addr_,
+                                RDRAM_EXPANSION_SIZE - 1};
+                DMACopy(pif, rdram, 64);
                 pif_command();
-                cpubus_.mi_interrupt_.SI = true;
-                Logger::Debug("Raising SI interrupt");
+                cpubus_.si_status_ |= 1;
+                cpubus_.scheduler_.Schedule(EventType::SIDMA, SI_DMA_CYCLES);
                 return;
             }
             case SI_PIF_AD_RD64B:
             {
                 pif_command();
-                std::memcpy(&cpubus_.rdram_[cpubus_.si_dram_addr_ & 0xff'ffff],
-                            cpubus_.pif_ram_.data(), 64);
-                cpubus_.mi_interrupt_.SI = true;
-                Logger::Debug("Raising SI interrupt");
+                uint32_t dram_addr = cpubus_.si_dram_addr_ & (RDRAM_EXPANSION_SIZE - 1);
+                cpubus_.wait_for_rcp(dram_addr, 64, true);
+                DMARegion rdram{cpubus_.rdram_.data(), dram_addr, RDRAM_EXPANSION_SIZE - 1};
+                DMARegion pif{cpubus_.pif_ram_.data(), 0, 63};
+                DMACopy(rdram, pif, 64);
+                invalidate_code(dram_addr, 64);
+                cpubus_.si_status_ |= 1;
+                cpubus_.scheduler_.Schedule(EventType::SIDMA, SI_DMA_CYCLES);
                 return;
             }
             case SI_STATUS:
@@ -244,11 +272,25 @@ namespace hydra::N64
                 case RSP_DMA_RAMADDR:
                     return rcp_.rsp_.write_hwio(RSPHWIO::DramAddr, data);
                 case RSP_DMA_RDLEN:
-                    return rcp_.rsp_.write_hwio(RSPHWIO::RdLen, data);
+                    rcp_.rsp_.write_hwio(RSPHWIO::RdLen, data);
+                    return schedule_sp_dma(data);
                 case RSP_DMA_WRLEN:
-                    return rcp_.rsp_.write_hwio(RSPHWIO::WrLen, data);
+                    rcp_.rsp_.write_hwio(RSPHWIO::WrLen, data);
+                    return schedule_sp_dma(data);
                 case RSP_STATUS:
-                    return rcp_.rsp_.write_hwio(RSPHWIO::Status, data);
+                {
+                    bool was_halted = rcp_.rsp_.status_.halt;
+                    rcp_.rsp_.write_hwio(RSPHWIO::Status, data);
+                    // Slices stop being scheduled once the RSP halts, see N64::handle_event
+                    if (was_halted && !rcp_.rsp_.status_.halt)
+                    {
+                        cpubus_.scheduler_.Schedule(EventType::RSPSlice,
+                                                    rcp_.rsp_.IsThreaded()
+                                                        ? RSP_THREAD_SLICE_CYCLES
+                                                        : RSP_SLICE_CYCLES);
+                    }
+                    return;
+                }
                 case RSP_SEMAPHORE:
                     return rcp_.rsp_.write_hwio(RSPHWIO::Semaphore, data);
                 case RSP_PC:
@@ -316,6 +358,10 @@ namespace hydra::N64
 
     uint32_t CPU::read_hwio(uint32_t addr)
     {
+        if (addr >= RSP_AREA_START && addr <= RDP_AREA_END)
+        {
+            rcp_.rsp_.Sync();
+        }
 #define redir_case(addr, data) \
     case addr:                 \
         return data;
@@ -649,14 +695,23 @@ namespace hydra::N64
         : gpr_regs_{}, fpr_regs_{}, instr_cache_(KB(16)), data_cache_(KB(8)), cpubus_(cpubus),
           rcp_(rcp), should_draw_(should_draw)
     {
-        rcp_.ai_.InstallBuses(&cpubus_.rdram_[0]);
-        rcp_.vi_.InstallBuses(&cpubus_.rdram_[0]);
-        rcp_.rsp_.InstallBuses(&cpubus_.rdram_[0], &rcp_.rdp_);
-        rcp_.rdp_.InstallBuses(&cpubus_.rdram_[0], &rcp_.rsp_.mem_[0]);
+        install_buses();
         rcp_.ai_.SetMIPtr(&cpubus_.mi_interrupt_);
         rcp_.vi_.SetMIPtr(&cpubus_.mi_interrupt_);
         rcp_.rsp_.SetMIPtr(&cpubus_.mi_interrupt_);
         rcp_.rdp_.SetMIPtr(&cpubus_.mi_interrupt_);
+        rcp_.vi_.SetDirtyMap(&cpubus_.rdram_dirty_);
+        rcp_.rdp_.SetDirtyMap(&cpubus_.rdram_dirty_);
+        rcp_.rsp_.SetRDRAMWriteCallback(
+            [this](uint32_t paddr, uint32_t length) { invalidate_code(paddr, length); });
+    }
+
+    void CPU::install_buses()
+    {
+        rcp_.ai_.InstallBuses(&cpubus_.rdram_[0]);
+        rcp_.vi_.InstallBuses(&cpubus_.rdram_[0]);
+        rcp_.rsp_.InstallBuses(&cpubus_.rdram_[0], &rcp_.rdp_);
+        rcp_.rdp_.InstallBuses(&cpubus_.rdram_[0], &rcp_.rsp_.mem_[0]);
     }
 
     void CPU::Reset()
@@ -685,15 +740,101 @@ namespace hydra::N64
         CP0Context.full = 0;
         CP0XContext.full = 0;
         CP0EntryHi.full = 0;
+        llbit_ = false;
         for (auto& entry : tlb_)
         {
             TLBEntry newentry{};
             newentry.initialized = false;
             std::swap(entry, newentry);
         }
-        store_word(
-            0x8000'0318,
-            0x800000); // TODO: probably done by pif somewhere if RI_SELECT is emulated or something
+        flush_tlb_cache();
+        tlb_cache_stats_ = {};
+        idle_loop_ = {};
+        profiler_.Reset();
+        // TODO: probably done by pif somewhere if RI_SELECT is emulated or something
+        store_word(0x8000'0318, cpubus_.rdram_size_);
+        if (jit_)
+        {
+            jit_->Reset();
+        }
+        for (auto& page : decoded_pages_)
+        {
+            page.reset();
+        }
+        decoded_vpage_ = 0xFFFF'FFFF;
+        decoded_page_ = nullptr;
+        schedule_compare();
+    }
+
+    void CPU::SetBackend(CPUBackend backend)
+    {
+        if (backend == CPUBackend::Dynarec && !N64_JIT_AVAILABLE)
+        {
+            Logger::Warn("The dynarec is only available on x86-64, using the interpreter");
+            backend = CPUBackend::Interpreter;
+        }
+        backend_ = backend;
+        if (backend_ == CPUBackend::Dynarec)
+        {
+            if (!jit_)
+            {
+                jit_ = std::make_unique<CPUJit>(*this);
+            }
+        }
+        else
+        {
+            jit_.reset();
+        }
+        decoded_pages_.clear();
+        decoded_vpage_ = 0xFFFF'FFFF;
+        decoded_page_ = nullptr;
+        if (backend_ == CPUBackend::CachedInterpreter)
+        {
+            // Everything below the PIF, which is RDRAM, RCP registers and the cartridge
+            decoded_pages_.resize(0x1FC00);
+        }
+    }
+
+    void CPU::SetFastmem(bool enabled)
+    {
+        if (!enabled || cpubus_.fastmem_)
+        {
+            return;
+        }
+        if (!N64_FASTMEM_AVAILABLE || !cpubus_.enable_fastmem())
+        {
+            Logger::Warn("Fastmem requested but not supported on this host");
+            return;
+        }
+        // RDRAM moved, so everything holding a pointer to it needs a new one
+        install_buses();
+        if (jit_)
+        {
+            jit_->Reset();
+        }
+        for (auto& page : decoded_pages_)
+        {
+            page.reset();
+        }
+        decoded_vpage_ = 0xFFFF'FFFF;
+        decoded_page_ = nullptr;
+    }
+
+    void CPU::SetIdleLoopDetection(bool enabled)
+    {
+        idle_loop_detection_ = enabled;
+        idle_loop_ = {};
+    }
+
+    // The data is copied right away, SP_DMA_BUSY stays set until the transfer would have
+    // finished. DMAs the RSP starts itself finish as soon as they're started
+    void CPU::schedule_sp_dma(uint32_t length)
+    {
+        uint64_t bytes_per_row = ((length & 0xFFF) + 8) & ~7;
+        uint64_t rows = ((length >> 12) & 0xFF) + 1;
+        rcp_.rsp_.status_.dma_busy = true;
+        cpubus_.scheduler_.Schedule(EventType::SPDMA,
+                                    SP_DMA_SETUP_CYCLES + bytes_per_row * rows / 8 * 3 / 2);
     }
 
     // Shamelessly stolen from dillon
@@ -776,7 +917,7 @@ namespace hydra::N64
     uint8_t CPU::load_byte(uint64_t vaddr)
     {
         TranslatedAddress paddr = translate_vaddr(vaddr);
-        uint8_t* ptr = cpubus_.redirect_paddress(paddr.paddr);
+        uint8_t* ptr = cpubus_.load_paddress(paddr.paddr);
 
         if (!ptr)
         {
@@ -789,7 +930,7 @@ namespace hydra::N64
     uint16_t CPU::load_halfword(uint64_t vaddr)
     {
         TranslatedAddress paddr = translate_vaddr(vaddr);
-        uint16_t* ptr = reinterpret_cast<uint16_t*>(cpubus_.redirect_paddress(paddr.paddr));
+        uint16_t* ptr = reinterpret_cast<uint16_t*>(cpubus_.load_paddress(paddr.paddr));
 
         if (!ptr)
         {
@@ -804,7 +945,7 @@ namespace hydra::N64
     uint32_t CPU::load_word(uint64_t vaddr)
     {
         TranslatedAddress paddr = translate_vaddr(vaddr);
-        uint8_t* ptr = cpubus_.redirect_paddress(paddr.paddr);
+        uint8_t* ptr = cpubus_.load_paddress(paddr.paddr);
         if (!ptr)
         {
             return read_hwio(paddr.paddr);
@@ -820,7 +961,7 @@ namespace hydra::N64
     uint64_t CPU::load_doubleword(uint64_t vaddr)
     {
         TranslatedAddress paddr = translate_vaddr(vaddr);
-        uint64_t* ptr = reinterpret_cast<uint64_t*>(cpubus_.redirect_paddress(paddr.paddr));
+        uint64_t* ptr = reinterpret_cast<uint64_t*>(cpubus_.load_paddress(paddr.paddr));
 
         if (!ptr)
         {
@@ -835,31 +976,35 @@ namespace hydra::N64
     void CPU::store_byte(uint64_t vaddr, uint8_t data)
     {
         TranslatedAddress paddr = translate_vaddr(vaddr);
-        uint8_t* ptr = cpubus_.redirect_paddress(paddr.paddr);
+        uint8_t* ptr = cpubus_.store_paddress(paddr.paddr, sizeof(uint8_t));
         if (!ptr)
         {
             Logger::Warn("Attempted to store byte to invalid address: {:08x}", vaddr);
             return;
         }
         *ptr = data;
+        invalidate_code(paddr.paddr, sizeof(uint8_t));
     }
 
     void CPU::store_halfword(uint64_t vaddr, uint16_t data)
     {
         TranslatedAddress paddr = translate_vaddr(vaddr);
-        uint16_t* ptr = reinterpret_cast<uint16_t*>(cpubus_.redirect_paddress(paddr.paddr));
+        uint16_t* ptr =
+            reinterpret_cast<uint16_t*>(cpubus_.store_paddress(paddr.paddr, sizeof(uint16_t)));
         if (!ptr)
         {
             Logger::Fatal("Attempted to store halfword to invalid address: {:08x}", vaddr);
         }
         data = hydra::bswap16(data);
         memcpy(ptr, &data, sizeof(uint16_t));
+        invalidate_code(paddr.paddr, sizeof(uint16_t));
     }
 
     void CPU::store_word(uint64_t vaddr, uint32_t data)
     {
         TranslatedAddress paddr = translate_vaddr(vaddr);
-        uint32_t* ptr = reinterpret_cast<uint32_t*>(cpubus_.redirect_paddress(paddr.paddr));
+        uint32_t* ptr =
+            reinterpret_cast<uint32_t*>(cpubus_.store_paddress(paddr.paddr, sizeof(uint32_t)));
         bool isviewer = paddr.paddr <= ISVIEWER_AREA_END && paddr.paddr >= ISVIEWER_FLUSH;
         if (!ptr || isviewer)
         {
@@ -869,45 +1014,428 @@ namespace hydra::N64
         {
             data = hydra::bswap32(data);
             memcpy(ptr, &data, sizeof(uint32_t));
+            invalidate_code(paddr.paddr, sizeof(uint32_t));
         }
     }
 
     void CPU::store_doubleword(uint64_t vaddr, uint64_t data)
     {
         TranslatedAddress paddr = translate_vaddr(vaddr);
-        uint64_t* ptr = reinterpret_cast<uint64_t*>(cpubus_.redirect_paddress(paddr.paddr));
+        uint64_t* ptr =
+            reinterpret_cast<uint64_t*>(cpubus_.store_paddress(paddr.paddr, sizeof(uint64_t)));
         if (!ptr)
         {
             Logger::Fatal("Attempted to store doubleword to invalid address: {:08x}", vaddr);
         }
         data = hydra::bswap64(data);
         memcpy(ptr, &data, sizeof(uint64_t));
+        invalidate_code(paddr.paddr, sizeof(uint64_t));
     }
 
-    void CPU::Tick()
+    void CPU::invalidate_code(uint32_t paddr, uint32_t length)
     {
-        if (rcp_.ai_.IsHungry())
+        cpubus_.rdram_dirty_.Mark(paddr, length);
+        // The loop could have been overwritten, look at it again
+        idle_loop_.head = ~0ull;
+        if ((paddr >> 12) == (0x0400'1000 >> 12)) [[unlikely]]
+        {
+            // IMEM, where the RSP recompiler gets its code. The RSP thread was already waited
+            // for when the store looked up the address
+            if (rcp_.rsp_.jit_)
+            {
+                rcp_.rsp_.jit_->InvalidateRange(paddr & 0xFFF, length);
+            }
+        }
+        if (backend_ == CPUBackend::Interpreter) [[likely]]
+        {
+            return;
+        }
+        if (jit_)
+        {
+            jit_->InvalidateRange(paddr, length);
+        }
+        uint32_t first = paddr >> 12;
+        uint32_t last = (paddr + length - 1) >> 12;
+        for (uint32_t page = first; page <= last && page < decoded_pages_.size(); page++)
+        {
+            if (decoded_pages_[page]) [[unlikely]]
+            {
+                if (decoded_pages_[page].get() == decoded_page_)
+                {
+                    decoded_vpage_ = 0xFFFF'FFFF;
+                    decoded_page_ = nullptr;
+                }
+                decoded_pages_[page].reset();
+            }
+        }
+    }
+
+    const CPU::DecodedInstruction* CPU::fetch_decoded(uint64_t vaddr)
+    {
+        uint32_t vpage = static_cast<uint32_t>(vaddr) >> 12;
+        if (vpage != decoded_vpage_) [[unlikely]]
+        {
+            // Only direct mapped code is cached, TLB mapped code could be remapped at any time
+            uint32_t vaddr32 = static_cast<uint32_t>(vaddr);
+            if (vaddr32 < 0x8000'0000 || vaddr32 >= 0xC000'0000 ||
+                static_cast<uint64_t>(static_cast<int32_t>(vaddr32)) != vaddr)
+            {
+                return nullptr;
+            }
+            uint32_t paddr = vaddr32 & 0x1FFF'F000;
+            if (!cpubus_.is_code_cacheable(paddr) || !cpubus_.redirect_paddress(paddr))
+            {
+                return nullptr;
+            }
+            auto& page = decoded_pages_[paddr >> 12];
+            if (!page)
+            {
+                page = std::make_unique<DecodedPage>();
+                decode_page(*page, paddr);
+            }
+            decoded_vpage_ = vpage;
+            decoded_page_ = page.get();
+        }
+        return &(*decoded_page_)[(vaddr >> 2) & 0x3FF];
+    }
+
+    void CPU::decode_page(DecodedPage& page, uint32_t paddr)
+    {
+        const uint8_t* code = cpubus_.redirect_paddress(paddr);
+        for (size_t i = 0; i < page.size(); i++)
+        {
+            uint32_t word;
+            std::memcpy(&word, code + i * 4, sizeof(uint32_t));
+            Instruction instruction;
+            instruction.full = hydra::bswap32(word);
+            func_ptr handler;
+            switch (instruction.IType.op)
+            {
+                case 0:
+                    handler = special_table_[instruction.RType.func];
+                    break;
+                case 1:
+                    handler = regimm_table_[instruction.RType.rt];
+                    break;
+                default:
+                    handler = instruction_table_[instruction.IType.op];
+                    break;
+            }
+            page[i] = {handler, instruction.full};
+        }
+    }
+
+    bool CPU::is_idle_loop(uint64_t head)
+    {
+        // Like the cached interpreter, only direct mapped code is looked at
+        uint32_t head32 = static_cast<uint32_t>(head);
+        if (head32 < KSEG0_START || head32 > KSEG1_END)
+        {
+            return false;
+        }
+        uint32_t paddr = head32 & 0x1FFF'FFFF;
+        const uint8_t* code = cpubus_.is_code_cacheable(paddr)
+                                  ? cpubus_.redirect_paddress(paddr & ~0xFFF)
+                                  : nullptr;
+        if (!code)
         {
-            ++cpubus_.time_;
-            cpubus_.time_ &= 0x1FFFFFFFF;
-            if (cpubus_.time_ == (cp0_regs_[CP0_COMPARE].UD << 1)) [[unlikely]]
+            return false;
+        }
+        bool delay_slot = false;
+        for (int i = 0; i < IDLE_LOOP_MAX_INSTRUCTIONS; i++)
+        {
+            uint32_t offset = (paddr & 0xFFF) + i * 4;
+            if (offset >= 0x1000)
+            {
+                return false;
+            }
+            uint32_t word;
+            std::memcpy(&word, code + offset, sizeof(uint32_t));
+            Instruction instruction;
+            instruction.full = hydra::bswap32(word);
+            uint32_t pc = head32 + i * 4;
+            int16_t branch_offset = static_cast<int16_t>(instruction.IType.immediate);
+            uint32_t branch_target = pc + 4 + (static_cast<int32_t>(branch_offset) << 2);
+            bool branch = false;
+            switch (instruction.IType.op)
+            {
+                case 0:
+                {
+                    switch (instruction.RType.func)
+                    {
+                        // Shifts and arithmetic that can't raise exceptions
+                        case 0x00:
+                        case 0x02:
+                        case 0x03:
+                        case 0x04:
+                        case 0x06:
+                        case 0x07:
+                        case 0x21:
+                        case 0x23:
+                        case 0x24:
+                        case 0x25:
+                        case 0x26:
+                        case 0x27:
+                        case 0x2A:
+                        case 0x2B:
+                        case 0x2D:
+                        case 0x2F:
+                            break;
+                        default:
+                            return false;
+                    }
+                    break;
+                }
+                case 1:
+                {
+                    // BLTZ, BGEZ, BLTZL, BGEZL
+                    if (instruction.RType.rt > 3)
+                    {
+                        return false;
+                    }
+                    branch = true;
+                    break;
+                }
+                case 2:
+                {
+                    branch_target = (pc & 0xF000'0000) | (instruction.JType.target << 2);
+                    branch = true;
+                    break;
+                }
+                case 0x04:
+                case 0x05:
+                case 0x06:
+                case 0x07:
+                case 0x14:
+                case 0x15:
+                case 0x16:
+                case 0x17:
+                {
+                    branch = true;
+                    break;
+                }
+                // Immediate arithmetic that can't raise exceptions
+                case 0x09:
+                case 0x0A:
+                case 0x0B:
+                case 0x0C:
+                case 0x0D:
+                case 0x0E:
+                case 0x0F:
+                case 0x19:
+                // Loads, the only way the loop observes the rest of the system
+                case 0x20:
+                case 0x21:
+                case 0x23:
+                case 0x24:
+                case 0x25:
+                case 0x27:
+                case 0x37:
+                    break;
+                default:
+                    return false;
+            }
+            if (delay_slot)
+            {
+                return !branch;
+            }
+            if (branch)
+            {
+                // Any other branch could leave the loop
+                if (branch_target != head32)
+                {
+                    return false;
+                }
+                delay_slot = true;
+            }
+        }
+        return false;
+    }
+
+    bool CPU::check_idle_loop(uint64_t head)
+    {
+        if (head != idle_loop_.head)
+        {
+            idle_loop_.head = head;
+            idle_loop_.idle = is_idle_loop(head);
+            idle_loop_.seen = false;
+            return false;
+        }
+        if (!idle_loop_.idle)
+        {
+            return false;
+        }
+        std::array<uint64_t, 34> registers;
+        for (size_t i = 0; i < gpr_regs_.size(); i++)
+        {
+            registers[i] = gpr_regs_[i].UD;
+        }
+        registers[32] = hi_;
+        registers[33] = lo_;
+        bool spinning = idle_loop_.seen && registers == idle_loop_.registers;
+        idle_loop_.registers = registers;
+        idle_loop_.seen = true;
+        return spinning;
+    }
+
+    int CPU::skip_idle_loop(int executed, int length)
+    {
+        const Scheduler& scheduler = cpubus_.scheduler_;
+        // The loop would keep reading the same values until something happens. Only whole trips
+        // that would have started before the next event are skipped, so the loop is at the same
+        // point it would be at without skipping when the event hits
+        uint64_t remaining = std::min<uint64_t>(scheduler.NextDeadline() - scheduler.Now(),
+                                                std::numeric_limits<int>::max());
+        int cycles = executed;
+        if (remaining > static_cast<uint64_t>(executed))
+        {
+            cycles += (static_cast<int>(remaining) - executed) / length * length;
+        }
+        advance_count(cycles - executed);
+        return cycles;
+    }
+
+    void CPU::advance_count(int cycles)
+    {
+        // Count increments every other cycle, time_ keeps the extra bit
+        cpubus_.time_ = (cpubus_.time_ + cycles) & 0x1FFFFFFFF;
+    }
+
+    void CPU::schedule_compare()
+    {
+        uint64_t distance = ((cp0_regs_[CP0_COMPARE].UD << 1) - cpubus_.time_) & 0x1FFFFFFFF;
+        if (distance == 0)
+        {
+            distance = 0x200000000;
+        }
+        cpubus_.scheduler_.Schedule(EventType::Compare, distance);
+    }
+
+    void CPU::handle_event(EventType type)
+    {
+        switch (type)
+        {
+            case EventType::Compare:
             {
                 CP0Cause.IP7 = true;
+                schedule_compare();
+                break;
+            }
+            case EventType::PIDMA:
+            {
+                cpubus_.dma_busy_ = false;
+                cpubus_.mi_interrupt_.PI = true;
+                Logger::Debug("Raising PI interrupt");
+                break;
             }
+            case EventType::SIDMA:
+            {
+                cpubus_.si_status_ &= ~1;
+                cpubus_.mi_interrupt_.SI = true;
+                Logger::Debug("Raising SI interrupt");
+                break;
+            }
+            case EventType::SPDMA:
+            {
+                rcp_.rsp_.Sync();
+                rcp_.rsp_.status_.dma_busy = false;
+                break;
+            }
+            default:
+            {
+                Logger::Fatal("CPU: Unhandled event {}", static_cast<int>(type));
+                break;
+            }
+        }
+    }
+
+    void CPU::Run()
+    {
+        Scheduler& scheduler = cpubus_.scheduler_;
+        // The deadline is read every time as the CPU can queue events, like DMA completion
+        while (scheduler.Now() < scheduler.NextDeadline())
+        {
+            scheduler.Advance(Tick());
+        }
+    }
+
+    int CPU::Tick()
+    {
+        if (rcp_.ai_.IsHungry())
+        {
+            // Blocks always start at a fresh instruction, delay slots are interpreted
+            if (backend_ == CPUBackend::Dynarec && !was_branch_ && next_pc_ == pc_ + 4)
+            {
+                prev_branch_ = false;
+                if (check_interrupts())
+                {
+                    advance_count(1);
+                    return 1;
+                }
+                uint64_t entry = pc_;
+                int executed = jit_->Run();
+                if (executed != 0)
+                {
+                    advance_count(executed);
+                    if constexpr (CPU_PROFILING)
+                    {
+                        // Only the entry of a recompiled block is known, attribute it all there
+                        profiler_.Tick(entry, EMPTY_INSTRUCTION, executed);
+                    }
+                    // A block that lands on its own start is a loop
+                    if (idle_loop_detection_ && pc_ == entry && check_idle_loop(entry))
+                    {
+                        return skip_idle_loop(executed, executed);
+                    }
+                    return executed;
+                }
+            }
+            advance_count(1);
             gpr_regs_[0].UD = 0;
             prev_branch_ = was_branch_;
             was_branch_ = false;
-            instruction_.full = load_word(pc_);
+            func_ptr handler = nullptr;
+            const DecodedInstruction* decoded =
+                backend_ == CPUBackend::CachedInterpreter ? fetch_decoded(pc_) : nullptr;
+            if (decoded)
+            {
+                // The decoded page can be freed by the instruction itself, so copy it out
+                instruction_.full = decoded->instruction;
+                handler = decoded->handler;
+            }
+            else
+            {
+                instruction_.full = load_word(pc_);
+            }
             if (check_interrupts())
             {
-                return;
+                return 1;
             }
             log_cpu_state<CPU_LOGGING>(true, 30'000'000, 0);
+            profile_instruction<CPU_PROFILING>();
             prev_pc_ = pc_;
             pc_ = next_pc_;
             next_pc_ += 4;
-            execute_instruction();
+            if (handler)
+            {
+                handler(this);
+            }
+            else
+            {
+                execute_instruction();
+            }
+            if (idle_loop_.fired) [[unlikely]]
+            {
+                idle_loop_.fired = false;
+                return skip_idle_loop(1, idle_loop_.length);
+            }
+        }
+        else
+        {
+            // Waiting on the audio device, time still passes for the rest of the system
+            advance_count(1);
         }
+        return 1;
     }
 
     void CPU::check_vi_interrupt()
@@ -969,6 +1497,15 @@ namespace hydra::N64
     {
         next_pc_ = address;
         was_branch_ = true;
+        // pc_ is the delay slot here. The recompiler looks for loops a whole block at a time
+        uint32_t distance = static_cast<uint32_t>(pc_) - static_cast<uint32_t>(address);
+        if (idle_loop_detection_ && backend_ != CPUBackend::Dynarec && distance - 1 <
+            static_cast<uint32_t>(IDLE_LOOP_MAX_INSTRUCTIONS * 4)) [[unlikely]]
+        {
+            uint64_t head = static_cast<int64_t>(static_cast<int32_t>(address));
+            idle_loop_.fired = check_idle_loop(head);
+            idle_loop_.length = distance / 4 + 1;
+        }
     }
 
     void CPU::execute_instruction()
@@ -1025,6 +1562,7 @@ namespace hydra::N64
                     entry.initialized = true;
 
                     tlb_[index] = entry;
+                    flush_tlb_cache();
                     break;
                 }
                 case CP0Instruction::TLBP:
@@ -1069,6 +1607,7 @@ namespace hydra::N64
                 }
                 case CP0Instruction::TLBWR:
                 {
+                    flush_tlb_cache();
                     return Logger::Warn("TLBWR is not implemented");
                 }
                 case CP0Instruction::WAIT:
@@ -1143,8 +1682,31 @@ namespace hydra::N64
         }
     }
 
+    void CPU::flush_tlb_cache()
+    {
+        tlb_cache_.fill({});
+        tlb_cache_asid_ = CP0EntryHi.ASID;
+    }
+
     TranslatedAddress CPU::probe_tlb(uint32_t vaddr)
     {
+        // Non global entries only match the current ASID, so a new ASID makes everything stale
+        if (tlb_cache_asid_ != CP0EntryHi.ASID)
+        {
+            flush_tlb_cache();
+        }
+        uint32_t vpage = vaddr >> 12;
+        TLBCacheEntry& cache_entry = tlb_cache_[vpage & (tlb_cache_.size() - 1)];
+        if (cache_entry.tag == vpage + 1)
+        {
+            tlb_cache_stats_.hits++;
+            return {
+                .paddr = cache_entry.paddr | (vaddr & 0xFFF),
+                .cached = cache_entry.cached,
+                .success = true,
+            };
+        }
+        tlb_cache_stats_.misses++;
         for (const TLBEntry& entry : tlb_)
         {
             if (!entry.initialized)
@@ -1178,6 +1740,11 @@ namespace hydra::N64
                     elo.full = entry.entry_even.full;
                 }
                 uint32_t paddr = (elo.PFN << 12) | (vaddr & offset_mask);
+                cache_entry = {
+                    .tag = vpage + 1,
+                    .paddr = paddr & ~0xFFF,
+                    .cached = elo.C != 2,
+                };
                 return {
                     .paddr = paddr,
                     .cached = elo.C != 2,
@@ -1639,6 +2206,10 @@ namespace hydra::N64
     {
         link_register(31);
         J();
+        if constexpr (CPU_PROFILING)
+        {
+            profiler_.Call(next_pc_, gpr_regs_[31].UD);
+        }
     }
 
     void CPU::J()
@@ -1661,6 +2232,10 @@ namespace hydra::N64
             // throw_exception(prev_pc_, ExceptionType::AddressErrorLoad);
         }
         s_JR();
+        if constexpr (CPU_PROFILING)
+        {
+            profiler_.Call(next_pc_, rdreg.UD);
+        }
     }
 
     void CPU::s_JR()
@@ -1677,6 +2252,10 @@ namespace hydra::N64
             return;
         }
         branch_to(jump_addr);
+        if constexpr (CPU_PROFILING)
+        {
+            profiler_.Return(jump_addr);
+        }
     }
 
     void CPU::r_BLTZ()
@@ -2551,11 +3130,13 @@ namespace hydra::N64
             {
                 CP0Cause.IP7 = false;
                 cp0_regs_[reg].UD = value;
+                schedule_compare();
                 break;
             }
             case CP0_COUNT:
             {
                 cpubus_.time_ = value << 1;
+                schedule_compare();
                 break;
             }
             case CP0_CONFIG:
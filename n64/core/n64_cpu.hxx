@@ -12,10 +12,17 @@
 #include <log.hxx>
 #include <memory>
 #include <n64/core/n64_addresses.hxx>
+#include <n64/core/n64_cpu_jit.hxx>
+#include <n64/core/n64_cartridge.hxx>
+#include <n64/core/n64_fastmem.hxx>
 #include <n64/core/n64_keys.hxx>
+#include <n64/core/n64_profiler.hxx>
 #include <n64/core/n64_rcp.hxx>
+#include <n64/core/n64_rdram.hxx>
+#include <n64/core/n64_scheduler.hxx>
 #include <n64/core/n64_types.hxx>
 #include <queue>
+#include <span>
 #include <vector>
 
 #define KB(x) (static_cast<size_t>(x << 10))
@@ -183,6 +190,12 @@ namespace hydra::N64
         bool success = false;
     };
 
+    struct TLBCacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
     /**
         32-bit address bus
 
@@ -201,16 +214,76 @@ namespace hydra::N64
         }
 
         void Reset();
+        // 8MB of RDRAM with the Expansion Pak, 4MB without. Has to be picked before fastmem
+        // is enabled
+        void SetExpansionPak(bool enabled);
+
+        RDRAMDirtyMap& GetDirtyMap()
+        {
+            return rdram_dirty_;
+        }
 
     private:
-        uint8_t* redirect_paddress(uint32_t paddr);
+        uint8_t* redirect_paddress(uint32_t paddr, uint32_t length = 8, bool write = false);
+
+        // Where the CPU loads from and stores to. With fastmem RDRAM is used straight from the
+        // region, which rules out the RSP and RDP threads so there is nothing to wait for
+        uint8_t* load_paddress(uint32_t paddr)
+        {
+            if (fastmem_base_ && paddr < rdram_size_) [[likely]]
+            {
+                return fastmem_base_ + paddr;
+            }
+            return redirect_paddress(paddr);
+        }
+
+        uint8_t* store_paddress(uint32_t paddr, uint32_t length)
+        {
+            if (fastmem_base_ && paddr < rdram_size_) [[likely]]
+            {
+                return fastmem_base_ + paddr;
+            }
+            return redirect_paddress(paddr, length, true);
+        }
+
+        // Waits for the RSP slice in flight, and for the RDP thread if it has yet to write the
+        // range, or to read it when write is set. Free when neither thread is enabled
+        void wait_for_rcp(uint32_t paddr, uint32_t length, bool write)
+        {
+            if (rcp_threads_active_) [[unlikely]]
+            {
+                wait_for_rcp_threads(paddr, length, write);
+            }
+        }
+
+        void wait_for_rcp_threads(uint32_t paddr, uint32_t length, bool write);
         void map_direct_addresses();
+        bool enable_fastmem();
+        void map_fastmem_cartridge();
+
+        // Only RDRAM and the cartridge have whole pages backed by memory and tracked writes,
+        // so those are the only places code gets cached or recompiled from
+        bool is_code_cacheable(uint32_t paddr)
+        {
+            return paddr < rdram_size_ || (paddr >= 0x1000'0000 && paddr < 0x1FC0'0000);
+        }
 
         static std::vector<uint8_t> ipl_;
-        std::vector<uint8_t> cart_rom_;
+        CartridgeRom cartridge_;
+        std::span<uint8_t> cart_rom_;
+        // Points to the storage vector, or to shared memory when fastmem is enabled
+        std::span<uint8_t> rdram_;
+        std::vector<uint8_t> rdram_storage_;
+        uint32_t rdram_size_ = RDRAM_EXPANSION_SIZE;
+        RDRAMDirtyMap rdram_dirty_;
+        std::unique_ptr<Fastmem> fastmem_;
+        // Base of the fastmem region, the interpreter uses it for RDRAM
+        uint8_t* fastmem_base_ = nullptr;
+        // Whether the RSP or the RDP runs on a thread of its own, kept up to date by the
+        // N64 setters
+        bool rcp_threads_active_ = false;
         bool rom_loaded_ = false;
         bool ipl_loaded_ = false;
-        std::vector<uint8_t> rdram_{};
         std::vector<uint8_t> sram_{};
         std::array<char, ISVIEWER_AREA_END - ISVIEWER_AREA_START> isviewer_buffer_{};
         std::array<uint8_t, 64> pif_ram_{};
@@ -255,12 +328,15 @@ namespace hydra::N64
         uint32_t si_status_ = 0;
 
         uint64_t time_ = 0;
+        Scheduler scheduler_;
 
         RCP& rcp_;
         friend class CPU;
+        friend class CPUJit;
         friend class hydra::N64::N64;
         friend class ::N64Debugger;
         friend class ::MmioViewer;
+        friend class QA;
     };
 
     template <auto MemberFunc>
@@ -276,8 +352,24 @@ namespace hydra::N64
     {
     public:
         CPU(CPUBus& cpubus, RCP& rcp, bool& should_draw);
-        void Tick();
+        // Returns the number of cycles that were executed
+        int Tick();
+        // Runs until the next scheduled event is due
+        void Run();
         void Reset();
+        void SetBackend(CPUBackend backend);
+        void SetFastmem(bool enabled);
+        void SetIdleLoopDetection(bool enabled);
+
+        TLBCacheStats GetTLBCacheStats() const
+        {
+            return tlb_cache_stats_;
+        }
+
+        Profiler& GetProfiler()
+        {
+            return profiler_;
+        }
 
     private:
         using PipelineStageRet = void;
@@ -294,6 +386,19 @@ namespace hydra::N64
         std::array<MemDataUnionDW, 32> fpr_regs_;
         std::array<MemDataUnionDW, 32> cp0_regs_;
         std::array<TLBEntry, 32> tlb_;
+
+        // Direct mapped cache of successful TLB lookups at 4KB granularity, so repeated accesses
+        // to the same page skip the scan. Tags are vpage + 1, so 0 means empty
+        struct TLBCacheEntry
+        {
+            uint32_t tag;
+            uint32_t paddr;
+            bool cached;
+        };
+
+        std::array<TLBCacheEntry, 1024> tlb_cache_{};
+        uint8_t tlb_cache_asid_ = 0;
+        TLBCacheStats tlb_cache_stats_;
         uint64_t temp;
         // CPU cache
         std::vector<uint8_t> instr_cache_;
@@ -316,10 +421,43 @@ namespace hydra::N64
         int32_t mouse_x_, mouse_y_;
         int32_t mouse_delta_x_, mouse_delta_y_;
         std::chrono::time_point<std::chrono::high_resolution_clock> last_second_time_;
+        CPUBackend backend_ = CPUBackend::Interpreter;
+        std::unique_ptr<CPUJit> jit_;
+
+        // Pre-decoded code for the cached interpreter, indexed by physical page
+        struct DecodedInstruction
+        {
+            void (*handler)(CPU*);
+            uint32_t instruction;
+        };
+
+        using DecodedPage = std::array<DecodedInstruction, 1024>;
+        std::vector<std::unique_ptr<DecodedPage>> decoded_pages_;
+        uint32_t decoded_vpage_ = 0xFFFF'FFFF;
+        DecodedPage* decoded_page_ = nullptr;
+
+        // Short loops that only load and compute are spinning if the registers are the same every
+        // time the loop branch is reached. Nothing they read can change until the next scheduled
+        // event, so time skips straight to it
+        struct IdleLoop
+        {
+            uint64_t head = ~0ull;
+            bool idle = false;
+            bool seen = false;
+            bool fired = false;
+            // Instructions from the head to the delay slot of the loop branch
+            int length = 0;
+            std::array<uint64_t, 34> registers;
+        };
+
+        bool idle_loop_detection_ = false;
+        IdleLoop idle_loop_;
+        Profiler profiler_{"cpu"};
 
         hydra_inline TranslatedAddress translate_vaddr(uint32_t vaddr);
         hydra_inline TranslatedAddress translate_vaddr_kernel(uint32_t vaddr);
         hydra_inline TranslatedAddress probe_tlb(uint32_t vaddr);
+        void flush_tlb_cache();
 
         uint32_t read_hwio(uint32_t addr);
         void write_hwio(uint32_t addr, uint32_t data);
@@ -421,8 +559,18 @@ namespace hydra::N64
         void store_doubleword(uint64_t address, uint64_t value);
 
         bool check_interrupts();
-        void handle_event();
+        hydra_inline void advance_count(int cycles);
+        hydra_inline void invalidate_code(uint32_t paddr, uint32_t length);
+        hydra_inline const DecodedInstruction* fetch_decoded(uint64_t vaddr);
+        void install_buses();
+        void decode_page(DecodedPage& page, uint32_t paddr);
+        bool is_idle_loop(uint64_t head);
+        bool check_idle_loop(uint64_t head);
+        int skip_idle_loop(int executed, int length);
+        void handle_event(EventType type);
+        void schedule_compare();
         uint32_t timing_pi_access(uint8_t domain, uint32_t length);
+        void schedule_sp_dma(uint32_t length);
         void check_vi_interrupt();
         void throw_exception(uint32_t, ExceptionType, uint8_t = 0);
         uint32_t get_cp0_register_32(uint8_t reg);
@@ -473,6 +621,9 @@ namespace hydra::N64
         template <bool DoLog>
         void log_cpu_state(bool use_crc, uint64_t instructions, uint64_t start = 0);
 
+        template <bool DoProfile>
+        void profile_instruction();
+
         bool is_kernel_mode();
         void dump_tlb();
         void dump_pif_ram();
@@ -483,5 +634,7 @@ namespace hydra::N64
         friend class ::MmioViewer;
         friend class hydra::N64::N64;
         friend class N64_TKPWrapper;
+        friend class CPUJit;
+        friend class QA;
     };
 } // namespace hydra::N64
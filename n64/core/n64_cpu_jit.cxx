@@ -0,0 +1,1221 @@
+#include <n64/core/n64_cpu.hxx>
+#include <n64/core/n64_cpu_jit.hxx>
+
+#if N64_JIT_AVAILABLE
+#include <n64/core/n64_register_allocation.hxx>
+#if N64_FASTMEM_AVAILABLE
+#include <ucontext.h>
+#endif
+
+namespace
+{
+    constexpr int MaxBlockInstructions = 64;
+    constexpr size_t CodeCacheSize = 32 * 1024 * 1024;
+    // A fallback with a full register flush is the biggest thing we emit per instruction
+    constexpr size_t MaxBlockSize = MaxBlockInstructions * 256;
+    constexpr uint32_t PhysicalPages = 0x2000'0000 >> 12;
+
+    enum class Condition { Equal, NotEqual, LessEqual, Greater, Less, GreaterEqual };
+
+    enum class InstructionKind { Normal, Branch, EndsBlock, Interpreted };
+
+    InstructionKind classify(uint32_t data)
+    {
+        hydra::N64::Instruction instruction{.full = data};
+        switch (instruction.IType.op)
+        {
+            case 0b000000:
+            {
+                switch (instruction.RType.func)
+                {
+                    case 0b001000: // JR
+                    case 0b001001: // JALR
+                        return InstructionKind::Branch;
+                    case 0b001100: // SYSCALL
+                    case 0b001101: // BREAK
+                        return InstructionKind::EndsBlock;
+                }
+                return InstructionKind::Normal;
+            }
+            case 0b000001:
+            {
+                switch (instruction.IType.rt)
+                {
+                    case 0b00000: // BLTZ
+                    case 0b00001: // BGEZ
+                    case 0b00010: // BLTZL
+                    case 0b00011: // BGEZL
+                    case 0b10001: // BGEZAL
+                    case 0b10011: // BGEZALL
+                        return InstructionKind::Branch;
+                }
+                // BLTZAL and BLTZALL are stubs in the interpreter, so they aren't branches there
+                return InstructionKind::Normal;
+            }
+            case 0b000010: // J
+            case 0b000011: // JAL
+            case 0b000100: // BEQ
+            case 0b000101: // BNE
+            case 0b000110: // BLEZ
+            case 0b000111: // BGTZ
+            case 0b010100: // BEQL
+            case 0b010101: // BNEL
+            case 0b010110: // BLEZL
+            case 0b010111: // BGTZL
+                return InstructionKind::Branch;
+            case 0b010000: // COP0, reads Count, may enable interrupts or change the TLB
+                return InstructionKind::Interpreted;
+        }
+        return InstructionKind::Normal;
+    }
+
+    template <class T>
+    int32_t state_offset(hydra::N64::CPU& cpu, T& member)
+    {
+        return reinterpret_cast<uint8_t*>(&member) - reinterpret_cast<uint8_t*>(&cpu);
+    }
+} // namespace
+
+#define cpu_state(member) (StatePointer + state_offset(cpu_, cpu_.member))
+
+namespace hydra::N64
+{
+    struct CPUJit::Emitter : x64::Emitter
+    {
+        Emitter() : x64::Emitter(CodeCacheSize) {}
+
+        void cmov(Condition condition, const Reg64& dst, const Reg64& src)
+        {
+            switch (condition)
+            {
+                case Condition::Equal:
+                    return cmove(dst, src);
+                case Condition::NotEqual:
+                    return cmovne(dst, src);
+                case Condition::LessEqual:
+                    return cmovle(dst, src);
+                case Condition::Greater:
+                    return cmovg(dst, src);
+                case Condition::Less:
+                    return cmovl(dst, src);
+                case Condition::GreaterEqual:
+                    return cmovge(dst, src);
+            }
+        }
+
+        void jump_unless(Condition condition, Label& label)
+        {
+            switch (condition)
+            {
+                case Condition::Equal:
+                    return jne(label);
+                case Condition::NotEqual:
+                    return je(label);
+                case Condition::LessEqual:
+                    return jg(label);
+                case Condition::Greater:
+                    return jle(label);
+                case Condition::Less:
+                    return jge(label);
+                case Condition::GreaterEqual:
+                    return jl(label);
+            }
+        }
+    };
+
+    CPUJit::CPUJit(CPU& cpu)
+        : cpu_(cpu), code_(std::make_unique<Emitter>()), code_pages_(PhysicalPages)
+    {
+        reset_allocation();
+        if (cpu_.cpubus_.fastmem_)
+        {
+            cpu_.cpubus_.fastmem_->SetFaultHandler(&CPUJit::handle_fault, this);
+        }
+    }
+
+    CPUJit::~CPUJit()
+    {
+        if (cpu_.cpubus_.fastmem_)
+        {
+            cpu_.cpubus_.fastmem_->SetFaultHandler(nullptr, nullptr);
+        }
+    }
+
+    int CPUJit::Run()
+    {
+        uint64_t pc = cpu_.pc_;
+        BlockFunc block;
+        auto it = blocks_.find(pc);
+        if (it != blocks_.end()) [[likely]]
+        {
+            block = it->second;
+        }
+        else
+        {
+            block = compile(pc);
+        }
+        if (!block)
+        {
+            return 0;
+        }
+        return block(&cpu_);
+    }
+
+    void CPUJit::Reset()
+    {
+        code_->Reset();
+        blocks_.clear();
+        page_blocks_.clear();
+        fastmem_sites_.clear();
+        std::fill(code_pages_.begin(), code_pages_.end(), 0);
+        if (cpu_.cpubus_.fastmem_)
+        {
+            cpu_.cpubus_.fastmem_->SetFaultHandler(&CPUJit::handle_fault, this);
+        }
+    }
+
+    bool CPUJit::handle_fault(void* jit, void* ucontext, uintptr_t)
+    {
+#if N64_FASTMEM_AVAILABLE
+        auto& self = *static_cast<CPUJit*>(jit);
+        auto& context = static_cast<ucontext_t*>(ucontext)->uc_mcontext;
+        uintptr_t rip = context.gregs[REG_RIP];
+        auto it = self.fastmem_sites_.find(rip);
+        if (it == self.fastmem_sites_.end())
+        {
+            return false;
+        }
+        // Whatever this access hit isn't plain memory, so from now on it always takes the
+        // slow path
+        uint8_t* site = reinterpret_cast<uint8_t*>(rip);
+        int32_t displacement = static_cast<int32_t>(it->second - (rip + 5));
+        site[0] = 0xE9;
+        memcpy(site + 1, &displacement, sizeof(int32_t));
+        context.gregs[REG_RIP] = it->second;
+        self.fastmem_sites_.erase(it);
+        return true;
+#else
+        (void)jit;
+        (void)ucontext;
+        return false;
+#endif
+    }
+
+    void CPUJit::invalidate_from_block(CPUJit* jit, uint32_t paddr, uint32_t length)
+    {
+        jit->InvalidateRange(paddr, length);
+    }
+
+    void CPUJit::register_block(uint64_t pc, uint32_t paddr, BlockFunc block)
+    {
+        blocks_[pc] = block;
+        page_blocks_[paddr >> 12].push_back(pc);
+        code_pages_[paddr >> 12] = 1;
+    }
+
+    void CPUJit::invalidate_page(uint32_t page)
+    {
+        // The host code stays in the buffer until the next Reset, which is fine since we can't be
+        // invalidating a block from inside a compile
+        for (uint64_t pc : page_blocks_[page])
+        {
+            blocks_.erase(pc);
+        }
+        page_blocks_.erase(page);
+        code_pages_[page] = 0;
+    }
+
+    CPUJit::BlockFunc CPUJit::compile(uint64_t pc)
+    {
+        uint32_t vaddr = pc;
+        if (vaddr < KSEG0_START || vaddr > KSEG1_END)
+        {
+            // TLB mapped code is left to the interpreter as its mapping can change under us
+            return nullptr;
+        }
+
+        uint32_t paddr = vaddr & 0x1FFF'FFFF;
+        const uint8_t* code =
+            cpu_.cpubus_.is_code_cacheable(paddr) ? cpu_.cpubus_.redirect_paddress(paddr) : nullptr;
+        uint32_t words = (0x1000 - (paddr & 0xFFF)) / 4;
+        auto fetch = [code](uint32_t index) {
+            uint32_t data;
+            memcpy(&data, code + index * 4, sizeof(uint32_t));
+            return hydra::bswap32(data);
+        };
+
+        auto starts_block = [&](uint32_t index) {
+            InstructionKind kind = classify(fetch(index));
+            return kind == InstructionKind::Branch || kind == InstructionKind::Interpreted;
+        };
+        bool interpreted = code && classify(fetch(0)) == InstructionKind::Interpreted;
+        bool branch_without_delay_slot = code && classify(fetch(0)) == InstructionKind::Branch &&
+                                         (words == 1 || starts_block(1));
+        if (!code || interpreted || branch_without_delay_slot)
+        {
+            register_block(pc, paddr, nullptr);
+            return nullptr;
+        }
+
+        auto& cg = *code_;
+        if (cg.Size() + MaxBlockSize > CodeCacheSize)
+        {
+            Reset();
+        }
+
+        BlockFunc block = cg.Current<BlockFunc>();
+        Label epilogue;
+        epilogue_ = &epilogue;
+
+        cg.push(StatePointer);
+        cg.push(RegisterPointer);
+        for (const auto& reg : NonVolatiles)
+        {
+            cg.push(reg);
+        }
+        // Keep the stack 16 byte aligned for the interpreter calls
+        cg.sub(rsp, 8);
+        cg.mov(StatePointer, arg1);
+        cg.lea(RegisterPointer, ptr[cpu_state(gpr_regs_)]);
+        reset_allocation();
+        fastmem_base_ = cpu_.cpubus_.fastmem_ ? cpu_.cpubus_.fastmem_->Base() : nullptr;
+
+        int count = 0;
+        uint64_t address = pc;
+        bool ended = false;
+        while (count < MaxBlockInstructions && static_cast<uint32_t>(count) < words)
+        {
+            uint32_t instruction = fetch(count);
+            InstructionKind kind = classify(instruction);
+
+            // Count is only brought up to date after the block, so these run on their own in
+            // the interpreter
+            if (kind == InstructionKind::Interpreted)
+            {
+                break;
+            }
+
+            if (kind == InstructionKind::Branch)
+            {
+                // The delay slot has to be in the same page and can't be a branch or an
+                // interpreted instruction, otherwise the branch is left for the interpreter
+                if (static_cast<uint32_t>(count + 1) == words || starts_block(count + 1))
+                {
+                    break;
+                }
+                uint32_t delay_slot = fetch(count + 1);
+                compile_branch(instruction, delay_slot, address, count);
+                ended = true;
+                break;
+            }
+
+            locked_ = 0;
+            if (kind == InstructionKind::EndsBlock ||
+                !compile_instruction(instruction, address, count, false))
+            {
+                compile_fallback(instruction, address, false);
+                count++;
+                if (kind == InstructionKind::EndsBlock)
+                {
+                    exit_block(count);
+                    ended = true;
+                    break;
+                }
+
+                // Exceptions and ERET move the pc somewhere else
+                Label next;
+                cg.mov(rax, address + 8);
+                cg.cmp(qword[cpu_state(next_pc_)], rax);
+                cg.je(next);
+                exit_block(count);
+                cg.Bind(next);
+            }
+            else
+            {
+                count++;
+            }
+            address += 4;
+        }
+
+        if (!ended)
+        {
+            set_pc_state(address - 4);
+            exit_block(count);
+        }
+
+        cg.Bind(epilogue);
+        cg.add(rsp, 8);
+        for (auto it = NonVolatiles.rbegin(); it != NonVolatiles.rend(); ++it)
+        {
+            cg.pop(*it);
+        }
+        cg.pop(RegisterPointer);
+        cg.pop(StatePointer);
+        cg.ret();
+        epilogue_ = nullptr;
+
+        register_block(pc, paddr, block);
+        return block;
+    }
+
+    bool CPUJit::compile_instruction(uint32_t data, uint64_t address, int count, bool delay_slot)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        uint32_t rs = instruction.RType.rs;
+        uint32_t rt = instruction.RType.rt;
+        uint32_t rd = instruction.RType.rd;
+        uint32_t sa = instruction.RType.sa;
+        int32_t seimm = static_cast<int16_t>(instruction.IType.immediate);
+        uint32_t imm = instruction.IType.immediate;
+
+        switch (instruction.IType.op)
+        {
+            case 0b000000:
+                break;
+            case 0b001001: // ADDIU
+            case 0b011001: // DADDIU
+            case 0b001010: // SLTI
+            case 0b001011: // SLTIU
+            case 0b001100: // ANDI
+            case 0b001101: // ORI
+            case 0b001110: // XORI
+            case 0b001111: // LUI
+            {
+                if (rt == 0)
+                {
+                    return true;
+                }
+                if (instruction.IType.op == 0b001111)
+                {
+                    cg.mov(Reg64(destination(rt)), static_cast<int64_t>(seimm * 0x10000));
+                    return true;
+                }
+                Reg64 src = Reg64(source(rs, rcx.Index()));
+                switch (instruction.IType.op)
+                {
+                    case 0b001001:
+                        cg.lea(eax, ptr[src + seimm]);
+                        cg.movsxd(rax, eax);
+                        break;
+                    case 0b011001:
+                        cg.lea(rax, ptr[src + seimm]);
+                        break;
+                    case 0b001010:
+                        cg.xor_(eax, eax);
+                        cg.cmp(src, seimm);
+                        cg.setl(al);
+                        break;
+                    case 0b001011:
+                        cg.xor_(eax, eax);
+                        cg.cmp(src, seimm);
+                        cg.setb(al);
+                        break;
+                    case 0b001100:
+                        cg.mov(rax, src);
+                        cg.and_(rax, imm);
+                        break;
+                    case 0b001101:
+                        cg.mov(rax, src);
+                        cg.or_(rax, imm);
+                        break;
+                    case 0b001110:
+                        cg.mov(rax, src);
+                        cg.xor_(rax, imm);
+                        break;
+                }
+                cg.mov(Reg64(destination(rt)), rax);
+                return true;
+            }
+            case 0b100000: // LB
+            case 0b100001: // LH
+            case 0b100011: // LW
+            case 0b100100: // LBU
+            case 0b100101: // LHU
+            case 0b100111: // LWU
+            case 0b110111: // LD
+            case 0b101000: // SB
+            case 0b101001: // SH
+            case 0b101011: // SW
+            case 0b111111: // SD
+            {
+                // An exception in a delay slot needs the branch state, leave those to the
+                // interpreter
+                if (!fastmem_base_ || delay_slot)
+                {
+                    return false;
+                }
+                return compile_memory_access(data, address, count);
+            }
+            default:
+                return false;
+        }
+
+        // SPECIAL
+        switch (instruction.RType.func)
+        {
+            case 0b010001: // MTHI
+            case 0b010011: // MTLO
+            {
+                Reg64 src = Reg64(source(rs, rcx.Index()));
+                if (instruction.RType.func == 0b010001)
+                {
+                    cg.mov(qword[cpu_state(hi_)], src);
+                }
+                else
+                {
+                    cg.mov(qword[cpu_state(lo_)], src);
+                }
+                return true;
+            }
+            case 0b000000: // SLL
+            case 0b000010: // SRL
+            case 0b000011: // SRA
+            case 0b000100: // SLLV
+            case 0b000110: // SRLV
+            case 0b000111: // SRAV
+            case 0b010100: // DSLLV
+            case 0b010110: // DSRLV
+            case 0b010111: // DSRAV
+            case 0b010000: // MFHI
+            case 0b010010: // MFLO
+            case 0b100001: // ADDU
+            case 0b100011: // SUBU
+            case 0b100100: // AND
+            case 0b100101: // OR
+            case 0b100110: // XOR
+            case 0b100111: // NOR
+            case 0b101010: // SLT
+            case 0b101011: // SLTU
+            case 0b101101: // DADDU
+            case 0b101111: // DSUBU
+            case 0b111000: // DSLL
+            case 0b111010: // DSRL
+            case 0b111011: // DSRA
+            case 0b111100: // DSLL32
+            case 0b111110: // DSRL32
+            case 0b111111: // DSRA32
+                break;
+            default:
+                return false;
+        }
+
+        if (rd == 0)
+        {
+            // Also covers NOP (SLL r0, r0, 0)
+            return true;
+        }
+
+        Reg64 t = Reg64(source(rt, rdx.Index()));
+        Reg64 s = Reg64(source(rs, rcx.Index()));
+        switch (instruction.RType.func)
+        {
+            case 0b000000:
+                cg.mov(eax, t.To32());
+                cg.shl(eax, sa);
+                cg.movsxd(rax, eax);
+                break;
+            case 0b000010:
+                cg.mov(eax, t.To32());
+                cg.shr(eax, sa);
+                cg.movsxd(rax, eax);
+                break;
+            case 0b000011:
+                cg.mov(rax, t);
+                cg.sar(rax, sa);
+                cg.movsxd(rax, eax);
+                break;
+            case 0b000100:
+                cg.mov(eax, t.To32());
+                cg.mov(ecx, s.To32());
+                cg.shl(eax, cl);
+                cg.movsxd(rax, eax);
+                break;
+            case 0b000110:
+                cg.mov(eax, t.To32());
+                cg.mov(ecx, s.To32());
+                cg.shr(eax, cl);
+                cg.movsxd(rax, eax);
+                break;
+            case 0b000111:
+                // Shifts the 64-bit value but only by up to 31
+                cg.mov(rax, t);
+                cg.mov(ecx, s.To32());
+                cg.and_(ecx, 0b11111);
+                cg.sar(rax, cl);
+                cg.movsxd(rax, eax);
+                break;
+            case 0b010100:
+                cg.mov(rax, t);
+                cg.mov(ecx, s.To32());
+                cg.shl(rax, cl);
+                break;
+            case 0b010110:
+                cg.mov(rax, t);
+                cg.mov(ecx, s.To32());
+                cg.shr(rax, cl);
+                break;
+            case 0b010111:
+                cg.mov(rax, t);
+                cg.mov(ecx, s.To32());
+                cg.sar(rax, cl);
+                break;
+            case 0b010000:
+                cg.mov(rax, qword[cpu_state(hi_)]);
+                break;
+            case 0b010010:
+                cg.mov(rax, qword[cpu_state(lo_)]);
+                break;
+            case 0b100001:
+                cg.mov(eax, s.To32());
+                cg.add(eax, t.To32());
+                cg.movsxd(rax, eax);
+                break;
+            case 0b100011:
+                cg.mov(eax, s.To32());
+                cg.sub(eax, t.To32());
+                cg.movsxd(rax, eax);
+                break;
+            case 0b100100:
+                cg.mov(rax, s);
+                cg.and_(rax, t);
+                break;
+            case 0b100101:
+                cg.mov(rax, s);
+                cg.or_(rax, t);
+                break;
+            case 0b100110:
+                cg.mov(rax, s);
+                cg.xor_(rax, t);
+                break;
+            case 0b100111:
+                cg.mov(rax, s);
+                cg.or_(rax, t);
+                cg.not_(rax);
+                break;
+            case 0b101010:
+                cg.xor_(eax, eax);
+                cg.cmp(s, t);
+                cg.setl(al);
+                break;
+            case 0b101011:
+                cg.xor_(eax, eax);
+                cg.cmp(s, t);
+                cg.setb(al);
+                break;
+            case 0b101101:
+                cg.mov(rax, s);
+                cg.add(rax, t);
+                break;
+            case 0b101111:
+                cg.mov(rax, s);
+                cg.sub(rax, t);
+                break;
+            case 0b111000:
+                cg.mov(rax, t);
+                cg.shl(rax, sa);
+                break;
+            case 0b111010:
+                cg.mov(rax, t);
+                cg.shr(rax, sa);
+                break;
+            case 0b111011:
+                cg.mov(rax, t);
+                cg.sar(rax, sa);
+                break;
+            case 0b111100:
+                cg.mov(rax, t);
+                cg.shl(rax, sa + 32);
+                break;
+            case 0b111110:
+                cg.mov(rax, t);
+                cg.shr(rax, sa + 32);
+                break;
+            case 0b111111:
+                cg.mov(rax, t);
+                cg.sar(rax, sa + 32);
+                break;
+        }
+        cg.mov(Reg64(destination(rd)), rax);
+        return true;
+    }
+
+    bool CPUJit::compile_memory_access(uint32_t data, uint64_t address, int count)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        uint32_t op = instruction.IType.op;
+        uint32_t rs = instruction.IType.rs;
+        uint32_t rt = instruction.IType.rt;
+        int32_t seimm = static_cast<int16_t>(instruction.IType.immediate);
+        // LD sits in the store half of the opcode table
+        bool store = op >= 0b101000 && op != 0b110111;
+        int size = 0;
+        switch (op)
+        {
+            case 0b100000:
+            case 0b100100:
+            case 0b101000:
+                size = 1;
+                break;
+            case 0b100001:
+            case 0b100101:
+            case 0b101001:
+                size = 2;
+                break;
+            case 0b100011:
+            case 0b100111:
+            case 0b101011:
+                size = 4;
+                break;
+            case 0b110111:
+            case 0b111111:
+                size = 8;
+                break;
+        }
+        if (!store && rt == 0)
+        {
+            // Loads into r0 are rare and still need to run for their side effects
+            return false;
+        }
+
+        Reg64 s = Reg64(source(rs, rcx.Index()));
+        cg.lea(rax, ptr[s + seimm]);
+        // Both paths need rt in the same host register, so loads fetch the old value too in
+        // case the slow path raises an exception instead of writing it
+        Reg64 t = rsi;
+        if (store)
+        {
+            t = Reg64(source(rt, rsi.Index()));
+        }
+        else
+        {
+            t = Reg64(allocate(rt, true));
+            dirty_ |= 1 << (t.Index() - allocateableRegisters[0].Index());
+        }
+
+        // Only sign extended KSEG0/KSEG1 addresses with the right alignment take the fast path
+        Label slow, done;
+        cg.movsxd(rdx, eax);
+        cg.cmp(rdx, rax);
+        cg.jne(slow);
+        cg.mov(edx, eax);
+        cg.sub(edx, 0x8000'0000);
+        cg.cmp(edx, 0x4000'0000);
+        cg.jae(slow);
+        if (size > 1)
+        {
+            cg.test(al, size - 1);
+            cg.jnz(slow);
+        }
+        cg.and_(edx, 0x1FFF'FFFF);
+        cg.mov(rcx, reinterpret_cast<uintptr_t>(fastmem_base_));
+
+        Label invalidate;
+        if (store)
+        {
+            // Byte swap first so the access itself is the instruction that faults
+            switch (size)
+            {
+                case 2:
+                    cg.mov(eax, t.To32());
+                    cg.rol(ax, 8);
+                    break;
+                case 4:
+                    cg.mov(eax, t.To32());
+                    cg.bswap(eax);
+                    break;
+                case 8:
+                    cg.mov(rax, t);
+                    cg.bswap(rax);
+                    break;
+            }
+        }
+        uintptr_t site = reinterpret_cast<uintptr_t>(cg.Current<const uint8_t*>());
+        if (!store)
+        {
+            switch (op)
+            {
+                case 0b100000:
+                    cg.movsx(rax, byte[rcx + rdx]);
+                    break;
+                case 0b100100:
+                    cg.movzx(eax, byte[rcx + rdx]);
+                    break;
+                case 0b100001:
+                    cg.movzx(eax, word[rcx + rdx]);
+                    cg.rol(ax, 8);
+                    cg.movsx(rax, ax);
+                    break;
+                case 0b100101:
+                    cg.movzx(eax, word[rcx + rdx]);
+                    cg.rol(ax, 8);
+                    cg.movzx(eax, ax);
+                    break;
+                case 0b100011:
+                    cg.mov(eax, dword[rcx + rdx]);
+                    cg.bswap(eax);
+                    cg.movsxd(rax, eax);
+                    break;
+                case 0b100111:
+                    cg.mov(eax, dword[rcx + rdx]);
+                    cg.bswap(eax);
+                    break;
+                case 0b110111:
+                    cg.mov(rax, qword[rcx + rdx]);
+                    cg.bswap(rax);
+                    break;
+            }
+            cg.mov(t, rax);
+        }
+        else
+        {
+            switch (size)
+            {
+                case 1:
+                    cg.mov(byte[rcx + rdx], t.To8());
+                    break;
+                case 2:
+                    cg.mov(word[rcx + rdx], ax);
+                    break;
+                case 4:
+                    cg.mov(dword[rcx + rdx], eax);
+                    break;
+                case 8:
+                    cg.mov(qword[rcx + rdx], rax);
+                    break;
+            }
+            cg.mov(esi, edx);
+            cg.mov(ecx, edx);
+            cg.shr(ecx, RDRAMDirtyMap::PAGE_SHIFT);
+            cg.mov(rax, reinterpret_cast<uintptr_t>(cpu_.cpubus_.rdram_dirty_.Data()));
+            cg.bts(qword[rax], rcx);
+            cg.shr(edx, 12);
+            cg.mov(rcx, reinterpret_cast<uintptr_t>(code_pages_.data()));
+            cg.cmp(byte[rcx + rdx], 0);
+            cg.jne(invalidate);
+        }
+        cg.jmp(done);
+        fastmem_sites_[site] = reinterpret_cast<uintptr_t>(cg.Current<const uint8_t*>());
+
+        // Slow path, the same thing compile_fallback does without touching the allocation
+        cg.Bind(slow);
+        save_registers();
+        set_pc_state(address);
+        cg.mov(byte[cpu_state(prev_branch_)], 0);
+        cg.mov(dword[cpu_state(instruction_)], data);
+        cg.mov(qword[RegisterPointer], 0);
+        cg.mov(arg1, StatePointer);
+        cg.mov(rax, reinterpret_cast<uintptr_t>(CPU::instruction_table_[op]));
+        cg.call(rax);
+        Label no_exception;
+        cg.mov(rax, address + 8);
+        cg.cmp(qword[cpu_state(next_pc_)], rax);
+        cg.je(no_exception);
+        // Registers were saved before the call, so just leave
+        cg.mov(eax, count + 1);
+        cg.jmp(*epilogue_);
+        cg.Bind(no_exception);
+        reload_registers();
+        cg.jmp(done);
+
+        if (store)
+        {
+            // The store hit a page with compiled code, which might be this very block
+            cg.Bind(invalidate);
+            save_registers();
+            cg.mov(arg1, reinterpret_cast<uintptr_t>(this));
+            cg.mov(edx, size);
+            cg.mov(rax, reinterpret_cast<uintptr_t>(&CPUJit::invalidate_from_block));
+            cg.call(rax);
+            set_pc_state(address);
+            cg.mov(byte[cpu_state(prev_branch_)], 0);
+            cg.mov(eax, count + 1);
+            cg.jmp(*epilogue_);
+        }
+
+        cg.Bind(done);
+        return true;
+    }
+
+    void CPUJit::compile_branch(uint32_t data, uint32_t delay_slot, uint64_t address, int count)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        uint64_t delay_address = address + 4;
+        int32_t offset = static_cast<int16_t>(instruction.IType.immediate << 2);
+        uint64_t target = delay_address + offset;
+        // Matches CPU::link_register, which runs while pc_ points to the delay slot
+        uint64_t link = static_cast<uint64_t>(static_cast<int32_t>(delay_address)) + 4;
+
+        bool conditional = true;
+        bool compare_rt = false;
+        bool wide = true;
+        bool likely = false;
+        bool link_after = false;
+        bool link_before = false;
+        Condition condition = Condition::Equal;
+
+        locked_ = 0;
+        switch (instruction.IType.op)
+        {
+            case 0b000000:
+            {
+                // JR, JALR
+                if (instruction.RType.func == 0b001001 && instruction.RType.rd != 0)
+                {
+                    cg.mov(Reg64(destination(instruction.RType.rd)), link);
+                }
+                Reg64 s = Reg64(source(instruction.RType.rs, rcx.Index()));
+                writeback_registers();
+                Label aligned;
+                cg.test(s.To32(), 0b11);
+                cg.jz(aligned);
+                // Let the interpreter raise the address error
+                compile_fallback(data, address, false);
+                exit_block(count + 1);
+                cg.Bind(aligned);
+                cg.mov(qword[cpu_state(next_pc_)], s);
+                cg.mov(byte[cpu_state(was_branch_)], 1);
+                conditional = false;
+                break;
+            }
+            case 0b000001:
+            {
+                switch (instruction.IType.rt)
+                {
+                    case 0b00000:
+                        condition = Condition::Less;
+                        break;
+                    case 0b00001:
+                        condition = Condition::GreaterEqual;
+                        wide = false;
+                        break;
+                    case 0b00010:
+                        condition = Condition::Less;
+                        likely = true;
+                        break;
+                    case 0b00011:
+                        condition = Condition::GreaterEqual;
+                        wide = false;
+                        likely = true;
+                        break;
+                    case 0b10001:
+                        condition = Condition::GreaterEqual;
+                        link_after = true;
+                        break;
+                    case 0b10011:
+                        condition = Condition::GreaterEqual;
+                        likely = true;
+                        link_before = true;
+                        break;
+                }
+                break;
+            }
+            case 0b000010: // J
+            case 0b000011: // JAL
+            {
+                if (instruction.IType.op == 0b000011)
+                {
+                    cg.mov(Reg64(destination(31)), link);
+                }
+                uint64_t jump_address = (address & 0xF000'0000) | (instruction.JType.target << 2);
+                cg.mov(rax, jump_address);
+                cg.mov(qword[cpu_state(next_pc_)], rax);
+                cg.mov(byte[cpu_state(was_branch_)], 1);
+                conditional = false;
+                break;
+            }
+            case 0b010100:
+            case 0b000100:
+                condition = Condition::Equal;
+                compare_rt = true;
+                break;
+            case 0b010101:
+            case 0b000101:
+                condition = Condition::NotEqual;
+                compare_rt = true;
+                break;
+            case 0b010110:
+            case 0b000110:
+                condition = Condition::LessEqual;
+                break;
+            case 0b010111:
+            case 0b000111:
+                condition = Condition::Greater;
+                break;
+        }
+
+        if (conditional)
+        {
+            likely |= instruction.IType.op >= 0b010100;
+            if (link_before)
+            {
+                cg.mov(Reg64(destination(31)), link);
+            }
+            Reg64 s = Reg64(source(instruction.IType.rs, rcx.Index()));
+            Reg64 t = compare_rt ? Reg64(source(instruction.IType.rt, rdx.Index())) : rdx;
+            if (likely)
+            {
+                // The not taken path leaves straight from here, so memory must be up to date
+                writeback_registers();
+            }
+            if (compare_rt)
+            {
+                cg.cmp(s, t);
+            }
+            else if (wide)
+            {
+                cg.cmp(s, 0);
+            }
+            else
+            {
+                cg.cmp(s.To32(), 0);
+            }
+
+            Label not_taken;
+            if (likely)
+            {
+                cg.jump_unless(condition, not_taken);
+                cg.mov(rax, target);
+            }
+            else
+            {
+                cg.mov(rax, address + 8);
+                cg.mov(rdx, target);
+                cg.cmov(condition, rax, rdx);
+            }
+            cg.mov(qword[cpu_state(next_pc_)], rax);
+            cg.mov(byte[cpu_state(was_branch_)], 1);
+            if (link_after)
+            {
+                cg.mov(Reg64(destination(31)), link);
+            }
+
+            locked_ = 0;
+            advance_pc_state(delay_address);
+            if (classify(delay_slot) != InstructionKind::Normal ||
+                !compile_instruction(delay_slot, delay_address, count + 1, true))
+            {
+                compile_fallback(delay_slot, delay_address, true);
+            }
+            exit_block(count + 2);
+
+            if (likely)
+            {
+                // conditional_branch_likely skips the delay slot when not taken
+                cg.Bind(not_taken);
+                cg.mov(rax, address);
+                cg.mov(qword[cpu_state(prev_pc_)], rax);
+                cg.mov(rax, address + 8);
+                cg.mov(qword[cpu_state(pc_)], rax);
+                cg.mov(rax, address + 12);
+                cg.mov(qword[cpu_state(next_pc_)], rax);
+                cg.mov(eax, count + 1);
+                cg.jmp(*epilogue_);
+            }
+            return;
+        }
+
+        locked_ = 0;
+        advance_pc_state(delay_address);
+        if (classify(delay_slot) != InstructionKind::Normal ||
+            !compile_instruction(delay_slot, delay_address, count + 1, true))
+        {
+            compile_fallback(delay_slot, delay_address, true);
+        }
+        exit_block(count + 2);
+    }
+
+    void CPUJit::compile_fallback(uint32_t instruction, uint64_t address, bool delay_slot)
+    {
+        auto& cg = *code_;
+        flush_registers();
+        if (!delay_slot)
+        {
+            // Same thing CPU::Tick does before executing an instruction
+            set_pc_state(address);
+            cg.mov(byte[cpu_state(prev_branch_)], 0);
+        }
+        cg.mov(dword[cpu_state(instruction_)], instruction);
+        cg.mov(qword[RegisterPointer], 0);
+        cg.mov(arg1, StatePointer);
+        cg.mov(rax, reinterpret_cast<uintptr_t>(CPU::instruction_table_[instruction >> 26]));
+        cg.call(rax);
+    }
+
+    void CPUJit::set_pc_state(uint64_t address)
+    {
+        auto& cg = *code_;
+        cg.mov(rax, address);
+        cg.mov(qword[cpu_state(prev_pc_)], rax);
+        cg.add(rax, 4);
+        cg.mov(qword[cpu_state(pc_)], rax);
+        cg.add(rax, 4);
+        cg.mov(qword[cpu_state(next_pc_)], rax);
+    }
+
+    void CPUJit::advance_pc_state(uint64_t address)
+    {
+        auto& cg = *code_;
+        cg.mov(rax, address);
+        cg.mov(qword[cpu_state(prev_pc_)], rax);
+        cg.mov(rax, qword[cpu_state(next_pc_)]);
+        cg.mov(qword[cpu_state(pc_)], rax);
+        cg.add(rax, 4);
+        cg.mov(qword[cpu_state(next_pc_)], rax);
+        cg.mov(byte[cpu_state(prev_branch_)], 1);
+        cg.mov(byte[cpu_state(was_branch_)], 0);
+    }
+
+    void CPUJit::exit_block(int count)
+    {
+        auto& cg = *code_;
+        // Doesn't touch the allocation state, the code after an early exit still relies on it
+        save_registers();
+        cg.mov(eax, count);
+        cg.jmp(*epilogue_);
+    }
+
+    int CPUJit::allocate(int guest, bool load)
+    {
+        int host = host_of_guest_[guest];
+        if (host == -1)
+        {
+            while (locked_ & (1 << next_victim_))
+            {
+                next_victim_ = (next_victim_ + 1) % 8;
+            }
+            host = next_victim_;
+            next_victim_ = (next_victim_ + 1) % 8;
+            spill(host);
+            if (load)
+            {
+                code_->mov(allocateableRegisters[host], qword[RegisterPointer + guest * 8]);
+            }
+            host_of_guest_[guest] = host;
+            guest_of_host_[host] = guest;
+        }
+        locked_ |= 1 << host;
+        return allocateableRegisters[host].Index();
+    }
+
+    int CPUJit::source(int guest, int scratch)
+    {
+        // r0 isn't guaranteed to be 0 in memory, the interpreter only clears it before
+        // each instruction
+        if (guest == 0)
+        {
+            code_->xor_(Reg32(scratch), Reg32(scratch));
+            return scratch;
+        }
+        return allocate(guest, true);
+    }
+
+    int CPUJit::destination(int guest)
+    {
+        int index = allocate(guest, false);
+        dirty_ |= 1 << (index - allocateableRegisters[0].Index());
+        return index;
+    }
+
+    void CPUJit::spill(int host)
+    {
+        int guest = guest_of_host_[host];
+        if (guest == -1)
+        {
+            return;
+        }
+        if (dirty_ & (1 << host))
+        {
+            code_->mov(qword[RegisterPointer + guest * 8], allocateableRegisters[host]);
+        }
+        host_of_guest_[guest] = -1;
+        guest_of_host_[host] = -1;
+        dirty_ &= ~(1 << host);
+    }
+
+    void CPUJit::flush_registers()
+    {
+        for (int host = 0; host < 8; host++)
+        {
+            spill(host);
+        }
+    }
+
+    void CPUJit::writeback_registers()
+    {
+        for (int host = 0; host < 8; host++)
+        {
+            if (dirty_ & (1 << host))
+            {
+                code_->mov(qword[RegisterPointer + guest_of_host_[host] * 8],
+                           allocateableRegisters[host]);
+            }
+        }
+        dirty_ = 0;
+    }
+
+    void CPUJit::save_registers()
+    {
+        // Like writeback_registers, but for code that branches off and the allocation has to
+        // stay as is for the code after it
+        for (int host = 0; host < 8; host++)
+        {
+            if (dirty_ & (1 << host))
+            {
+                code_->mov(qword[RegisterPointer + guest_of_host_[host] * 8],
+                           allocateableRegisters[host]);
+            }
+        }
+    }
+
+    void CPUJit::reload_registers()
+    {
+        for (int host = 0; host < 8; host++)
+        {
+            if (guest_of_host_[host] != -1)
+            {
+                code_->mov(allocateableRegisters[host],
+                           qword[RegisterPointer + guest_of_host_[host] * 8]);
+            }
+        }
+    }
+
+    void CPUJit::reset_allocation()
+    {
+        host_of_guest_.fill(-1);
+        guest_of_host_.fill(-1);
+        dirty_ = 0;
+        locked_ = 0;
+        next_victim_ = 0;
+    }
+} // namespace hydra::N64
+
+#undef cpu_state
+#else
+namespace hydra::N64
+{
+    struct CPUJit::Emitter
+    {};
+
+    CPUJit::CPUJit(CPU& cpu) : cpu_(cpu)
+    {
+        Logger::Warn("The N64 dynarec is only available on x86-64");
+    }
+
+    CPUJit::~CPUJit() = default;
+
+    int CPUJit::Run()
+    {
+        return 0;
+    }
+
+    void CPUJit::Reset() {}
+
+    void CPUJit::invalidate_page(uint32_t page)
+    {
+        code_pages_[page] = 0;
+    }
+} // namespace hydra::N64
+#endif
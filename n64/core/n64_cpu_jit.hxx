@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <n64/core/n64_x64_emitter.hxx>
+#include <unordered_map>
+#include <vector>
+
+namespace hydra::N64
+{
+    class CPU;
+
+    // CachedInterpreter runs the regular interpreter handlers, but decodes each page of code once
+    enum class CPUBackend { Interpreter, CachedInterpreter, Dynarec };
+
+    /**
+        Block based x86-64 recompiler for the VR4300
+
+        A block starts at a direct mapped (KSEG0/KSEG1) address and ends after the delay slot of
+        its first branch, after a syscall or break, before a COP0 instruction or at the end of the
+        4KB page. COP0 instructions are always interpreted, as Count is only advanced once the
+        block is done. Opcodes that aren't emitted natively are run by calling the
+        interpreter handler with the guest pc state synced, so the JIT never has to know about
+        exceptions, the FPU or memory mapped IO.
+
+        With fastmem, direct mapped loads and stores access the host region with a single
+        instruction. When one of them faults on something that isn't memory, it gets patched to
+        jump to the interpreter fallback emitted next to it.
+    */
+    class CPUJit final
+    {
+    public:
+        CPUJit(CPU& cpu);
+        ~CPUJit();
+
+        // Runs the block at the current pc and returns how many instructions it executed,
+        // or 0 if the code at pc can't be recompiled and should be interpreted instead
+        int Run();
+        void Reset();
+
+        void InvalidateRange(uint32_t paddr, uint32_t length)
+        {
+            uint32_t first = paddr >> 12;
+            uint32_t last = (paddr + length - 1) >> 12;
+            for (uint32_t page = first; page <= last && page < code_pages_.size(); page++)
+            {
+                if (code_pages_[page]) [[unlikely]]
+                {
+                    invalidate_page(page);
+                }
+            }
+        }
+
+    private:
+        using BlockFunc = int (*)(CPU*);
+        struct Emitter;
+
+        CPU& cpu_;
+        std::unique_ptr<Emitter> code_;
+        x64::Label* epilogue_ = nullptr;
+        std::unordered_map<uint64_t, BlockFunc> blocks_;
+        std::unordered_map<uint32_t, std::vector<uint64_t>> page_blocks_;
+        std::vector<uint8_t> code_pages_;
+        // Host address of each fastmem access mapped to its slow path
+        std::unordered_map<uintptr_t, uintptr_t> fastmem_sites_;
+        uint8_t* fastmem_base_ = nullptr;
+
+        // Guest GPRs cached in host registers while a block is being compiled
+        std::array<int8_t, 32> host_of_guest_;
+        std::array<int8_t, 8> guest_of_host_;
+        uint8_t dirty_ = 0;
+        uint8_t locked_ = 0;
+        int next_victim_ = 0;
+
+        BlockFunc compile(uint64_t pc);
+        bool compile_instruction(uint32_t instruction, uint64_t address, int count,
+                                 bool delay_slot);
+        bool compile_memory_access(uint32_t instruction, uint64_t address, int count);
+        void compile_branch(uint32_t instruction, uint32_t delay_slot, uint64_t address, int count);
+        void compile_fallback(uint32_t instruction, uint64_t address, bool delay_slot);
+        void register_block(uint64_t pc, uint32_t paddr, BlockFunc block);
+        void invalidate_page(uint32_t page);
+
+        // These return x86 register indices
+        int allocate(int guest, bool load);
+        int source(int guest, int scratch);
+        int destination(int guest);
+        void spill(int host);
+        void flush_registers();
+        void writeback_registers();
+        void save_registers();
+        void reload_registers();
+        void reset_allocation();
+        void exit_block(int count);
+        void set_pc_state(uint64_t address);
+        void advance_pc_state(uint64_t address);
+
+        static bool handle_fault(void* jit, void* ucontext, uintptr_t address);
+        static void invalidate_from_block(CPUJit* jit, uint32_t paddr, uint32_t length);
+    };
+} // namespace hydra::N64
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <fmt/format.h>
 #include <fstream>
 #include <iostream>
@@ -12,28 +13,24 @@ namespace hydra::N64
 
     CPUBus::CPUBus(RCP& rcp) : rcp_(rcp)
     {
-        cart_rom_.resize(0xFC00000);
-        rdram_.resize(0x800000);
+        rdram_storage_.resize(RDRAM_EXPANSION_SIZE);
+        cart_rom_ = std::span<uint8_t>(cartridge_.Data(), CART_ROM_SIZE);
+        rdram_ = rdram_storage_;
         map_direct_addresses();
     }
 
     bool CPUBus::LoadCartridge(std::string path)
     {
-        std::ifstream ifs(path, std::ios::in | std::ios::binary);
-        if (ifs.is_open())
+        if (!cartridge_.Load(path))
         {
-            ifs.unsetf(std::ios::skipws);
-            ifs.seekg(0, std::ios::end);
-            std::streampos size = ifs.tellg();
-            ifs.seekg(0, std::ios::beg);
-            ifs.read(reinterpret_cast<char*>(cart_rom_.data()), size);
-            rom_loaded_ = true;
-            Reset();
+            return false;
         }
-        else
+        if (fastmem_)
         {
-            return false;
+            map_fastmem_cartridge();
         }
+        rom_loaded_ = true;
+        Reset();
         return true;
     }
 
@@ -60,11 +57,29 @@ namespace hydra::N64
         return true;
     }
 
+    void CPUBus::SetExpansionPak(bool enabled)
+    {
+        uint32_t size = enabled ? RDRAM_EXPANSION_SIZE : RDRAM_SIZE;
+        if (size == rdram_size_)
+        {
+            return;
+        }
+        if (fastmem_)
+        {
+            Logger::Warn("The Expansion Pak can't be changed after fastmem is enabled");
+            return;
+        }
+        rdram_size_ = size;
+        map_direct_addresses();
+    }
+
     // These resets are called multiple times - why?
     void CPUBus::Reset()
     {
         pif_ram_.fill(0);
         time_ = 0;
+        // Whatever was derived from RDRAM before the reset is stale
+        rdram_dirty_.MarkAll();
 
         uint32_t crc = 0xFFFF'FFFF;
         for (int i = 0; i < 0x9c0; i++)
@@ -104,11 +119,17 @@ namespace hydra::N64
         pif_ram_[0x27] = 0x3F;
     }
 
-    uint8_t* CPUBus::redirect_paddress(uint32_t paddr)
+    uint8_t* CPUBus::redirect_paddress(uint32_t paddr, uint32_t length, bool write)
     {
         uint8_t* ptr = page_table_[paddr >> 16];
         if (ptr) [[likely]]
         {
+            if ((paddr >> 16) == (0x0400'0000 >> 16)) [[unlikely]]
+            {
+                // DMEM and IMEM belong to the RSP thread while it runs a slice
+                rcp_.rsp_.Sync();
+            }
+            wait_for_rcp(paddr, length, write);
             ptr += (paddr & static_cast<uint32_t>(0xFFFF));
             return ptr;
         }
@@ -119,15 +140,30 @@ namespace hydra::N64
         return nullptr;
     }
 
+    void CPUBus::wait_for_rcp_threads(uint32_t paddr, uint32_t length, bool write)
+    {
+        if (paddr >= RDRAM_EXPANSION_SIZE)
+        {
+            return;
+        }
+        // Any RDRAM access waits for the RSP slice in flight, see RSPThread. It also stops the
+        // RSP thread from sending the RDP more commands while its pages are checked
+        rcp_.rsp_.Sync();
+        if (rcp_.rdp_.IsPending(paddr, length, write))
+        {
+            rcp_.rdp_.Sync();
+        }
+    }
+
     void CPUBus::map_direct_addresses()
     {
         // https://wheremyfoodat.github.io/software-fastmem/
         const uint32_t PAGE_SIZE = 0x10000;
 #define ADDR_TO_PAGE(addr) ((addr) >> 16)
-        // Map rdram
-        for (int i = 0; i < ADDR_TO_PAGE(0x800'000); i++)
+        // Map rdram, the upper 4MB are open bus without the Expansion Pak
+        for (uint32_t i = 0; i < ADDR_TO_PAGE(RDRAM_EXPANSION_SIZE); i++)
         {
-            page_table_[i] = &rdram_[PAGE_SIZE * i];
+            page_table_[i] = i < ADDR_TO_PAGE(rdram_size_) ? &rdram_[PAGE_SIZE * i] : nullptr;
         }
         page_table_[ADDR_TO_PAGE(0x04000000)] = &rcp_.rsp_.mem_[0];
 
@@ -144,4 +180,47 @@ namespace hydra::N64
         page_table_[ADDR_TO_PAGE(ISVIEWER_AREA_START)] = nullptr;
 #undef ADDR_TO_PAGE
     }
+
+    bool CPUBus::enable_fastmem()
+    {
+        if (fastmem_)
+        {
+            return true;
+        }
+        auto fastmem = std::make_unique<Fastmem>();
+        if (!fastmem->Reserve())
+        {
+            return false;
+        }
+        uint8_t* rdram = fastmem->Map(0, rdram_.size(), true);
+        std::memcpy(rdram, rdram_.data(), rdram_.size());
+        rdram_ = std::span<uint8_t>(rdram, rdram_.size());
+        rdram_storage_ = {};
+        if (rdram_size_ < rdram_.size())
+        {
+            fastmem->Unmap(rdram_size_, rdram_.size() - rdram_size_);
+        }
+        fastmem_ = std::move(fastmem);
+        fastmem_base_ = fastmem_->Base();
+        if (rom_loaded_)
+        {
+            map_fastmem_cartridge();
+        }
+        map_direct_addresses();
+        return true;
+    }
+
+    void CPUBus::map_fastmem_cartridge()
+    {
+        // The image is mapped a second time instead of copied, so it stays paged in on demand.
+        // It is read only through the region so stores take the slow path, same goes for the
+        // ISViewer buffer which needs to be handled as MMIO
+        if (!cartridge_.MapReadOnly(fastmem_->Base() + 0x1000'0000))
+        {
+            Logger::Warn("Fastmem: Failed to map the cartridge, it will take the slow path");
+            fastmem_->Unmap(0x1000'0000, CART_ROM_SIZE);
+            return;
+        }
+        fastmem_->Unmap(ISVIEWER_AREA_START & ~0xFFFF, 0x10000);
+    }
 } // namespace hydra::N64
\ No newline at end of file
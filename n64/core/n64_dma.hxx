@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace hydra::N64
+{
+    // One side of a DMA, a memory whose size is a power of two that addresses wrap around in
+    struct DMARegion
+    {
+        uint8_t* data;
+        uint32_t address;
+        uint32_t mask;
+    };
+
+    /**
+        Copies length bytes from source to dest and advances both addresses
+
+        The bytes are moved with as few memcpy calls as there are places where either side wraps
+        around, usually one. Everything the RCP transfers between is kept big endian, so nothing
+        needs swapping on the way.
+    */
+    inline void DMACopy(DMARegion& dest, DMARegion& source, uint32_t length)
+    {
+        while (length != 0)
+        {
+            uint32_t dest_offset = dest.address & dest.mask;
+            uint32_t source_offset = source.address & source.mask;
+            uint32_t run =
+                std::min({length, dest.mask + 1 - dest_offset, source.mask + 1 - source_offset});
+            std::memcpy(dest.data + dest_offset, source.data + source_offset, run);
+            dest.address += run;
+            source.address += run;
+            length -= run;
+        }
+    }
+} // namespace hydra::N64
@@ -0,0 +1,144 @@
+#include <log.hxx>
+#include <n64/core/n64_fastmem.hxx>
+
+#if N64_FASTMEM_AVAILABLE
+#include <csignal>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t RegionSize = 0x1'0000'0000;
+    constexpr size_t HostPageSize = 0x1000;
+
+    // Only one region can own the fault handler at a time
+    hydra::N64::Fastmem* active_region = nullptr;
+    struct sigaction previous_action
+    {};
+} // namespace
+
+namespace hydra::N64
+{
+    Fastmem::~Fastmem()
+    {
+        if (active_region == this)
+        {
+            sigaction(SIGSEGV, &previous_action, nullptr);
+            active_region = nullptr;
+        }
+        for (auto& view : views_)
+        {
+            munmap(view.ptr, view.size);
+        }
+        if (base_)
+        {
+            munmap(base_, RegionSize);
+        }
+    }
+
+    bool Fastmem::Reserve()
+    {
+        void* base = mmap(nullptr, RegionSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                          -1, 0);
+        if (base == MAP_FAILED)
+        {
+            Logger::Warn("Fastmem: Failed to reserve the address space: {}", strerror(errno));
+            return false;
+        }
+        base_ = static_cast<uint8_t*>(base);
+        return true;
+    }
+
+    uint8_t* Fastmem::Map(uint32_t paddr, size_t size, bool writable)
+    {
+        size = (size + HostPageSize - 1) & ~(HostPageSize - 1);
+        int fd = memfd_create("hydra-n64", MFD_CLOEXEC);
+        if (fd == -1 || ftruncate(fd, size) == -1)
+        {
+            Logger::Fatal("Fastmem: Failed to create shared memory: {}", strerror(errno));
+        }
+        void* mirror = mmap(base_ + paddr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                            MAP_SHARED | MAP_FIXED, fd, 0);
+        void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        // The mappings keep the memory alive
+        close(fd);
+        if (mirror == MAP_FAILED || view == MAP_FAILED)
+        {
+            Logger::Fatal("Fastmem: Failed to map shared memory: {}", strerror(errno));
+        }
+        views_.push_back({static_cast<uint8_t*>(view), size});
+        return static_cast<uint8_t*>(view);
+    }
+
+    void Fastmem::Unmap(uint32_t paddr, size_t size)
+    {
+        mmap(base_ + paddr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE,
+             -1, 0);
+    }
+
+    void Fastmem::SetFaultHandler(FaultHandler handler, void* context)
+    {
+        handler_ = handler;
+        handler_context_ = context;
+        if (active_region == this)
+        {
+            return;
+        }
+        if (active_region)
+        {
+            Logger::Fatal("Fastmem: Only one region can handle faults");
+        }
+        active_region = this;
+        struct sigaction action
+        {};
+        action.sa_sigaction = reinterpret_cast<void (*)(int, siginfo_t*, void*)>(&signal_handler);
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_action);
+    }
+
+    void Fastmem::signal_handler(int sig, void* info, void* ucontext)
+    {
+        uintptr_t address = reinterpret_cast<uintptr_t>(static_cast<siginfo_t*>(info)->si_addr);
+        Fastmem* region = active_region;
+        if (region && region->handler_ && address >= reinterpret_cast<uintptr_t>(region->base_) &&
+            address < reinterpret_cast<uintptr_t>(region->base_) + RegionSize)
+        {
+            if (region->handler_(region->handler_context_, ucontext, address))
+            {
+                return;
+            }
+        }
+        // Not ours, let the previous handler or the default action deal with it
+        sigaction(SIGSEGV, &previous_action, nullptr);
+        (void)sig;
+    }
+} // namespace hydra::N64
+#else
+namespace hydra::N64
+{
+    Fastmem::~Fastmem() = default;
+
+    bool Fastmem::Reserve()
+    {
+        Logger::Warn("Fastmem is not supported on this platform");
+        return false;
+    }
+
+    uint8_t* Fastmem::Map(uint32_t, size_t, bool)
+    {
+        return nullptr;
+    }
+
+    void Fastmem::Unmap(uint32_t, size_t) {}
+
+    void Fastmem::SetFaultHandler(FaultHandler handler, void* context)
+    {
+        handler_ = handler;
+        handler_context_ = context;
+    }
+
+    void Fastmem::signal_handler(int, void*, void*) {}
+} // namespace hydra::N64
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Needs memfd_create and the Linux signal context layout to recover from faults
+#if defined(__linux__) && defined(__x86_64__)
+#define N64_FASTMEM_AVAILABLE 1
+#else
+#define N64_FASTMEM_AVAILABLE 0
+#endif
+
+namespace hydra::N64
+{
+    /**
+        4GB of reserved host address space laid out like the VR4300 physical address space
+
+        Memory is mapped in from shared memory objects, so the same pages can be reached both
+        through the region and through the pointer the rest of the emulator uses. Anything left
+        unmapped, like MMIO, faults, and the fault handler gets a chance to recover from it.
+    */
+    class Fastmem final
+    {
+    public:
+        // Returns true if the fault was handled and execution can resume
+        using FaultHandler = bool (*)(void* context, void* ucontext, uintptr_t host_address);
+
+        Fastmem() = default;
+        ~Fastmem();
+        Fastmem(const Fastmem&) = delete;
+        Fastmem& operator=(const Fastmem&) = delete;
+
+        bool Reserve();
+        // Creates `size` bytes of memory visible at `paddr` in the region, and returns the
+        // pointer everything else should use to access it
+        uint8_t* Map(uint32_t paddr, size_t size, bool writable);
+        // Punches a hole in a mapping, for MMIO that lives inside a memory range
+        void Unmap(uint32_t paddr, size_t size);
+        void SetFaultHandler(FaultHandler handler, void* context);
+
+        uint8_t* Base() const
+        {
+            return base_;
+        }
+
+    private:
+        struct View
+        {
+            uint8_t* ptr;
+            size_t size;
+        };
+
+        uint8_t* base_ = nullptr;
+        std::vector<View> views_;
+        FaultHandler handler_ = nullptr;
+        void* handler_context_ = nullptr;
+
+        static void signal_handler(int sig, void* info, void* ucontext);
+    };
+} // namespace hydra::N64
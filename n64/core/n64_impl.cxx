@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <n64/core/n64_impl.hxx>
@@ -25,41 +26,22 @@ namespace hydra::N64
 
     void N64::Update()
     {
-        static int cycles = 0;
-        for (int f = 0; f < 1; f++)
-        { // fields
-            for (int hl = 0; hl < cpu_.rcp_.vi_.num_halflines_; hl++)
-            { // halflines
-                cpu_.rcp_.vi_.vi_v_current_ = (hl << 1) + f;
-                cpu_.check_vi_interrupt();
-                while (cycles <= cpu_.rcp_.vi_.cycles_per_halfline_)
-                {
-                    static int cpu_cycles = 0;
-                    cpu_cycles++;
-                    cpu_.Tick();
-                    rcp_.ai_.Step();
-                    if (!cpu_.rcp_.rsp_.IsHalted())
-                    {
-                        while (cpu_cycles > 2)
-                        {
-                            cpu_.rcp_.rsp_.Tick();
-                            if (!cpu_.rcp_.rsp_.IsHalted())
-                            {
-                                cpu_.rcp_.rsp_.Tick();
-                            }
-                            cpu_cycles -= 3;
-                        }
-                    }
-                    else
-                    {
-                        cpu_cycles = 0;
-                    }
-                    cycles++;
-                }
-                cycles -= cpu_.rcp_.vi_.cycles_per_halfline_;
+        Scheduler& scheduler = cpubus_.scheduler_;
+        frame_done_ = false;
+        while (!frame_done_)
+        {
+            cpu_.Run();
+            EventType type;
+            while (!frame_done_ && scheduler.Pop(type))
+            {
+                handle_event(type);
             }
-            cpu_.check_vi_interrupt();
         }
+        // Between frames the frontend may change settings or look at the RSP, and the VI
+        // scans out what the RDP drew
+        rcp_.rsp_.Sync();
+        rcp_.rdp_.Sync();
+        rcp_.rdp_.TraceFrame();
         if (std::chrono::duration_cast<std::chrono::milliseconds>(
                 std::chrono::high_resolution_clock::now() - cpu_.last_second_time_)
                 .count() >= 1000)
@@ -74,8 +56,176 @@ namespace hydra::N64
 
     void N64::Reset()
     {
+        cpubus_.scheduler_.Reset();
         cpu_.Reset();
         rcp_.Reset();
+        halfline_ = 0;
+        cpubus_.scheduler_.Schedule(EventType::VIHalfline, 0);
+        cpubus_.scheduler_.Schedule(EventType::AISample, rcp_.ai_.Period());
+    }
+
+    void N64::handle_event(EventType type)
+    {
+        Scheduler& scheduler = cpubus_.scheduler_;
+        switch (type)
+        {
+            case EventType::VIHalfline:
+            {
+                Vi& vi = rcp_.vi_;
+                if (halfline_ >= vi.num_halflines_)
+                {
+                    // The frame ends here, the first halfline of the next one runs on the next
+                    // Update
+                    halfline_ = 0;
+                    cpu_.check_vi_interrupt();
+                    frame_done_ = true;
+                    scheduler.Schedule(EventType::VIHalfline, 0);
+                    break;
+                }
+                vi.vi_v_current_ = halfline_ << 1;
+                cpu_.check_vi_interrupt();
+                halfline_++;
+                scheduler.Schedule(EventType::VIHalfline, vi.cycles_per_halfline_);
+                break;
+            }
+            case EventType::AISample:
+            {
+                // The sample may be in RDRAM the RSP or RDP thread is writing
+                if (rcp_.ai_.IsPlaying())
+                {
+                    cpubus_.wait_for_rcp(rcp_.ai_.DMAAddress(), 4, false);
+                }
+                rcp_.ai_.Step();
+                scheduler.Schedule(EventType::AISample, rcp_.ai_.Period());
+                break;
+            }
+            case EventType::RSPSlice:
+            {
+                // Slices are only scheduled while the RSP runs, see CPU::write_hwio, so idle
+                // loops can skip ahead freely while it's halted
+                RSP& rsp = rcp_.rsp_;
+                if (rsp.IsThreaded())
+                {
+                    // Whether the slice in flight halted the RSP only shows after waiting for it
+                    rsp.Sync();
+                    if (!rsp.IsHalted())
+                    {
+                        rsp.RunAsync(RSP_THREAD_SLICE_CYCLES / 3 * 2);
+                        scheduler.Schedule(EventType::RSPSlice, RSP_THREAD_SLICE_CYCLES);
+                    }
+                    break;
+                }
+                rsp.Run(RSP_SLICE_CYCLES / 3 * 2);
+                if (!rsp.IsHalted())
+                {
+                    scheduler.Schedule(EventType::RSPSlice, RSP_SLICE_CYCLES);
+                }
+                break;
+            }
+            default:
+            {
+                cpu_.handle_event(type);
+                break;
+            }
+        }
+    }
+
+    void N64::SetCPUBackend(CPUBackend backend)
+    {
+        cpu_.SetBackend(backend);
+    }
+
+    void N64::SetRSPBackend(RSPBackend backend)
+    {
+        rcp_.rsp_.SetBackend(backend);
+    }
+
+    void N64::SetFastmem(bool enabled)
+    {
+        if (enabled && rcp_.rdp_.IsThreaded())
+        {
+            Logger::Warn("Fastmem can't be used together with the RDP thread");
+            return;
+        }
+        if (enabled && rcp_.rsp_.IsThreaded())
+        {
+            Logger::Warn("Fastmem can't be used together with the RSP thread");
+            return;
+        }
+        cpu_.SetFastmem(enabled);
+    }
+
+    void N64::SetExpansionPak(bool enabled)
+    {
+        cpubus_.SetExpansionPak(enabled);
+    }
+
+    void N64::SetIdleLoopDetection(bool enabled)
+    {
+        cpu_.SetIdleLoopDetection(enabled);
+    }
+
+    void N64::SetRSPHLE(bool enabled)
+    {
+        rcp_.rsp_.SetHLE(enabled);
+    }
+
+    void N64::SetRSPThread(bool enabled)
+    {
+        // Same as with the RDP thread, the RSP DMAs a slice has in flight would go unnoticed
+        if (enabled && cpubus_.fastmem_)
+        {
+            Logger::Warn("The RSP thread can't be used together with fastmem");
+            return;
+        }
+        rcp_.rsp_.SetThread(enabled);
+        cpubus_.rcp_threads_active_ = rcp_.rsp_.IsThreaded() || rcp_.rdp_.IsThreaded();
+    }
+
+    void N64::SetRDPThread(bool enabled)
+    {
+        // Recompiled loads and stores go straight to fastmem, so nothing would wait for the
+        // RDP to be done with the memory they access
+        if (enabled && cpubus_.fastmem_)
+        {
+            Logger::Warn("The RDP thread can't be used together with fastmem");
+            return;
+        }
+        rcp_.rsp_.Sync();
+        rcp_.rdp_.SetThread(enabled);
+        cpubus_.rcp_threads_active_ = rcp_.rsp_.IsThreaded() || rcp_.rdp_.IsThreaded();
+    }
+
+    void N64::SetRDPThreads(int count)
+    {
+        // The RSP thread may be in the middle of sending the RDP commands
+        rcp_.rsp_.Sync();
+        rcp_.rdp_.SetThreadCount(std::max(count, 0));
+    }
+
+    bool N64::StartRDPTrace(const std::string& path)
+    {
+        rcp_.rsp_.Sync();
+        return rcp_.rdp_.StartTrace(path);
+    }
+
+    bool N64::DumpProfile(const std::string& prefix)
+    {
+        if constexpr (!CPU_PROFILING && !RSP_PROFILING)
+        {
+            Logger::Warn("Profiling is compiled out, set CPU_PROFILING or RSP_PROFILING");
+            return false;
+        }
+        bool ok = true;
+        if constexpr (CPU_PROFILING)
+        {
+            ok &= cpu_.GetProfiler().Dump(prefix + "-cpu");
+        }
+        if constexpr (RSP_PROFILING)
+        {
+            ok &= rcp_.rsp_.GetProfiler().Dump(prefix + "-rsp");
+        }
+        return ok;
     }
 
     void N64::SetMousePos(int32_t x, int32_t y)
@@ -17,6 +17,21 @@ namespace hydra::N64
         void Update();
         void Reset();
         void SetMousePos(int32_t x, int32_t y);
+        void SetCPUBackend(CPUBackend backend);
+        void SetRSPBackend(RSPBackend backend);
+        void SetFastmem(bool enabled);
+        void SetExpansionPak(bool enabled);
+        void SetIdleLoopDetection(bool enabled);
+        void SetRSPHLE(bool enabled);
+        void SetRSPThread(bool enabled);
+        // Runs RDP commands on a thread of their own, can't be combined with fastmem
+        void SetRDPThread(bool enabled);
+        // Threads the RDP renders large primitives on, 0 uses one per hardware thread
+        void SetRDPThreads(int count);
+        // Writes the RDP commands of every frame from now on to a trace, see RDPTraceWriter
+        bool StartRDPTrace(const std::string& path);
+        // Writes the CPU and RSP profiles next to prefix, see CPU_PROFILING in log.hxx
+        bool DumpProfile(const std::string& prefix);
 
         void* GetColorData()
         {
@@ -33,6 +48,11 @@ namespace hydra::N64
             return rcp_.vi_.height_;
         }
 
+        TLBCacheStats GetTLBCacheStats() const
+        {
+            return cpu_.GetTLBCacheStats();
+        }
+
         void SetKeyState(uint32_t key, bool state)
         {
             cpu_.key_state_[key] = state;
@@ -42,8 +62,13 @@ namespace hydra::N64
         RCP rcp_;
         CPUBus cpubus_;
         CPU cpu_;
+        int halfline_ = 0;
+        bool frame_done_ = false;
+
+        void handle_event(EventType type);
         friend class N64_TKPWrapper;
         friend class ::N64Debugger;
         friend class ::MmioViewer;
+        friend class QA;
     };
 } // namespace hydra::N64
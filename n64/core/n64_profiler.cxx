@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <fmt/format.h>
+#include <fstream>
+#include <log.hxx>
+#include <n64/core/n64_profiler.hxx>
+#include <n64/core/n64_types.hxx>
+
+namespace
+{
+    constexpr size_t RecompiledClass = 128;
+
+    size_t opcode_class(uint32_t instruction)
+    {
+        if (instruction == hydra::N64::EMPTY_INSTRUCTION)
+        {
+            return RecompiledClass;
+        }
+        uint32_t op = instruction >> 26;
+        return op == 0 ? 64 + (instruction & 0x3F) : op;
+    }
+
+    std::string opcode_class_name(size_t index)
+    {
+        if (index == RecompiledClass)
+        {
+            return "(recompiled)";
+        }
+        return index < 64 ? hydra::N64::OperationCodes[index]
+                          : hydra::N64::SpecialCodes[index - 64];
+    }
+
+    // Guest addresses are sign extended, the low word is what people know them by
+    std::string frame_name(uint64_t address)
+    {
+        return fmt::format("{:08x}", static_cast<uint32_t>(address));
+    }
+} // namespace
+
+namespace hydra::N64
+{
+    Profiler::Profiler(const char* name, uint32_t interval)
+        : name_(name), interval_(interval), countdown_(interval)
+    {
+    }
+
+    void Profiler::Call(uint64_t target, uint64_t return_address)
+    {
+        if (stack_.size() == MaxDepth)
+        {
+            // Runaway recursion or a stack that never unwinds, keep the innermost frames
+            stack_.erase(stack_.begin());
+        }
+        stack_.push_back({target, return_address});
+    }
+
+    void Profiler::Return(uint64_t target)
+    {
+        // jr is also used for jump tables and exceptions skip returns entirely, so only
+        // unwind when the target matches a frame
+        for (size_t i = stack_.size(); i-- > 0;)
+        {
+            if (stack_[i].return_address == target)
+            {
+                stack_.resize(i);
+                return;
+            }
+        }
+    }
+
+    void Profiler::Reset()
+    {
+        countdown_ = interval_;
+        samples_ = 0;
+        pcs_.clear();
+        classes_.fill(0);
+        stack_.clear();
+        stacks_.clear();
+    }
+
+    void Profiler::sample(uint64_t pc, uint32_t instruction, uint32_t hits)
+    {
+        samples_ += hits;
+        pcs_[pc] += hits;
+        classes_[opcode_class(instruction)] += hits;
+        std::vector<uint64_t> frames;
+        frames.reserve(stack_.size() + 1);
+        for (const Frame& frame : stack_)
+        {
+            frames.push_back(frame.function);
+        }
+        // The sampled pc is the leaf, so time in a function body isn't all charged to its entry
+        frames.push_back(pc);
+        stacks_[frames] += hits;
+    }
+
+    bool Profiler::Dump(const std::string& prefix) const
+    {
+        std::ofstream flat(prefix + ".txt", std::ios::out | std::ios::trunc);
+        std::ofstream folded(prefix + ".folded", std::ios::out | std::ios::trunc);
+        if (!flat.is_open() || !folded.is_open())
+        {
+            Logger::Warn("Profiler: Could not write to {}", prefix);
+            return false;
+        }
+
+        std::vector<std::pair<uint64_t, uint64_t>> pcs(pcs_.begin(), pcs_.end());
+        std::sort(pcs.begin(), pcs.end(),
+                  [](const auto& a, const auto& b) { return a.second > b.second; });
+        std::vector<std::pair<size_t, uint64_t>> classes;
+        for (size_t i = 0; i < classes_.size(); i++)
+        {
+            if (classes_[i] != 0)
+            {
+                classes.push_back({i, classes_[i]});
+            }
+        }
+        std::sort(classes.begin(), classes.end(),
+                  [](const auto& a, const auto& b) { return a.second > b.second; });
+
+        double total = samples_ ? static_cast<double>(samples_) : 1.0;
+        flat << fmt::format("{}: {} samples, one every {} instructions\n\n", name_, samples_,
+                            interval_);
+        flat << fmt::format("{:>12} {:>7}  {}\n", "samples", "%", "pc");
+        for (const auto& [pc, count] : pcs)
+        {
+            flat << fmt::format("{:>12} {:>6.2f}%  {}\n", count, count * 100.0 / total,
+                                frame_name(pc));
+        }
+        flat << fmt::format("\n{:>12} {:>7}  {}\n", "samples", "%", "opcode");
+        for (const auto& [index, count] : classes)
+        {
+            flat << fmt::format("{:>12} {:>6.2f}%  {}\n", count, count * 100.0 / total,
+                                opcode_class_name(index));
+        }
+
+        // One line per distinct stack, outermost frame first and the sampled pc last
+        for (const auto& [frames, count] : stacks_)
+        {
+            folded << name_;
+            for (uint64_t function : frames)
+            {
+                folded << ';' << frame_name(function);
+            }
+            folded << ' ' << count << '\n';
+        }
+        Logger::Info("Profiler: Wrote {} samples to {}.txt and {}.folded", samples_, prefix,
+                     prefix);
+        return flat.good() && folded.good();
+    }
+} // namespace hydra::N64
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hydra::N64
+{
+    /**
+        Sampling profiler for the guest processors
+
+        Every interval instructions the current pc and its opcode class are recorded, along with
+        a shadow call stack built from jal/jalr and jr. Dump writes a flat histogram and a
+        collapsed stack file, ending each stack with the sampled pc, that flamegraph.pl,
+        speedscope and the like can read.
+
+        The hooks are only compiled in when CPU_PROFILING/RSP_PROFILING are set in log.hxx
+    */
+    class Profiler final
+    {
+    public:
+        explicit Profiler(const char* name, uint32_t interval = 997);
+
+        // Counts weight instructions that ran at pc, sampling whenever the interval runs out.
+        // EMPTY_INSTRUCTION stands for a recompiled block whose instructions aren't known
+        void Tick(uint64_t pc, uint32_t instruction, uint32_t weight = 1)
+        {
+            if (countdown_ > weight) [[likely]]
+            {
+                countdown_ -= weight;
+                return;
+            }
+            uint32_t hits = 1 + (weight - countdown_) / interval_;
+            countdown_ = interval_ - (weight - countdown_) % interval_;
+            sample(pc, instruction, hits);
+        }
+
+        void Call(uint64_t target, uint64_t return_address);
+        void Return(uint64_t target);
+        void Reset();
+        // Writes <prefix>.txt and <prefix>.folded
+        bool Dump(const std::string& prefix) const;
+
+        uint64_t Samples() const
+        {
+            return samples_;
+        }
+
+    private:
+        struct Frame
+        {
+            uint64_t function;
+            uint64_t return_address;
+        };
+
+        static constexpr size_t MaxDepth = 128;
+
+        const char* name_;
+        uint32_t interval_;
+        uint32_t countdown_;
+        uint64_t samples_ = 0;
+        std::unordered_map<uint64_t, uint64_t> pcs_;
+        // Primary opcodes, then the SPECIAL functions, then recompiled blocks
+        std::array<uint64_t, 129> classes_{};
+        std::vector<Frame> stack_;
+        std::map<std::vector<uint64_t>, uint64_t> stacks_;
+
+        void sample(uint64_t pc, uint32_t instruction, uint32_t hits);
+    };
+} // namespace hydra::N64
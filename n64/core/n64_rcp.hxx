@@ -39,5 +39,6 @@ namespace hydra::N64
         friend class hydra::N64::CPU;
         friend class ::N64Debugger;
         friend class ::MmioViewer;
+        friend class QA;
     };
 } // namespace hydra::N64
@@ -10,11 +10,18 @@
 #include <n64/core/n64_addresses.hxx>
 #include <n64/core/n64_rdp.hxx>
 #include <n64/core/n64_rdp_commands.hxx>
+#include <n64/core/n64_rdp_span.hxx>
 #include <sstream>
 #include <str_hash.hxx>
+#include <utility>
 
-// For debugging purposes
+// For debugging purposes, checks every primitive against angrylion's edgewalker. Enabled with
+// the N64_RDP_SLOW_ASSERTIONS CMake option, which is on by default only in debug builds
+#ifdef N64_RDP_SLOW_ASSERTIONS
 constexpr bool slow_assertions = true;
+#else
+constexpr bool slow_assertions = false;
+#endif
 
 hydra_inline static uint32_t irand(uint32_t* state)
 {
@@ -22,6 +29,24 @@ hydra_inline static uint32_t irand(uint32_t* state)
     return ((*state >> 16) & 0x7fff);
 }
 
+// The state irand leaves behind after count calls, found by repeatedly squaring the step
+static uint32_t irand_skip(uint32_t state, uint32_t count)
+{
+    uint32_t multiplier = 0x343fd;
+    uint32_t increment = 0x269ec3;
+    while (count != 0)
+    {
+        if (count & 1)
+        {
+            state = state * multiplier + increment;
+        }
+        increment *= multiplier + 1;
+        multiplier *= multiplier;
+        count >>= 1;
+    }
+    return state;
+}
+
 hydra_inline static uint32_t rgba16_to_rgba32(uint16_t color)
 {
     uint8_t r16 = (color >> 11) & 0x1F;
@@ -43,23 +68,35 @@ hydra_inline static uint16_t rgba32_to_rgba16(uint32_t color)
     return (r << 11) | (g << 6) | (b << 1) | a;
 }
 
-static std::pair<int32_t, int32_t> perspective_correction(int32_t s, int32_t t, int32_t w)
+namespace hydra::N64
 {
-    if ((w >> 15) == 0)
+    // Smaller primitives aren't worth waking the workers up for
+    constexpr uint32_t RDP_PARALLEL_MIN_PIXELS = 2048;
+    // Command words process_commands byte swaps at once
+    constexpr uint32_t RDP_COMMAND_BATCH = 256;
+
+    constexpr TexelMode get_texel_mode(Format format, uint8_t size)
     {
-        Logger::WarnOnce("Division by zero in perspective correction");
-        return {0, 0};
+        switch (format)
+        {
+            case Format::RGBA:
+                return size == 16   ? TexelMode::RGBA16
+                       : size == 32 ? TexelMode::RGBA32
+                                    : TexelMode::Unsupported;
+            case Format::IA:
+                return size == 4    ? TexelMode::IA4
+                       : size == 8  ? TexelMode::IA8
+                       : size == 16 ? TexelMode::IA16
+                                    : TexelMode::Unsupported;
+            case Format::I:
+                return size == 4   ? TexelMode::I4
+                       : size == 8 ? TexelMode::I8
+                                   : TexelMode::Unsupported;
+            default:
+                return TexelMode::Unsupported;
+        }
     }
-    return {(s / (w >> 15)) >> 5, (t / (w >> 15)) >> 5};
-}
 
-static std::pair<int32_t, int32_t> no_perspective_correction(int32_t s, int32_t t, int32_t w)
-{
-    return {(int16_t)s >> 16, (int16_t)t >> 16};
-}
-
-namespace hydra::N64
-{
     constexpr inline std::string_view get_rdp_command_name(RDPCommandType type)
     {
         switch (type)
@@ -90,14 +127,49 @@ namespace hydra::N64
         }
     }
 
+    std::pair<uint32_t, uint32_t> get_texture_load_range(RDPCommandType type, uint64_t command,
+                                                         uint32_t address, uint32_t width,
+                                                         uint32_t bits)
+    {
+        switch (type)
+        {
+            case RDPCommandType::LoadTile:
+            {
+                LoadTileCommand load;
+                load.full = command;
+                uint32_t row = (width * bits + 7) / 8;
+                return {address + (load.TL >> 2) * row, address + ((load.TH >> 2) + 1) * row};
+            }
+            case RDPCommandType::LoadTLUT:
+            {
+                // One 16-bit entry for every texel from SL to SH, whatever the image size
+                LoadTileCommand load;
+                load.full = command;
+                return {address + (load.SL >> 2) * 2, address + ((load.SH >> 2) + 1) * 2};
+            }
+            case RDPCommandType::LoadBlock:
+            {
+                LoadBlockCommand load;
+                load.full = command;
+                uint32_t bytes = ((load.SH + 1) * bits + 7) / 8;
+                return {address, address + bytes + 8};
+            }
+            default:
+                return {address, address};
+        }
+    }
+
     RDP::RDP()
     {
-        rdram_9th_bit_.resize(0x800000);
+        rdram_9th_bit_.resize(RDRAM_EXPANSION_SIZE);
         init_depth_luts();
+        pixel_[CombinerInput::One] = 0xFFFF'FFFF;
+        texel_cache_dirty_.fill({0, static_cast<uint32_t>(tmem_.size())});
     }
 
     void RDP::InstallBuses(uint8_t* rdram_ptr, uint8_t* spmem_ptr)
     {
+        Sync();
         rdram_ptr_ = rdram_ptr;
         spmem_ptr_ = spmem_ptr;
     }
@@ -186,72 +258,260 @@ namespace hydra::N64
 
     void RDP::Reset()
     {
-        seed_ = 3;
+        Sync();
+        pixel_.seed = 3;
         status_.ready = 1;
-        color_sub_a_[0] = color_sub_a_[1] = &color_one_;
-        color_sub_b_[0] = color_sub_b_[1] = &color_zero_;
-        color_multiplier_[0] = color_multiplier_[1] = &color_one_;
-        color_adder_[0] = color_adder_[1] = &color_zero_;
-        alpha_sub_a_[0] = alpha_sub_a_[1] = &color_zero_;
-        alpha_sub_b_[0] = alpha_sub_b_[1] = &color_zero_;
-        alpha_multiplier_[0] = alpha_multiplier_[1] = &color_one_;
-        alpha_adder_[0] = alpha_adder_[1] = &color_zero_;
+        color_sub_a_[0] = color_sub_a_[1] = CombinerInput::One;
+        color_sub_b_[0] = color_sub_b_[1] = CombinerInput::Zero;
+        color_multiplier_[0] = color_multiplier_[1] = CombinerInput::One;
+        color_adder_[0] = color_adder_[1] = CombinerInput::Zero;
+        alpha_sub_a_[0] = alpha_sub_a_[1] = CombinerInput::Zero;
+        alpha_sub_b_[0] = alpha_sub_b_[1] = CombinerInput::Zero;
+        alpha_multiplier_[0] = alpha_multiplier_[1] = CombinerInput::One;
+        alpha_adder_[0] = alpha_adder_[1] = CombinerInput::Zero;
         blender_1a_[0] = blender_1a_[1] = 0;
         blender_1b_[0] = blender_1b_[1] = 0;
         blender_2a_[0] = blender_2a_[1] = 0;
         blender_2b_[0] = blender_2b_[1] = 0;
-        texel_color_[0] = texel_color_[1] = 0xFFFFFFFF;
-        texel_alpha_[0] = texel_alpha_[1] = 0xFFFFFFFF;
+        pixel_[CombinerInput::Texel0] = pixel_[CombinerInput::Texel1] = 0xFFFFFFFF;
+        pixel_[CombinerInput::Texel0Alpha] = pixel_[CombinerInput::Texel1Alpha] = 0xFFFFFFFF;
         cycle_type_ = CycleType::Cycle1;
-        perspective_correction_func_ = &no_perspective_correction;
+        persp_tex_en_ = false;
+        update_pipeline();
+    }
+
+    void RDP::SetThreadCount(uint32_t count)
+    {
+        Sync();
+        workers_.reset();
+        if (count != 1)
+        {
+            workers_ = std::make_unique<RDPWorkers>(count);
+            if (workers_->Count() == 1)
+            {
+                workers_.reset();
+            }
+        }
+        bands_.resize(workers_ ? workers_->Count() : 0);
+    }
+
+    void RDP::SetThread(bool enabled)
+    {
+        Sync();
+        if (enabled && !thread_)
+        {
+            thread_ = std::make_unique<RDPThread>(*this);
+        }
+        else if (!enabled)
+        {
+            thread_.reset();
+        }
+    }
+
+    void RDP::Sync()
+    {
+        if (!thread_)
+        {
+            return;
+        }
+        thread_->Sync();
+        if (dirty_map_)
+        {
+            dirty_map_->Merge(thread_->DirtyMap());
+        }
+    }
+
+    void RDP::SendCommand(std::span<const uint64_t> command)
+    {
+        submit(command);
+        if (thread_)
+        {
+            thread_->Publish();
+        }
+    }
+
+    bool RDP::StartTrace(const std::string& path)
+    {
+        Sync();
+        trace_ = std::make_unique<RDPTraceWriter>(rdram_ptr_);
+        if (!trace_->Open(path))
+        {
+            trace_.reset();
+            return false;
+        }
+        Logger::Info("Writing RDP trace to {}", path);
+        return true;
+    }
+
+    void RDP::StopTrace()
+    {
+        Sync();
+        trace_.reset();
     }
 
-    void RDP::SendCommand(const std::vector<uint64_t>& data)
+    void RDP::TraceFrame()
     {
-        execute_command(data);
+        if (trace_)
+        {
+            Sync();
+            trace_->Frame();
+        }
+    }
+
+    void RDP::submit(std::span<const uint64_t> command)
+    {
+        if (!thread_)
+        {
+            execute_command(command);
+            return;
+        }
+
+        auto type = static_cast<RDPCommandType>((command[0] >> 56) & 0b111111);
+        if (type == RDPCommandType::SyncFull)
+        {
+            // The interrupt tells the game that everything before it was drawn
+            Sync();
+            execute_command(command.first(1));
+            return;
+        }
+        thread_->Push(command.data(), command.size());
+    }
+
+    // Byte swaps big endian command words out of RDRAM or DMEM
+    static void read_command_words(const uint8_t* src, uint64_t* dst, uint32_t count)
+    {
+        uint32_t i = 0;
+#if HYDRA_SIMD_AVAILABLE
+        const __m128i swap = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+        for (; i + 2 <= count; i += 2)
+        {
+            __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(words, swap));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            uint64_t word;
+            std::memcpy(&word, src + i * 8, sizeof(word));
+            dst[i] = hydra::bswap64(word);
+        }
     }
 
     void RDP::process_commands()
     {
         uint32_t current = current_address_ & 0xFFFFF8;
         uint32_t end = end_address_ & 0xFFFFF8;
+        const uint8_t* memory = status_.dma_source_dmem ? spmem_ptr_ : rdram_ptr_;
 
+        // Commands are executed straight out of a batch of words swapped in one go, one that
+        // doesn't fit in what's left of the batch starts the next one
+        std::array<uint64_t, RDP_COMMAND_BATCH> words;
         status_.freeze = 1;
         while (current < end)
         {
-            uintptr_t address = status_.dma_source_dmem ? reinterpret_cast<uintptr_t>(spmem_ptr_)
-                                                        : reinterpret_cast<uintptr_t>(rdram_ptr_);
-            uint64_t data = hydra::bswap64(*reinterpret_cast<uint64_t*>(address + current));
-            uint8_t command_type = (data >> 56) & 0b111111;
-
-            if (command_type >= 8)
+            uint32_t count = std::min((end - current) / 8, RDP_COMMAND_BATCH);
+            read_command_words(memory + current, words.data(), count);
+            uint32_t i = 0;
+            while (i < count)
             {
-                int length = get_rdp_command_length(static_cast<RDPCommandType>(command_type));
-                std::vector<uint64_t> command;
-                command.resize(length);
-                for (int i = 0; i < length; i++)
+                uint8_t command_type = (words[i] >> 56) & 0b111111;
+                if (command_type < 8)
                 {
-                    command[i] =
-                        hydra::bswap64(*reinterpret_cast<uint64_t*>(address + current + (i * 8)));
+                    i++;
+                    continue;
                 }
-                execute_command(command);
+
+                uint32_t length =
+                    get_rdp_command_length(static_cast<RDPCommandType>(command_type));
+                if (i + length > count)
+                {
+                    if (i != 0)
+                    {
+                        break;
+                    }
+                    // The last command runs past DP_END, the RDP reads the rest of it anyway
+                    read_command_words(memory + current, words.data(), length);
+                }
+                submit(std::span<const uint64_t>(words.data() + i, length));
                 // Logger::Info("RDP: Command {} ({:02x})",
                 // get_rdp_command_name(static_cast<RDPCommandType>(command_type)),
                 // static_cast<int>(command_type));
-                current += length * 8;
-            }
-            else
-            {
-                current += 8;
+                i += length;
             }
+            current += i * 8;
         }
 
+        if (thread_)
+        {
+            thread_->Publish();
+        }
         current_address_ = end_address_;
         status_.freeze = 0;
     }
 
-    void RDP::execute_command(const std::vector<uint64_t>& data)
+    // Same ranges as RDPThread::track, out of the state the command is executed with
+    void RDP::trace_command(std::span<const uint64_t> data)
+    {
+        RDPCommandType id = static_cast<RDPCommandType>((data[0] >> 56) & 0b111111);
+        uint32_t color_end = 0, depth_end = 0;
+        switch (id)
+        {
+            case RDPCommandType::Triangle:
+            case RDPCommandType::TriangleDepth:
+            case RDPCommandType::TriangleTexture:
+            case RDPCommandType::TriangleTextureDepth:
+            case RDPCommandType::TriangleShade:
+            case RDPCommandType::TriangleShadeDepth:
+            case RDPCommandType::TriangleShadeTexture:
+            case RDPCommandType::TriangleShadeTextureDepth:
+            case RDPCommandType::Rectangle:
+            case RDPCommandType::TextureRectangle:
+            case RDPCommandType::TextureRectangleFlip:
+            {
+                uint32_t pixels = ((scissor_yl_ >> 2) + 1) * framebuffer_width_ +
+                                  (scissor_xl_ >> 2) + 1;
+                color_end = framebuffer_dram_address_ +
+                            (pixels * framebuffer_pixel_size_ + 7) / 8 + 4;
+                trace_->Read(framebuffer_dram_address_, color_end);
+                if (z_compare_en_ || z_update_en_)
+                {
+                    depth_end = zbuffer_dram_address_ + pixels * 2;
+                    trace_->Read(zbuffer_dram_address_, depth_end);
+                }
+                break;
+            }
+            case RDPCommandType::LoadTile:
+            case RDPCommandType::LoadTLUT:
+            case RDPCommandType::LoadBlock:
+            {
+                auto [start, end] = get_texture_load_range(
+                    id, data[0], texture_dram_address_latch_, texture_width_latch_,
+                    texture_pixel_size_latch_);
+                trace_->Read(start, end);
+                break;
+            }
+            default:
+                break;
+        }
+
+        trace_->Command(data);
+        if (color_end != 0)
+        {
+            trace_->Written(framebuffer_dram_address_, color_end);
+        }
+        if (depth_end != 0 && z_update_en_)
+        {
+            trace_->Written(zbuffer_dram_address_, depth_end);
+        }
+    }
+
+    void RDP::execute_command(std::span<const uint64_t> data)
     {
+        if (trace_) [[unlikely]]
+        {
+            trace_command(data);
+        }
+
         RDPCommandType id = static_cast<RDPCommandType>((data[0] >> 56) & 0b111111);
         // Logger::Info("RDP: {}", get_rdp_command_name(id));
         switch (id)
@@ -274,6 +534,7 @@ namespace hydra::N64
                 framebuffer_format_ = color_format.format;
                 // 0 = 4bpp, 1 = 8bpp, 2 = 16bpp, 3 = 32bpp
                 framebuffer_pixel_size_ = 4 * (1 << color_format.size);
+                update_pipeline();
                 break;
             }
             case RDPCommandType::Triangle:
@@ -371,6 +632,10 @@ namespace hydra::N64
                     {
                         sh *= sizeof(uint16_t);
                         sl *= sizeof(uint16_t);
+                        if (sl < sh)
+                        {
+                            tmem_written(tile.tmem_address + sl, tile.tmem_address + sh + 8);
+                        }
                         for (int i = sl; i < sh; i += 8)
                         {
                             uint64_t src = *reinterpret_cast<uint64_t*>(
@@ -419,6 +684,7 @@ namespace hydra::N64
                 tile.tmem_address = command.TMemAddress;
                 tile.format = static_cast<Format>(command.format);
                 tile.size = 4 * (1 << command.size);
+                tile.texel_mode = get_texel_mode(tile.format, tile.size);
                 tile.line_width = command.Line * 8; // in 64bit / 8 byte words
                 // This number is used as the MS 4b of an 8b index.
                 tile.palette_index = command.Palette << 4;
@@ -480,14 +746,8 @@ namespace hydra::N64
 
                 image_read_en_ = command.image_read_en;
                 alpha_compare_en_ = command.alpha_compare_en;
-                if (command.persp_tex_en)
-                {
-                    perspective_correction_func_ = &perspective_correction;
-                }
-                else
-                {
-                    perspective_correction_func_ = &no_perspective_correction;
-                }
+                persp_tex_en_ = command.persp_tex_en;
+                update_pipeline();
                 break;
             }
             case RDPCommandType::SetPrimDepth:
@@ -503,11 +763,12 @@ namespace hydra::N64
             }
             case RDPCommandType::SetEnvironmentColor:
             {
-                environment_color_ = data[0] & 0xFFFFFFFF;
-                environment_color_ = hydra::bswap32(environment_color_);
+                uint32_t color = hydra::bswap32(data[0] & 0xFFFFFFFF);
+                pixel_[CombinerInput::Environment] = color;
 
-                uint8_t alpha = environment_color_ >> 24;
-                environment_alpha_ = (alpha << 24) | (alpha << 16) | (alpha << 8) | alpha;
+                uint8_t alpha = color >> 24;
+                pixel_[CombinerInput::EnvironmentAlpha] =
+                    (alpha << 24) | (alpha << 16) | (alpha << 8) | alpha;
                 break;
             }
             case RDPCommandType::SetBlendColor:
@@ -518,11 +779,12 @@ namespace hydra::N64
             }
             case RDPCommandType::SetPrimitiveColor:
             {
-                primitive_color_ = data[0] & 0xFFFFFFFF;
-                primitive_color_ = hydra::bswap32(primitive_color_);
+                uint32_t color = hydra::bswap32(data[0] & 0xFFFFFFFF);
+                pixel_[CombinerInput::Primitive] = color;
 
-                uint8_t alpha = primitive_color_ >> 24;
-                primitive_alpha_ = (alpha << 24) | (alpha << 16) | (alpha << 8) | alpha;
+                uint8_t alpha = color >> 24;
+                pixel_[CombinerInput::PrimitiveAlpha] =
+                    (alpha << 24) | (alpha << 16) | (alpha << 8) | alpha;
                 break;
             }
             case RDPCommandType::SetScissor:
@@ -568,6 +830,7 @@ namespace hydra::N64
                 alpha_sub_b_[1] = alpha_get_sub_add(command.sub_B_Alpha_1);
                 alpha_multiplier_[1] = alpha_get_mul(command.mul_Alpha_1);
                 alpha_adder_[1] = alpha_get_sub_add(command.add_Alpha_1);
+                update_pipeline();
                 break;
             }
             case RDPCommandType::SetKeyR:
@@ -585,86 +848,86 @@ namespace hydra::N64
         }
     }
 
-    uint32_t* RDP::color_get_sub_a(uint8_t sub_a)
+    CombinerInput RDP::color_get_sub_a(uint8_t sub_a)
     {
         switch (sub_a & 0b1111)
         {
             case 0:
-                return &combined_color_;
+                return CombinerInput::Combined;
             case 1:
-                return &texel_color_[0];
+                return CombinerInput::Texel0;
             case 2:
-                return &texel_color_[1];
+                return CombinerInput::Texel1;
             case 3:
-                return &primitive_color_;
+                return CombinerInput::Primitive;
             case 4:
-                return &shade_color_;
+                return CombinerInput::Shade;
             case 5:
-                return &environment_color_;
+                return CombinerInput::Environment;
             case 6:
-                return &color_one_;
+                return CombinerInput::One;
             case 7:
-                return &noise_color_;
+                return CombinerInput::Noise;
             default:
-                return &color_zero_;
+                return CombinerInput::Zero;
         }
     }
 
-    uint32_t* RDP::color_get_sub_b(uint8_t sub_b)
+    CombinerInput RDP::color_get_sub_b(uint8_t sub_b)
     {
         switch (sub_b & 0b1111)
         {
             case 0:
-                return &combined_color_;
+                return CombinerInput::Combined;
             case 1:
-                return &texel_color_[0];
+                return CombinerInput::Texel0;
             case 2:
-                return &texel_color_[1];
+                return CombinerInput::Texel1;
             case 3:
-                return &primitive_color_;
+                return CombinerInput::Primitive;
             case 4:
-                return &shade_color_;
+                return CombinerInput::Shade;
             case 5:
-                return &environment_color_;
+                return CombinerInput::Environment;
             // TODO: Key center??
             case 6:
-                return &color_zero_;
+                return CombinerInput::Zero;
             // TODO: Convert K4??
             case 7:
-                return &color_zero_;
+                return CombinerInput::Zero;
             default:
-                return &color_zero_;
+                return CombinerInput::Zero;
         }
     }
 
-    uint32_t* RDP::color_get_mul(uint8_t mul)
+    CombinerInput RDP::color_get_mul(uint8_t mul)
     {
         switch (mul & 0b11111)
         {
             case 0:
-                return &combined_color_;
+                return CombinerInput::Combined;
             case 1:
-                return &texel_color_[0];
+                return CombinerInput::Texel0;
             case 2:
-                return &texel_color_[1];
+                return CombinerInput::Texel1;
             case 3:
-                return &primitive_color_;
+                return CombinerInput::Primitive;
             case 4:
-                return &shade_color_;
+                return CombinerInput::Shade;
             case 5:
-                return &environment_color_;
+                return CombinerInput::Environment;
             case 7:
-                return &combined_alpha_;
+                return CombinerInput::CombinedAlpha;
             case 8:
-                return &texel_alpha_[0];
+                return CombinerInput::Texel0Alpha;
             case 9:
-                return &texel_alpha_[1];
+                return CombinerInput::Texel1Alpha;
             case 10:
-                return &primitive_alpha_;
+                return CombinerInput::PrimitiveAlpha;
             case 11:
-                return &shade_alpha_;
+                return CombinerInput::ShadeAlpha;
             case 12:
-                return &environment_alpha_;
+                return CombinerInput::EnvironmentAlpha;
             // TODO: rest of the colors
             case 16:
             case 17:
@@ -682,166 +945,155 @@ namespace hydra::N64
             case 29:
             case 30:
             case 31:
-                return &color_zero_;
+                return CombinerInput::Zero;
             default:
                 Logger::WarnOnce("Unhandled mul: {}", mul);
-                return &color_zero_;
+                return CombinerInput::Zero;
         }
     }
 
-    uint32_t* RDP::color_get_add(uint8_t add)
+    CombinerInput RDP::color_get_add(uint8_t add)
     {
         switch (add & 0b111)
         {
             case 0:
-                return &combined_color_;
+                return CombinerInput::Combined;
             case 1:
-                return &texel_color_[0];
+                return CombinerInput::Texel0;
             case 2:
-                return &texel_color_[1];
+                return CombinerInput::Texel1;
             case 3:
-                return &primitive_color_;
+                return CombinerInput::Primitive;
             case 4:
-                return &shade_color_;
+                return CombinerInput::Shade;
             case 5:
-                return &environment_color_;
+                return CombinerInput::Environment;
             case 6:
-                return &color_one_;
+                return CombinerInput::One;
             case 7:
-                return &color_zero_;
+                return CombinerInput::Zero;
         }
         Logger::Fatal("Unreachable!");
-        return nullptr;
+        return CombinerInput::Zero;
     }
 
-    uint32_t* RDP::alpha_get_sub_add(uint8_t sub_a)
+    CombinerInput RDP::alpha_get_sub_add(uint8_t sub_a)
     {
         switch (sub_a & 0b111)
         {
             case 0:
-                return &combined_alpha_;
+                return CombinerInput::CombinedAlpha;
             case 1:
-                return &texel_alpha_[0];
+                return CombinerInput::Texel0Alpha;
             case 2:
-                return &texel_alpha_[1];
+                return CombinerInput::Texel1Alpha;
             case 3:
-                return &primitive_alpha_;
+                return CombinerInput::PrimitiveAlpha;
             case 4:
-                return &shade_alpha_;
+                return CombinerInput::ShadeAlpha;
             case 5:
-                return &environment_alpha_;
+                return CombinerInput::EnvironmentAlpha;
             case 6:
-                return &color_one_;
+                return CombinerInput::One;
             default:
-                return &color_zero_;
+                return CombinerInput::Zero;
         }
     }
 
-    uint32_t* RDP::alpha_get_mul(uint8_t mul)
+    CombinerInput RDP::alpha_get_mul(uint8_t mul)
     {
         switch (mul & 0b111)
         {
             case 0:
             {
                 Logger::WarnOnce("Unhandled alpha mul: LOD fraction", mul);
-                return &color_one_;
+                return CombinerInput::One;
             }
             case 1:
-                return &texel_alpha_[0];
+                return CombinerInput::Texel0Alpha;
             case 2:
-                return &texel_alpha_[1];
+                return CombinerInput::Texel1Alpha;
             case 3:
-                return &primitive_alpha_;
+                return CombinerInput::PrimitiveAlpha;
             case 4:
-                return &shade_alpha_;
+                return CombinerInput::ShadeAlpha;
             case 5:
-                return &environment_alpha_;
+                return CombinerInput::EnvironmentAlpha;
             case 6:
             {
                 Logger::WarnOnce("Unhandled alpha mul: Primitive LOD fraction", mul);
-                return &color_zero_;
+                return CombinerInput::Zero;
             }
             default:
-                return &color_zero_;
+                return CombinerInput::Zero;
         }
     }
 
-    void RDP::draw_pixel(int x, int y)
+    template <RDP::CycleType Cycle, bool Pixel32>
+    void RDP::draw_pixel(PixelState& state, int x, int y)
     {
-        uintptr_t address = reinterpret_cast<uintptr_t>(rdram_ptr_) + framebuffer_dram_address_ +
-                            (y * framebuffer_width_ + x) * (framebuffer_pixel_size_ >> 3);
-        switch (cycle_type_)
+        // The written range is marked dirty for the whole primitive by render_primitive
+        uint32_t offset = framebuffer_dram_address_ +
+                          (y * framebuffer_width_ + x) * (framebuffer_pixel_size_ >> 3);
+        uintptr_t address = reinterpret_cast<uintptr_t>(rdram_ptr_) + offset;
+        uint16_t* ptr16 = reinterpret_cast<uint16_t*>(address);
+        uint32_t* ptr32 = reinterpret_cast<uint32_t*>(address);
+        if constexpr (Cycle == CycleType::Cycle2)
         {
-            case CycleType::Cycle2:
+            // The first blender cycle isn't fed into the second one yet, so it's skipped
+            color_combiner(state, 0);
+            color_combiner(state, 1);
+            if constexpr (Pixel32)
             {
-                color_combiner(0);
-                color_combiner(1);
-                blender(0);
-                // TODO: remove code duplication
-                if (framebuffer_pixel_size_ == 16)
-                {
-                    uint16_t* ptr = reinterpret_cast<uint16_t*>(address);
-                    framebuffer_color_ = rgba16_to_rgba32(*ptr);
-                    *ptr = rgba32_to_rgba16(blender(1));
-                }
-                else
-                {
-                    uint32_t* ptr = reinterpret_cast<uint32_t*>(address);
-                    framebuffer_color_ = *ptr;
-                    *ptr = blender(1);
-                }
-                break;
+                state.framebuffer_color = *ptr32;
+                *ptr32 = blender(state, 1);
             }
-            case CycleType::Cycle1:
+            else
             {
-                // TODO: there's may be a way to check which cycle we should get the data from
-                color_combiner(1);
-                if (framebuffer_pixel_size_ == 16)
-                {
-                    uint16_t* ptr = reinterpret_cast<uint16_t*>(address);
-                    framebuffer_color_ = rgba16_to_rgba32(*ptr);
-                    *ptr = rgba32_to_rgba16(blender(0));
-                }
-                else
-                {
-                    uint32_t* ptr = reinterpret_cast<uint32_t*>(address);
-                    framebuffer_color_ = *ptr;
-                    *ptr = blender(0);
-                }
-                break;
+                state.framebuffer_color = rgba16_to_rgba32(*ptr16);
+                *ptr16 = rgba32_to_rgba16(blender(state, 1));
             }
-            case CycleType::Copy:
+        }
+        else if constexpr (Cycle == CycleType::Cycle1)
+        {
+            // TODO: there's may be a way to check which cycle we should get the data from
+            color_combiner(state, 1);
+            if constexpr (Pixel32)
             {
-                if (alpha_compare_en_ && texel_alpha_[0] == 0)
-                {
-                    break;
-                }
+                state.framebuffer_color = *ptr32;
+                *ptr32 = blender(state, 0);
+            }
+            else
+            {
+                state.framebuffer_color = rgba16_to_rgba32(*ptr16);
+                *ptr16 = rgba32_to_rgba16(blender(state, 0));
+            }
+        }
+        else if constexpr (Cycle == CycleType::Copy)
+        {
+            if (alpha_compare_en_ && state[CombinerInput::Texel0Alpha] == 0)
+            {
+                return;
+            }
 
-                if (framebuffer_pixel_size_ == 16)
-                {
-                    uint16_t* ptr = reinterpret_cast<uint16_t*>(address);
-                    *ptr = rgba32_to_rgba16(texel_color_[0]);
-                }
-                else
-                {
-                    uint32_t* ptr = reinterpret_cast<uint32_t*>(address);
-                    *ptr = texel_color_[0];
-                }
-                break;
+            if constexpr (Pixel32)
+            {
+                *ptr32 = state[CombinerInput::Texel0];
             }
-            case CycleType::Fill:
+            else
             {
-                if (framebuffer_pixel_size_ == 16)
-                {
-                    uint16_t* ptr = reinterpret_cast<uint16_t*>(address);
-                    *ptr = x & 1 ? fill_color_16_0_ : fill_color_16_1_;
-                }
-                else
-                {
-                    uint32_t* ptr = reinterpret_cast<uint32_t*>(address);
-                    *ptr = fill_color_32_;
-                }
-                break;
+                *ptr16 = rgba32_to_rgba16(state[CombinerInput::Texel0]);
+            }
+        }
+        else
+        {
+            if constexpr (Pixel32)
+            {
+                *ptr32 = fill_color_32_;
+            }
+            else
+            {
+                *ptr16 = x & 1 ? fill_color_16_0_ : fill_color_16_1_;
             }
         }
     }
@@ -852,67 +1104,80 @@ namespace hydra::N64
         return (a - b) * c / 0xFF + d;
     }
 
-    void RDP::color_combiner(int cycle)
+    void RDP::color_combiner(PixelState& state, int cycle)
     {
-        uint8_t r = combine(*color_sub_a_[cycle], *color_sub_b_[cycle], *color_multiplier_[cycle],
-                            *color_adder_[cycle]);
-        uint8_t g = combine(*color_sub_a_[cycle] >> 8, *color_sub_b_[cycle] >> 8,
-                            *color_multiplier_[cycle] >> 8, *color_adder_[cycle] >> 8);
-        uint8_t b = combine(*color_sub_a_[cycle] >> 16, *color_sub_b_[cycle] >> 16,
-                            *color_multiplier_[cycle] >> 16, *color_adder_[cycle] >> 16);
-        uint8_t a = combine(*alpha_sub_a_[cycle], *alpha_sub_b_[cycle], *alpha_multiplier_[cycle],
-                            *alpha_adder_[cycle]);
-        combined_color_ = (a << 24) | (b << 16) | (g << 8) | r;
-        combined_alpha_ = a << 24 | a << 16 | a << 8 | a;
+        uint32_t sub_a = state[color_sub_a_[cycle]];
+        uint32_t sub_b = state[color_sub_b_[cycle]];
+        uint32_t multiplier = state[color_multiplier_[cycle]];
+        uint32_t adder = state[color_adder_[cycle]];
+        uint8_t r = combine(sub_a, sub_b, multiplier, adder);
+        uint8_t g = combine(sub_a >> 8, sub_b >> 8, multiplier >> 8, adder >> 8);
+        uint8_t b = combine(sub_a >> 16, sub_b >> 16, multiplier >> 16, adder >> 16);
+        uint8_t a = combine(state[alpha_sub_a_[cycle]], state[alpha_sub_b_[cycle]],
+                            state[alpha_multiplier_[cycle]], state[alpha_adder_[cycle]]);
+        state[CombinerInput::Combined] = (a << 24) | (b << 16) | (g << 8) | r;
+        state[CombinerInput::CombinedAlpha] = a << 24 | a << 16 | a << 8 | a;
     }
 
-    uint32_t RDP::blender(int cycle)
+    // Whether a combiner cycle reads an input, either its color or its alpha
+    bool RDP::combiner_reads(int cycle, CombinerInput color, CombinerInput alpha)
     {
-        uint32_t color1, color2;
-        uint8_t multiplier1, multiplier2;
+        for (CombinerInput input : {color_sub_a_[cycle], color_sub_b_[cycle],
+                                    color_multiplier_[cycle], color_adder_[cycle],
+                                    alpha_sub_a_[cycle], alpha_sub_b_[cycle],
+                                    alpha_multiplier_[cycle], alpha_adder_[cycle]})
+        {
+            if (input == color || input == alpha)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
 
-        switch (blender_1a_[cycle] & 0b11)
+    uint32_t RDP::blender_color(const PixelState& state, uint8_t select)
+    {
+        switch (select & 0b11)
         {
             case 0:
-                color1 = combined_color_;
-                break;
+                return state[CombinerInput::Combined];
             case 1:
-                color1 = framebuffer_color_;
-                break;
+                return state.framebuffer_color;
             case 2:
-                color1 = blend_color_;
-                break;
-            case 3:
-                color1 = fog_color_;
-                break;
+                return blend_color_;
+            default:
+                return fog_color_;
         }
+    }
 
-        switch (blender_2a_[cycle] & 0b11)
+    uint32_t RDP::blender(const PixelState& state, int cycle)
+    {
+        // Dividing by the sum of the multipliers gives back one of the colors as is when the
+        // other one's multiplier is zero
+        switch (blender_result_[cycle])
         {
-            case 0:
-                color2 = combined_color_;
-                break;
-            case 1:
-                color2 = framebuffer_color_;
-                break;
-            case 2:
-                color2 = blend_color_;
-                break;
-            case 3:
-                color2 = fog_color_;
+            case BlenderResult::First:
+                return blender_color(state, blender_1a_[cycle]) | 0xFF00'0000;
+            case BlenderResult::Second:
+                return blender_color(state, blender_2a_[cycle]) | 0xFF00'0000;
+            case BlenderResult::Blend:
                 break;
         }
 
+        uint32_t color1 = blender_color(state, blender_1a_[cycle]);
+        uint32_t color2 = blender_color(state, blender_2a_[cycle]);
+        uint8_t multiplier1, multiplier2;
+
         switch (blender_1b_[cycle] & 0b11)
         {
             case 0:
-                multiplier1 = combined_alpha_;
+                multiplier1 = state[CombinerInput::CombinedAlpha];
                 break;
             case 1:
                 multiplier1 = fog_alpha_;
                 break;
             case 2:
-                multiplier1 = shade_alpha_;
+                multiplier1 = state[CombinerInput::ShadeAlpha];
                 break;
             case 3:
                 multiplier1 = 0x00;
@@ -1022,8 +1287,8 @@ namespace hydra::N64
     void RDP::z_set(int x, int y, uint32_t z)
     {
         z &= 0x3FFFF;
-        uintptr_t address = reinterpret_cast<uintptr_t>(rdram_ptr_) + zbuffer_dram_address_ +
-                            (y * framebuffer_width_ + x) * 2;
+        uint32_t offset = zbuffer_dram_address_ + (y * framebuffer_width_ + x) * 2;
+        uintptr_t address = reinterpret_cast<uintptr_t>(rdram_ptr_) + offset;
         uint16_t* ptr = reinterpret_cast<uint16_t*>(address);
         uint16_t compressed = z_compress_lut_[z & 0x3FFFF];
         *ptr = compressed;
@@ -1056,9 +1321,164 @@ namespace hydra::N64
         return bits & 0x3FFFF;
     }
 
-    void RDP::fetch_texels(int texel, int tile, int32_t s, int32_t t)
+    void warn_unsupported_texels(const TileDescriptor& td)
+    {
+        switch (td.format)
+        {
+            case Format::RGBA:
+                Logger::WarnOnce("Unimplemented texture size for RGBA: {}",
+                                 static_cast<int>(td.size));
+                break;
+            case Format::IA:
+                Logger::WarnOnce("Unimplemented texture size for IA: {}",
+                                 static_cast<int>(td.size));
+                break;
+            case Format::I:
+                Logger::WarnOnce("Unimplemented texture size for I: {}",
+                                 static_cast<int>(td.size));
+                break;
+            default:
+                Logger::WarnOnce("Unimplemented texture format: {}", static_cast<int>(td.format));
+                break;
+        }
+    }
+
+    // Texels are indexed by the byte they start at, 4-bit ones by nibble
+    constexpr uint32_t texel_cache_size(TexelMode mode)
+    {
+        return mode == TexelMode::IA4 || mode == TexelMode::I4 ? 0x2000 : 0x1000;
+    }
+
+    Texel RDP::decode_texel(TexelMode mode, uint32_t index)
+    {
+        uint32_t color = 0, alpha = 0;
+        switch (mode)
+        {
+            case TexelMode::RGBA16:
+            {
+                uint8_t byte1 = tmem_[index];
+                uint8_t byte2 = tmem_[(index + 1) & 0xFFF];
+                color = rgba16_to_rgba32((byte1 << 8) | byte2);
+                alpha = (color >> 24) | (color >> 16) | (color >> 8) | color;
+                break;
+            }
+            case TexelMode::RGBA32:
+            {
+                uint8_t byte1 = tmem_[index];
+                uint8_t byte2 = tmem_[(index + 1) & 0xFFF];
+                uint8_t byte3 = tmem_[(index + 2) & 0xFFF];
+                uint8_t byte4 = tmem_[(index + 3) & 0xFFF];
+                color = (byte1 << 24) | (byte2 << 16) | (byte3 << 8) | byte4;
+                alpha = (color >> 24) | (color >> 16) | (color >> 8) | color;
+                break;
+            }
+            case TexelMode::IA4:
+            {
+                uint8_t ia = tmem_[index >> 1];
+                ia = (index & 1) ? (ia & 0xF) : (ia >> 4);
+                uint8_t i = ia & 0xE;
+                i = (i << 4) | (i << 1) | (i >> 2);
+                uint8_t a = (ia & 0x1) ? 0xFF : 0;
+                color = (a << 24) | (i << 16) | (i << 8) | i;
+                alpha = (a << 24) | (a << 16) | (a << 8) | a;
+                break;
+            }
+            case TexelMode::IA8:
+            {
+                uint8_t ia = tmem_[index];
+                uint8_t i = (ia >> 4) | (ia & 0xF0);
+                uint8_t a = (ia & 0xF) | (ia << 4);
+                color = (a << 24) | (i << 16) | (i << 8) | i;
+                alpha = (a << 24) | (a << 16) | (a << 8) | a;
+                break;
+            }
+            case TexelMode::IA16:
+            {
+                uint8_t i = tmem_[index];
+                uint8_t a = tmem_[(index + 1) & 0xFFF];
+                color = (a << 24) | (i << 16) | (i << 8) | i;
+                alpha = (a << 24) | (a << 16) | (a << 8) | a;
+                break;
+            }
+            case TexelMode::I4:
+            {
+                uint8_t i = tmem_[index >> 1];
+                i = (index & 1) ? (i & 0xF) : (i >> 4);
+                color = (i << 24) | (i << 16) | (i << 8) | i;
+                alpha = color;
+                break;
+            }
+            case TexelMode::I8:
+            {
+                uint8_t i = tmem_[index];
+                color = (i << 24) | (i << 16) | (i << 8) | i;
+                alpha = color;
+                break;
+            }
+            default:
+                break;
+        }
+        return {color, alpha};
+    }
+
+    void RDP::update_texel_cache(TexelMode mode)
     {
-        TileDescriptor& td = tiles_[tile];
+        TmemRange& dirty = texel_cache_dirty_[static_cast<size_t>(mode)];
+        if (dirty.start >= dirty.end)
+        {
+            return;
+        }
+        auto& cache = texel_cache_[static_cast<size_t>(mode)];
+        uint32_t size = texel_cache_size(mode);
+        cache.resize(size);
+
+        // 4-bit texels are two to a byte, the others are decoded from up to 4 bytes starting
+        // at their index, wrapping around the end of TMEM, so the 3 texels before the range
+        // change too
+        uint32_t first, last;
+        if (size != tmem_.size())
+        {
+            first = dirty.start * 2;
+            last = dirty.end * 2;
+        }
+        else
+        {
+            first = dirty.start + size - 3;
+            last = std::min(dirty.end + size, first + size);
+        }
+        for (uint32_t i = first; i < last; i++)
+        {
+            uint32_t index = i & (size - 1);
+            cache[index] = decode_texel(mode, index);
+        }
+        dirty = {0, 0};
+    }
+
+    void RDP::tmem_written(uint32_t start, uint32_t end)
+    {
+        end = std::min(end, static_cast<uint32_t>(tmem_.size()));
+        if (start >= end)
+        {
+            return;
+        }
+        for (TmemRange& dirty : texel_cache_dirty_)
+        {
+            if (dirty.start >= dirty.end)
+            {
+                dirty = {start, end};
+            }
+            else
+            {
+                dirty = {std::min(dirty.start, start), std::max(dirty.end, end)};
+            }
+        }
+    }
+
+    // Both texels come from the same tile for now. The cache of the tile's mode is brought up
+    // to date by render_primitive
+    void RDP::fetch_texels(PixelState& state, int tile, int32_t s, int32_t t)
+    {
+        const TileDescriptor& td = tiles_[tile];
         if (td.clamp_s)
         {
             auto max_s = ((td.sh >> 2) - (td.sl >> 2)) & 0x3ff;
@@ -1073,145 +1493,46 @@ namespace hydra::N64
         }
         else if (!td.mirror_t)
             t &= td.mask_t;
-        switch (td.format)
+
+        uint32_t row = td.tmem_address + t * td.line_width;
+        uint32_t index;
+        switch (td.texel_mode)
         {
-            case Format::RGBA:
+            case TexelMode::RGBA16:
+            case TexelMode::IA16:
             {
-                switch (td.size)
+                index = (row + s * 2) & 0xFFF;
+                if (t & 1)
                 {
-                    case 16:
-                    {
-                        uint16_t address = (td.tmem_address + (t * td.line_width) + s * 2) & 0xFFF;
-                        if (t & 1)
-                        {
-                            address ^= 0b10;
-                        }
-                        uint8_t byte1 = tmem_[address & 0xFFF];
-                        uint8_t byte2 = tmem_[(address + 1) & 0xFFF];
-                        texel_color_[texel] = rgba16_to_rgba32((byte1 << 8) | byte2);
-                        texel_alpha_[texel] = (texel_color_[texel] >> 24) |
-                                              (texel_color_[texel] >> 16) |
-                                              (texel_color_[texel] >> 8) | texel_color_[texel];
-                        break;
-                    }
-                    case 32:
-                    {
-                        uint16_t address = (td.tmem_address + (t * td.line_width) + s * 2) & 0xFFF;
-                        uint8_t byte1 = tmem_[address & 0xFFF];
-                        uint8_t byte2 = tmem_[(address + 1) & 0xFFF];
-                        uint8_t byte3 = tmem_[(address + 2) & 0xFFF];
-                        uint8_t byte4 = tmem_[(address + 3) & 0xFFF];
-                        texel_color_[texel] = (byte1 << 24) | (byte2 << 16) | (byte3 << 8) | byte4;
-                        texel_alpha_[texel] = (texel_color_[texel] >> 24) |
-                                              (texel_color_[texel] >> 16) |
-                                              (texel_color_[texel] >> 8) | texel_color_[texel];
-                        break;
-                    }
-                    default:
-                    {
-                        Logger::WarnOnce("Unimplemented texture size for RGBA: {}",
-                                         static_cast<int>(td.size));
-                        break;
-                    }
+                    index ^= 0b10;
                 }
                 break;
             }
-            case Format::IA:
-            {
-                switch (td.size)
-                {
-                    case 4:
-                    {
-                        uint16_t address = (td.tmem_address + (t * td.line_width) + s / 2) & 0xFFF;
-                        uint8_t ia = tmem_[address & 0xFFF];
-                        ia = (s & 1) ? (ia & 0xF) : (ia >> 4);
-                        uint8_t i = ia & 0xE;
-                        i = (i << 4) | (i << 1) | (i >> 2);
-                        uint8_t a = (ia & 0x1) ? 0xFF : 0;
-                        texel_color_[texel] = (a << 24) | (i << 16) | (i << 8) | i;
-                        texel_alpha_[texel] = (a << 24) | (a << 16) | (a << 8) | a;
-                        break;
-                    }
-                    case 8:
-                    {
-                        uint16_t address = (td.tmem_address + (t * td.line_width) + s) & 0xFFF;
-                        uint8_t ia = tmem_[address & 0xFFF];
-                        uint8_t i = (ia >> 4) | (ia & 0xF0);
-                        uint8_t a = (ia & 0xF) | (ia << 4);
-                        texel_color_[texel] = (a << 24) | (i << 16) | (i << 8) | i;
-                        texel_alpha_[texel] = (a << 24) | (a << 16) | (a << 8) | a;
-                        break;
-                    }
-                    case 16:
-                    {
-                        uint16_t address = (td.tmem_address + (t * td.line_width) + s * 2) & 0xFFF;
-                        if (t & 1)
-                        {
-                            address ^= 0b10;
-                        }
-                        uint8_t i = tmem_[address & 0xFFF];
-                        uint8_t a = tmem_[(address + 1) & 0xFFF];
-                        texel_color_[texel] = (a << 24) | (i << 16) | (i << 8) | i;
-                        texel_alpha_[texel] = (a << 24) | (a << 16) | (a << 8) | a;
-                        break;
-                    }
-                    default:
-                    {
-                        Logger::WarnOnce("Unimplemented texture size for IA: {}",
-                                         static_cast<int>(td.size));
-                        break;
-                    }
-                }
+            case TexelMode::RGBA32:
+                index = (row + s * 2) & 0xFFF;
                 break;
-            }
-            case Format::I:
-            {
-                switch (td.size)
-                {
-                    case 4:
-                    {
-                        uint16_t address = (td.tmem_address + (t * td.line_width) + s / 2) & 0xFFF;
-                        uint8_t i = tmem_[address & 0xFFF];
-                        if (s & 1)
-                        {
-                            i &= 0xF;
-                        }
-                        else
-                        {
-                            i >>= 4;
-                        }
-                        texel_color_[texel] = (i << 24) | (i << 16) | (i << 8) | i;
-                        texel_alpha_[texel] = texel_color_[texel];
-                        break;
-                    }
-                    case 8:
-                    {
-                        uint16_t address = (td.tmem_address + (t * td.line_width) + s) & 0xFFF;
-                        uint8_t i = tmem_[address & 0xFFF];
-                        texel_color_[texel] = (i << 24) | (i << 16) | (i << 8) | i;
-                        texel_alpha_[texel] = texel_color_[texel];
-                        break;
-                    }
-                    default:
-                    {
-                        Logger::WarnOnce("Unimplemented texture size for I: {}",
-                                         static_cast<int>(td.size));
-                        break;
-                    }
-                }
+            case TexelMode::IA8:
+            case TexelMode::I8:
+                index = (row + s) & 0xFFF;
+                break;
+            case TexelMode::IA4:
+            case TexelMode::I4:
+                index = ((row + s / 2) & 0xFFF) * 2 + (s & 1);
                 break;
-            }
             default:
-            {
-                Logger::WarnOnce("Unimplemented texture format: {}", static_cast<int>(td.format));
-            }
+                warn_unsupported_texels(td);
+                return;
         }
+
+        const Texel& texel = texel_cache_[static_cast<size_t>(td.texel_mode)][index];
+        state[CombinerInput::Texel0] = state[CombinerInput::Texel1] = texel.color;
+        state[CombinerInput::Texel0Alpha] = state[CombinerInput::Texel1Alpha] = texel.alpha;
     }
 
-    void RDP::get_noise()
+    void RDP::get_noise(PixelState& state)
     {
-        auto r = irand(&seed_);
-        noise_color_ = (r << 24) | (r << 16) | (r << 8) | r;
+        auto r = irand(&state.seed);
+        state[CombinerInput::Noise] = (r << 24) | (r << 16) | (r << 8) | r;
     }
 
     void RDP::load_tile(const LoadTileCommand& command)
@@ -1227,6 +1548,13 @@ namespace hydra::N64
         td.sh = command.SH;
         td.tl = command.TL;
         td.th = command.TH;
+        if (x_start <= x_end && y_start <= y_end)
+        {
+            // What the rows below write, 16-bit texels of odd rows are swapped within 4 bytes
+            uint32_t row_bytes = td.size == 8 ? x_end - x_start + 1 : (x_end - x_start) * 2 + 4;
+            uint32_t tmem_end = td.tmem_address + (y_end - y_start) * td.line_width + row_bytes;
+            tmem_written(td.tmem_address & ~3u, (tmem_end + 3) & ~3u);
+        }
 
         switch (td.size)
         {
@@ -1311,7 +1639,7 @@ namespace hydra::N64
     // Code: https://github.com/ata4/angrylion-rdp-plus
     Primitive RDP::get_angrylion_primitive(const EdgewalkerInput& input)
     {
-        Primitive ret;
+        Primitive ret{};
 
         int j = 0;
         int xleft = 0, xright = 0, xleft_inc = 0, xright_inc = 0;
@@ -1684,7 +2012,7 @@ namespace hydra::N64
     }
 
     void RDP::check_primitive(const Primitive& my_primitive, const EdgewalkerInput& input,
-                              const std::vector<uint64_t>& data)
+                              std::span<const uint64_t> data)
     {
         Primitive angrylion_primitive = get_angrylion_primitive(input);
         if (my_primitive.y_start != angrylion_primitive.y_start)
@@ -1772,7 +2100,7 @@ namespace hydra::N64
         }
     }
 
-    EdgewalkerInput RDP::triangle_get_edgewalker_input(const std::vector<uint64_t>& data,
+    EdgewalkerInput RDP::triangle_get_edgewalker_input(std::span<const uint64_t> data,
                                                        bool shade, bool texture, bool depth)
     {
         EdgewalkerInput ret;
@@ -1900,7 +2228,7 @@ namespace hydra::N64
     }
 
     template <bool Texture, bool Flip>
-    EdgewalkerInput RDP::rectangle_get_edgewalker_input(const std::vector<uint64_t>& data)
+    EdgewalkerInput RDP::rectangle_get_edgewalker_input(std::span<const uint64_t> data)
     {
         // Rectangles are simply triangles with slopes = 0 in the RDP
         EdgewalkerInput ret;
@@ -2100,15 +2428,46 @@ namespace hydra::N64
         primitive.y_start = y_top >> 2;
         primitive.y_end = y_bottom >> 2;
 
-        Span current_span;
+        if (y_top > y_bottom)
+        {
+            // Entirely above or below the scissor box
+            return primitive;
+        }
+
+        // The rows above the scissor box only step the edges and attributes, which is done
+        // in one go for all of them
+        int32_t y_walk = y_start;
+        if (y_top > y_start)
+        {
+            int32_t subpixels = y_top - y_start;
+            int32_t rows = subpixels >> 2;
+            if (ym >= y_start && ym < y_top)
+            {
+                x_left_inc = (input.slopel >> 2) & ~1;
+                x_left = span_step(xl, x_left_inc, y_top - ym);
+            }
+            else
+            {
+                x_left = span_step(x_left, x_left_inc, subpixels);
+            }
+            x_right = span_step(x_right, x_right_inc, subpixels);
+            r = span_step(r, DrDe, rows);
+            g = span_step(g, DgDe, rows);
+            b = span_step(b, DbDe, rows);
+            a = span_step(a, DaDe, rows);
+            s = span_step(s, DsDe, rows);
+            t = span_step(t, DtDe, rows);
+            w = span_step(w, DwDe, rows);
+            z = span_step(z, DzDe, rows);
+            y_walk = y_top;
+        }
+
+        Span current_span{};
 
         // To check whether every subpixel is inside the scissor
         bool all_invalid = true, all_over = true, all_under = true;
 
-        // We start from y_start instead of y_top because we need to
-        // edgewalk the shade/texture/depth values regardless of whether
-        // we're drawing the current span
-        for (int32_t y = y_start; y <= y_bottom; y++)
+        for (int32_t y = y_walk; y <= y_bottom; y++)
         {
             if (y == ym)
             {
@@ -2269,115 +2628,365 @@ namespace hydra::N64
         return primitive;
     }
 
-    hydra_inline uint8_t color_clamp(uint16_t color)
+    void RDP::render_primitive(const Primitive& primitive)
     {
-        switch ((color >> 7) & 3)
+        // Find the rows that have pixels and how many, which is also how many times each of
+        // them steps the noise generator
+        int32_t y_first = -1, y_last = -1;
+        int32_t x_min = INT32_MAX, x_max = INT32_MIN;
+        uint32_t pixels = 0;
+        for (int y = primitive.y_start; y <= primitive.y_end; y++)
         {
-            case 0:
-            case 1:
-                return color & 0xff;
-            case 2:
-                return 0xff;
-            default:
-                return 0;
+            const Span& span = primitive.spans[y];
+            if (!span.valid || span.max_x < span.min_x)
+                continue;
+
+            if (y_first == -1)
+            {
+                y_first = y;
+            }
+            y_last = y;
+            x_min = std::min(x_min, span.min_x);
+            x_max = std::max(x_max, span.max_x);
+            pixels += span.max_x - span.min_x + 1;
+        }
+
+        if (pixels == 0)
+        {
+            return;
+        }
+
+        if (pipeline_ & PIPELINE_TEXTURE)
+        {
+            TexelMode mode = tiles_[primitive.tile_index].texel_mode;
+            if (mode != TexelMode::Unsupported)
+            {
+                update_texel_cache(mode);
+            }
+        }
+
+        int32_t first = y_first * framebuffer_width_ + x_min;
+        int32_t last = y_last * framebuffer_width_ + x_max;
+        int32_t bytes = framebuffer_pixel_size_ >> 3;
+        uint32_t color_start = framebuffer_dram_address_ + first * bytes;
+        uint32_t color_end = framebuffer_dram_address_ + last * bytes + 4;
+        uint32_t depth_start = zbuffer_dram_address_ + first * 2;
+        uint32_t depth_end = zbuffer_dram_address_ + last * 2 + 2;
+        bool uses_depth = z_compare_en_ || z_update_en_;
+
+        RDRAMDirtyMap* dirty_map = thread_ ? &thread_->DirtyMap() : dirty_map_;
+        if (dirty_map)
+        {
+            dirty_map->Mark(color_start, color_end - color_start);
+            if (z_update_en_)
+            {
+                dirty_map->Mark(depth_start, depth_end - depth_start);
+            }
+        }
+
+        // Rows can be rendered independently as long as none of them touches memory another
+        // one does and no pixel depends on the one drawn before it. Noise does, but where
+        // the generator is at the start of every row can be worked out in advance
+        bool parallel = workers_ && pixels >= RDP_PARALLEL_MIN_PIXELS && x_min >= 0 &&
+                        x_max < framebuffer_width_ &&
+                        (framebuffer_pixel_size_ == 16 || framebuffer_pixel_size_ == 32) &&
+                        !(uses_depth && color_start < depth_end && depth_start < color_end);
+        if (cycle_type_ == CycleType::Cycle1)
+        {
+            parallel = parallel &&
+                       !combiner_reads(1, CombinerInput::Combined, CombinerInput::CombinedAlpha);
+        }
+        else if (cycle_type_ == CycleType::Cycle2)
+        {
+            parallel = parallel &&
+                       !combiner_reads(0, CombinerInput::Combined, CombinerInput::CombinedAlpha);
+        }
+
+        if (!parallel)
+        {
+            (this->*render_rows_)(primitive, y_first, y_last, pixel_);
+            return;
         }
+
+        // Split the rows into one band per worker with about as many pixels each
+        uint32_t count = std::min<uint32_t>(workers_->Count(), y_last - y_first + 1);
+        uint32_t done = 0;
+        int32_t y = y_first;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            RDPBand& band = bands_[i];
+            band.y_start = y;
+            band.pixels = 0;
+            band.drawn = false;
+            band.pixel = pixel_;
+            band.pixel.seed = irand_skip(pixel_.seed, done);
+            uint64_t target = static_cast<uint64_t>(pixels) * (i + 1) / count;
+            while (y <= y_last && done < target)
+            {
+                const Span& span = primitive.spans[y];
+                if (span.valid && span.max_x >= span.min_x)
+                {
+                    uint32_t row = span.max_x - span.min_x + 1;
+                    band.pixels += row;
+                    done += row;
+                }
+                y++;
+            }
+            band.y_end = y - 1;
+        }
+        for (uint32_t i = count; i < bands_.size(); i++)
+        {
+            bands_[i].y_start = 0;
+            bands_[i].y_end = -1;
+        }
+
+        // Captures no more than std::function stores without allocating
+        workers_->Run([this, &primitive](uint32_t worker) {
+            RDPBand& band = bands_[worker];
+            if (band.y_start <= band.y_end)
+            {
+                band.drawn =
+                    (this->*render_rows_)(primitive, band.y_start, band.y_end, band.pixel);
+            }
+        });
+
+        // Leave the state as the last pixel rendered in order would have, the last pixel that
+        // passed the depth test also fetched texels and ran the combiner
+        uint32_t seed = pixel_.seed;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const RDPBand& band = bands_[i];
+            if (band.drawn)
+            {
+                pixel_ = band.pixel;
+            }
+            else if (band.pixels != 0)
+            {
+                pixel_[CombinerInput::Shade] = band.pixel[CombinerInput::Shade];
+                pixel_[CombinerInput::ShadeAlpha] = band.pixel[CombinerInput::ShadeAlpha];
+                pixel_[CombinerInput::Noise] = band.pixel[CombinerInput::Noise];
+            }
+        }
+        pixel_.seed = irand_skip(seed, pixels);
     }
 
-    hydra_inline int32_t z_correct(int32_t z)
+    // Copy mode always textures and fill mode neither textures nor combines, so their unused
+    // bits are dropped to not instantiate the same thing over and over
+    constexpr uint32_t canonical_pipeline(uint32_t pipeline)
     {
-        z >>= 3;
-
-        switch ((z >> 17) & 3)
+        switch (pipeline & PIPELINE_CYCLE_MASK)
         {
-            case 0:
-            case 1:
-                return z & 0x3ffff;
             case 2:
-                return 0x3ffff;
+                return (pipeline & ~PIPELINE_NOISE) | PIPELINE_TEXTURE;
+            case 3:
+                return pipeline & ~(PIPELINE_TEXTURE | PIPELINE_NOISE);
             default:
-                return 0;
+                return pipeline;
         }
     }
 
-    void RDP::render_primitive(const Primitive& primitive)
+    void RDP::update_pipeline()
     {
-        int32_t x_start = 0, x_inc = 0;
-        int32_t DzDx = primitive.DzDx;
-        int32_t DrDx = primitive.DrDx;
-        int32_t DgDx = primitive.DgDx;
-        int32_t DbDx = primitive.DbDx;
-        int32_t DaDx = primitive.DaDx;
+        uint32_t pipeline = cycle_type_;
+        if (framebuffer_pixel_size_ != 16)
+        {
+            pipeline |= PIPELINE_PIXEL_32;
+        }
+        if (z_compare_en_)
+        {
+            pipeline |= PIPELINE_Z_COMPARE;
+        }
+        if (z_update_en_)
+        {
+            pipeline |= PIPELINE_Z_UPDATE;
+        }
 
-        if (z_source_sel_)
+        // Cycle1 only runs the second combiner cycle
+        int first_cycle = cycle_type_ == CycleType::Cycle2 ? 0 : 1;
+        for (int cycle = first_cycle; cycle < 2; cycle++)
         {
-            DzDx = 0;
+            if (combiner_reads(cycle, CombinerInput::Texel0, CombinerInput::Texel0Alpha) ||
+                combiner_reads(cycle, CombinerInput::Texel1, CombinerInput::Texel1Alpha))
+            {
+                pipeline |= PIPELINE_TEXTURE;
+            }
+            if (combiner_reads(cycle, CombinerInput::Noise, CombinerInput::Noise))
+            {
+                pipeline |= PIPELINE_NOISE;
+            }
         }
+        render_rows_ = get_render_rows(pipeline);
+        pipeline_ = canonical_pipeline(pipeline);
 
-        for (int y = primitive.y_start; y <= primitive.y_end; y++)
+        for (int cycle = 0; cycle < 2; cycle++)
+        {
+            bool multiplier1_zero = (blender_1b_[cycle] & 0b11) == 3;
+            bool multiplier2_zero = (blender_2b_[cycle] & 0b11) == 1 ||
+                                    (blender_2b_[cycle] & 0b11) == 3;
+            if (multiplier2_zero)
+            {
+                blender_result_[cycle] = BlenderResult::First;
+            }
+            else if (multiplier1_zero)
+            {
+                blender_result_[cycle] = BlenderResult::Second;
+            }
+            else
+            {
+                blender_result_[cycle] = BlenderResult::Blend;
+            }
+        }
+    }
+
+    RDP::RenderRowsFunc RDP::get_render_rows(uint32_t pipeline)
+    {
+        static constexpr auto table = []<size_t... I>(std::index_sequence<I...>) {
+            return std::array<RenderRowsFunc, PIPELINE_COUNT>{
+                &RDP::render_rows<canonical_pipeline(I)>...};
+        }(std::make_index_sequence<PIPELINE_COUNT>{});
+        return table[pipeline];
+    }
+
+    template <uint32_t Pipeline>
+    bool RDP::render_rows(const Primitive& primitive, int32_t y_start, int32_t y_end,
+                          PixelState& state)
+    {
+        constexpr auto Cycle = static_cast<CycleType>(Pipeline & PIPELINE_CYCLE_MASK);
+        constexpr bool Pixel32 = Pipeline & PIPELINE_PIXEL_32;
+        constexpr bool ZCompare = Pipeline & PIPELINE_Z_COMPARE;
+        constexpr bool ZUpdate = Pipeline & PIPELINE_Z_UPDATE;
+        constexpr bool Texture = Pipeline & PIPELINE_TEXTURE;
+        constexpr bool Noise = Pipeline & PIPELINE_NOISE;
+        constexpr bool Shade = Cycle == CycleType::Cycle1 || Cycle == CycleType::Cycle2;
+        constexpr bool Depth = ZCompare || ZUpdate;
+
+        // Fill mode reads nothing, so its rows are stored in one go as long as every pixel
+        // has an address of its own
+        bool fill_rows = Cycle == CycleType::Fill && !Depth &&
+                         framebuffer_pixel_size_ == (Pixel32 ? 32 : 16);
+        bool drawn = false;
+
+        for (int y = y_start; y <= y_end; y++)
         {
             const Span& span = primitive.spans[y];
             if (!span.valid)
                 continue;
 
-            int32_t r = span.r;
-            int32_t g = span.g;
-            int32_t b = span.b;
-            int32_t a = span.a;
-            int32_t s = span.s;
-            int32_t t = span.t;
-            int32_t w = span.w;
-            int32_t z = z_source_sel_ ? primitive_depth_ : span.z;
+            int length = span.max_x - span.min_x;
 
-            if (primitive.right_major)
+            if constexpr (!Noise)
             {
-                x_start = span.min_x;
-                x_inc = 1;
+                // Nothing reads the noise, but the generator still steps once per pixel
+                if (length >= 0)
+                {
+                    state.seed = irand_skip(state.seed, length + 1);
+                }
             }
-            else
+
+            if (fill_rows)
             {
-                x_start = span.max_x;
-                x_inc = -1;
+                if (length >= 0)
+                {
+                    uintptr_t address =
+                        reinterpret_cast<uintptr_t>(rdram_ptr_) + framebuffer_dram_address_ +
+                        (y * framebuffer_width_ + span.min_x) * (framebuffer_pixel_size_ >> 3);
+                    if constexpr (Pixel32)
+                    {
+                        fill_span32(reinterpret_cast<uint32_t*>(address), length + 1,
+                                    fill_color_32_);
+                    }
+                    else
+                    {
+                        bool odd = span.min_x & 1;
+                        fill_span16(reinterpret_cast<uint16_t*>(address), length + 1,
+                                    odd ? fill_color_16_0_ : fill_color_16_1_,
+                                    odd ? fill_color_16_1_ : fill_color_16_0_);
+                    }
+                    drawn = true;
+                }
+                continue;
             }
 
-            int32_t x = x_start;
-            int length = span.max_x - span.min_x;
-
-            for (int i = 0; i <= length; i++)
+            int32_t x_inc = primitive.right_major ? 1 : -1;
+            int32_t x = primitive.right_major ? span.min_x : span.max_x;
+            int32_t z = z_source_sel_ ? static_cast<int32_t>(primitive_depth_) : span.z;
+            SpanAttributes attributes = {span.r, span.g, span.b, span.a, span.s, span.t, span.w, z};
+            SpanAttributes step = {primitive.DrDx * x_inc,
+                                   primitive.DgDx * x_inc,
+                                   primitive.DbDx * x_inc,
+                                   primitive.DaDx * x_inc,
+                                   primitive.DsDx * x_inc,
+                                   primitive.DtDx * x_inc,
+                                   primitive.DwDx * x_inc,
+                                   z_source_sel_ ? 0 : primitive.DzDx * x_inc};
+            SpanChunk chunk;
+
+            for (int i = 0; i <= length; i += RDP_SPAN_CHUNK)
             {
-                uint8_t r8 = color_clamp(r >> 16);
-                uint8_t g8 = color_clamp(g >> 16);
-                uint8_t b8 = color_clamp(b >> 16);
-                uint8_t a8 = color_clamp(a >> 16);
-
-                shade_color_ = (a8 << 24) | (b8 << 16) | (g8 << 8) | r8;
-                shade_alpha_ = (a8 << 24) | (a8 << 16) | (a8 << 8) | a8;
+                int count = std::min(RDP_SPAN_CHUNK, length + 1 - i);
+                if (interpolate_span<Shade, Depth, Texture>(attributes, step, persp_tex_en_,
+                                                            count, chunk))
+                {
+                    Logger::WarnOnce("Division by zero in perspective correction");
+                }
+                span_advance(attributes, step, RDP_SPAN_CHUNK);
 
-                get_noise();
+                if constexpr (ZCompare)
+                {
+                    bool occluded = true;
+                    for (int j = 0; j < count && occluded; j++)
+                    {
+                        occluded = !depth_test(x + j * x_inc, y, chunk.z[j], 0);
+                    }
+                    if (occluded)
+                    {
+                        // Nothing in the chunk is drawn, all it leaves behind is the shade
+                        // and noise of its last pixel
+                        if constexpr (Shade)
+                        {
+                            state[CombinerInput::Shade] = chunk.shade[count - 1];
+                            state[CombinerInput::ShadeAlpha] = chunk.shade_alpha[count - 1];
+                        }
+                        if constexpr (Noise)
+                        {
+                            state.seed = irand_skip(state.seed, count - 1);
+                            get_noise(state);
+                        }
+                        x += x_inc * count;
+                        continue;
+                    }
+                }
 
-                int32_t z_cur = z_correct((z >> 10) & 0x3f'ffff);
-                if (depth_test(x, y, z_cur, 0))
+                for (int j = 0; j < count; j++, x += x_inc)
                 {
-                    auto [s_cur, t_cur] = perspective_correction_func_(s, t, w);
-                    fetch_texels(0, primitive.tile_index, s_cur, t_cur);
-                    fetch_texels(1, primitive.tile_index, s_cur, t_cur);
-                    draw_pixel(x, y);
+                    if constexpr (Shade)
+                    {
+                        state[CombinerInput::Shade] = chunk.shade[j];
+                        state[CombinerInput::ShadeAlpha] = chunk.shade_alpha[j];
+                    }
 
-                    if (z_update_en_)
+                    if constexpr (Noise)
                     {
-                        z_set(x, y, z_cur);
+                        get_noise(state);
                     }
-                }
 
-                z += DzDx * x_inc;
-                r += DrDx * x_inc;
-                g += DgDx * x_inc;
-                b += DbDx * x_inc;
-                a += DaDx * x_inc;
-                s += primitive.DsDx * x_inc;
-                t += primitive.DtDx * x_inc;
-                w += primitive.DwDx * x_inc;
-                x += x_inc;
+                    if (!ZCompare || depth_test(x, y, chunk.z[j], 0))
+                    {
+                        if constexpr (Texture)
+                        {
+                            fetch_texels(state, primitive.tile_index, chunk.s[j], chunk.t[j]);
+                        }
+                        draw_pixel<Cycle, Pixel32>(state, x, y);
+                        drawn = true;
+
+                        if constexpr (ZUpdate)
+                        {
+                            z_set(x, y, chunk.z[j]);
+                        }
+                    }
+                }
             }
         }
+        return drawn;
     }
 } // namespace hydra::N64
\ No newline at end of file
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <array>
 #include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <n64/core/n64_rdp_thread.hxx>
+#include <n64/core/n64_rdp_trace.hxx>
+#include <n64/core/n64_rdp_workers.hxx>
+#include <n64/core/n64_rdram.hxx>
 #include <n64/core/n64_types.hxx>
+#include <span>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -42,14 +51,13 @@
     X(SetEnvironmentColor, 0x3B, 1)       \
     X(SetFogColor, 0x38, 1)
 
-using persp_func_ptr = std::pair<int32_t, int32_t> (*)(int32_t, int32_t, int32_t);
-
 class N64Debugger;
 class MmioViewer;
 
 namespace hydra::N64
 {
     class RSP;
+    class RSPThread;
     union LoadTileCommand;
 
     enum class RDPCommandType {
@@ -103,13 +111,48 @@ namespace hydra::N64
 
     static_assert(sizeof(RDPStatusWrite) == sizeof(uint32_t));
 
+    // The render mode bits render_rows is specialized on, the low two bits are the cycle type
+    constexpr uint32_t PIPELINE_CYCLE_MASK = 0b11;
+    constexpr uint32_t PIPELINE_PIXEL_32 = 1 << 2;
+    constexpr uint32_t PIPELINE_Z_COMPARE = 1 << 3;
+    constexpr uint32_t PIPELINE_Z_UPDATE = 1 << 4;
+    constexpr uint32_t PIPELINE_TEXTURE = 1 << 5;
+    constexpr uint32_t PIPELINE_NOISE = 1 << 6;
+    constexpr uint32_t PIPELINE_COUNT = 1 << 7;
+
     enum class Format { RGBA, YUV, CI, IA, I };
 
+    // The RDRAM a LoadTile, LoadTLUT or LoadBlock reads, end exclusive. width and bits are
+    // those of the texture image at address, LoadTile is rounded out to whole rows
+    std::pair<uint32_t, uint32_t> get_texture_load_range(RDPCommandType type, uint64_t command,
+                                                         uint32_t address, uint32_t width,
+                                                         uint32_t bits);
+
+    // The texel formats fetch_texels can sample, each has a decoded copy of TMEM of its own
+    enum class TexelMode : uint8_t {
+        RGBA16,
+        RGBA32,
+        IA4,
+        IA8,
+        IA16,
+        I4,
+        I8,
+        Count,
+        Unsupported = Count,
+    };
+
+    struct Texel
+    {
+        uint32_t color;
+        uint32_t alpha;
+    };
+
     struct TileDescriptor
     {
         uint16_t tmem_address;
         Format format;
         uint8_t size;
+        TexelMode texel_mode = TexelMode::Unsupported;
         uint8_t palette_index;
         uint16_t line_width;
         uint8_t mask_s, mask_t;
@@ -144,7 +187,7 @@ namespace hydra::N64
     struct Span
     {
         int32_t min_x, max_x;
-        bool valid = false;
+        bool valid;
         int32_t r, g, b, a;
         int32_t s, t, w;
         int32_t z;
@@ -152,7 +195,8 @@ namespace hydra::N64
 
     struct Primitive
     {
-        std::array<Span, 1024> spans{};
+        // Left alone outside of the rows between y_start and y_end, which are all written
+        std::array<Span, 1024> spans;
         int32_t y_start = 0;
         int32_t y_end = 0;
         int32_t DrDx, DgDx, DbDx, DaDx;
@@ -162,6 +206,55 @@ namespace hydra::N64
         bool right_major;
     };
 
+    // What the color combiner selects its inputs from
+    enum class CombinerInput : uint8_t {
+        Combined,
+        Texel0,
+        Texel1,
+        Primitive,
+        Shade,
+        Environment,
+        Noise,
+        One,
+        Zero,
+        CombinedAlpha,
+        Texel0Alpha,
+        Texel1Alpha,
+        PrimitiveAlpha,
+        ShadeAlpha,
+        EnvironmentAlpha,
+        Count,
+    };
+
+    // Everything the pixel pipeline reads and writes while drawing a pixel. Each band of a
+    // primitive that is rendered in parallel gets a copy of its own
+    struct PixelState
+    {
+        std::array<uint32_t, static_cast<size_t>(CombinerInput::Count)> inputs{};
+        uint32_t framebuffer_color = 0;
+        uint32_t seed = 0;
+
+        uint32_t& operator[](CombinerInput input)
+        {
+            return inputs[static_cast<size_t>(input)];
+        }
+
+        uint32_t operator[](CombinerInput input) const
+        {
+            return inputs[static_cast<size_t>(input)];
+        }
+    };
+
+    // Consecutive rows of a primitive and the state they are rendered with
+    struct RDPBand
+    {
+        int32_t y_start = 0;
+        int32_t y_end = -1;
+        uint32_t pixels = 0;
+        bool drawn = false;
+        PixelState pixel;
+    };
+
     class RDP final
     {
     public:
@@ -173,18 +266,64 @@ namespace hydra::N64
             mi_interrupt_ = ptr;
         }
 
+        void SetDirtyMap(RDRAMDirtyMap* dirty_map)
+        {
+            dirty_map_ = dirty_map;
+        }
+
         uint32_t ReadWord(uint32_t addr);
         void WriteWord(uint32_t addr, uint32_t data);
         void Reset();
 
-        // Used for QA
-        void SendCommand(const std::vector<uint64_t>& command);
+        // Large primitives are split into bands of rows rendered on this many threads, 0 uses
+        // one per hardware thread
+        void SetThreadCount(uint32_t count);
+        // Executes commands on a thread of its own, see RDPThread
+        void SetThread(bool enabled);
+
+        bool IsThreaded() const
+        {
+            return thread_ != nullptr;
+        }
+
+        // Waits for the RDP thread to execute every command sent so far
+        void Sync();
+
+        // Whether commands the RDP thread hasn't executed yet write the range, or also read
+        // it if write is set. Anything about to touch RDRAM waits for it when this is true
+        bool IsPending(uint32_t paddr, uint32_t length, bool write) const
+        {
+            return thread_ && thread_->IsPending(paddr, length, write);
+        }
+
+        void WaitFor(uint32_t paddr, uint32_t length, bool write)
+        {
+            if (IsPending(paddr, length, write))
+            {
+                Sync();
+            }
+        }
+
+        // Used for QA and by the HLE graphics microcode
+        void SendCommand(std::span<const uint64_t> command);
+
+        void SendCommand(std::initializer_list<uint64_t> command)
+        {
+            SendCommand(std::span<const uint64_t>(command.begin(), command.size()));
+        }
+
+        // Writes every command executed from now on to a trace file, see RDPTraceWriter
+        bool StartTrace(const std::string& path);
+        void StopTrace();
+        // Marks the end of a frame in the trace, if there is one
+        void TraceFrame();
 
     private:
         RDPStatus status_;
         uint8_t* rdram_ptr_ = nullptr;
         uint8_t* spmem_ptr_ = nullptr;
         MIInterrupt* mi_interrupt_ = nullptr;
+        RDRAMDirtyMap* dirty_map_ = nullptr;
         uint32_t start_address_;
         uint32_t end_address_;
         uint32_t current_address_;
@@ -200,38 +339,34 @@ namespace hydra::N64
         uint16_t fill_color_16_0_, fill_color_16_1_;
         uint32_t blend_color_;
         uint32_t fog_color_;
-        uint32_t combined_color_;
-        uint32_t shade_color_;
-        uint32_t primitive_color_;
-        uint32_t texel_color_[2];
-        uint32_t texel_alpha_[2];
-        uint32_t environment_color_;
-        uint32_t framebuffer_color_;
-        uint32_t noise_color_;
-
-        uint32_t combined_alpha_;
-        uint32_t primitive_alpha_;
-        uint32_t shade_alpha_;
-        uint32_t environment_alpha_;
         uint32_t fog_alpha_;
 
-        uint32_t* color_sub_a_[2];
-        uint32_t* color_sub_b_[2];
-        uint32_t* color_multiplier_[2];
-        uint32_t* color_adder_[2];
+        // Also holds the primitive and environment colors, which are set by commands
+        PixelState pixel_;
 
-        uint32_t* alpha_sub_a_[2];
-        uint32_t* alpha_sub_b_[2];
-        uint32_t* alpha_multiplier_[2];
-        uint32_t* alpha_adder_[2];
+        CombinerInput color_sub_a_[2];
+        CombinerInput color_sub_b_[2];
+        CombinerInput color_multiplier_[2];
+        CombinerInput color_adder_[2];
+
+        CombinerInput alpha_sub_a_[2];
+        CombinerInput alpha_sub_b_[2];
+        CombinerInput alpha_multiplier_[2];
+        CombinerInput alpha_adder_[2];
 
         uint8_t blender_1a_[2];
         uint8_t blender_1b_[2];
         uint8_t blender_2a_[2];
         uint8_t blender_2b_[2];
 
-        uint32_t color_zero_ = 0;
-        uint32_t color_one_ = 0xFFFF'FFFF;
+        // What a blender cycle boils down to when one of its multipliers is always zero
+        enum class BlenderResult : uint8_t
+        {
+            Blend,
+            First,
+            Second,
+        };
+        BlenderResult blender_result_[2];
 
         uint32_t texture_dram_address_latch_;
         uint32_t texture_width_latch_;
@@ -240,6 +375,17 @@ namespace hydra::N64
 
         std::array<TileDescriptor, 8> tiles_;
         std::array<uint8_t, 4096> tmem_;
+        // TMEM decoded into colors for each texel mode, indexed by where the texel is in TMEM.
+        // Loads mark the bytes they wrote and only those texels are decoded again, before the
+        // next primitive that uses the mode
+        struct TmemRange
+        {
+            // Empty when start isn't below end
+            uint32_t start;
+            uint32_t end;
+        };
+        std::array<std::vector<Texel>, static_cast<size_t>(TexelMode::Count)> texel_cache_;
+        std::array<TmemRange, static_cast<size_t>(TexelMode::Count)> texel_cache_dirty_;
         std::vector<bool> rdram_9th_bit_;
         std::array<uint32_t, 0x4000> z_decompress_lut_;
         std::array<uint32_t, 0x40000> z_compress_lut_;
@@ -258,17 +404,36 @@ namespace hydra::N64
         uint16_t scissor_xl_ = 0;
         uint16_t scissor_yl_ = 0;
 
-        uint32_t seed_;
-        persp_func_ptr perspective_correction_func_;
+        bool persp_tex_en_ = false;
+
+        std::unique_ptr<RDPWorkers> workers_;
+        std::vector<RDPBand> bands_;
 
         enum CycleType { Cycle1, Cycle2, Copy, Fill } cycle_type_;
 
+        // render_rows specialized for the current render mode, see update_pipeline
+        using RenderRowsFunc = bool (RDP::*)(const Primitive&, int32_t, int32_t, PixelState&);
+        RenderRowsFunc render_rows_ = nullptr;
+        uint32_t pipeline_ = 0;
+
+        std::unique_ptr<RDPTraceWriter> trace_;
+
+        // Only the status, the command addresses, the MI interrupt and the dirty map belong to
+        // whoever sends the commands, everything else to the RDP thread when there is one.
+        // Declared last so the thread stops before what it renders with is destroyed
+        std::unique_ptr<RDPThread> thread_;
+
         void process_commands();
-        void execute_command(const std::vector<uint64_t>& data);
-        void draw_triangle(const std::vector<uint64_t>& data);
-        inline void draw_pixel(int x, int y);
-        void color_combiner(int cycle);
-        uint32_t blender(int cycle);
+        void submit(std::span<const uint64_t> command);
+        void execute_command(std::span<const uint64_t> data);
+        void trace_command(std::span<const uint64_t> data);
+        template <CycleType Cycle, bool Pixel32>
+        inline void draw_pixel(PixelState& state, int x, int y);
+        inline void color_combiner(PixelState& state, int cycle);
+        inline uint32_t blender(const PixelState& state, int cycle);
+        inline uint32_t blender_color(const PixelState& state, uint8_t select);
+        bool combiner_reads(int cycle, CombinerInput color, CombinerInput alpha);
+        void update_pipeline();
 
         bool depth_test(int x, int y, uint32_t z, uint16_t dz);
         inline uint32_t z_get(int x, int y);
@@ -278,32 +443,42 @@ namespace hydra::N64
         uint32_t z_compress(uint32_t z);
         uint32_t z_decompress(uint32_t z);
         void init_depth_luts();
-        void fetch_texels(int texel, int tile, int32_t s, int32_t t);
-        void get_noise();
+        inline void fetch_texels(PixelState& state, int tile, int32_t s, int32_t t);
+        void update_texel_cache(TexelMode mode);
+        void tmem_written(uint32_t start, uint32_t end);
+        Texel decode_texel(TexelMode mode, uint32_t index);
+        void get_noise(PixelState& state);
         void load_tile(const LoadTileCommand& command);
 
-        uint32_t* color_get_sub_a(uint8_t sub_a);
-        uint32_t* color_get_sub_b(uint8_t sub_b);
-        uint32_t* color_get_mul(uint8_t mul);
-        uint32_t* color_get_add(uint8_t add);
-        uint32_t* alpha_get_sub_add(uint8_t sub_a);
-        uint32_t* alpha_get_mul(uint8_t mul);
+        CombinerInput color_get_sub_a(uint8_t sub_a);
+        CombinerInput color_get_sub_b(uint8_t sub_b);
+        CombinerInput color_get_mul(uint8_t mul);
+        CombinerInput color_get_add(uint8_t add);
+        CombinerInput alpha_get_sub_add(uint8_t sub_a);
+        CombinerInput alpha_get_mul(uint8_t mul);
 
-        EdgewalkerInput triangle_get_edgewalker_input(const std::vector<uint64_t>& data, bool shade,
+        EdgewalkerInput triangle_get_edgewalker_input(std::span<const uint64_t> data, bool shade,
                                                       bool texture, bool depth);
 
         template <bool Texture, bool Flip>
-        EdgewalkerInput rectangle_get_edgewalker_input(const std::vector<uint64_t>& data);
+        EdgewalkerInput rectangle_get_edgewalker_input(std::span<const uint64_t> data);
 
         Primitive edgewalker(const EdgewalkerInput& data);
         void render_primitive(const Primitive& primitive);
+        template <uint32_t Pipeline>
+        bool render_rows(const Primitive& primitive, int32_t y_start, int32_t y_end,
+                         PixelState& state);
+        static RenderRowsFunc get_render_rows(uint32_t pipeline);
 
         Primitive get_angrylion_primitive(const EdgewalkerInput& data);
         void check_primitive(const Primitive& primitive, const EdgewalkerInput& input,
-                             const std::vector<uint64_t>& data);
+                             std::span<const uint64_t> data);
 
         friend class hydra::N64::RSP;
+        friend class hydra::N64::RSPThread;
+        friend class hydra::N64::RDPThread;
         friend class ::N64Debugger;
         friend class ::MmioViewer;
+        friend class QA;
     };
 } // namespace hydra::N64
\ No newline at end of file
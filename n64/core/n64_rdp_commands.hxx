@@ -4,6 +4,9 @@
 
 namespace hydra::N64
 {
+    // In words, TriangleShadeTextureDepth
+    constexpr int RDP_MAX_COMMAND_LENGTH = 22;
+
     union SetColorImageCommand
     {
         uint64_t full;
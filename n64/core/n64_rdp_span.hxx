@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <compatibility.hxx>
+#include <cstdint>
+
+namespace hydra::N64
+{
+    // Pixels of a span that are interpolated together
+    constexpr int RDP_SPAN_CHUNK = 8;
+
+    // The shade, texture and depth attributes of a pixel, or how much they change per pixel
+    struct SpanAttributes
+    {
+        int32_t r, g, b, a, s, t, w, z;
+    };
+
+    // What the pixel pipeline needs out of the attributes of a chunk of pixels
+    struct SpanChunk
+    {
+        alignas(16) uint32_t shade[RDP_SPAN_CHUNK];
+        alignas(16) uint32_t shade_alpha[RDP_SPAN_CHUNK];
+        alignas(16) int32_t z[RDP_SPAN_CHUNK];
+        alignas(16) int32_t s[RDP_SPAN_CHUNK];
+        alignas(16) int32_t t[RDP_SPAN_CHUNK];
+    };
+
+    hydra_inline uint8_t span_color_clamp(uint16_t color)
+    {
+        switch ((color >> 7) & 3)
+        {
+            case 0:
+            case 1:
+                return color & 0xff;
+            case 2:
+                return 0xff;
+            default:
+                return 0;
+        }
+    }
+
+    hydra_inline int32_t span_z_correct(int32_t z)
+    {
+        z >>= 3;
+
+        switch ((z >> 17) & 3)
+        {
+            case 0:
+            case 1:
+                return z & 0x3ffff;
+            case 2:
+                return 0x3ffff;
+            default:
+                return 0;
+        }
+    }
+
+    // Attributes step with wrap around like the hardware's adders do
+    hydra_inline int32_t span_step(int32_t value, int32_t step, int32_t pixels)
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(value) +
+                                    static_cast<uint32_t>(step) * static_cast<uint32_t>(pixels));
+    }
+
+    inline void span_advance(SpanAttributes& attributes, const SpanAttributes& step, int pixels)
+    {
+        attributes.r = span_step(attributes.r, step.r, pixels);
+        attributes.g = span_step(attributes.g, step.g, pixels);
+        attributes.b = span_step(attributes.b, step.b, pixels);
+        attributes.a = span_step(attributes.a, step.a, pixels);
+        attributes.s = span_step(attributes.s, step.s, pixels);
+        attributes.t = span_step(attributes.t, step.t, pixels);
+        attributes.w = span_step(attributes.w, step.w, pixels);
+        attributes.z = span_step(attributes.z, step.z, pixels);
+    }
+
+    /**
+        Interpolates the attributes of the next RDP_SPAN_CHUNK pixels of a span, starting at
+        start and changing by step every pixel
+
+        Shade, Depth and Texture pick which of the outputs are worked out. Returns whether a
+        perspective divide among the first count pixels divided by zero, those get 0 for s and t.
+    */
+    template <bool Shade, bool Depth, bool Texture>
+    bool interpolate_span_scalar(const SpanAttributes& start, const SpanAttributes& step,
+                                 bool perspective, int count, SpanChunk& chunk)
+    {
+        bool division_by_zero = false;
+        for (int i = 0; i < RDP_SPAN_CHUNK; i++)
+        {
+            if constexpr (Shade)
+            {
+                uint8_t r = span_color_clamp(span_step(start.r, step.r, i) >> 16);
+                uint8_t g = span_color_clamp(span_step(start.g, step.g, i) >> 16);
+                uint8_t b = span_color_clamp(span_step(start.b, step.b, i) >> 16);
+                uint8_t a = span_color_clamp(span_step(start.a, step.a, i) >> 16);
+                chunk.shade[i] = (a << 24) | (b << 16) | (g << 8) | r;
+                chunk.shade_alpha[i] = (a << 24) | (a << 16) | (a << 8) | a;
+            }
+
+            if constexpr (Depth)
+            {
+                chunk.z[i] = span_z_correct((span_step(start.z, step.z, i) >> 10) & 0x3f'ffff);
+            }
+
+            if constexpr (Texture)
+            {
+                int32_t s = span_step(start.s, step.s, i);
+                int32_t t = span_step(start.t, step.t, i);
+                if (!perspective)
+                {
+                    chunk.s[i] = static_cast<int16_t>(s) >> 16;
+                    chunk.t[i] = static_cast<int16_t>(t) >> 16;
+                    continue;
+                }
+
+                int32_t w = span_step(start.w, step.w, i) >> 15;
+                if (w == 0)
+                {
+                    division_by_zero |= i < count;
+                    chunk.s[i] = 0;
+                    chunk.t[i] = 0;
+                }
+                else
+                {
+                    chunk.s[i] = (s / w) >> 5;
+                    chunk.t[i] = (t / w) >> 5;
+                }
+            }
+        }
+        return division_by_zero;
+    }
+
+#if HYDRA_SIMD_AVAILABLE
+    // The value of an attribute in each lane, the second vector is 4 pixels further
+    inline void span_lanes(int32_t start, int32_t step, __m128i (&lanes)[2])
+    {
+        __m128i steps = _mm_set1_epi32(step);
+        lanes[0] = _mm_add_epi32(_mm_set1_epi32(start),
+                                 _mm_mullo_epi32(steps, _mm_setr_epi32(0, 1, 2, 3)));
+        lanes[1] = _mm_add_epi32(lanes[0], _mm_slli_epi32(steps, 2));
+    }
+
+    inline __m128i span_color_clamp_sse(__m128i value)
+    {
+        __m128i color = _mm_srai_epi32(value, 16);
+        __m128i range = _mm_and_si128(color, _mm_set1_epi32(0x180));
+        __m128i saturate = _mm_cmpeq_epi32(range, _mm_set1_epi32(0x100));
+        __m128i underflow = _mm_cmpeq_epi32(range, _mm_set1_epi32(0x180));
+        __m128i low = _mm_and_si128(color, _mm_set1_epi32(0xFF));
+        return _mm_or_si128(_mm_andnot_si128(_mm_or_si128(saturate, underflow), low),
+                            _mm_and_si128(saturate, _mm_set1_epi32(0xFF)));
+    }
+
+    inline __m128i span_z_correct_sse(__m128i value)
+    {
+        __m128i z = _mm_srli_epi32(
+            _mm_and_si128(_mm_srai_epi32(value, 10), _mm_set1_epi32(0x3f'ffff)), 3);
+        __m128i range = _mm_and_si128(z, _mm_set1_epi32(0x60000));
+        __m128i saturate = _mm_cmpeq_epi32(range, _mm_set1_epi32(0x40000));
+        __m128i underflow = _mm_cmpeq_epi32(range, _mm_set1_epi32(0x60000));
+        __m128i low = _mm_and_si128(z, _mm_set1_epi32(0x3ffff));
+        return _mm_or_si128(_mm_andnot_si128(_mm_or_si128(saturate, underflow), low),
+                            _mm_and_si128(saturate, _mm_set1_epi32(0x3ffff)));
+    }
+
+    // Truncating division through doubles, which is exact for 32-bit operands
+    inline __m128i span_divide_sse(__m128i dividend, __m128i divisor)
+    {
+        __m128d low = _mm_div_pd(_mm_cvtepi32_pd(dividend), _mm_cvtepi32_pd(divisor));
+        __m128d high = _mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(dividend, 8)),
+                                  _mm_cvtepi32_pd(_mm_srli_si128(divisor, 8)));
+        return _mm_unpacklo_epi64(_mm_cvttpd_epi32(low), _mm_cvttpd_epi32(high));
+    }
+
+    template <bool Shade, bool Depth, bool Texture>
+    bool interpolate_span_sse(const SpanAttributes& start, const SpanAttributes& step,
+                              bool perspective, int count, SpanChunk& chunk)
+    {
+        int zero_lanes = 0;
+        if constexpr (Shade)
+        {
+            __m128i r[2], g[2], b[2], a[2];
+            span_lanes(start.r, step.r, r);
+            span_lanes(start.g, step.g, g);
+            span_lanes(start.b, step.b, b);
+            span_lanes(start.a, step.a, a);
+            for (int i = 0; i < 2; i++)
+            {
+                __m128i alpha = span_color_clamp_sse(a[i]);
+                __m128i shade = _mm_or_si128(
+                    _mm_or_si128(span_color_clamp_sse(r[i]),
+                                 _mm_slli_epi32(span_color_clamp_sse(g[i]), 8)),
+                    _mm_or_si128(_mm_slli_epi32(span_color_clamp_sse(b[i]), 16),
+                                 _mm_slli_epi32(alpha, 24)));
+                _mm_store_si128(reinterpret_cast<__m128i*>(&chunk.shade[i * 4]), shade);
+                _mm_store_si128(reinterpret_cast<__m128i*>(&chunk.shade_alpha[i * 4]),
+                                _mm_mullo_epi32(alpha, _mm_set1_epi32(0x01010101)));
+            }
+        }
+
+        if constexpr (Depth)
+        {
+            __m128i z[2];
+            span_lanes(start.z, step.z, z);
+            for (int i = 0; i < 2; i++)
+            {
+                _mm_store_si128(reinterpret_cast<__m128i*>(&chunk.z[i * 4]),
+                                span_z_correct_sse(z[i]));
+            }
+        }
+
+        if constexpr (Texture)
+        {
+            __m128i s[2], t[2], w[2];
+            span_lanes(start.s, step.s, s);
+            span_lanes(start.t, step.t, t);
+            span_lanes(start.w, step.w, w);
+            for (int i = 0; i < 2; i++)
+            {
+                __m128i s_cur, t_cur;
+                if (perspective)
+                {
+                    __m128i divisor = _mm_srai_epi32(w[i], 15);
+                    __m128i zero = _mm_cmpeq_epi32(divisor, _mm_setzero_si128());
+                    divisor = _mm_or_si128(divisor, _mm_and_si128(zero, _mm_set1_epi32(1)));
+                    s_cur = _mm_andnot_si128(
+                        zero, _mm_srai_epi32(span_divide_sse(s[i], divisor), 5));
+                    t_cur = _mm_andnot_si128(
+                        zero, _mm_srai_epi32(span_divide_sse(t[i], divisor), 5));
+                    zero_lanes |= _mm_movemask_ps(_mm_castsi128_ps(zero)) << (i * 4);
+                }
+                else
+                {
+                    s_cur = _mm_srai_epi32(_mm_slli_epi32(s[i], 16), 31);
+                    t_cur = _mm_srai_epi32(_mm_slli_epi32(t[i], 16), 31);
+                }
+                _mm_store_si128(reinterpret_cast<__m128i*>(&chunk.s[i * 4]), s_cur);
+                _mm_store_si128(reinterpret_cast<__m128i*>(&chunk.t[i * 4]), t_cur);
+            }
+        }
+
+        int lanes = (1 << std::clamp(count, 0, RDP_SPAN_CHUNK)) - 1;
+        return zero_lanes & lanes;
+    }
+#endif
+
+    template <bool Shade, bool Depth, bool Texture>
+    bool interpolate_span(const SpanAttributes& start, const SpanAttributes& step,
+                          bool perspective, int count, SpanChunk& chunk)
+    {
+#if HYDRA_SIMD_AVAILABLE
+        return interpolate_span_sse<Shade, Depth, Texture>(start, step, perspective, count,
+                                                            chunk);
+#else
+        return interpolate_span_scalar<Shade, Depth, Texture>(start, step, perspective, count,
+                                                               chunk);
+#endif
+    }
+
+    inline void fill_span32(uint32_t* dst, int count, uint32_t color)
+    {
+        int i = 0;
+#if HYDRA_SIMD_AVAILABLE
+        __m128i colors = _mm_set1_epi32(color);
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), colors);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] = color;
+        }
+    }
+
+    // The colors alternate between pixels, starting with first
+    inline void fill_span16(uint16_t* dst, int count, uint16_t first, uint16_t second)
+    {
+        int i = 0;
+#if HYDRA_SIMD_AVAILABLE
+        __m128i colors = _mm_set1_epi32(first | (second << 16));
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), colors);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] = i & 1 ? second : first;
+        }
+    }
+} // namespace hydra::N64
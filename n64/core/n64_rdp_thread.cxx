@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <n64/core/n64_rdp.hxx>
+#include <n64/core/n64_rdp_commands.hxx>
+#include <n64/core/n64_rdp_thread.hxx>
+
+namespace hydra::N64
+{
+    RDPThread::RDPThread(RDP& rdp) : rdp_(rdp), ring_(std::make_unique<uint64_t[]>(RING_SIZE))
+    {
+        thread_ = std::thread([this]() { loop(); });
+    }
+
+    RDPThread::~RDPThread()
+    {
+        Sync();
+        stop_ = true;
+        head_.fetch_add(1, std::memory_order_release);
+        head_.notify_one();
+        thread_.join();
+    }
+
+    void RDPThread::Push(const uint64_t* command, uint32_t length)
+    {
+        track(command);
+        // Nothing reads past the longest command, so neither does the RDP thread
+        length = std::min<uint32_t>(length, RDP_MAX_COMMAND_LENGTH);
+        // Every command is preceded by its length, so the RDP thread doesn't need to decode
+        // it to know where the next one starts
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        while (push_ + length + 1 - tail > RING_SIZE)
+        {
+            Publish();
+            tail_.wait(tail, std::memory_order_acquire);
+            tail = tail_.load(std::memory_order_acquire);
+        }
+        ring_[push_++ & (RING_SIZE - 1)] = length;
+        for (uint32_t i = 0; i < length; i++)
+        {
+            ring_[push_++ & (RING_SIZE - 1)] = command[i];
+        }
+    }
+
+    void RDPThread::Publish()
+    {
+        if (head_.load(std::memory_order_relaxed) != push_)
+        {
+            head_.store(push_, std::memory_order_release);
+            head_.notify_one();
+        }
+    }
+
+    void RDPThread::Sync()
+    {
+        Publish();
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        while (tail != push_)
+        {
+            tail_.wait(tail, std::memory_order_acquire);
+            tail = tail_.load(std::memory_order_acquire);
+        }
+        written_.Clear();
+        read_.Clear();
+    }
+
+    bool RDPThread::IsPending(uint32_t paddr, uint32_t length, bool write) const
+    {
+        // Pairs with the release in Publish, so the pages of every command the RDP thread can
+        // see are visible here even when the RSP thread queued them
+        head_.load(std::memory_order_acquire);
+        return written_.Contains(paddr, length) || (write && read_.Contains(paddr, length));
+    }
+
+    void RDPThread::loop()
+    {
+        uint32_t tail = 0;
+        while (true)
+        {
+            head_.wait(tail, std::memory_order_acquire);
+            if (stop_)
+            {
+                return;
+            }
+            uint32_t head = head_.load(std::memory_order_acquire);
+            while (tail != head)
+            {
+                uint32_t length = ring_[tail++ & (RING_SIZE - 1)];
+                for (uint32_t i = 0; i < length; i++)
+                {
+                    command_[i] = ring_[tail++ & (RING_SIZE - 1)];
+                }
+                rdp_.execute_command(std::span<const uint64_t>(command_.data(), length));
+                tail_.store(tail, std::memory_order_release);
+                tail_.notify_one();
+            }
+        }
+    }
+
+    void RDPThread::track(const uint64_t* command)
+    {
+        auto type = static_cast<RDPCommandType>((command[0] >> 56) & 0b111111);
+        switch (type)
+        {
+            case RDPCommandType::SetColorImage:
+            {
+                SetColorImageCommand color_image;
+                color_image.full = command[0];
+                state_.color_address = color_image.dram_address;
+                state_.color_width = color_image.width + 1;
+                state_.color_bits = 4 << color_image.size;
+                break;
+            }
+            case RDPCommandType::SetZImage:
+            {
+                state_.depth_address = command[0] & 0x1FFFFFF;
+                break;
+            }
+            case RDPCommandType::SetScissor:
+            {
+                SetScissorCommand scissor;
+                scissor.full = command[0];
+                state_.scissor_xl = scissor.XL >> 2;
+                state_.scissor_yl = scissor.YL >> 2;
+                break;
+            }
+            case RDPCommandType::SetOtherModes:
+            {
+                SetOtherModesCommand other_modes;
+                other_modes.full = command[0];
+                state_.z_compare = other_modes.z_compare_en;
+                state_.z_update = other_modes.z_update_en;
+                break;
+            }
+            case RDPCommandType::SetTextureImage:
+            {
+                SetTextureImageCommand texture_image;
+                texture_image.full = command[0];
+                state_.texture_address = texture_image.DRAMAddress;
+                state_.texture_width = texture_image.width + 1;
+                state_.texture_bits = 4 << texture_image.size;
+                break;
+            }
+            case RDPCommandType::Triangle:
+            case RDPCommandType::TriangleDepth:
+            case RDPCommandType::TriangleTexture:
+            case RDPCommandType::TriangleTextureDepth:
+            case RDPCommandType::TriangleShade:
+            case RDPCommandType::TriangleShadeDepth:
+            case RDPCommandType::TriangleShadeTexture:
+            case RDPCommandType::TriangleShadeTextureDepth:
+            case RDPCommandType::Rectangle:
+            case RDPCommandType::TextureRectangle:
+            case RDPCommandType::TextureRectangleFlip:
+            {
+                // Everything above the bottom of the scissor box, plus the columns that spill
+                // into the next row when the box is wider than the image
+                uint32_t pixels =
+                    (state_.scissor_yl + 1) * state_.color_width + state_.scissor_xl + 1;
+                uint32_t color_end = state_.color_address + (pixels * state_.color_bits + 7) / 8;
+                mark(written_, state_.color_address, color_end + 4);
+                uint32_t depth_end = state_.depth_address + pixels * 2;
+                if (state_.z_update)
+                {
+                    mark(written_, state_.depth_address, depth_end);
+                }
+                else if (state_.z_compare)
+                {
+                    mark(read_, state_.depth_address, depth_end);
+                }
+                break;
+            }
+            case RDPCommandType::LoadTile:
+            case RDPCommandType::LoadTLUT:
+            case RDPCommandType::LoadBlock:
+            {
+                auto [start, end] =
+                    get_texture_load_range(type, command[0], state_.texture_address,
+                                           state_.texture_width, state_.texture_bits);
+                mark(read_, start, end);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void RDPThread::mark(RDRAMPageSet& pages, uint32_t start, uint32_t end)
+    {
+        if (end > start)
+        {
+            pages.Mark(start, end - start);
+        }
+    }
+} // namespace hydra::N64
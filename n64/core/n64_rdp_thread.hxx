@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <n64/core/n64_rdp_commands.hxx>
+#include <n64/core/n64_rdram.hxx>
+#include <thread>
+
+namespace hydra::N64
+{
+    class RDP;
+
+    /**
+        Runs the RDP on a host thread of its own
+
+        Whoever writes DP_END, the CPU or the RSP, copies the command words into a single
+        producer single consumer ring and carries on while the RDP thread decodes and renders
+        them. The producer keeps track of the RDRAM pages the queued commands will read and
+        write, and only waits for the RDP thread when something is about to touch one of those,
+        on SyncFull, and between frames before the VI scans out the framebuffer.
+
+        Like with the RSP thread, the pages the RDP writes are marked in a dirty map of its own
+        that is merged into the shared one when the producer waits for the RDP thread.
+    */
+    class RDPThread final
+    {
+    public:
+        RDPThread(RDP& rdp);
+        ~RDPThread();
+
+        // Queues a command, the RDP thread doesn't see it before the next Publish
+        void Push(const uint64_t* command, uint32_t length);
+        void Publish();
+        // Waits until every queued command was executed
+        void Sync();
+
+        // Whether a published command writes the range, or also reads it if write is set. The
+        // producer can't be in the middle of queueing more, the CPU thread waits for the RSP
+        // slice in flight before asking
+        bool IsPending(uint32_t paddr, uint32_t length, bool write) const;
+
+        RDRAMDirtyMap& DirtyMap()
+        {
+            return dirty_map_;
+        }
+
+    private:
+        static constexpr uint32_t RING_SIZE = 0x10000;
+
+        RDP& rdp_;
+        std::unique_ptr<uint64_t[]> ring_;
+        // Where the producer writes next, ahead of head_ until it's published
+        uint32_t push_ = 0;
+        std::atomic<uint32_t> head_{0};
+        std::atomic<uint32_t> tail_{0};
+        std::atomic<bool> stop_{false};
+        std::array<uint64_t, RDP_MAX_COMMAND_LENGTH> command_;
+        RDRAMDirtyMap dirty_map_;
+
+        // Pages queued commands write to and read from. Marked before the commands are
+        // published with head_, which is what makes them visible to the CPU thread when the
+        // RSP thread is the producer
+        RDRAMPageSet written_;
+        RDRAMPageSet read_;
+
+        // The little of the RDP state the producer needs to know which pages a command touches
+        struct
+        {
+            uint32_t color_address = 0;
+            uint32_t color_width = 0;
+            uint32_t color_bits = 0;
+            uint32_t depth_address = 0;
+            uint32_t scissor_xl = 0;
+            uint32_t scissor_yl = 0;
+            bool z_compare = false;
+            bool z_update = false;
+            uint32_t texture_address = 0;
+            uint32_t texture_width = 0;
+            uint32_t texture_bits = 0;
+        } state_;
+
+        std::thread thread_;
+
+        void loop();
+        void track(const uint64_t* command);
+        static void mark(RDRAMPageSet& pages, uint32_t start, uint32_t end);
+    };
+} // namespace hydra::N64
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <log.hxx>
+#include <n64/core/n64_rdp_trace.hxx>
+#include <n64/core/n64_rdram.hxx>
+
+namespace hydra::N64
+{
+    namespace
+    {
+        template <class T>
+        void put(std::ofstream& file, const T& value)
+        {
+            file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <class T>
+        bool get(const std::vector<uint8_t>& data, size_t& offset, T& value)
+        {
+            if (data.size() - offset < sizeof(T))
+            {
+                return false;
+            }
+            std::memcpy(&value, data.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        }
+    } // namespace
+
+    RDPTraceWriter::RDPTraceWriter(const uint8_t* rdram)
+        : rdram_(rdram), shadow_(RDRAM_EXPANSION_SIZE),
+          written_(RDRAM_EXPANSION_SIZE >> PAGE_SHIFT),
+          in_frame_(RDRAM_EXPANSION_SIZE >> PAGE_SHIFT)
+    {
+    }
+
+    bool RDPTraceWriter::Open(const std::string& path)
+    {
+        file_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file_.is_open())
+        {
+            Logger::Warn("Could not create RDP trace {}", path);
+            return false;
+        }
+        file_.write(RDP_TRACE_MAGIC, sizeof(RDP_TRACE_MAGIC));
+        put(file_, RDP_TRACE_VERSION);
+        return true;
+    }
+
+    void RDPTraceWriter::Command(std::span<const uint64_t> command)
+    {
+        put(file_, RDPTraceRecordType::Command);
+        put(file_, static_cast<uint8_t>(command.size()));
+        file_.write(reinterpret_cast<const char*>(command.data()), command.size_bytes());
+    }
+
+    void RDPTraceWriter::Read(uint32_t start, uint32_t end)
+    {
+        end = std::min(end, RDRAM_EXPANSION_SIZE);
+        if (end <= start)
+        {
+            return;
+        }
+
+        // Neighbouring pages go in the same record
+        uint32_t last = (end - 1) >> PAGE_SHIFT;
+        uint32_t first = 0, pages = 0;
+        for (uint32_t page = start >> PAGE_SHIFT; page <= last; page++)
+        {
+            if (!needs_page(page))
+            {
+                continue;
+            }
+            if (pages != 0 && first + pages != page)
+            {
+                memory(first, pages);
+                pages = 0;
+            }
+            if (pages == 0)
+            {
+                first = page;
+            }
+            pages++;
+        }
+        if (pages != 0)
+        {
+            memory(first, pages);
+        }
+    }
+
+    void RDPTraceWriter::Written(uint32_t start, uint32_t end)
+    {
+        end = std::min(end, RDRAM_EXPANSION_SIZE);
+        if (end <= start)
+        {
+            return;
+        }
+        uint32_t last = (end - 1) >> PAGE_SHIFT;
+        for (uint32_t page = start >> PAGE_SHIFT; page <= last; page++)
+        {
+            written_[page] = true;
+        }
+    }
+
+    void RDPTraceWriter::Frame()
+    {
+        put(file_, RDPTraceRecordType::Frame);
+        std::fill(in_frame_.begin(), in_frame_.end(), false);
+    }
+
+    bool RDPTraceWriter::needs_page(uint32_t page)
+    {
+        // What the RDP drew in the page the replay draws too, what matters is whatever else
+        // was written there since, which is only looked for once a frame
+        if (written_[page])
+        {
+            return !in_frame_[page];
+        }
+        uint32_t offset = page << PAGE_SHIFT;
+        return std::memcmp(rdram_ + offset, shadow_.data() + offset, PAGE_SIZE) != 0;
+    }
+
+    void RDPTraceWriter::memory(uint32_t first_page, uint32_t pages)
+    {
+        uint32_t address = first_page << PAGE_SHIFT;
+        uint32_t size = pages << PAGE_SHIFT;
+        put(file_, RDPTraceRecordType::Memory);
+        put(file_, address);
+        put(file_, size);
+        file_.write(reinterpret_cast<const char*>(rdram_ + address), size);
+        std::memcpy(shadow_.data() + address, rdram_ + address, size);
+        for (uint32_t page = first_page; page < first_page + pages; page++)
+        {
+            written_[page] = false;
+            in_frame_[page] = true;
+        }
+    }
+
+    bool RDPTraceReader::Load(const std::string& path)
+    {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        if (!ifs.is_open())
+        {
+            Logger::Warn("Could not open RDP trace {}", path);
+            return false;
+        }
+        std::vector<uint8_t> data{std::istreambuf_iterator<char>(ifs),
+                                  std::istreambuf_iterator<char>()};
+
+        records_.clear();
+        words_.clear();
+        bytes_.clear();
+        frames_ = 0;
+
+        size_t offset = 0;
+        char magic[sizeof(RDP_TRACE_MAGIC)];
+        uint32_t version = 0;
+        if (!get(data, offset, magic) ||
+            std::memcmp(magic, RDP_TRACE_MAGIC, sizeof(RDP_TRACE_MAGIC)) != 0 ||
+            !get(data, offset, version) || version != RDP_TRACE_VERSION)
+        {
+            Logger::Warn("{} is not a RDP trace of version {}", path, RDP_TRACE_VERSION);
+            return false;
+        }
+
+        while (offset != data.size())
+        {
+            Record record{};
+            bool valid = get(data, offset, record.type);
+            switch (record.type)
+            {
+                case RDPTraceRecordType::Command:
+                {
+                    uint8_t length = 0;
+                    valid = valid && get(data, offset, length);
+                    record.offset = words_.size();
+                    record.size = length;
+                    for (uint8_t i = 0; valid && i < length; i++)
+                    {
+                        uint64_t word = 0;
+                        valid = get(data, offset, word);
+                        words_.push_back(word);
+                    }
+                    break;
+                }
+                case RDPTraceRecordType::Memory:
+                {
+                    valid = valid && get(data, offset, record.address) &&
+                            get(data, offset, record.size) &&
+                            data.size() - offset >= record.size &&
+                            record.address <= RDRAM_EXPANSION_SIZE &&
+                            record.size <= RDRAM_EXPANSION_SIZE - record.address;
+                    if (valid)
+                    {
+                        record.offset = bytes_.size();
+                        bytes_.insert(bytes_.end(), data.begin() + offset,
+                                      data.begin() + offset + record.size);
+                        offset += record.size;
+                    }
+                    break;
+                }
+                case RDPTraceRecordType::Frame:
+                {
+                    frames_++;
+                    break;
+                }
+                default:
+                {
+                    valid = false;
+                    break;
+                }
+            }
+
+            if (!valid)
+            {
+                Logger::Warn("RDP trace {} is corrupt at offset {}", path, offset);
+                return false;
+            }
+            records_.push_back(record);
+        }
+        return true;
+    }
+} // namespace hydra::N64
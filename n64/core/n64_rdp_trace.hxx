@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace hydra::N64
+{
+    constexpr char RDP_TRACE_MAGIC[8] = {'H', 'Y', 'D', 'R', 'D', 'P', 'T', 'R'};
+    constexpr uint32_t RDP_TRACE_VERSION = 1;
+
+    enum class RDPTraceRecordType : uint8_t
+    {
+        // Command words as the RDP executes them
+        Command,
+        // RDRAM contents the next commands read
+        Memory,
+        // The end of a VI frame
+        Frame,
+    };
+
+    /**
+        Writes the commands the RDP executes to a file, along with the RDRAM they read
+
+        A trace starts with RDP_TRACE_MAGIC and RDP_TRACE_VERSION and goes on with records, each
+        one a RDPTraceRecordType byte followed by:
+        - Command: the length in words as a byte, then the words
+        - Memory: the address and size as 32-bit words, then the bytes
+        - Frame: nothing
+        Everything is in host byte order, the RDRAM bytes are as the RDP sees them.
+
+        Replaying starts from a reset RDP and zeroed RDRAM, so a trace has to start before the
+        first command. RDRAM is written in pages, only the pages commands read and only when the
+        replay would have something else in them: pages the RDP wrote to are written once per
+        frame before they're read, other pages every time they changed since they were last
+        written. Writes to pages the RDP drew into that happen in the middle of a frame are
+        missed.
+    */
+    class RDPTraceWriter final
+    {
+    public:
+        RDPTraceWriter(const uint8_t* rdram);
+
+        bool Open(const std::string& path);
+        void Command(std::span<const uint64_t> command);
+        // The next command reads the range
+        void Read(uint32_t start, uint32_t end);
+        // The last command wrote to the range
+        void Written(uint32_t start, uint32_t end);
+        void Frame();
+
+    private:
+        static constexpr uint32_t PAGE_SHIFT = 12;
+        static constexpr uint32_t PAGE_SIZE = 1u << PAGE_SHIFT;
+
+        const uint8_t* rdram_;
+        std::ofstream file_;
+        // RDRAM as the replay has it when it last got the page
+        std::vector<uint8_t> shadow_;
+        std::vector<bool> written_;
+        std::vector<bool> in_frame_;
+
+        bool needs_page(uint32_t page);
+        void memory(uint32_t first_page, uint32_t pages);
+    };
+
+    // A whole trace loaded in memory, see RDPTraceWriter for the format
+    class RDPTraceReader final
+    {
+    public:
+        struct Record
+        {
+            RDPTraceRecordType type;
+            // Only used by Memory records
+            uint32_t address;
+            // Into the command words or memory bytes
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        bool Load(const std::string& path);
+
+        const std::vector<Record>& Records() const
+        {
+            return records_;
+        }
+
+        std::span<const uint64_t> Command(const Record& record) const
+        {
+            return {words_.data() + record.offset, record.size};
+        }
+
+        std::span<const uint8_t> Memory(const Record& record) const
+        {
+            return {bytes_.data() + record.offset, record.size};
+        }
+
+        uint32_t Frames() const
+        {
+            return frames_;
+        }
+
+    private:
+        std::vector<Record> records_;
+        std::vector<uint64_t> words_;
+        std::vector<uint8_t> bytes_;
+        uint32_t frames_ = 0;
+    };
+} // namespace hydra::N64
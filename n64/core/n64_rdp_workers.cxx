@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <n64/core/n64_rdp_workers.hxx>
+
+namespace hydra::N64
+{
+    // Same limit as angrylion
+    constexpr uint32_t RDP_MAX_WORKERS = 64;
+
+    RDPWorkers::RDPWorkers(uint32_t count)
+    {
+        if (count == 0)
+        {
+            count = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        count_ = std::min(count, RDP_MAX_WORKERS);
+        for (uint32_t worker = 1; worker < count_; worker++)
+        {
+            threads_.emplace_back([this, worker]() { loop(worker); });
+        }
+    }
+
+    RDPWorkers::~RDPWorkers()
+    {
+        stop_ = true;
+        generation_.fetch_add(1, std::memory_order_release);
+        generation_.notify_all();
+        for (auto& thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    void RDPWorkers::Run(const std::function<void(uint32_t)>& task)
+    {
+        if (count_ == 1)
+        {
+            task(0);
+            return;
+        }
+
+        task_ = &task;
+        remaining_.store(count_ - 1, std::memory_order_relaxed);
+        generation_.fetch_add(1, std::memory_order_release);
+        generation_.notify_all();
+
+        task(0);
+
+        uint32_t remaining = remaining_.load(std::memory_order_acquire);
+        while (remaining != 0)
+        {
+            remaining_.wait(remaining, std::memory_order_acquire);
+            remaining = remaining_.load(std::memory_order_acquire);
+        }
+    }
+
+    void RDPWorkers::loop(uint32_t worker)
+    {
+        uint32_t generation = 0;
+        while (true)
+        {
+            generation_.wait(generation, std::memory_order_acquire);
+            generation = generation_.load(std::memory_order_acquire);
+            if (stop_)
+            {
+                return;
+            }
+            (*task_)(worker);
+            if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                remaining_.notify_one();
+            }
+        }
+    }
+} // namespace hydra::N64
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace hydra::N64
+{
+    /**
+        A fixed pool of threads the RDP hands the bands of a primitive to
+
+        Modelled after the worker pool in angrylion-rdp-plus. Run gives every worker the same
+        task along with its index and returns once all of them are done. The calling thread is
+        worker 0, so a pool of one worker has no threads at all.
+    */
+    class RDPWorkers final
+    {
+    public:
+        // 0 picks one worker per hardware thread
+        RDPWorkers(uint32_t count);
+        ~RDPWorkers();
+
+        void Run(const std::function<void(uint32_t)>& task);
+
+        uint32_t Count() const
+        {
+            return count_;
+        }
+
+    private:
+        uint32_t count_;
+        std::vector<std::thread> threads_;
+        const std::function<void(uint32_t)>* task_ = nullptr;
+        // Bumped by Run to wake the workers up, a worker that finds it unchanged keeps sleeping
+        std::atomic<uint32_t> generation_{0};
+        std::atomic<uint32_t> remaining_{0};
+        bool stop_ = false;
+
+        void loop(uint32_t worker);
+    };
+} // namespace hydra::N64
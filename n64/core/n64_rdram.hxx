@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace hydra::N64
+{
+    // Without the Expansion Pak only the first half is there. Storage is always allocated for
+    // the larger size so the raw pointers the RCP holds never point past the end
+    constexpr uint32_t RDRAM_SIZE = 0x40'0000;
+    constexpr uint32_t RDRAM_EXPANSION_SIZE = 0x80'0000;
+
+    enum class DirtyConsumer
+    {
+        // VI skips converting a framebuffer nothing wrote to
+        Framebuffer,
+        Count,
+    };
+
+    /**
+        One dirty bit for every 64KB of RDRAM
+
+        Everything that writes to RDRAM (CPU stores, PI/SI DMA, RSP DMA, the RDP) calls Mark,
+        which sets a bit in a single shared bitmap so that it stays a couple of instructions.
+        Every consumer has its own copy of the bitmap that the shared one is folded into when
+        it asks, so consumers clear their bits without hiding writes from each other.
+
+        Addresses wrap around instead of being checked, marking too much is harmless
+    */
+    class RDRAMDirtyMap final
+    {
+    public:
+        static constexpr uint32_t PAGE_SHIFT = 16;
+        static constexpr uint32_t PAGE_SIZE = 1u << PAGE_SHIFT;
+        static constexpr uint32_t PAGE_COUNT = RDRAM_EXPANSION_SIZE >> PAGE_SHIFT;
+        static constexpr uint32_t WORD_COUNT = PAGE_COUNT / 64;
+
+        void Mark(uint32_t paddr)
+        {
+            uint32_t page = (paddr >> PAGE_SHIFT) & (PAGE_COUNT - 1);
+            written_[page >> 6] |= 1ull << (page & 63);
+        }
+
+        void Mark(uint32_t paddr, uint32_t length)
+        {
+            if (length == 0) [[unlikely]]
+            {
+                return;
+            }
+            uint32_t first = paddr >> PAGE_SHIFT;
+            uint32_t last = (paddr + length - 1) >> PAGE_SHIFT;
+            if (last - first >= PAGE_COUNT) [[unlikely]]
+            {
+                MarkAll();
+                return;
+            }
+            for (uint32_t page = first; page <= last; page++)
+            {
+                Mark(page << PAGE_SHIFT);
+            }
+        }
+
+        void MarkAll()
+        {
+            written_.fill(~0ull);
+        }
+
+        // Marks everything other has marked and empties it, for writers that collect their
+        // marks on another thread
+        void Merge(RDRAMDirtyMap& other)
+        {
+            for (uint32_t i = 0; i < WORD_COUNT; i++)
+            {
+                written_[i] |= other.written_[i];
+                other.written_[i] = 0;
+            }
+        }
+
+        // Whether anything in the range was written since consumer last cleared it
+        bool IsDirty(DirtyConsumer consumer, uint32_t paddr, uint32_t length)
+        {
+            return scan(consumer, paddr, length, false);
+        }
+
+        bool TestAndClear(DirtyConsumer consumer, uint32_t paddr, uint32_t length)
+        {
+            return scan(consumer, paddr, length, true);
+        }
+
+        void Clear(DirtyConsumer consumer)
+        {
+            fold();
+            dirty_[static_cast<size_t>(consumer)].fill(0);
+        }
+
+        // Calls func with the index of every page dirty for consumer and clears them
+        template <class Func>
+        void ForEachDirty(DirtyConsumer consumer, Func&& func)
+        {
+            fold();
+            auto& words = dirty_[static_cast<size_t>(consumer)];
+            for (uint32_t i = 0; i < WORD_COUNT; i++)
+            {
+                uint64_t word = words[i];
+                words[i] = 0;
+                while (word)
+                {
+                    func(i * 64 + std::countr_zero(word));
+                    word &= word - 1;
+                }
+            }
+        }
+
+        // Used by the recompiler to set bits straight from emitted code
+        uint64_t* Data()
+        {
+            return written_.data();
+        }
+
+    private:
+        using Bitmap = std::array<uint64_t, WORD_COUNT>;
+
+        Bitmap written_{};
+        std::array<Bitmap, static_cast<size_t>(DirtyConsumer::Count)> dirty_{};
+
+        void fold()
+        {
+            for (uint32_t i = 0; i < WORD_COUNT; i++)
+            {
+                if (written_[i])
+                {
+                    for (auto& bitmap : dirty_)
+                    {
+                        bitmap[i] |= written_[i];
+                    }
+                    written_[i] = 0;
+                }
+            }
+        }
+
+        bool scan(DirtyConsumer consumer, uint32_t paddr, uint32_t length, bool clear)
+        {
+            fold();
+            auto& words = dirty_[static_cast<size_t>(consumer)];
+            if (length == 0)
+            {
+                return false;
+            }
+            uint32_t first = paddr >> PAGE_SHIFT;
+            uint32_t last = (paddr + length - 1) >> PAGE_SHIFT;
+            if (last - first >= PAGE_COUNT)
+            {
+                last = first + PAGE_COUNT - 1;
+            }
+            bool dirty = false;
+            for (uint32_t i = first; i <= last; i++)
+            {
+                uint32_t page = i & (PAGE_COUNT - 1);
+                uint64_t bit = 1ull << (page & 63);
+                dirty |= (words[page >> 6] & bit) != 0;
+                if (clear)
+                {
+                    words[page >> 6] &= ~bit;
+                }
+            }
+            return dirty;
+        }
+    };
+
+    /**
+        A set of RDRAM pages one thread marks while another checks them
+
+        Used for the pages the RSP and RDP threads are about to read or write, so the CPU thread
+        knows when it has to wait for them. Same granularity as RDRAMDirtyMap
+    */
+    class RDRAMPageSet final
+    {
+    public:
+        void Mark(uint32_t paddr, uint32_t length)
+        {
+            if (length == 0)
+            {
+                return;
+            }
+            uint32_t first = paddr >> RDRAMDirtyMap::PAGE_SHIFT;
+            uint32_t last = (paddr + length - 1) >> RDRAMDirtyMap::PAGE_SHIFT;
+            last = std::min(last, first + RDRAMDirtyMap::PAGE_COUNT - 1);
+            for (uint32_t i = first; i <= last; i++)
+            {
+                uint32_t page = i & (RDRAMDirtyMap::PAGE_COUNT - 1);
+                words_[page >> 6].fetch_or(1ull << (page & 63), std::memory_order_relaxed);
+            }
+        }
+
+        bool Contains(uint32_t paddr, uint32_t length) const
+        {
+            if (length == 0)
+            {
+                return false;
+            }
+            uint32_t first = paddr >> RDRAMDirtyMap::PAGE_SHIFT;
+            uint32_t last = (paddr + length - 1) >> RDRAMDirtyMap::PAGE_SHIFT;
+            last = std::min(last, first + RDRAMDirtyMap::PAGE_COUNT - 1);
+            for (uint32_t i = first; i <= last; i++)
+            {
+                uint32_t page = i & (RDRAMDirtyMap::PAGE_COUNT - 1);
+                if (words_[page >> 6].load(std::memory_order_relaxed) & (1ull << (page & 63)))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Clear()
+        {
+            for (auto& word : words_)
+            {
+                word.store(0, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, RDRAMDirtyMap::WORD_COUNT> words_{};
+    };
+} // namespace hydra::N64
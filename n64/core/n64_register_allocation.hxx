@@ -1,16 +1,17 @@
 #pragma once
 
 #include <array>
-#include <xbyak/xbyak.h>
+#include <n64/core/n64_x64_emitter.hxx>
 
-using namespace Xbyak;
-using namespace Xbyak::util;
+using namespace hydra::N64::x64;
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
 static_assert(false && "Whoopsies");
 #else
 constexpr Reg64 RegisterPointer = rbp;
 constexpr Reg64 PcPointer = rbx;
+// The VR4300 recompiler keeps the CPU object here and addresses pc_ and friends relative to it
+constexpr Reg64 StatePointer = rbx;
 constexpr std::array<Reg64, 8> allocateableRegisters = {r8, r9, r10, r11, r12, r13, r14, r15};
 constexpr std::array<Reg64, 4> Volatiles = {r8, r9, r10, r11};
 constexpr std::array<Reg64, 4> NonVolatiles = {r12, r13, r14, r15};
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <compatibility.hxx>
 #include <fmt/format.h>
 #include <fstream>
@@ -5,6 +6,7 @@
 #include <iostream>
 #include <log.hxx>
 #include <n64/core/n64_addresses.hxx>
+#include <n64/core/n64_dma.hxx>
 #include <n64/core/n64_rdp.hxx>
 #include <n64/core/n64_rsp.hxx>
 #include <sstream>
@@ -59,18 +61,102 @@ namespace hydra::N64
         printf("\n");
     }
 
+    template <>
+    void RSP::profile_instruction<false>()
+    {
+    }
+
+    template <>
+    void RSP::profile_instruction<true>()
+    {
+        profiler_.Tick(pc_, instruction_.full);
+    }
+
     RSP::RSP()
     {
         status_.halt = true;
+        SetVectorSIMD(true);
     }
 
     void RSP::Reset()
     {
+        Sync();
         pc_ = 0;
         next_pc_ = 4;
         status_.halt = true;
+        status_.dma_busy = false;
         std::fill(mem_.begin(), mem_.end(), 0);
         div_in_ready_ = false;
+        profiler_.Reset();
+        budget_ = 0;
+        if (jit_)
+        {
+            jit_->Reset();
+        }
+        if (hle_)
+        {
+            hle_->Reset();
+        }
+    }
+
+    void RSP::SetBackend(RSPBackend backend)
+    {
+        if (backend == RSPBackend::Dynarec && !N64_JIT_AVAILABLE)
+        {
+            Logger::Warn("The RSP dynarec is only available on x86-64, using the interpreter");
+            backend = RSPBackend::Interpreter;
+        }
+        if (backend == RSPBackend::Dynarec)
+        {
+            if (!jit_)
+            {
+                jit_ = std::make_unique<RSPJit>(*this);
+            }
+        }
+        else
+        {
+            jit_.reset();
+        }
+        budget_ = 0;
+    }
+
+    void RSP::SetVectorSIMD(bool enabled)
+    {
+#if HYDRA_SIMD_AVAILABLE
+        vu_table_ = enabled ? vu_simd_instruction_table_.data() : vu_instruction_table_.data();
+#else
+        (void)enabled;
+        vu_table_ = vu_instruction_table_.data();
+#endif
+        // Recompiled blocks call the handlers directly
+        if (jit_)
+        {
+            jit_->Reset();
+        }
+    }
+
+    void RSP::SetHLE(bool enabled)
+    {
+        if (enabled && !hle_)
+        {
+            hle_ = std::make_unique<RSPHLE>(*this);
+        }
+        else if (!enabled)
+        {
+            hle_.reset();
+        }
+    }
+
+    void RSP::SetThread(bool enabled)
+    {
+        if (enabled && !thread_)
+        {
+            thread_ = std::make_unique<RSPThread>(*this);
+        }
+        else if (!enabled)
+        {
+            thread_.reset();
+        }
     }
 
     void RSP::Tick()
@@ -80,12 +166,69 @@ namespace hydra::N64
         instruction_.full = instruction;
 
         log_cpu_state<RSP_LOGGING>(true, 10000000);
+        profile_instruction<RSP_PROFILING>();
 
         pc_ = next_pc_ & 0xFFF;
         next_pc_ = (pc_ + 4) & 0xFFF;
         execute_instruction();
     }
 
+    void RSP::Run(int instructions)
+    {
+        if (jit_)
+        {
+            return run_recompiled(instructions);
+        }
+        for (int i = 0; i < instructions && !status_.halt; i++)
+        {
+            Tick();
+        }
+    }
+
+    void RSP::RunAsync(int instructions)
+    {
+        if (thread_)
+        {
+            return thread_->Run(instructions);
+        }
+        Run(instructions);
+    }
+
+    void RSP::run_recompiled(int instructions)
+    {
+        budget_ += instructions;
+        while (budget_ > 0 && !status_.halt)
+        {
+            int executed = 0;
+            // Blocks always start at a fresh instruction, a delay slot left pending by the CPU
+            // writing SP_PC or by an interpreted branch finishes in the interpreter
+            if (next_pc_ == ((pc_ + 4) & 0xFFF))
+            {
+                uint32_t entry = pc_;
+                executed = jit_->Run();
+                if constexpr (RSP_PROFILING)
+                {
+                    if (executed != 0)
+                    {
+                        // Only the entry of a recompiled block is known, attribute it all there
+                        profiler_.Tick(entry, EMPTY_INSTRUCTION, executed);
+                    }
+                }
+            }
+            if (executed == 0)
+            {
+                Tick();
+                executed = 1;
+            }
+            budget_ -= executed;
+        }
+        if (status_.halt)
+        {
+            // Time spent halted can't be used to run more later
+            budget_ = std::min(budget_, 0);
+        }
+    }
+
     void RSP::execute_instruction()
     {
         (instruction_table_[instruction_.IType.op])(this);
@@ -161,25 +304,31 @@ namespace hydra::N64
         bytes_per_row = (bytes_per_row + 0x7) & ~0x7;
         uint32_t row_count = (rd_len_ >> 12) & 0xFF;
         uint32_t row_stride = (rd_len_ >> 20) & 0xFFF;
-        auto rdram_index = rdram_addr_ & 0xFFFFF8;
-        auto rsp_index = mem_addr_ & 0xFF8;
-        uint8_t* dest = dma_imem_ ? &mem_[0x1000] : &mem_[0];
-        uint8_t* source = rdram_ptr_;
+        uint32_t rdram_start = rdram_addr_ & 0xFFFFF8;
+        uint32_t rdram_length = (row_count + 1) * (bytes_per_row + row_stride);
+        if (rdp_ptr_)
+        {
+            rdp_ptr_->WaitFor(rdram_start, rdram_length, false);
+        }
+        DMARegion source{rdram_ptr_, rdram_start, RDRAM_EXPANSION_SIZE - 1};
+        DMARegion dest{dma_imem_ ? &mem_[0x1000] : &mem_[0], mem_addr_ & 0xFF8, 0xFFF};
 
         for (uint32_t i = 0; i < row_count + 1; i++)
         {
-            for (uint32_t j = 0; j < bytes_per_row; j++)
-            {
-                dest[rsp_index++] = source[rdram_index++];
-            }
-            rdram_index += row_stride;
-            rdram_index &= 0xFFFFF8;
-            rsp_index &= 0xFF8;
+            DMACopy(dest, source, bytes_per_row);
+            source.address = (source.address + row_stride) & 0xFFFFF8;
+            dest.address &= 0xFF8;
+        }
+
+        if (dma_imem_ && jit_)
+        {
+            uint32_t length = std::min<uint32_t>((row_count + 1) * bytes_per_row, 0x1000);
+            jit_->InvalidateRange(mem_addr_ & 0xFF8, length);
         }
 
-        mem_addr_ = rsp_index;
+        mem_addr_ = dest.address;
         mem_addr_ |= dma_imem_ ? 0x1000 : 0;
-        rdram_addr_ = rdram_index;
+        rdram_addr_ = source.address;
         // After the DMA transfer is finished, this field contains the value 0xFF8
         // The reason is that the field is internally decremented by 8 for each transferred word
         // so the final value will be -8 (in hex, 0xFF8)
@@ -198,25 +347,42 @@ namespace hydra::N64
         bytes_per_row = (bytes_per_row + 0x7) & ~0x7;
         uint32_t row_count = (wr_len_ >> 12) & 0xFF;
         uint32_t row_stride = (wr_len_ >> 20) & 0xFFF;
-        auto rdram_index = rdram_addr_ & 0xFFFFF8;
-        auto rsp_index = mem_addr_ & 0xFF8;
-        uint8_t* dest = rdram_ptr_;
-        uint8_t* source = dma_imem_ ? &mem_[0x1000] : &mem_[0];
+        uint32_t rdram_start = rdram_addr_ & 0xFFFFF8;
+        uint32_t rdram_length = (row_count + 1) * (bytes_per_row + row_stride);
+        if (rdp_ptr_)
+        {
+            rdp_ptr_->WaitFor(rdram_start, rdram_length, true);
+        }
+        DMARegion source{dma_imem_ ? &mem_[0x1000] : &mem_[0], mem_addr_ & 0xFF8, 0xFFF};
+        DMARegion dest{rdram_ptr_, rdram_start, RDRAM_EXPANSION_SIZE - 1};
 
+        // Rows that follow each other are reported as one write
+        uint32_t written_start = dest.address;
+        uint32_t written_length = 0;
         for (uint32_t i = 0; i < row_count + 1; i++)
         {
-            for (uint32_t j = 0; j < bytes_per_row; j++)
+            if (dest.address != written_start + written_length)
             {
-                dest[rdram_index++] = source[rsp_index++];
+                if (rdram_written_)
+                {
+                    rdram_written_(written_start, written_length);
+                }
+                written_start = dest.address;
+                written_length = 0;
             }
-            rdram_index += row_stride;
-            rdram_index &= 0xFFFFF8;
-            rsp_index &= 0xFF8;
+            DMACopy(dest, source, bytes_per_row);
+            written_length += bytes_per_row;
+            dest.address = (dest.address + row_stride) & 0xFFFFF8;
+            source.address &= 0xFF8;
+        }
+        if (rdram_written_)
+        {
+            rdram_written_(written_start, written_length);
         }
 
-        mem_addr_ = rsp_index;
+        mem_addr_ = source.address;
         mem_addr_ |= dma_imem_ ? 0x1000 : 0;
-        rdram_addr_ = rdram_index;
+        rdram_addr_ = dest.address;
         // After the DMA transfer is finished, this field contains the value 0xFF8
         // The reason is that the field is internally decremented by 8 for each transferred word
         // so the final value will be -8 (in hex, 0xFF8)
@@ -280,6 +446,7 @@ namespace hydra::N64
             {
                 RSPStatusWrite sp_write;
                 sp_write.full = data;
+                bool was_halted = status_.halt;
                 if (sp_write.clear_intr && !sp_write.set_intr)
                 {
                     mi_interrupt_->SP = false;
@@ -314,6 +481,11 @@ namespace hydra::N64
                 flag(intr_break);
                 flag(sstep);
 #undef flag
+                // A task starting, which HLE either finishes right here or leaves to the RSP
+                if (hle_ && was_halted && !status_.halt)
+                {
+                    hle_->RunTask();
+                }
                 break;
             }
             case RSPHWIO::CmdStart:
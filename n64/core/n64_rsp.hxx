@@ -1,9 +1,22 @@
 #pragma once
 
+#include <compatibility.hxx>
+#include <functional>
+#include <memory>
+#include <n64/core/n64_profiler.hxx>
+#include <n64/core/n64_rsp_hle.hxx>
+#include <n64/core/n64_rsp_jit.hxx>
+#include <n64/core/n64_rsp_thread.hxx>
 #include <n64/core/n64_types.hxx>
 
 namespace hydra::N64
 {
+    // The RSP runs 2 instructions for every 3 CPU cycles, in batches of this many CPU cycles
+    constexpr uint64_t RSP_SLICE_CYCLES = 96;
+    // Handing a slice to the RSP thread costs more than running 64 instructions, so the slices
+    // it gets are longer
+    constexpr uint64_t RSP_THREAD_SLICE_CYCLES = RSP_SLICE_CYCLES * 32;
+
     enum class RSPHWIO {
         Cache = 0,
         DramAddr = 1,
@@ -30,67 +43,102 @@ namespace hydra::N64
     class RDP;
     using VectorRegister = std::array<uint16_t, 8>;
 
+    struct Accumulator;
+
+    // One lane of the 48-bit accumulator, which is stored split in three vectors
     struct AccumulatorLane
     {
-        void Set(uint64_t new_value)
+        AccumulatorLane(Accumulator& accumulator, int lane)
+            : accumulator_(accumulator), lane_(lane)
         {
-            value_ = new_value & 0xFFFF'FFFF'FFFF;
         }
 
-        void SetHigh(uint16_t new_value)
-        {
-            value_ = (static_cast<uint64_t>(new_value) << 32) | (value_ & 0xFFFF'FFFF);
-        }
+        void Set(uint64_t new_value);
+        void SetHigh(uint16_t new_value);
+        void SetMiddle(uint16_t new_value);
+        void SetLow(uint16_t new_value);
+        uint64_t Get() const;
+        uint16_t GetHigh() const;
+        uint16_t GetMiddle() const;
+        uint16_t GetLow() const;
 
-        void SetMiddle(uint16_t new_value)
+        int64_t GetSigned() const
         {
-            value_ = (static_cast<uint64_t>(new_value) << 16) | (value_ & 0xFFFF'0000'FFFF);
+            return static_cast<int64_t>(Get() << 16) >> 16;
         }
 
-        void SetLow(uint16_t new_value)
+        int16_t GetHighSigned() const
         {
-            value_ = (value_ & 0xFFFF'FFFF'0000) | new_value;
+            return GetHigh();
         }
 
-        uint64_t Get() const
+        void Add(int64_t value)
         {
-            return value_;
+            Set(static_cast<int64_t>(Get()) + value);
         }
 
-        int64_t GetSigned() const
-        {
-            return static_cast<int64_t>(value_ << 16) >> 16;
-        }
+    private:
+        Accumulator& accumulator_;
+        int lane_;
+    };
 
-        uint16_t GetHigh() const
-        {
-            return value_ >> 32;
-        }
+    // Kept as bits 47-32, 31-16 and 15-0 of all 8 lanes so the SIMD kernels can load each part
+    // with a single instruction
+    struct Accumulator
+    {
+        alignas(16) VectorRegister high{};
+        alignas(16) VectorRegister middle{};
+        alignas(16) VectorRegister low{};
 
-        uint16_t GetMiddle() const
+        AccumulatorLane operator[](int lane)
         {
-            return (value_ >> 16) & 0xFFFF;
+            return AccumulatorLane(*this, lane);
         }
+    };
 
-        uint16_t GetLow() const
-        {
-            return value_ & 0xFFFF;
-        }
+    inline void AccumulatorLane::Set(uint64_t new_value)
+    {
+        accumulator_.high[lane_] = new_value >> 32;
+        accumulator_.middle[lane_] = new_value >> 16;
+        accumulator_.low[lane_] = new_value;
+    }
 
-        int16_t GetHighSigned() const
-        {
-            return value_ >> 32;
-        }
+    inline void AccumulatorLane::SetHigh(uint16_t new_value)
+    {
+        accumulator_.high[lane_] = new_value;
+    }
 
-        void Add(int64_t value)
-        {
-            value_ = static_cast<int64_t>(value_) + value;
-            value_ &= 0xFFFF'FFFF'FFFF;
-        }
+    inline void AccumulatorLane::SetMiddle(uint16_t new_value)
+    {
+        accumulator_.middle[lane_] = new_value;
+    }
 
-    private:
-        uint64_t value_ = 0;
-    };
+    inline void AccumulatorLane::SetLow(uint16_t new_value)
+    {
+        accumulator_.low[lane_] = new_value;
+    }
+
+    inline uint64_t AccumulatorLane::Get() const
+    {
+        return (static_cast<uint64_t>(accumulator_.high[lane_]) << 32) |
+               (static_cast<uint64_t>(accumulator_.middle[lane_]) << 16) |
+               accumulator_.low[lane_];
+    }
+
+    inline uint16_t AccumulatorLane::GetHigh() const
+    {
+        return accumulator_.high[lane_];
+    }
+
+    inline uint16_t AccumulatorLane::GetMiddle() const
+    {
+        return accumulator_.middle[lane_];
+    }
+
+    inline uint16_t AccumulatorLane::GetLow() const
+    {
+        return accumulator_.low[lane_];
+    }
 
     struct VUControl16
     {
@@ -229,6 +277,34 @@ namespace hydra::N64
     public:
         RSP();
         void Tick();
+        // Runs up to this many instructions, stopping early if the RSP halts
+        void Run(int instructions);
+        // Same as Run but on the RSP thread when there is one, returns without waiting for it
+        void RunAsync(int instructions);
+
+        // Waits for the RSP thread, anything the RSP owns has to be left alone until then
+        void Sync()
+        {
+            if (thread_) [[unlikely]]
+            {
+                thread_->Sync();
+            }
+        }
+
+        void SetBackend(RSPBackend backend);
+        // Picks the SSE4.1 vector unit kernels over the scalar ones, on by default when available
+        void SetVectorSIMD(bool enabled);
+        // Runs tasks of the standard audio and graphics microcodes natively, anything else
+        // still runs on the RSP
+        void SetHLE(bool enabled);
+        // Runs the RSP on a host thread of its own, see RSPThread
+        void SetThread(bool enabled);
+
+        bool IsThreaded() const
+        {
+            return thread_ != nullptr;
+        }
+
         void Reset();
 
         bool IsHalted()
@@ -247,6 +323,17 @@ namespace hydra::N64
             mi_interrupt_ = ptr;
         }
 
+        // Called with the rdram address and length of every row written by a DMA
+        void SetRDRAMWriteCallback(std::function<void(uint32_t, uint32_t)> func)
+        {
+            rdram_written_ = func;
+        }
+
+        Profiler& GetProfiler()
+        {
+            return profiler_;
+        }
+
     private:
         using func_ptr = void (*)(RSP*);
 
@@ -270,6 +357,14 @@ namespace hydra::N64
 
         void MFC2(), CFC2(), MTC2(), CTC2();
 
+#if HYDRA_SIMD_AVAILABLE
+        void sse_VMULF(), sse_VMULU(), sse_VMUDL(), sse_VMUDM(), sse_VMUDN(), sse_VMUDH(),
+            sse_VMACF(), sse_VMACU(), sse_VMADL(), sse_VMADM(), sse_VMADN(), sse_VMADH(),
+            sse_VADD(), sse_VABS(), sse_VADDC(), sse_VSAR(), sse_VAND(), sse_VNAND(), sse_VOR(),
+            sse_VNOR(), sse_VXOR(), sse_VNXOR(), sse_VSUB(), sse_VLT(), sse_VSUBC(), sse_VEQ(),
+            sse_VNE(), sse_VGE(), sse_VCL(), sse_VCH(), sse_VCR(), sse_VMRG(), sse_VZERO();
+#endif
+
         void ERROR();
         void ERROR2();
 
@@ -348,6 +443,45 @@ namespace hydra::N64
             &lut_wrapper<&RSP::VNOP>,
         };
 
+#if HYDRA_SIMD_AVAILABLE
+        // Same layout as vu_instruction_table_, the ops that aren't lane parallel (VRCP and
+        // friends, VMOV, VMULQ, VMACQ) share the scalar implementation
+        constexpr static std::array<func_ptr, 64> vu_simd_instruction_table_ = {
+            &lut_wrapper<&RSP::sse_VMULF>, &lut_wrapper<&RSP::sse_VMULU>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::VMULQ>,
+            &lut_wrapper<&RSP::sse_VMUDL>, &lut_wrapper<&RSP::sse_VMUDM>,
+            &lut_wrapper<&RSP::sse_VMUDN>, &lut_wrapper<&RSP::sse_VMUDH>,
+            &lut_wrapper<&RSP::sse_VMACF>, &lut_wrapper<&RSP::sse_VMACU>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::sse_VMADL>, &lut_wrapper<&RSP::sse_VMADM>,
+            &lut_wrapper<&RSP::sse_VMADN>, &lut_wrapper<&RSP::sse_VMADH>,
+            &lut_wrapper<&RSP::sse_VADD>,  &lut_wrapper<&RSP::sse_VSUB>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VABS>,
+            &lut_wrapper<&RSP::sse_VADDC>, &lut_wrapper<&RSP::sse_VSUBC>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VSAR>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::sse_VLT>,   &lut_wrapper<&RSP::sse_VEQ>,
+            &lut_wrapper<&RSP::sse_VNE>,   &lut_wrapper<&RSP::sse_VGE>,
+            &lut_wrapper<&RSP::sse_VCL>,   &lut_wrapper<&RSP::sse_VCH>,
+            &lut_wrapper<&RSP::sse_VCR>,   &lut_wrapper<&RSP::sse_VMRG>,
+            &lut_wrapper<&RSP::sse_VAND>,  &lut_wrapper<&RSP::sse_VNAND>,
+            &lut_wrapper<&RSP::sse_VOR>,   &lut_wrapper<&RSP::sse_VNOR>,
+            &lut_wrapper<&RSP::sse_VXOR>,  &lut_wrapper<&RSP::sse_VNXOR>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::VRCP>,      &lut_wrapper<&RSP::VRCPL>,
+            &lut_wrapper<&RSP::VRCPH>,     &lut_wrapper<&RSP::VMOV>,
+            &lut_wrapper<&RSP::VRSQ>,      &lut_wrapper<&RSP::VRSQL>,
+            &lut_wrapper<&RSP::VRCPH>,     &lut_wrapper<&RSP::VNOP>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::sse_VZERO>,
+            &lut_wrapper<&RSP::sse_VZERO>, &lut_wrapper<&RSP::VNOP>,
+        };
+#endif
+
         constexpr static std::array<func_ptr, 32> regimm_table_ = {
             &lut_wrapper<&RSP::r_BLTZ>, &lut_wrapper<&RSP::r_BGEZ>,   &lut_wrapper<&RSP::ERROR2>,
             &lut_wrapper<&RSP::ERROR2>, &lut_wrapper<&RSP::ERROR2>,   &lut_wrapper<&RSP::ERROR2>,
@@ -363,6 +497,7 @@ namespace hydra::N64
         };
 
         void execute_instruction();
+        void run_recompiled(int instructions);
         uint32_t fetch_instruction();
         uint8_t load_byte(uint16_t address);
         uint16_t load_halfword(uint16_t address);
@@ -390,14 +525,19 @@ namespace hydra::N64
         template <bool DoLog>
         void log_cpu_state(bool use_crc, uint64_t instructions);
 
+        template <bool DoProfile>
+        void profile_instruction();
+
         std::array<uint8_t, 0x2000> mem_{};
         std::array<MemDataUnionW, 32> gpr_regs_;
-        std::array<VectorRegister, 32> vu_regs_;
+        alignas(16) std::array<VectorRegister, 32> vu_regs_;
         VUControl16 vco_, vcc_;
         VUControl8 vce_;
         int16_t div_in_, div_out_;
         bool div_in_ready_;
-        std::array<AccumulatorLane, 8> accumulator_;
+        Accumulator accumulator_;
+        // Either vu_instruction_table_ or vu_simd_instruction_table_
+        const func_ptr* vu_table_ = vu_instruction_table_.data();
 
         // TODO: some are probably not needed
         Instruction instruction_;
@@ -412,11 +552,24 @@ namespace hydra::N64
         bool semaphore_;
         uint8_t* rdram_ptr_ = nullptr;
         MIInterrupt* mi_interrupt_ = nullptr;
+        std::function<void(uint32_t, uint32_t)> rdram_written_;
         RDP* rdp_ptr_ = nullptr;
+        Profiler profiler_{"rsp"};
+        std::unique_ptr<RSPJit> jit_;
+        std::unique_ptr<RSPHLE> hle_;
+        // Blocks don't stop at the exact instruction count, what they ran over is paid back in
+        // the next Run
+        int budget_ = 0;
+        // Last so it's stopped before anything it uses goes away
+        std::unique_ptr<RSPThread> thread_;
 
         friend class hydra::N64::CPU;
         friend class hydra::N64::CPUBus;
         friend class hydra::N64::RCP;
+        friend class hydra::N64::RSPJit;
+        friend class hydra::N64::RSPHLE;
+        friend class hydra::N64::RSPThread;
         friend class MmioViewer;
+        friend class QA;
     };
 } // namespace hydra::N64
\ No newline at end of file
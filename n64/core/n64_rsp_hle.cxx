@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <compatibility.hxx>
+#include <log.hxx>
+#include <n64/core/n64_rdp.hxx>
+#include <n64/core/n64_rsp.hxx>
+#include <n64/core/n64_rsp_hle.hxx>
+#include <string_view>
+
+namespace hydra::N64
+{
+    namespace
+    {
+        constexpr uint32_t IMEM_TEXT_SIZE = 0xF80;
+        constexpr uint32_t UCODE_DATA_SCAN_SIZE = 0x800;
+        constexpr uint32_t DMEM_SIZE = 0x1000;
+
+        // Finds a string in the microcode's data segment, where the graphics microcodes keep
+        // their version string
+        size_t find_string(const HLEMemory& memory, uint32_t address, uint32_t size,
+                           std::string_view needle)
+        {
+            size = std::min(size, UCODE_DATA_SCAN_SIZE);
+            for (uint32_t i = 0; i + needle.size() <= size; i++)
+            {
+                bool found = true;
+                for (size_t j = 0; j < needle.size(); j++)
+                {
+                    if (memory.Read8(address + i + j) != static_cast<uint8_t>(needle[j]))
+                    {
+                        found = false;
+                        break;
+                    }
+                }
+                if (found)
+                {
+                    return i;
+                }
+            }
+            return std::string_view::npos;
+        }
+    } // namespace
+
+    void HLEMemory::WaitFor(uint32_t address, uint32_t length, bool write) const
+    {
+        if (rdp)
+        {
+            rdp->WaitFor(address & (RDRAM_EXPANSION_SIZE - 1), length, write);
+        }
+    }
+
+    RSPHLE::RSPHLE(RSP& rsp) : rsp_(rsp) {}
+
+    void RSPHLE::Reset()
+    {
+        audio_.Reset();
+        graphics_.Reset();
+    }
+
+    bool RSPHLE::RunTask()
+    {
+        // The OS always starts tasks from the start of IMEM with rspboot
+        if (rsp_.pc_ != 0)
+        {
+            return false;
+        }
+
+        HLEMemory memory{rsp_.mem_.data(), rsp_.rdram_ptr_, &rsp_.rdram_written_, rsp_.rdp_ptr_};
+        HLETask task = read_task(memory);
+        Microcode microcode = identify(task, memory);
+        switch (microcode)
+        {
+            case Microcode::Unknown:
+            {
+                return false;
+            }
+            case Microcode::AudioABI1:
+            {
+                audio_.Run(task, memory);
+                break;
+            }
+            case Microcode::Fast3D:
+            case Microcode::F3DEX:
+            case Microcode::F3DEX2:
+            {
+                if (!graphics_.Run(task, memory, *rsp_.rdp_ptr_, microcode))
+                {
+                    Logger::WarnOnce("RSP HLE: display list loaded an unknown microcode, the "
+                                     "rest of it was skipped");
+                }
+                break;
+            }
+        }
+        finish_task();
+        return true;
+    }
+
+    HLETask RSPHLE::read_task(const HLEMemory& memory)
+    {
+        std::array<uint32_t, 16> words;
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            words[i] = memory.ReadDMEM32(HLETask::DMEM_ADDRESS + i * 4);
+        }
+        return HLETask{
+            .type = words[0],
+            .flags = words[1],
+            .ucode_boot = words[2],
+            .ucode_boot_size = words[3],
+            .ucode = words[4],
+            .ucode_size = words[5],
+            .ucode_data = words[6],
+            .ucode_data_size = words[7],
+            .dram_stack = words[8],
+            .dram_stack_size = words[9],
+            .output_buff = words[10],
+            .output_buff_size = words[11],
+            .data_ptr = words[12],
+            .data_size = words[13],
+            .yield_data_ptr = words[14],
+            .yield_data_size = words[15],
+        };
+    }
+
+    Microcode RSPHLE::identify(const HLETask& task, const HLEMemory& memory)
+    {
+        // IMEM only holds rspboot at this point, so hash the text rspboot is about to load
+        uint32_t size = task.ucode_size == 0 ? IMEM_TEXT_SIZE : task.ucode_size;
+        size = std::min(size, IMEM_TEXT_SIZE) & ~3;
+        uint32_t hash = hydra::crc32_u32(0xFFFF'FFFF, task.type);
+        for (uint32_t i = 0; i < size; i += 4)
+        {
+            hash = hydra::crc32_u32(hash, memory.Read32(task.ucode + i));
+        }
+
+        auto it = microcodes_.find(hash);
+        if (it != microcodes_.end())
+        {
+            return it->second;
+        }
+
+        Microcode microcode = classify(task, memory);
+        static constexpr const char* names[] = {"unknown", "audio ABI1", "Fast3D", "F3DEX",
+                                                "F3DEX2"};
+        Logger::Info("RSP HLE: microcode {:08x} is {}{}", hash,
+                     names[static_cast<int>(microcode)],
+                     microcode == Microcode::Unknown ? ", running it on the RSP" : "");
+        microcodes_[hash] = microcode;
+        return microcode;
+    }
+
+    Microcode RSPHLE::classify(const HLETask& task, const HLEMemory& memory)
+    {
+        switch (task.type)
+        {
+            case HLETask::AUDIO:
+            {
+                // The three words mupen64plus uses to tell the audio ABIs apart. GoldenEye,
+                // Blast Corps, Diddy Kong Racing and the ABI2 family don't match and stay on the
+                // RSP, and so does anything without a RESAMPLE table to read
+                if (memory.Read32(task.ucode_data) == 0x0000'0001 &&
+                    memory.Read32(task.ucode_data + 0x30) == 0xF000'0F00 &&
+                    memory.Read32(task.ucode_data + 0x28) == 0x1E24'138C &&
+                    FindResampleTable(memory, task.ucode_data, task.ucode_data_size) !=
+                        std::string_view::npos)
+                {
+                    return Microcode::AudioABI1;
+                }
+                return Microcode::Unknown;
+            }
+            case HLETask::GRAPHICS:
+            {
+                return IdentifyGraphicsMicrocode(memory, task.ucode_data, task.ucode_data_size);
+            }
+            default:
+            {
+                return Microcode::Unknown;
+            }
+        }
+    }
+
+    size_t FindResampleTable(const HLEMemory& memory, uint32_t data, uint32_t size)
+    {
+        // The table starts with the taps for the first phase, these are the values
+        // mupen64plus-rsp-hle has
+        constexpr std::array<uint16_t, 4> first_phase = {0x0C39, 0x66AD, 0x0D46, 0xFFDF};
+        size = std::min(size, DMEM_SIZE);
+        for (uint32_t i = 0; i + RESAMPLE_TABLE_ENTRIES * 2 <= size; i += 2)
+        {
+            bool found = true;
+            for (size_t j = 0; j < first_phase.size(); j++)
+            {
+                if (memory.Read16(data + i + j * 2) != first_phase[j])
+                {
+                    found = false;
+                    break;
+                }
+            }
+            if (found)
+            {
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    Microcode IdentifyGraphicsMicrocode(const HLEMemory& memory, uint32_t data, uint32_t size)
+    {
+        if (find_string(memory, data, size, "RSP SW Version: 2.0") != std::string_view::npos)
+        {
+            return Microcode::Fast3D;
+        }
+
+        // e.g. "RSP Gfx ucode F3DEX       fifo 2.08  Yoshitaka Yasumoto 1999 Nintendo."
+        constexpr std::string_view prefix = "RSP Gfx ucode ";
+        size_t offset = find_string(memory, data, size, prefix);
+        if (offset == std::string_view::npos)
+        {
+            return Microcode::Unknown;
+        }
+        uint32_t name = data + offset + prefix.size();
+        char text[5];
+        for (int i = 0; i < 5; i++)
+        {
+            text[i] = memory.Read8(name + i);
+        }
+        std::string_view family(text, 5);
+        // F3DZEX, S2DEX, L3DEX and friends differ in more than the opcode table
+        if (family != "F3DEX" && family != "F3DLX" && family != "F3DLP")
+        {
+            return Microcode::Unknown;
+        }
+        // Rejection microcodes (F3DEX.Rej) throw away triangles clipping would have kept
+        if (memory.Read32(name + 5) == 0x2E52'656A)
+        {
+            return Microcode::Unknown;
+        }
+        // The major version is the first digit after the name, 1.x and 2.x have different
+        // opcode tables
+        for (uint32_t i = 5; i < 40; i++)
+        {
+            uint8_t c = memory.Read8(name + i);
+            if (c >= '0' && c <= '9' && memory.Read8(name + i + 1) == '.')
+            {
+                switch (c)
+                {
+                    case '1':
+                        return Microcode::F3DEX;
+                    case '2':
+                        return Microcode::F3DEX2;
+                    default:
+                        return Microcode::Unknown;
+                }
+            }
+        }
+        return Microcode::Unknown;
+    }
+
+    void RSPHLE::finish_task()
+    {
+        // Task done is signal 2, the interrupt tells the OS to look at it
+        rsp_.status_.halt = true;
+        rsp_.status_.broke = true;
+        rsp_.status_.signal_2 = true;
+        if (rsp_.status_.intr_break)
+        {
+            rsp_.mi_interrupt_->SP = true;
+        }
+    }
+} // namespace hydra::N64
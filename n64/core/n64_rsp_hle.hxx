@@ -0,0 +1,299 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <n64/core/n64_rdram.hxx>
+#include <unordered_map>
+#include <vector>
+
+namespace hydra::N64
+{
+    class RSP;
+    class RDP;
+
+    enum class Microcode {
+        Unknown,
+        AudioABI1,
+        Fast3D,
+        F3DEX,
+        F3DEX2,
+    };
+
+    // The OSTask structure libultra leaves at the end of DMEM before starting the RSP
+    struct HLETask
+    {
+        static constexpr uint32_t DMEM_ADDRESS = 0xFC0;
+        static constexpr uint32_t GRAPHICS = 1;
+        static constexpr uint32_t AUDIO = 2;
+
+        uint32_t type;
+        uint32_t flags;
+        uint32_t ucode_boot, ucode_boot_size;
+        uint32_t ucode, ucode_size;
+        uint32_t ucode_data, ucode_data_size;
+        uint32_t dram_stack, dram_stack_size;
+        uint32_t output_buff, output_buff_size;
+        uint32_t data_ptr, data_size;
+        uint32_t yield_data_ptr, yield_data_size;
+    };
+
+    // DMEM and RDRAM the way the microcodes see them, big endian and wrapping around
+    struct HLEMemory
+    {
+        uint8_t* dmem;
+        uint8_t* rdram;
+        const std::function<void(uint32_t, uint32_t)>* rdram_written;
+        RDP* rdp;
+
+        uint8_t ReadDMEM8(uint32_t address) const
+        {
+            return dmem[address & 0xFFF];
+        }
+
+        uint16_t ReadDMEM16(uint32_t address) const
+        {
+            return (ReadDMEM8(address) << 8) | ReadDMEM8(address + 1);
+        }
+
+        uint32_t ReadDMEM32(uint32_t address) const
+        {
+            return (ReadDMEM16(address) << 16) | ReadDMEM16(address + 2);
+        }
+
+        void WriteDMEM8(uint32_t address, uint8_t value)
+        {
+            dmem[address & 0xFFF] = value;
+        }
+
+        void WriteDMEM16(uint32_t address, uint16_t value)
+        {
+            WriteDMEM8(address, value >> 8);
+            WriteDMEM8(address + 1, value);
+        }
+
+        uint8_t Read8(uint32_t address) const
+        {
+            return rdram[address & (RDRAM_EXPANSION_SIZE - 1)];
+        }
+
+        uint16_t Read16(uint32_t address) const
+        {
+            return (Read8(address) << 8) | Read8(address + 1);
+        }
+
+        uint32_t Read32(uint32_t address) const
+        {
+            return (Read16(address) << 16) | Read16(address + 2);
+        }
+
+        void Write16(uint32_t address, uint16_t value)
+        {
+            rdram[address & (RDRAM_EXPANSION_SIZE - 1)] = value >> 8;
+            rdram[(address + 1) & (RDRAM_EXPANSION_SIZE - 1)] = value;
+        }
+
+        // Has to come before touching RDRAM, like the RSP DMAs the microcodes would use, in
+        // case the RDP thread is still using it
+        void WaitFor(uint32_t address, uint32_t length, bool write) const;
+
+        // Has to follow every write so the code caches and the VI notice
+        void Written(uint32_t address, uint32_t length)
+        {
+            if (*rdram_written)
+            {
+                (*rdram_written)(address & (RDRAM_EXPANSION_SIZE - 1), length);
+            }
+        }
+    };
+
+    // Works out the graphics microcode from the version string in its data segment
+    Microcode IdentifyGraphicsMicrocode(const HLEMemory& memory, uint32_t data, uint32_t size);
+
+    // RESAMPLE filter taps, four for every 1/64th of a sample
+    constexpr uint32_t RESAMPLE_TABLE_ENTRIES = 64 * 4;
+
+    // Offset of the RESAMPLE filter table in the audio microcode's data segment, npos if it
+    // isn't there
+    size_t FindResampleTable(const HLEMemory& memory, uint32_t data, uint32_t size);
+
+    /**
+        The standard audio microcode, ABI1 in HLE plugin terms
+
+        Commands work on sample buffers in DMEM, offsets in the commands are relative to where
+        the microcode keeps them (DMEM_BASE). State that outlives a task (ADPCM history,
+        resampler position, envelope ramps) is written back to RDRAM like the microcode does.
+        RESAMPLE filters with the table in the microcode's own data segment.
+    */
+    class HLEAudio final
+    {
+    public:
+        void Run(const HLETask& task, HLEMemory memory);
+        void Reset();
+
+    private:
+        static constexpr uint32_t DMEM_BASE = 0x5C0;
+
+        HLEMemory memory_{};
+        std::array<uint32_t, 16> segments_{};
+        uint16_t in_ = 0, out_ = 0, count_ = 0;
+        uint16_t dry_right_ = 0, wet_left_ = 0, wet_right_ = 0;
+        std::array<int16_t, 2> volume_{};
+        std::array<int16_t, 2> target_{};
+        std::array<int32_t, 2> rate_{};
+        int16_t dry_ = 0, wet_ = 0;
+        uint32_t loop_ = 0;
+        std::array<int16_t, 128> adpcm_table_{};
+        std::array<int16_t, RESAMPLE_TABLE_ENTRIES> resample_table_{};
+
+        uint32_t address(uint32_t segmented);
+        int16_t sample(uint32_t address);
+        void set_sample(uint32_t address, int16_t value);
+
+        void ADPCM(uint32_t w0, uint32_t w1);
+        void CLEARBUFF(uint32_t w0, uint32_t w1);
+        void ENVMIXER(uint32_t w0, uint32_t w1);
+        void LOADBUFF(uint32_t w0, uint32_t w1);
+        void RESAMPLE(uint32_t w0, uint32_t w1);
+        void SAVEBUFF(uint32_t w0, uint32_t w1);
+        void SEGMENT(uint32_t w0, uint32_t w1);
+        void SETBUFF(uint32_t w0, uint32_t w1);
+        void SETVOL(uint32_t w0, uint32_t w1);
+        void DMEMMOVE(uint32_t w0, uint32_t w1);
+        void LOADADPCM(uint32_t w0, uint32_t w1);
+        void MIXER(uint32_t w0, uint32_t w1);
+        void INTERLEAVE(uint32_t w0, uint32_t w1);
+        void POLEF(uint32_t w0, uint32_t w1);
+        void SETLOOP(uint32_t w0, uint32_t w1);
+    };
+
+    /**
+        Fast3D, F3DEX and F3DEX2 display lists turned into RDP commands
+
+        Vertices are transformed, lit and clipped in floating point and every triangle that
+        survives is sent to the RDP with the same edge and attribute coefficients the microcode
+        would have produced, give or take rounding. RDP commands in the display list go through
+        with their segmented addresses resolved.
+    */
+    class HLEGraphics final
+    {
+    public:
+        // Returns false if the display list switched to a microcode that isn't handled
+        bool Run(const HLETask& task, HLEMemory memory, RDP& rdp, Microcode microcode);
+        void Reset();
+
+    private:
+        struct Vertex
+        {
+            // Clip space
+            float x, y, z, w;
+            // Screen space, z scaled to the RDP's 0-0x7FFF
+            float sx, sy, sz;
+            float r, g, b, a;
+            float s, t;
+            uint8_t clip;
+        };
+
+        struct Light
+        {
+            std::array<float, 3> color;
+            std::array<float, 3> direction;
+        };
+
+        using Matrix = std::array<std::array<float, 4>, 4>;
+
+        HLEMemory memory_{};
+        RDP* rdp_ = nullptr;
+        Microcode microcode_ = Microcode::Unknown;
+        std::array<uint32_t, 16> segments_{};
+        std::vector<uint32_t> dl_stack_;
+        uint32_t pc_ = 0;
+        bool done_ = false;
+
+        std::vector<Matrix> modelview_stack_;
+        Matrix projection_{};
+        Matrix mvp_{};
+        std::array<Vertex, 64> vertices_{};
+        std::array<float, 3> viewport_scale_{};
+        std::array<float, 3> viewport_translate_{};
+        std::array<Light, 8> lights_{};
+        std::array<std::array<float, 3>, 2> lookat_{};
+        int light_count_ = 0;
+        // Light and look at directions taken to model space, redone when the modelview changes
+        bool lights_dirty_ = true;
+        std::array<std::array<float, 3>, 8> model_lights_{};
+        std::array<std::array<float, 3>, 2> model_lookat_{};
+        float fog_multiplier_ = 0, fog_offset_ = 0;
+
+        uint32_t geometry_mode_ = 0;
+        uint32_t othermode_high_ = 0, othermode_low_ = 0;
+        bool texture_on_ = false;
+        uint8_t texture_tile_ = 0, texture_level_ = 0;
+        float texture_scale_s_ = 0, texture_scale_t_ = 0;
+        uint32_t rdp_half_1_ = 0;
+
+        uint32_t address(uint32_t segmented);
+        uint64_t next_command();
+
+        void execute_fast3d(uint32_t w0, uint32_t w1);
+        void execute_f3dex(uint32_t w0, uint32_t w1);
+        void execute_f3dex2(uint32_t w0, uint32_t w1);
+        // Commands the microcodes pass on to the RDP, returns false for anything else
+        bool execute_rdp(uint32_t w0, uint32_t w1);
+
+        void load_matrix(uint32_t address, bool projection, bool load, bool push);
+        void pop_matrix(int count);
+        void load_vertices(uint32_t address, int first, int count);
+        void load_viewport(uint32_t address);
+        void load_light(uint32_t address, int index);
+        void load_lookat(uint32_t address, int index);
+        void load_microcode(uint32_t data, uint32_t size);
+        void move_word(uint32_t index, uint32_t offset, uint32_t value);
+        void set_other_mode(bool high, int shift, int length, uint32_t data);
+        void set_texture(int level, int tile, bool on, uint32_t scales);
+        void call_display_list(uint32_t segmented, bool push);
+        void end_display_list();
+        void cull_display_list(int first, int last);
+        void branch_z(int vertex, uint32_t z);
+        void modify_vertex(int index, uint32_t where, uint32_t value);
+        void texture_rectangle(uint32_t w0, uint32_t w1);
+
+        void update_lights();
+        void project(Vertex& vertex);
+        void draw_triangle(int v0, int v1, int v2);
+        void clip_triangle(const std::array<Vertex, 3>& triangle);
+        void send_triangle(const Vertex& a, const Vertex& b, const Vertex& c);
+
+        // Geometry mode bits that moved between the microcode versions
+        uint32_t cull_front_bit() const;
+        uint32_t cull_back_bit() const;
+        uint32_t smooth_shading_bit() const;
+    };
+
+    /**
+        Runs RSP tasks without the RSP when their microcode is one of the standard ones
+
+        The microcode is identified once per unique hash of the code the task would load into
+        IMEM and remembered, so games that swap microcodes every frame pay for it only once.
+        Anything that isn't recognized is left to the RSP, which runs it as usual.
+    */
+    class RSPHLE final
+    {
+    public:
+        RSPHLE(RSP& rsp);
+        // Called when the RSP is unhalted, returns false if the RSP should run the task itself
+        bool RunTask();
+        void Reset();
+
+    private:
+        RSP& rsp_;
+        std::unordered_map<uint32_t, Microcode> microcodes_;
+        HLEAudio audio_;
+        HLEGraphics graphics_;
+
+        HLETask read_task(const HLEMemory& memory);
+        Microcode identify(const HLETask& task, const HLEMemory& memory);
+        Microcode classify(const HLETask& task, const HLEMemory& memory);
+        void finish_task();
+    };
+} // namespace hydra::N64
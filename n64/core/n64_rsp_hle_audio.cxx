@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <log.hxx>
+#include <n64/core/n64_rsp_hle.hxx>
+
+// Command semantics follow mupen64plus-rsp-hle, which matches the microcode bit for bit
+
+namespace hydra::N64
+{
+    namespace
+    {
+        enum AudioFlags {
+            A_INIT = 0x01,
+            A_LEFT = 0x02,
+            A_LOOP = 0x02,
+            A_VOL = 0x04,
+            A_AUX = 0x08,
+        };
+
+        constexpr uint16_t align(uint16_t value, uint16_t alignment)
+        {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        constexpr int16_t clamp_s16(int32_t value)
+        {
+            return std::clamp(value, -32768, 32767);
+        }
+
+        constexpr int32_t vmulf(int16_t x, int16_t y)
+        {
+            return (x * y + 0x4000) >> 15;
+        }
+
+        // Sum of x[0..n) * y[n - 1..0], the FIR part of the ADPCM and pole filters
+        int32_t rdot(size_t n, const int16_t* x, const int16_t* y)
+        {
+            int32_t accumulator = 0;
+            y += n;
+            while (n != 0)
+            {
+                accumulator += *(x++) * *(--y);
+                n--;
+            }
+            return accumulator;
+        }
+
+        struct Ramp
+        {
+            int32_t value;
+            int32_t step;
+            int32_t target;
+
+            int16_t Step()
+            {
+                value += step;
+                bool reached = step <= 0 ? value <= target : value >= target;
+                if (reached)
+                {
+                    value = target;
+                    step = 0;
+                }
+                return value >> 16;
+            }
+        };
+    } // namespace
+
+    void HLEAudio::Reset()
+    {
+        *this = HLEAudio{};
+    }
+
+    void HLEAudio::Run(const HLETask& task, HLEMemory memory)
+    {
+        memory_ = memory;
+        segments_.fill(0);
+        // Identifying the microcode made sure the table is there
+        uint32_t table = task.ucode_data +
+                         FindResampleTable(memory_, task.ucode_data, task.ucode_data_size);
+        for (uint32_t i = 0; i < RESAMPLE_TABLE_ENTRIES; i++)
+        {
+            resample_table_[i] = memory_.Read16(table + i * 2);
+        }
+        memory_.WaitFor(task.data_ptr, task.data_size, false);
+        for (uint32_t offset = 0; offset + 8 <= task.data_size; offset += 8)
+        {
+            uint32_t w0 = memory_.Read32(task.data_ptr + offset);
+            uint32_t w1 = memory_.Read32(task.data_ptr + offset + 4);
+            switch ((w0 >> 24) & 0x7F)
+            {
+                case 0x00:
+                    // SPNOOP
+                    break;
+                case 0x01:
+                    ADPCM(w0, w1);
+                    break;
+                case 0x02:
+                    CLEARBUFF(w0, w1);
+                    break;
+                case 0x03:
+                    ENVMIXER(w0, w1);
+                    break;
+                case 0x04:
+                    LOADBUFF(w0, w1);
+                    break;
+                case 0x05:
+                    RESAMPLE(w0, w1);
+                    break;
+                case 0x06:
+                    SAVEBUFF(w0, w1);
+                    break;
+                case 0x07:
+                    SEGMENT(w0, w1);
+                    break;
+                case 0x08:
+                    SETBUFF(w0, w1);
+                    break;
+                case 0x09:
+                    SETVOL(w0, w1);
+                    break;
+                case 0x0A:
+                    DMEMMOVE(w0, w1);
+                    break;
+                case 0x0B:
+                    LOADADPCM(w0, w1);
+                    break;
+                case 0x0C:
+                    MIXER(w0, w1);
+                    break;
+                case 0x0D:
+                    INTERLEAVE(w0, w1);
+                    break;
+                case 0x0E:
+                    POLEF(w0, w1);
+                    break;
+                case 0x0F:
+                    SETLOOP(w0, w1);
+                    break;
+                default:
+                    Logger::WarnOnce("RSP HLE: unknown audio command {:08x} {:08x}", w0, w1);
+                    break;
+            }
+        }
+    }
+
+    uint32_t HLEAudio::address(uint32_t segmented)
+    {
+        return (segments_[(segmented >> 24) & 0xF] + (segmented & 0xFF'FFFF)) & 0xFF'FFFF;
+    }
+
+    int16_t HLEAudio::sample(uint32_t address)
+    {
+        return memory_.ReadDMEM16(address);
+    }
+
+    void HLEAudio::set_sample(uint32_t address, int16_t value)
+    {
+        memory_.WriteDMEM16(address, value);
+    }
+
+    void HLEAudio::ADPCM(uint32_t w0, uint32_t w1)
+    {
+        uint8_t flags = w0 >> 16;
+        uint32_t state = address(w1);
+        uint16_t out = out_;
+        uint16_t in = in_;
+        uint16_t count = align(count_, 32);
+
+        std::array<int16_t, 16> last_frame{};
+        memory_.WaitFor(state, 32, true);
+        if (!(flags & A_INIT))
+        {
+            uint32_t from = (flags & A_LOOP) ? loop_ : state;
+            memory_.WaitFor(from, 32, false);
+            for (int i = 0; i < 16; i++)
+            {
+                last_frame[i] = memory_.Read16(from + i * 2);
+            }
+        }
+
+        for (int i = 0; i < 16; i++, out += 2)
+        {
+            set_sample(out, last_frame[i]);
+        }
+
+        while (count != 0)
+        {
+            uint8_t code = memory_.ReadDMEM8(in++);
+            int scale = code >> 4;
+            const int16_t* book1 = &adpcm_table_[(code & 0xF) * 16];
+            const int16_t* book2 = book1 + 8;
+            int right_shift = scale < 12 ? 12 - scale : 0;
+
+            std::array<int16_t, 16> frame;
+            for (int i = 0; i < 8; i++)
+            {
+                uint8_t byte = memory_.ReadDMEM8(in++);
+                frame[i * 2] = static_cast<int16_t>((byte & 0xF0) << 8) >> right_shift;
+                frame[i * 2 + 1] = static_cast<int16_t>((byte & 0x0F) << 12) >> right_shift;
+            }
+
+            // Each half is predicted from the two samples before it
+            for (int half = 0; half < 2; half++)
+            {
+                int16_t l1 = half == 0 ? last_frame[14] : last_frame[6];
+                int16_t l2 = half == 0 ? last_frame[15] : last_frame[7];
+                const int16_t* residuals = &frame[half * 8];
+                for (int i = 0; i < 8; i++)
+                {
+                    int32_t accumulator = residuals[i] << 11;
+                    accumulator += book1[i] * l1 + book2[i] * l2 + rdot(i, book2, residuals);
+                    last_frame[half * 8 + i] = clamp_s16(accumulator >> 11);
+                }
+            }
+
+            for (int i = 0; i < 16; i++, out += 2)
+            {
+                set_sample(out, last_frame[i]);
+            }
+            count -= 32;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            memory_.Write16(state + i * 2, last_frame[i]);
+        }
+        memory_.Written(state, 32);
+    }
+
+    void HLEAudio::CLEARBUFF(uint32_t w0, uint32_t w1)
+    {
+        uint16_t dmem = w0 + DMEM_BASE;
+        uint16_t count = align(w1 & 0xFFF, 16);
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memory_.WriteDMEM8(dmem + i, 0);
+        }
+    }
+
+    void HLEAudio::ENVMIXER(uint32_t w0, uint32_t w1)
+    {
+        uint8_t flags = w0 >> 16;
+        uint32_t state = address(w1);
+        bool aux = flags & A_AUX;
+        memory_.WaitFor(state, 40, true);
+
+        std::array<Ramp, 2> ramps;
+        std::array<int32_t, 2> sequence;
+        std::array<int32_t, 2> rates;
+        int16_t dry = dry_;
+        int16_t wet = wet_;
+        if (flags & A_INIT)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                ramps[i].value = volume_[i] << 16;
+                ramps[i].target = target_[i] << 16;
+                rates[i] = rate_[i];
+                sequence[i] = volume_[i] * rate_[i];
+            }
+        }
+        else
+        {
+            // The layout is private to the microcode, it only has to read back what it wrote
+            wet = memory_.Read32(state + 0);
+            dry = memory_.Read32(state + 4);
+            for (int i = 0; i < 2; i++)
+            {
+                ramps[i].target = memory_.Read32(state + 8 + i * 4);
+                rates[i] = memory_.Read32(state + 16 + i * 4);
+                sequence[i] = memory_.Read32(state + 24 + i * 4);
+                ramps[i].value = memory_.Read32(state + 32 + i * 4);
+            }
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            ramps[i].step = ramps[i].target - ramps[i].value;
+        }
+
+        uint16_t in = in_;
+        std::array<uint16_t, 4> buffers = {out_, dry_right_, wet_left_, wet_right_};
+        for (int y = 0; y < count_; y += 16)
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                if (ramps[i].step != 0)
+                {
+                    sequence[i] = (static_cast<int64_t>(sequence[i]) * rates[i]) >> 16;
+                    ramps[i].step = (sequence[i] - ramps[i].value) >> 3;
+                }
+            }
+
+            for (int x = 0; x < 8; x++)
+            {
+                int16_t left = ramps[0].Step();
+                int16_t right = ramps[1].Step();
+                std::array<int16_t, 4> gains = {
+                    clamp_s16((left * dry + 0x4000) >> 15),
+                    clamp_s16((right * dry + 0x4000) >> 15),
+                    clamp_s16((left * wet + 0x4000) >> 15),
+                    clamp_s16((right * wet + 0x4000) >> 15),
+                };
+                int16_t input = sample(in);
+                for (int i = 0; i < (aux ? 4 : 2); i++)
+                {
+                    set_sample(buffers[i], clamp_s16(sample(buffers[i]) + ((input * gains[i]) >> 15)));
+                }
+                in += 2;
+                for (auto& buffer : buffers)
+                {
+                    buffer += 2;
+                }
+            }
+        }
+
+        auto write32 = [this](uint32_t addr, uint32_t value) {
+            memory_.Write16(addr, value >> 16);
+            memory_.Write16(addr + 2, value);
+        };
+        write32(state + 0, wet);
+        write32(state + 4, dry);
+        for (int i = 0; i < 2; i++)
+        {
+            write32(state + 8 + i * 4, ramps[i].target);
+            write32(state + 16 + i * 4, rates[i]);
+            write32(state + 24 + i * 4, sequence[i]);
+            write32(state + 32 + i * 4, ramps[i].value);
+        }
+        memory_.Written(state, 40);
+    }
+
+    void HLEAudio::LOADBUFF(uint32_t, uint32_t w1)
+    {
+        uint32_t from = address(w1) & ~3;
+        uint16_t dmem = in_ & ~3;
+        uint16_t count = align(count_, 4);
+        memory_.WaitFor(from, count, false);
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memory_.WriteDMEM8(dmem + i, memory_.Read8(from + i));
+        }
+    }
+
+    void HLEAudio::RESAMPLE(uint32_t w0, uint32_t w1)
+    {
+        uint8_t flags = w0 >> 16;
+        // Q1.15 in the command, Q16.16 from here on
+        uint32_t pitch = (w0 & 0xFFFF) << 1;
+        uint32_t state = address(w1);
+        uint16_t count = align(count_, 16) >> 1;
+
+        // Input positions are in samples, the four before the input are the previous task's tail
+        uint16_t in = (in_ >> 1) - 4;
+        uint16_t out = out_ >> 1;
+        uint32_t accumulator = 0;
+        memory_.WaitFor(state, 10, true);
+        for (int k = 0; k < 4; k++)
+        {
+            set_sample((in + k) * 2, (flags & A_INIT) ? 0 : memory_.Read16(state + k * 2));
+        }
+        if (!(flags & A_INIT))
+        {
+            accumulator = memory_.Read16(state + 8);
+        }
+
+        while (count != 0)
+        {
+            const int16_t* taps = &resample_table_[(accumulator & 0xFC00) >> 8];
+            int32_t value = 0;
+            for (int k = 0; k < 4; k++)
+            {
+                value += sample((in + k) * 2) * taps[k];
+            }
+            set_sample(out++ * 2, clamp_s16(value >> 15));
+
+            accumulator += pitch;
+            in += accumulator >> 16;
+            accumulator &= 0xFFFF;
+            count--;
+        }
+
+        for (int k = 0; k < 4; k++)
+        {
+            memory_.Write16(state + k * 2, sample((in + k) * 2));
+        }
+        memory_.Write16(state + 8, accumulator);
+        memory_.Written(state, 10);
+    }
+
+    void HLEAudio::SAVEBUFF(uint32_t, uint32_t w1)
+    {
+        uint32_t to = address(w1) & ~3;
+        uint16_t dmem = out_ & ~3;
+        uint16_t count = align(count_, 4);
+        if (count == 0)
+        {
+            return;
+        }
+        memory_.WaitFor(to, count, true);
+        for (uint16_t i = 0; i < count; i += 2)
+        {
+            memory_.Write16(to + i, memory_.ReadDMEM16(dmem + i));
+        }
+        memory_.Written(to, count);
+    }
+
+    void HLEAudio::SEGMENT(uint32_t, uint32_t w1)
+    {
+        segments_[(w1 >> 24) & 0xF] = w1 & 0xFF'FFFF;
+    }
+
+    void HLEAudio::SETBUFF(uint32_t w0, uint32_t w1)
+    {
+        uint8_t flags = w0 >> 16;
+        if (flags & A_AUX)
+        {
+            dry_right_ = w0 + DMEM_BASE;
+            wet_left_ = (w1 >> 16) + DMEM_BASE;
+            wet_right_ = w1 + DMEM_BASE;
+        }
+        else
+        {
+            in_ = w0 + DMEM_BASE;
+            out_ = (w1 >> 16) + DMEM_BASE;
+            count_ = w1;
+        }
+    }
+
+    void HLEAudio::SETVOL(uint32_t w0, uint32_t w1)
+    {
+        // aSetVolume packs the volume in the first word and the target or rate in the second
+        uint8_t flags = w0 >> 16;
+        int channel = (flags & A_LEFT) ? 0 : 1;
+        if (flags & A_AUX)
+        {
+            dry_ = w0;
+            wet_ = w1;
+        }
+        else if (flags & A_VOL)
+        {
+            volume_[channel] = w0;
+        }
+        else
+        {
+            target_[channel] = w0;
+            rate_[channel] = w1;
+        }
+    }
+
+    void HLEAudio::DMEMMOVE(uint32_t w0, uint32_t w1)
+    {
+        uint16_t in = w0 + DMEM_BASE;
+        uint16_t out = (w1 >> 16) + DMEM_BASE;
+        uint16_t count = align(w1 & 0xFFFF, 16);
+        // Byte by byte on purpose, overlapping moves smear like they do on the RSP
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memory_.WriteDMEM8(out + i, memory_.ReadDMEM8(in + i));
+        }
+    }
+
+    void HLEAudio::LOADADPCM(uint32_t w0, uint32_t w1)
+    {
+        uint32_t from = address(w1);
+        size_t count = std::min<size_t>(align(w0 & 0xFFFF, 8) >> 1, adpcm_table_.size());
+        memory_.WaitFor(from, count * 2, false);
+        for (size_t i = 0; i < count; i++)
+        {
+            adpcm_table_[i] = memory_.Read16(from + i * 2);
+        }
+    }
+
+    void HLEAudio::MIXER(uint32_t w0, uint32_t w1)
+    {
+        int16_t gain = w0;
+        uint16_t in = (w1 >> 16) + DMEM_BASE;
+        uint16_t out = w1 + DMEM_BASE;
+        uint16_t count = align(count_, 32);
+        for (uint16_t i = 0; i < count; i += 2)
+        {
+            set_sample(out + i, clamp_s16(sample(out + i) + vmulf(sample(in + i), gain)));
+        }
+    }
+
+    void HLEAudio::INTERLEAVE(uint32_t, uint32_t w1)
+    {
+        uint16_t left = (w1 >> 16) + DMEM_BASE;
+        uint16_t right = w1 + DMEM_BASE;
+        uint16_t count = align(count_, 16) >> 1;
+        // The output may overlap the inputs, which are read a pair ahead of being written
+        for (uint16_t i = 0; i < count; i += 2)
+        {
+            int16_t l1 = sample(left + i * 2);
+            int16_t l2 = sample(left + i * 2 + 2);
+            int16_t r1 = sample(right + i * 2);
+            int16_t r2 = sample(right + i * 2 + 2);
+            set_sample(out_ + i * 4, l1);
+            set_sample(out_ + i * 4 + 2, r1);
+            set_sample(out_ + i * 4 + 4, l2);
+            set_sample(out_ + i * 4 + 6, r2);
+        }
+    }
+
+    void HLEAudio::POLEF(uint32_t w0, uint32_t w1)
+    {
+        uint8_t flags = w0 >> 16;
+        int16_t gain = w0;
+        uint32_t state = address(w1);
+        uint16_t count = align(count_, 16);
+        if (count == 0)
+        {
+            return;
+        }
+
+        const int16_t* h1 = &adpcm_table_[0];
+        int16_t* h2 = &adpcm_table_[8];
+        int16_t l1 = 0, l2 = 0;
+        memory_.WaitFor(state, 8, true);
+        if (!(flags & A_INIT))
+        {
+            l1 = memory_.Read16(state + 4);
+            l2 = memory_.Read16(state + 6);
+        }
+
+        // The microcode scales the second row in place and later commands see the result
+        std::array<int16_t, 8> h2_before;
+        for (int i = 0; i < 8; i++)
+        {
+            h2_before[i] = h2[i];
+            h2[i] = (h2[i] * gain) >> 14;
+        }
+
+        uint16_t in = in_;
+        uint16_t out = out_;
+        std::array<int16_t, 8> last{};
+        while (count != 0)
+        {
+            std::array<int16_t, 8> frame;
+            for (int i = 0; i < 8; i++, in += 2)
+            {
+                frame[i] = sample(in);
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                int32_t accumulator = frame[i] * gain;
+                accumulator += h1[i] * l1 + h2_before[i] * l2 + rdot(i, h2, frame.data());
+                last[i] = clamp_s16(accumulator >> 14);
+                set_sample(out + i * 2, last[i]);
+            }
+            l1 = last[6];
+            l2 = last[7];
+            out += 16;
+            count -= 16;
+        }
+
+        for (int i = 0; i < 4; i++)
+        {
+            memory_.Write16(state + i * 2, last[4 + i]);
+        }
+        memory_.Written(state, 8);
+    }
+
+    void HLEAudio::SETLOOP(uint32_t, uint32_t w1)
+    {
+        loop_ = address(w1);
+    }
+} // namespace hydra::N64
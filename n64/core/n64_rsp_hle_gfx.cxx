@@ -0,0 +1,1313 @@
+#include <algorithm>
+#include <cmath>
+#include <log.hxx>
+#include <n64/core/n64_rdp.hxx>
+#include <n64/core/n64_rdp_commands.hxx>
+#include <n64/core/n64_rsp_hle.hxx>
+#include <numbers>
+
+// Opcodes, geometry mode bits and command layouts are the ones in each microcode's gbi.h, the
+// triangle setup follows libdragon's rdpq_triangle
+
+namespace hydra::N64
+{
+    namespace
+    {
+        enum GeometryMode : uint32_t {
+            G_ZBUFFER = 0x0000'0001,
+            G_SHADE = 0x0000'0004,
+            G_FOG = 0x0001'0000,
+            G_LIGHTING = 0x0002'0000,
+            G_TEXTURE_GEN = 0x0004'0000,
+            G_TEXTURE_GEN_LINEAR = 0x0008'0000,
+        };
+
+        enum MoveWord {
+            G_MW_MATRIX = 0x00,
+            G_MW_NUMLIGHT = 0x02,
+            G_MW_CLIP = 0x04,
+            G_MW_SEGMENT = 0x06,
+            G_MW_FOG = 0x08,
+            G_MW_LIGHTCOL = 0x0A,
+            G_MW_POINTS = 0x0C,
+            G_MW_PERSPNORM = 0x0E,
+        };
+
+        enum ClipFlags : uint8_t {
+            CLIP_LEFT = 1 << 0,
+            CLIP_RIGHT = 1 << 1,
+            CLIP_TOP = 1 << 2,
+            CLIP_BOTTOM = 1 << 3,
+            CLIP_NEAR = 1 << 4,
+            CLIP_FAR = 1 << 5,
+        };
+
+        // Triangles are clipped against a band twice the size of the viewport, anything
+        // further out wouldn't fit in the RDP's coordinates
+        constexpr float GUARD_BAND = 2.0f;
+        constexpr float NEAR_W = 1e-5f;
+        // Stops display lists that jump into garbage from hanging the emulator
+        constexpr int MAX_COMMANDS = 1 << 22;
+
+        int32_t float_to_s16_16(float value)
+        {
+            if (!(value < 32768.0f))
+            {
+                return value >= 32768.0f ? 0x7FFF'FFFF : 0;
+            }
+            if (value < -32768.0f)
+            {
+                return static_cast<int32_t>(0x8000'0000);
+            }
+            return static_cast<int32_t>(std::floor(value * 65536.0f));
+        }
+
+        float safe_div(float a, float b)
+        {
+            return std::fabs(b) > 1e-20f ? a / b : 0.0f;
+        }
+
+        // The integer and fractional halves of four s15.16 attributes, as the RDP wants them
+        struct AttributeWords
+        {
+            uint64_t integer;
+            uint64_t fraction;
+        };
+
+        AttributeWords split(int32_t a, int32_t b, int32_t c, int32_t d)
+        {
+            auto high = [](int32_t value) { return static_cast<uint64_t>(value >> 16) & 0xFFFF; };
+            auto low = [](int32_t value) { return static_cast<uint64_t>(value) & 0xFFFF; };
+            return AttributeWords{
+                .integer = (high(a) << 48) | (high(b) << 32) | (high(c) << 16) | high(d),
+                .fraction = (low(a) << 48) | (low(b) << 32) | (low(c) << 16) | low(d),
+            };
+        }
+
+        float s15_16(int16_t integer, uint16_t fraction)
+        {
+            return static_cast<int32_t>((static_cast<uint32_t>(integer) << 16) | fraction) /
+                   65536.0f;
+        }
+    } // namespace
+
+    void HLEGraphics::Reset()
+    {
+        // Every task reloads the microcode and its data, nothing carries over between them
+        segments_.fill(0);
+        dl_stack_.clear();
+        done_ = false;
+        Matrix identity{};
+        for (int i = 0; i < 4; i++)
+        {
+            identity[i][i] = 1.0f;
+        }
+        modelview_stack_.assign(1, identity);
+        projection_ = identity;
+        mvp_ = identity;
+        vertices_ = {};
+        viewport_scale_ = {};
+        viewport_translate_ = {};
+        lights_ = {};
+        lookat_ = {};
+        light_count_ = 0;
+        lights_dirty_ = true;
+        fog_multiplier_ = 0;
+        fog_offset_ = 0;
+        geometry_mode_ = 0;
+        othermode_high_ = 0;
+        othermode_low_ = 0;
+        texture_on_ = false;
+        texture_tile_ = 0;
+        texture_level_ = 0;
+        texture_scale_s_ = 0;
+        texture_scale_t_ = 0;
+        rdp_half_1_ = 0;
+    }
+
+    bool HLEGraphics::Run(const HLETask& task, HLEMemory memory, RDP& rdp, Microcode microcode)
+    {
+        Reset();
+        memory_ = memory;
+        rdp_ = &rdp;
+        microcode_ = microcode;
+        pc_ = task.data_ptr;
+
+        int commands = 0;
+        while (!done_)
+        {
+            if (++commands > MAX_COMMANDS)
+            {
+                Logger::WarnOnce("RSP HLE: display list never ended");
+                break;
+            }
+
+            uint64_t command = next_command();
+            uint32_t w0 = command >> 32;
+            uint32_t w1 = command;
+            switch (microcode_)
+            {
+                case Microcode::Fast3D:
+                    execute_fast3d(w0, w1);
+                    break;
+                case Microcode::F3DEX:
+                    execute_f3dex(w0, w1);
+                    break;
+                case Microcode::F3DEX2:
+                    execute_f3dex2(w0, w1);
+                    break;
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t HLEGraphics::address(uint32_t segmented)
+    {
+        return (segments_[(segmented >> 24) & 0xF] + (segmented & 0xFF'FFFF)) & 0xFF'FFFF;
+    }
+
+    uint64_t HLEGraphics::next_command()
+    {
+        uint64_t command = (static_cast<uint64_t>(memory_.Read32(pc_)) << 32) |
+                           memory_.Read32(pc_ + 4);
+        pc_ += 8;
+        return command;
+    }
+
+    // Fast3D and F3DEX share most of their opcodes, F3DEX added TRI2, vertex indices scaled by
+    // 2 instead of 10 and a bigger vertex buffer
+    void HLEGraphics::execute_fast3d(uint32_t w0, uint32_t w1)
+    {
+        uint8_t opcode = w0 >> 24;
+        switch (opcode)
+        {
+            case 0x04:
+            {
+                // G_VTX
+                int count = ((w0 >> 20) & 0xF) + 1;
+                int first = (w0 >> 16) & 0xF;
+                load_vertices(address(w1), first, count);
+                break;
+            }
+            case 0xB2:
+            {
+                // G_RDPHALF_CONT, only meaningful after a texture rectangle
+                break;
+            }
+            case 0xBE:
+            {
+                // G_CULLDL, the end is one past the last vertex
+                cull_display_list((w0 & 0xFF'FFFF) / 40, (w1 & 0xFFFF) / 40 - 1);
+                break;
+            }
+            case 0xBF:
+            {
+                // G_TRI1
+                draw_triangle(((w1 >> 16) & 0xFF) / 10, ((w1 >> 8) & 0xFF) / 10,
+                              (w1 & 0xFF) / 10);
+                break;
+            }
+            case 0xBC:
+            {
+                // G_MOVEWORD
+                uint32_t index = w0 & 0xFF;
+                uint32_t offset = (w0 >> 8) & 0xFFFF;
+                if (index == G_MW_POINTS)
+                {
+                    modify_vertex(offset / 40, offset % 40, w1);
+                    break;
+                }
+                move_word(index, offset, w1);
+                break;
+            }
+            default:
+            {
+                execute_f3dex(w0, w1);
+                break;
+            }
+        }
+    }
+
+    void HLEGraphics::execute_f3dex(uint32_t w0, uint32_t w1)
+    {
+        uint8_t opcode = w0 >> 24;
+        switch (opcode)
+        {
+            case 0x00:
+            {
+                // G_SPNOOP
+                break;
+            }
+            case 0x01:
+            {
+                // G_MTX
+                uint8_t params = w0 >> 16;
+                load_matrix(address(w1), params & 0x1, params & 0x2, params & 0x4);
+                break;
+            }
+            case 0x03:
+            {
+                // G_MOVEMEM
+                uint8_t index = w0 >> 16;
+                uint32_t from = address(w1);
+                if (index == 0x80)
+                {
+                    load_viewport(from);
+                }
+                else if (index == 0x82)
+                {
+                    load_lookat(from, 1);
+                }
+                else if (index == 0x84)
+                {
+                    load_lookat(from, 0);
+                }
+                else if (index >= 0x86 && index <= 0x94)
+                {
+                    load_light(from, (index - 0x86) / 2);
+                }
+                else if (index >= 0x98 && index <= 0x9E)
+                {
+                    Logger::WarnOnce("RSP HLE: forced matrix loads aren't supported");
+                }
+                break;
+            }
+            case 0x04:
+            {
+                // G_VTX
+                int first = ((w0 >> 16) & 0xFF) / 2;
+                int count = (w0 >> 10) & 0x3F;
+                load_vertices(address(w1), first, count);
+                break;
+            }
+            case 0x06:
+            {
+                // G_DL
+                call_display_list(w1, ((w0 >> 16) & 0xFF) == 0);
+                break;
+            }
+            case 0xAF:
+            {
+                // G_LOAD_UCODE, the data segment address comes in the RDPHALF before it
+                load_microcode(rdp_half_1_, (w0 & 0xFFFF) + 1);
+                break;
+            }
+            case 0xB0:
+            {
+                // G_BRANCH_Z
+                branch_z((w0 & 0xFFF) / 2, w1);
+                break;
+            }
+            case 0xB1:
+            {
+                // G_TRI2
+                draw_triangle(((w0 >> 16) & 0xFF) / 2, ((w0 >> 8) & 0xFF) / 2, (w0 & 0xFF) / 2);
+                draw_triangle(((w1 >> 16) & 0xFF) / 2, ((w1 >> 8) & 0xFF) / 2, (w1 & 0xFF) / 2);
+                break;
+            }
+            case 0xB2:
+            {
+                // G_MODIFYVTX
+                modify_vertex((w0 & 0xFFFF) / 2, (w0 >> 16) & 0xFF, w1);
+                break;
+            }
+            case 0xB3:
+            {
+                // G_RDPHALF_2, only meaningful after a texture rectangle
+                break;
+            }
+            case 0xB4:
+            {
+                // G_RDPHALF_1
+                rdp_half_1_ = w1;
+                break;
+            }
+            case 0xB6:
+            {
+                // G_CLEARGEOMETRYMODE
+                geometry_mode_ &= ~w1;
+                break;
+            }
+            case 0xB7:
+            {
+                // G_SETGEOMETRYMODE
+                geometry_mode_ |= w1;
+                break;
+            }
+            case 0xB8:
+            {
+                // G_ENDDL
+                end_display_list();
+                break;
+            }
+            case 0xB9:
+            case 0xBA:
+            {
+                // G_SETOTHERMODE_L and G_SETOTHERMODE_H
+                set_other_mode(opcode == 0xBA, (w0 >> 8) & 0xFF, w0 & 0xFF, w1);
+                break;
+            }
+            case 0xBB:
+            {
+                // G_TEXTURE
+                set_texture((w0 >> 11) & 0x7, (w0 >> 8) & 0x7, (w0 & 0xFF) != 0, w1);
+                break;
+            }
+            case 0xBC:
+            {
+                // G_MOVEWORD
+                move_word(w0 & 0xFF, (w0 >> 8) & 0xFFFF, w1);
+                break;
+            }
+            case 0xBD:
+            {
+                // G_POPMTX, only the modelview matrix has a stack
+                pop_matrix(1);
+                break;
+            }
+            case 0xBE:
+            {
+                // G_CULLDL
+                cull_display_list((w0 & 0xFFFF) / 2, (w1 & 0xFFFF) / 2);
+                break;
+            }
+            case 0xBF:
+            {
+                // G_TRI1
+                draw_triangle(((w1 >> 16) & 0xFF) / 2, ((w1 >> 8) & 0xFF) / 2, (w1 & 0xFF) / 2);
+                break;
+            }
+            case 0xC0:
+            {
+                // G_NOOP
+                break;
+            }
+            default:
+            {
+                if (!execute_rdp(w0, w1))
+                {
+                    Logger::WarnOnce("RSP HLE: unhandled F3DEX command {:02x}", opcode);
+                }
+                break;
+            }
+        }
+    }
+
+    void HLEGraphics::execute_f3dex2(uint32_t w0, uint32_t w1)
+    {
+        uint8_t opcode = w0 >> 24;
+        switch (opcode)
+        {
+            case 0x00:
+            case 0xD3:
+            case 0xD4:
+            case 0xD5:
+            case 0xD6:
+            case 0xE0:
+            {
+                // G_SPNOOP, the three G_SPECIALs, G_DMA_IO and G_NOOP
+                break;
+            }
+            case 0x01:
+            {
+                // G_VTX
+                int count = (w0 >> 12) & 0xFF;
+                int first = ((w0 >> 1) & 0x7F) - count;
+                load_vertices(address(w1), first, count);
+                break;
+            }
+            case 0x02:
+            {
+                // G_MODIFYVTX
+                modify_vertex((w0 & 0xFFFF) / 2, (w0 >> 16) & 0xFF, w1);
+                break;
+            }
+            case 0x03:
+            {
+                // G_CULLDL
+                cull_display_list((w0 & 0xFFFF) / 2, (w1 & 0xFFFF) / 2);
+                break;
+            }
+            case 0x04:
+            {
+                // G_BRANCH_Z
+                branch_z((w0 & 0xFFF) / 2, w1);
+                break;
+            }
+            case 0x05:
+            {
+                // G_TRI1
+                draw_triangle(((w0 >> 16) & 0xFF) / 2, ((w0 >> 8) & 0xFF) / 2, (w0 & 0xFF) / 2);
+                break;
+            }
+            case 0x06:
+            case 0x07:
+            {
+                // G_TRI2 and G_QUAD, which is two triangles as well
+                draw_triangle(((w0 >> 16) & 0xFF) / 2, ((w0 >> 8) & 0xFF) / 2, (w0 & 0xFF) / 2);
+                draw_triangle(((w1 >> 16) & 0xFF) / 2, ((w1 >> 8) & 0xFF) / 2, (w1 & 0xFF) / 2);
+                break;
+            }
+            case 0xD7:
+            {
+                // G_TEXTURE
+                set_texture((w0 >> 11) & 0x7, (w0 >> 8) & 0x7, ((w0 >> 1) & 0x7F) != 0, w1);
+                break;
+            }
+            case 0xD8:
+            {
+                // G_POPMTX
+                pop_matrix(w1 / 64);
+                break;
+            }
+            case 0xD9:
+            {
+                // G_GEOMETRYMODE, the first word holds the bits to keep
+                geometry_mode_ = (geometry_mode_ & w0 & 0xFF'FFFF) | w1;
+                break;
+            }
+            case 0xDA:
+            {
+                // G_MTX, the push bit is stored inverted
+                uint8_t params = (w0 & 0xFF) ^ 0x1;
+                load_matrix(address(w1), params & 0x4, params & 0x2, params & 0x1);
+                break;
+            }
+            case 0xDB:
+            {
+                // G_MOVEWORD
+                move_word((w0 >> 16) & 0xFF, w0 & 0xFFFF, w1);
+                break;
+            }
+            case 0xDC:
+            {
+                // G_MOVEMEM
+                uint8_t index = w0 & 0xFF;
+                uint32_t offset = ((w0 >> 8) & 0xFF) * 8;
+                uint32_t from = address(w1);
+                if (index == 8)
+                {
+                    load_viewport(from);
+                }
+                else if (index == 10)
+                {
+                    // Both look at directions and then the lights, 24 bytes apart
+                    if (offset < 48)
+                    {
+                        load_lookat(from, offset / 24);
+                    }
+                    else
+                    {
+                        load_light(from, (offset - 48) / 24);
+                    }
+                }
+                else if (index == 14)
+                {
+                    Logger::WarnOnce("RSP HLE: forced matrix loads aren't supported");
+                }
+                break;
+            }
+            case 0xDD:
+            {
+                // G_LOAD_UCODE
+                load_microcode(rdp_half_1_, (w0 & 0xFFFF) + 1);
+                break;
+            }
+            case 0xDE:
+            {
+                // G_DL
+                call_display_list(w1, ((w0 >> 16) & 0xFF) == 0);
+                break;
+            }
+            case 0xDF:
+            {
+                // G_ENDDL
+                end_display_list();
+                break;
+            }
+            case 0xE1:
+            {
+                // G_RDPHALF_1
+                rdp_half_1_ = w1;
+                break;
+            }
+            case 0xE2:
+            case 0xE3:
+            {
+                // G_SETOTHERMODE_L and G_SETOTHERMODE_H
+                int length = (w0 & 0xFF) + 1;
+                int shift = 32 - ((w0 >> 8) & 0xFF) - length;
+                set_other_mode(opcode == 0xE3, shift, length, w1);
+                break;
+            }
+            case 0xF1:
+            {
+                // G_RDPHALF_2, only meaningful after a texture rectangle
+                break;
+            }
+            default:
+            {
+                if (!execute_rdp(w0, w1))
+                {
+                    Logger::WarnOnce("RSP HLE: unhandled F3DEX2 command {:02x}", opcode);
+                }
+                break;
+            }
+        }
+    }
+
+    bool HLEGraphics::execute_rdp(uint32_t w0, uint32_t w1)
+    {
+        uint8_t opcode = w0 >> 24;
+        if (opcode < 0xE4)
+        {
+            return false;
+        }
+
+        switch (opcode)
+        {
+            case 0xE4:
+            case 0xE5:
+            {
+                texture_rectangle(w0, w1);
+                return true;
+            }
+            case 0xEF:
+            {
+                othermode_high_ = w0 & 0xFF'FFFF;
+                othermode_low_ = w1;
+                break;
+            }
+            case 0xFD:
+            case 0xFE:
+            case 0xFF:
+            {
+                // Image addresses are segmented
+                w1 = address(w1);
+                break;
+            }
+        }
+        rdp_->SendCommand({(static_cast<uint64_t>(w0) << 32) | w1});
+        return true;
+    }
+
+    void HLEGraphics::texture_rectangle(uint32_t w0, uint32_t w1)
+    {
+        // Followed by two RDPHALF commands with the texture coordinates and their slopes, in
+        // every microcode
+        uint32_t coordinates = static_cast<uint32_t>(next_command());
+        uint32_t slopes = static_cast<uint32_t>(next_command());
+        rdp_->SendCommand({(static_cast<uint64_t>(w0) << 32) | w1,
+                           (static_cast<uint64_t>(coordinates) << 32) | slopes});
+    }
+
+    void HLEGraphics::set_other_mode(bool high, int shift, int length, uint32_t data)
+    {
+        uint32_t mask = static_cast<uint32_t>(((1ull << length) - 1) << shift);
+        uint32_t& mode = high ? othermode_high_ : othermode_low_;
+        mode = (mode & ~mask) | (data & mask);
+        uint64_t command = (0xEFull << 56) | (static_cast<uint64_t>(othermode_high_ & 0xFF'FFFF) << 32) |
+                           othermode_low_;
+        rdp_->SendCommand({command});
+    }
+
+    void HLEGraphics::set_texture(int level, int tile, bool on, uint32_t scales)
+    {
+        texture_level_ = level;
+        texture_tile_ = tile;
+        texture_on_ = on;
+        texture_scale_s_ = (scales >> 16) / 65536.0f;
+        texture_scale_t_ = (scales & 0xFFFF) / 65536.0f;
+    }
+
+    void HLEGraphics::move_word(uint32_t index, uint32_t offset, uint32_t value)
+    {
+        switch (index)
+        {
+            case G_MW_MATRIX:
+            {
+                // Two halfwords of the combined matrix, integer parts first
+                bool fraction = offset >= 0x20;
+                int element = (offset & 0x1F) / 2;
+                for (int i = 0; i < 2; i++)
+                {
+                    float& entry = mvp_[(element + i) / 4][(element + i) % 4];
+                    uint16_t half = i == 0 ? value >> 16 : value;
+                    float integer = std::floor(entry);
+                    entry = fraction ? integer + half / 65536.0f
+                                     : static_cast<int16_t>(half) + (entry - integer);
+                }
+                break;
+            }
+            case G_MW_NUMLIGHT:
+            {
+                int count = microcode_ == Microcode::F3DEX2
+                                ? static_cast<int>(value / 24)
+                                : static_cast<int>((value - 0x8000'0000) / 32) - 1;
+                light_count_ = std::clamp(count, 0, 7);
+                break;
+            }
+            case G_MW_SEGMENT:
+            {
+                segments_[(offset / 4) & 0xF] = value & 0xFF'FFFF;
+                break;
+            }
+            case G_MW_FOG:
+            {
+                fog_multiplier_ = static_cast<int16_t>(value >> 16);
+                fog_offset_ = static_cast<int16_t>(value);
+                break;
+            }
+            case G_MW_LIGHTCOL:
+            {
+                uint32_t stride = microcode_ == Microcode::F3DEX2 ? 24 : 32;
+                Light& light = lights_[(offset / stride) & 7];
+                // col and colc are both written, only the first is used
+                light.color = {static_cast<float>(value >> 24),
+                               static_cast<float>((value >> 16) & 0xFF),
+                               static_cast<float>((value >> 8) & 0xFF)};
+                break;
+            }
+            case G_MW_CLIP:
+            case G_MW_POINTS:
+            case G_MW_PERSPNORM:
+            {
+                break;
+            }
+            default:
+            {
+                Logger::WarnOnce("RSP HLE: unhandled moveword index {:02x}", index);
+                break;
+            }
+        }
+    }
+
+    void HLEGraphics::load_microcode(uint32_t data, uint32_t size)
+    {
+        Microcode microcode = IdentifyGraphicsMicrocode(memory_, data, size);
+        if (microcode == Microcode::Unknown)
+        {
+            // Can't hand a half done display list back to the RSP, drop the rest of it
+            microcode_ = Microcode::Unknown;
+            done_ = true;
+            return;
+        }
+        microcode_ = microcode;
+    }
+
+    void HLEGraphics::call_display_list(uint32_t segmented, bool push)
+    {
+        if (push)
+        {
+            if (dl_stack_.size() >= 18)
+            {
+                Logger::WarnOnce("RSP HLE: display list stack overflow");
+                return;
+            }
+            dl_stack_.push_back(pc_);
+        }
+        pc_ = address(segmented);
+    }
+
+    void HLEGraphics::end_display_list()
+    {
+        if (dl_stack_.empty())
+        {
+            done_ = true;
+            return;
+        }
+        pc_ = dl_stack_.back();
+        dl_stack_.pop_back();
+    }
+
+    void HLEGraphics::cull_display_list(int first, int last)
+    {
+        uint8_t outside = CLIP_LEFT | CLIP_RIGHT | CLIP_TOP | CLIP_BOTTOM | CLIP_NEAR | CLIP_FAR;
+        for (int i = first; i <= last && i < static_cast<int>(vertices_.size()); i++)
+        {
+            outside &= vertices_[i].clip;
+        }
+        if (outside)
+        {
+            end_display_list();
+        }
+    }
+
+    void HLEGraphics::branch_z(int vertex, uint32_t z)
+    {
+        // Taken when the vertex is at least as close as the value, which is a screen z in
+        // s15.16 with 0x3FF the far plane
+        const Vertex& v = vertices_[vertex & 63];
+        if (v.sz / 32.0f <= static_cast<int32_t>(z) / 65536.0f)
+        {
+            pc_ = address(rdp_half_1_);
+        }
+    }
+
+    void HLEGraphics::load_matrix(uint32_t address, bool projection, bool load, bool push)
+    {
+        Matrix matrix;
+        for (int i = 0; i < 16; i++)
+        {
+            int16_t integer = memory_.Read16(address + i * 2);
+            uint16_t fraction = memory_.Read16(address + 32 + i * 2);
+            matrix[i / 4][i % 4] = s15_16(integer, fraction);
+        }
+
+        // Row vectors, so a matrix multiplied onto the current one applies first
+        auto multiply = [](const Matrix& a, const Matrix& b) {
+            Matrix result{};
+            for (int i = 0; i < 4; i++)
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    for (int k = 0; k < 4; k++)
+                    {
+                        result[i][j] += a[i][k] * b[k][j];
+                    }
+                }
+            }
+            return result;
+        };
+
+        if (projection)
+        {
+            projection_ = load ? matrix : multiply(matrix, projection_);
+        }
+        else
+        {
+            if (push)
+            {
+                if (modelview_stack_.size() >= 32)
+                {
+                    Logger::WarnOnce("RSP HLE: matrix stack overflow");
+                }
+                else
+                {
+                    modelview_stack_.push_back(modelview_stack_.back());
+                }
+            }
+            Matrix& modelview = modelview_stack_.back();
+            modelview = load ? matrix : multiply(matrix, modelview);
+            lights_dirty_ = true;
+        }
+        mvp_ = multiply(modelview_stack_.back(), projection_);
+    }
+
+    void HLEGraphics::pop_matrix(int count)
+    {
+        while (count-- > 0 && modelview_stack_.size() > 1)
+        {
+            modelview_stack_.pop_back();
+        }
+        Matrix result{};
+        const Matrix& modelview = modelview_stack_.back();
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    result[i][j] += modelview[i][k] * projection_[k][j];
+                }
+            }
+        }
+        mvp_ = result;
+        lights_dirty_ = true;
+    }
+
+    void HLEGraphics::load_viewport(uint32_t address)
+    {
+        // Scale and translation for x and y are in quarter pixels, y is flipped since clip
+        // space points up
+        for (int i = 0; i < 3; i++)
+        {
+            float scale = static_cast<int16_t>(memory_.Read16(address + i * 2));
+            float translate = static_cast<int16_t>(memory_.Read16(address + 8 + i * 2));
+            viewport_scale_[i] = i < 2 ? scale / 4.0f : scale;
+            viewport_translate_[i] = i < 2 ? translate / 4.0f : translate;
+        }
+        viewport_scale_[1] = -viewport_scale_[1];
+    }
+
+    void HLEGraphics::load_light(uint32_t address, int index)
+    {
+        if (index < 0 || index >= static_cast<int>(lights_.size()))
+        {
+            return;
+        }
+        Light& light = lights_[index];
+        for (int i = 0; i < 3; i++)
+        {
+            light.color[i] = memory_.Read8(address + i);
+            light.direction[i] = static_cast<int8_t>(memory_.Read8(address + 8 + i));
+        }
+        lights_dirty_ = true;
+    }
+
+    void HLEGraphics::load_lookat(uint32_t address, int index)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            lookat_[index & 1][i] = static_cast<int8_t>(memory_.Read8(address + 8 + i));
+        }
+        lights_dirty_ = true;
+    }
+
+    void HLEGraphics::update_lights()
+    {
+        // Directions are given in world space, taking them to model space once is cheaper than
+        // taking every normal out of it
+        const Matrix& modelview = modelview_stack_.back();
+        auto to_model = [&modelview](const std::array<float, 3>& direction) {
+            std::array<float, 3> result;
+            for (int i = 0; i < 3; i++)
+            {
+                result[i] = modelview[i][0] * direction[0] + modelview[i][1] * direction[1] +
+                            modelview[i][2] * direction[2];
+            }
+            float length = std::sqrt(result[0] * result[0] + result[1] * result[1] +
+                                     result[2] * result[2]);
+            if (length > 0)
+            {
+                for (auto& component : result)
+                {
+                    component /= length;
+                }
+            }
+            return result;
+        };
+
+        for (size_t i = 0; i < lights_.size(); i++)
+        {
+            model_lights_[i] = to_model(lights_[i].direction);
+        }
+        for (size_t i = 0; i < lookat_.size(); i++)
+        {
+            model_lookat_[i] = to_model(lookat_[i]);
+        }
+        lights_dirty_ = false;
+    }
+
+    void HLEGraphics::load_vertices(uint32_t address, int first, int count)
+    {
+        if (first < 0 || first + count > static_cast<int>(vertices_.size()))
+        {
+            Logger::WarnOnce("RSP HLE: vertex load out of bounds");
+            return;
+        }
+
+        bool lighting = geometry_mode_ & G_LIGHTING;
+        if (lighting && lights_dirty_)
+        {
+            update_lights();
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t from = address + i * 16;
+            Vertex& vertex = vertices_[first + i];
+            float position[3];
+            for (int j = 0; j < 3; j++)
+            {
+                position[j] = static_cast<int16_t>(memory_.Read16(from + j * 2));
+            }
+            float* clip[4] = {&vertex.x, &vertex.y, &vertex.z, &vertex.w};
+            for (int j = 0; j < 4; j++)
+            {
+                *clip[j] = position[0] * mvp_[0][j] + position[1] * mvp_[1][j] +
+                           position[2] * mvp_[2][j] + mvp_[3][j];
+            }
+
+            vertex.s = static_cast<int16_t>(memory_.Read16(from + 8));
+            vertex.t = static_cast<int16_t>(memory_.Read16(from + 10));
+            std::array<uint8_t, 4> color;
+            for (int j = 0; j < 4; j++)
+            {
+                color[j] = memory_.Read8(from + 12 + j);
+            }
+            vertex.a = color[3];
+
+            if (lighting)
+            {
+                // The color is a normal when lighting is on
+                std::array<float, 3> normal;
+                for (int j = 0; j < 3; j++)
+                {
+                    normal[j] = static_cast<int8_t>(color[j]) / 127.0f;
+                }
+                auto dot = [&normal](const std::array<float, 3>& direction) {
+                    return normal[0] * direction[0] + normal[1] * direction[1] +
+                           normal[2] * direction[2];
+                };
+
+                std::array<float, 3> lit = lights_[light_count_].color;
+                for (int l = 0; l < light_count_; l++)
+                {
+                    float intensity = std::max(dot(model_lights_[l]), 0.0f);
+                    for (int j = 0; j < 3; j++)
+                    {
+                        lit[j] += intensity * lights_[l].color[j];
+                    }
+                }
+                vertex.r = std::min(lit[0], 255.0f);
+                vertex.g = std::min(lit[1], 255.0f);
+                vertex.b = std::min(lit[2], 255.0f);
+
+                if (geometry_mode_ & G_TEXTURE_GEN)
+                {
+                    // Approximation of the microcode's spherical mapping, the result spans
+                    // the same range before the texture scale is applied
+                    float x = std::clamp(dot(model_lookat_[0]), -1.0f, 1.0f);
+                    float y = std::clamp(dot(model_lookat_[1]), -1.0f, 1.0f);
+                    if (geometry_mode_ & G_TEXTURE_GEN_LINEAR)
+                    {
+                        vertex.s = std::acos(x) * (32768.0f / std::numbers::pi_v<float>);
+                        vertex.t = std::acos(y) * (32768.0f / std::numbers::pi_v<float>);
+                    }
+                    else
+                    {
+                        vertex.s = (x + 1.0f) * 16384.0f;
+                        vertex.t = (y + 1.0f) * 16384.0f;
+                    }
+                }
+            }
+            else
+            {
+                vertex.r = color[0];
+                vertex.g = color[1];
+                vertex.b = color[2];
+            }
+
+            vertex.s *= texture_scale_s_;
+            vertex.t *= texture_scale_t_;
+
+            if (geometry_mode_ & G_FOG)
+            {
+                float depth = vertex.w > 0 ? vertex.z / vertex.w : -1.0f;
+                vertex.a = std::clamp(depth * fog_multiplier_ + fog_offset_, 0.0f, 255.0f);
+            }
+
+            project(vertex);
+        }
+    }
+
+    void HLEGraphics::modify_vertex(int index, uint32_t where, uint32_t value)
+    {
+        if (index < 0 || index >= static_cast<int>(vertices_.size()))
+        {
+            return;
+        }
+        Vertex& vertex = vertices_[index];
+        switch (where)
+        {
+            case 0x10:
+            {
+                vertex.r = value >> 24;
+                vertex.g = (value >> 16) & 0xFF;
+                vertex.b = (value >> 8) & 0xFF;
+                vertex.a = value & 0xFF;
+                break;
+            }
+            case 0x14:
+            {
+                vertex.s = static_cast<int16_t>(value >> 16);
+                vertex.t = static_cast<int16_t>(value);
+                break;
+            }
+            case 0x18:
+            {
+                // Screen coordinates in quarter pixels, the vertex is drawn where it's put
+                vertex.sx = static_cast<int16_t>(value >> 16) / 4.0f;
+                vertex.sy = static_cast<int16_t>(value) / 4.0f;
+                vertex.clip = 0;
+                break;
+            }
+            case 0x1C:
+            {
+                vertex.sz = static_cast<int32_t>(value) / 65536.0f * 32.0f;
+                break;
+            }
+            default:
+            {
+                Logger::WarnOnce("RSP HLE: unhandled vertex modification {:02x}", where);
+                break;
+            }
+        }
+    }
+
+    void HLEGraphics::project(Vertex& vertex)
+    {
+        vertex.clip = 0;
+        vertex.clip |= vertex.x < -vertex.w ? CLIP_LEFT : 0;
+        vertex.clip |= vertex.x > vertex.w ? CLIP_RIGHT : 0;
+        vertex.clip |= vertex.y > vertex.w ? CLIP_TOP : 0;
+        vertex.clip |= vertex.y < -vertex.w ? CLIP_BOTTOM : 0;
+        vertex.clip |= vertex.z < -vertex.w ? CLIP_NEAR : 0;
+        vertex.clip |= vertex.z > vertex.w ? CLIP_FAR : 0;
+
+        float inverse_w = vertex.w > NEAR_W ? 1.0f / vertex.w : 1.0f / NEAR_W;
+        vertex.sx = vertex.x * inverse_w * viewport_scale_[0] + viewport_translate_[0];
+        vertex.sy = vertex.y * inverse_w * viewport_scale_[1] + viewport_translate_[1];
+        float z = (vertex.z * inverse_w * viewport_scale_[2] + viewport_translate_[2]) * 32.0f;
+        vertex.sz = std::clamp(z, 0.0f, 32767.0f);
+    }
+
+    void HLEGraphics::draw_triangle(int v0, int v1, int v2)
+    {
+        std::array<Vertex, 3> triangle = {vertices_[v0 & 63], vertices_[v1 & 63],
+                                          vertices_[v2 & 63]};
+        if (triangle[0].clip & triangle[1].clip & triangle[2].clip)
+        {
+            return;
+        }
+
+        // Flat shading uses the first vertex's color
+        if (!(geometry_mode_ & smooth_shading_bit()))
+        {
+            for (int i = 1; i < 3; i++)
+            {
+                triangle[i].r = triangle[0].r;
+                triangle[i].g = triangle[0].g;
+                triangle[i].b = triangle[0].b;
+                triangle[i].a = triangle[0].a;
+            }
+        }
+
+        auto inside_guard = [](const Vertex& v) {
+            float band = v.w * GUARD_BAND;
+            return v.w > NEAR_W && v.z >= -v.w && v.x >= -band && v.x <= band && v.y >= -band &&
+                   v.y <= band;
+        };
+        // Vertices moved in screen space with G_MODIFYVTX are taken as they are
+        auto unclipped = [&inside_guard](const Vertex& v) { return v.clip == 0 || inside_guard(v); };
+        if (unclipped(triangle[0]) && unclipped(triangle[1]) && unclipped(triangle[2]))
+        {
+            send_triangle(triangle[0], triangle[1], triangle[2]);
+            return;
+        }
+
+        clip_triangle(triangle);
+    }
+
+    void HLEGraphics::clip_triangle(const std::array<Vertex, 3>& triangle)
+    {
+        // Sutherland-Hodgman in clip space, where attributes interpolate linearly
+        using Plane = float (*)(const Vertex&);
+        static constexpr Plane planes[] = {
+            [](const Vertex& v) { return v.z + v.w; },
+            [](const Vertex& v) { return v.w - NEAR_W; },
+            [](const Vertex& v) { return v.w * GUARD_BAND - v.x; },
+            [](const Vertex& v) { return v.w * GUARD_BAND + v.x; },
+            [](const Vertex& v) { return v.w * GUARD_BAND - v.y; },
+            [](const Vertex& v) { return v.w * GUARD_BAND + v.y; },
+        };
+        constexpr size_t max_vertices = 3 + std::size(planes);
+
+        std::array<Vertex, max_vertices> polygon{};
+        std::array<Vertex, max_vertices> next{};
+        std::copy(triangle.begin(), triangle.end(), polygon.begin());
+        size_t count = 3;
+
+        for (Plane plane : planes)
+        {
+            size_t next_count = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                const Vertex& current = polygon[i];
+                const Vertex& following = polygon[(i + 1) % count];
+                float d0 = plane(current);
+                float d1 = plane(following);
+                if (d0 >= 0)
+                {
+                    next[next_count++] = current;
+                }
+                if ((d0 >= 0) != (d1 >= 0) && next_count < max_vertices)
+                {
+                    float t = d0 / (d0 - d1);
+                    auto lerp = [t](float a, float b) { return a + (b - a) * t; };
+                    Vertex& v = next[next_count++];
+                    v.x = lerp(current.x, following.x);
+                    v.y = lerp(current.y, following.y);
+                    v.z = lerp(current.z, following.z);
+                    v.w = lerp(current.w, following.w);
+                    v.r = lerp(current.r, following.r);
+                    v.g = lerp(current.g, following.g);
+                    v.b = lerp(current.b, following.b);
+                    v.a = lerp(current.a, following.a);
+                    v.s = lerp(current.s, following.s);
+                    v.t = lerp(current.t, following.t);
+                }
+            }
+            polygon = next;
+            count = next_count;
+            if (count < 3)
+            {
+                return;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            project(polygon[i]);
+        }
+        for (size_t i = 1; i + 1 < count; i++)
+        {
+            send_triangle(polygon[0], polygon[i], polygon[i + 1]);
+        }
+    }
+
+    void HLEGraphics::send_triangle(const Vertex& a, const Vertex& b, const Vertex& c)
+    {
+        // Front faces are counterclockwise on screen, which is clockwise once y points down
+        float area = (b.sx - a.sx) * (c.sy - a.sy) - (b.sy - a.sy) * (c.sx - a.sx);
+        if ((area > 0 && (geometry_mode_ & cull_back_bit())) ||
+            (area < 0 && (geometry_mode_ & cull_front_bit())))
+        {
+            return;
+        }
+
+        bool shade = geometry_mode_ & G_SHADE;
+        bool texture = texture_on_;
+        bool depth = geometry_mode_ & G_ZBUFFER;
+
+        const Vertex* v1 = &a;
+        const Vertex* v2 = &b;
+        const Vertex* v3 = &c;
+        if (v1->sy > v2->sy)
+        {
+            std::swap(v1, v2);
+        }
+        if (v2->sy > v3->sy)
+        {
+            std::swap(v2, v3);
+        }
+        if (v1->sy > v2->sy)
+        {
+            std::swap(v1, v2);
+        }
+
+        auto to_s11_2 = [](float y) {
+            return static_cast<int32_t>(std::clamp(std::floor(y * 4.0f), -8192.0f, 8191.0f));
+        };
+        int32_t y1f = to_s11_2(v1->sy);
+        int32_t y2f = to_s11_2(v2->sy);
+        int32_t y3f = to_s11_2(v3->sy);
+        float y1 = y1f / 4.0f;
+        float y2 = y2f / 4.0f;
+        float y3 = y3f / 4.0f;
+
+        float hx = v3->sx - v1->sx;
+        float hy = y3 - y1;
+        float mx = v2->sx - v1->sx;
+        float my = y2 - y1;
+        float lx = v3->sx - v2->sx;
+        float ly = y3 - y2;
+        float nz = hx * my - hy * mx;
+        float attr_factor = std::fabs(nz) > 1e-20f ? -1.0f / nz : 0.0f;
+        uint64_t lft = nz < 0;
+
+        float ish = safe_div(hx, hy);
+        float ism = safe_div(mx, my);
+        float isl = safe_div(lx, ly);
+        float fy = std::floor(y1) - y1;
+        float xh = v1->sx + fy * ish;
+        float xm = v1->sx + fy * ism;
+        float xl = v2->sx;
+
+        auto edge = [](float x, float slope) {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(float_to_s16_16(x))) << 32) |
+                   static_cast<uint32_t>(float_to_s16_16(slope));
+        };
+
+        uint64_t id = 0x08 | (shade << 2) | (texture << 1) | depth;
+        std::array<uint64_t, RDP_MAX_COMMAND_LENGTH> command;
+        size_t length = 0;
+        command[length++] = (id << 56) | (lft << 55) |
+                            (static_cast<uint64_t>(texture_level_) << 51) |
+                            (static_cast<uint64_t>(texture_tile_) << 48) |
+                            (static_cast<uint64_t>(y3f & 0x3FFF) << 32) |
+                            (static_cast<uint64_t>(y2f & 0x3FFF) << 16) | (y1f & 0x3FFF);
+        command[length++] = edge(xl, isl);
+        command[length++] = edge(xh, ish);
+        command[length++] = edge(xm, ism);
+
+        // Value at the top of the triangle and the gradients along x, y and the major edge
+        struct Gradient
+        {
+            int32_t value, dx, dy, de;
+        };
+        auto gradient = [&](float a1, float a2, float a3) {
+            float ma = a2 - a1;
+            float ha = a3 - a1;
+            float dx = (hy * ma - my * ha) * attr_factor;
+            float dy = (mx * ha - hx * ma) * attr_factor;
+            float de = dy + dx * ish;
+            return Gradient{float_to_s16_16(a1 + fy * de), float_to_s16_16(dx),
+                            float_to_s16_16(dy), float_to_s16_16(de)};
+        };
+        auto push_attributes = [&command, &length](const Gradient& g0, const Gradient& g1,
+                                                   const Gradient& g2, const Gradient& g3) {
+            AttributeWords value = split(g0.value, g1.value, g2.value, g3.value);
+            AttributeWords dx = split(g0.dx, g1.dx, g2.dx, g3.dx);
+            AttributeWords de = split(g0.de, g1.de, g2.de, g3.de);
+            AttributeWords dy = split(g0.dy, g1.dy, g2.dy, g3.dy);
+            for (uint64_t word : {value.integer, dx.integer, value.fraction, dx.fraction,
+                                  de.integer, dy.integer, de.fraction, dy.fraction})
+            {
+                command[length++] = word;
+            }
+        };
+
+        if (shade)
+        {
+            push_attributes(gradient(v1->r, v2->r, v3->r), gradient(v1->g, v2->g, v3->g),
+                            gradient(v1->b, v2->b, v3->b), gradient(v1->a, v2->a, v3->a));
+        }
+
+        if (texture)
+        {
+            // Perspective correction divides by w per pixel, so s and t go in premultiplied
+            // by a 1/w normalized against the closest vertex
+            float w1 = 1.0f / std::max(v1->w, NEAR_W);
+            float w2 = 1.0f / std::max(v2->w, NEAR_W);
+            float w3 = 1.0f / std::max(v3->w, NEAR_W);
+            float normalize = 1.0f / std::max({w1, w2, w3});
+            w1 *= normalize;
+            w2 *= normalize;
+            w3 *= normalize;
+            Gradient none{};
+            push_attributes(gradient(v1->s * w1, v2->s * w2, v3->s * w3),
+                            gradient(v1->t * w1, v2->t * w2, v3->t * w3),
+                            gradient(w1 * 0x7FFF, w2 * 0x7FFF, w3 * 0x7FFF), none);
+        }
+
+        if (depth)
+        {
+            Gradient z = gradient(v1->sz, v2->sz, v3->sz);
+            command[length++] = (static_cast<uint64_t>(static_cast<uint32_t>(z.value)) << 32) |
+                                static_cast<uint32_t>(z.dx);
+            command[length++] = (static_cast<uint64_t>(static_cast<uint32_t>(z.de)) << 32) |
+                                static_cast<uint32_t>(z.dy);
+        }
+
+        rdp_->SendCommand(std::span<const uint64_t>(command.data(), length));
+    }
+
+    uint32_t HLEGraphics::cull_front_bit() const
+    {
+        return microcode_ == Microcode::F3DEX2 ? 0x0000'0200 : 0x0000'1000;
+    }
+
+    uint32_t HLEGraphics::cull_back_bit() const
+    {
+        return microcode_ == Microcode::F3DEX2 ? 0x0000'0400 : 0x0000'2000;
+    }
+
+    uint32_t HLEGraphics::smooth_shading_bit() const
+    {
+        return microcode_ == Microcode::F3DEX2 ? 0x0020'0000 : 0x0000'0200;
+    }
+} // namespace hydra::N64
@@ -0,0 +1,1730 @@
+#include <log.hxx>
+#include <n64/core/n64_rsp.hxx>
+#include <n64/core/n64_rsp_jit.hxx>
+
+#if N64_JIT_AVAILABLE
+#include <cstddef>
+#include <cstring>
+#include <n64/core/n64_register_allocation.hxx>
+
+namespace
+{
+    constexpr int MaxBlockInstructions = 64;
+    constexpr uint32_t MaxBlockBytes = MaxBlockInstructions * 4;
+    constexpr size_t CodeCacheSize = 4 * 1024 * 1024;
+    // A memory access with its slow path is the biggest thing we emit per instruction
+    constexpr size_t MaxBlockSize = MaxBlockInstructions * 128;
+
+    static_assert(sizeof(hydra::N64::MemDataUnionW) == sizeof(uint32_t));
+
+    enum class Condition { Equal, NotEqual, LessEqual, Greater, Less, GreaterEqual };
+
+    enum class InstructionKind { Normal, Branch, EndsBlock };
+
+    InstructionKind classify(uint32_t data)
+    {
+        hydra::N64::Instruction instruction{.full = data};
+        switch (instruction.IType.op)
+        {
+            case 0b000000:
+            {
+                switch (instruction.RType.func)
+                {
+                    case 0b001000: // JR
+                    case 0b001001: // JALR
+                        return InstructionKind::Branch;
+                    case 0b001101: // BREAK
+                        return InstructionKind::EndsBlock;
+                }
+                return InstructionKind::Normal;
+            }
+            case 0b000001:
+            {
+                switch (instruction.IType.rt)
+                {
+                    case 0b00000: // BLTZ
+                    case 0b00001: // BGEZ
+                    case 0b10000: // BLTZAL
+                    case 0b10001: // BGEZAL
+                        return InstructionKind::Branch;
+                }
+                return InstructionKind::Normal;
+            }
+            case 0b000010: // J
+            case 0b000011: // JAL
+            case 0b000100: // BEQ
+            case 0b000101: // BNE
+            case 0b000110: // BLEZ
+            case 0b000111: // BGTZ
+                return InstructionKind::Branch;
+            case 0b010000:
+            {
+                // MTC0 can halt the RSP or DMA new code into IMEM
+                return instruction.RType.rs == 4 ? InstructionKind::EndsBlock
+                                                 : InstructionKind::Normal;
+            }
+        }
+        return InstructionKind::Normal;
+    }
+
+    template <class T>
+    int32_t state_offset(hydra::N64::RSP& rsp, T& member)
+    {
+        return reinterpret_cast<uint8_t*>(&member) - reinterpret_cast<uint8_t*>(&rsp);
+    }
+
+    // pshufb masks for the 16 vt element selectors, same as the ones in n64_rsp_vu_sse.cxx
+    constexpr std::array<std::array<uint8_t, 16>, 16> make_shuffles()
+    {
+        std::array<std::array<uint8_t, 16>, 16> shuffles{};
+        for (int element = 0; element < 16; element++)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                int lane = element < 2   ? i
+                           : element < 4 ? (i & ~1) | (element & 1)
+                           : element < 8 ? (i & ~3) | (element & 3)
+                                         : element & 7;
+                shuffles[element][i * 2] = lane * 2;
+                shuffles[element][i * 2 + 1] = lane * 2 + 1;
+            }
+        }
+        return shuffles;
+    }
+
+    alignas(16) constexpr std::array<std::array<uint8_t, 16>, 16> shuffles = make_shuffles();
+    // DMEM is big endian and the vector registers are host endian
+    alignas(16) constexpr std::array<uint8_t, 16> byte_swap = {1, 0, 3,  2,  5,  4,  7,  6,
+                                                               9, 8, 11, 10, 13, 12, 15, 14};
+    alignas(16) constexpr std::array<uint16_t, 8> lane_bits = {1, 2, 4, 8, 16, 32, 64, 128};
+    alignas(16) constexpr std::array<uint16_t, 8> sign_bits = {0x8000, 0x8000, 0x8000, 0x8000,
+                                                               0x8000, 0x8000, 0x8000, 0x8000};
+} // namespace
+
+#define rsp_state(member) (StatePointer + state_offset(rsp_, rsp_.member))
+
+namespace hydra::N64
+{
+    struct RSPJit::Emitter : x64::Emitter
+    {
+        Emitter() : x64::Emitter(CodeCacheSize) {}
+
+        void cmov(Condition condition, const Reg32& dst, const Reg32& src)
+        {
+            switch (condition)
+            {
+                case Condition::Equal:
+                    return cmove(dst, src);
+                case Condition::NotEqual:
+                    return cmovne(dst, src);
+                case Condition::LessEqual:
+                    return cmovle(dst, src);
+                case Condition::Greater:
+                    return cmovg(dst, src);
+                case Condition::Less:
+                    return cmovl(dst, src);
+                case Condition::GreaterEqual:
+                    return cmovge(dst, src);
+            }
+        }
+
+        // The vector helpers below mirror the ones in n64_rsp_vu_sse.cxx. vs is in xmm1, the
+        // shuffled vt in xmm2 and the accumulator parts in xmm3 (high), xmm4 (middle) and xmm5
+        // (low). Clamped results end up in xmm1, rax and xmm0 to xmm7 are clobbered.
+
+        void load_constant(const Xmm& dst, const void* data)
+        {
+            mov(rax, reinterpret_cast<uintptr_t>(data));
+            movdqa(dst, xword[rax]);
+        }
+
+        void ones(const Xmm& dst)
+        {
+            pcmpeqw(dst, dst);
+        }
+
+        void zero(const Xmm& dst)
+        {
+            pxor(dst, dst);
+        }
+
+        // Bit i of eax becomes lane i of dst
+        void expand_mask(const Xmm& dst)
+        {
+            movd(dst, eax);
+            pshuflw(dst, dst, 0);
+            pshufd(dst, dst, 0);
+            mov(rax, reinterpret_cast<uintptr_t>(lane_bits.data()));
+            pand(dst, xword[rax]);
+            pcmpeqw(dst, xword[rax]);
+        }
+
+        // The lanes of low go to bits 0-7 of eax and the ones of high to bits 8-15, low is
+        // clobbered
+        void pack_mask(const Xmm& low, const Xmm& high)
+        {
+            packsswb(low, high);
+            pmovmskb(eax, low);
+        }
+
+        void store_accumulator(const RegExp& accumulator)
+        {
+            movdqa(xword[accumulator + offsetof(Accumulator, high)], xmm3);
+            movdqa(xword[accumulator + offsetof(Accumulator, middle)], xmm4);
+            movdqa(xword[accumulator + offsetof(Accumulator, low)], xmm5);
+        }
+
+        // 2 * vs * vt, rounded by 0x8000 when round is set
+        void fraction_product(bool round)
+        {
+            movdqa(xmm5, xmm1);
+            pmullw(xmm5, xmm2);
+            movdqa(xmm3, xmm1);
+            pmulhw(xmm3, xmm2);
+            movdqa(xmm4, xmm3);
+            psllw(xmm4, 1);
+            movdqa(xmm6, xmm5);
+            psrlw(xmm6, 15);
+            por(xmm4, xmm6);
+            psllw(xmm5, 1);
+            if (!round)
+            {
+                psraw(xmm3, 15);
+                return;
+            }
+            movdqa(xmm6, xmm5);
+            psrlw(xmm6, 15);
+            paddw(xmm4, xmm6);
+            load_constant(xmm6, sign_bits.data());
+            pxor(xmm5, xmm6);
+            // Only 0x8000 * 0x8000 doesn't fit in 32 bits after doubling
+            pcmpeqw(xmm6, xmm1);
+            movdqa(xmm7, xmm1);
+            pcmpeqw(xmm7, xmm2);
+            pand(xmm6, xmm7);
+            movdqa(xmm3, xmm4);
+            psraw(xmm3, 15);
+            pandn(xmm6, xmm3);
+            movdqa(xmm3, xmm6);
+        }
+
+        // Signed a times unsigned b
+        void mixed_product(const Xmm& a, const Xmm& b)
+        {
+            movdqa(xmm4, a);
+            pmulhw(xmm4, b);
+            movdqa(xmm6, b);
+            psraw(xmm6, 15);
+            pand(xmm6, a);
+            paddw(xmm4, xmm6);
+            movdqa(xmm3, xmm4);
+            psraw(xmm3, 15);
+            movdqa(xmm5, a);
+            pmullw(xmm5, b);
+        }
+
+        // Adds the product to the accumulator, vs and vt are gone afterwards
+        void accumulate(const RegExp& accumulator)
+        {
+            ones(xmm7);
+            movdqa(xmm6, xword[accumulator + offsetof(Accumulator, low)]);
+            paddw(xmm6, xmm5);
+            pmaxuw(xmm5, xmm6);
+            pcmpeqw(xmm5, xmm6);
+            pxor(xmm5, xmm7);
+            movdqa(xmm0, xword[accumulator + offsetof(Accumulator, middle)]);
+            paddw(xmm0, xmm4);
+            pmaxuw(xmm4, xmm0);
+            pcmpeqw(xmm4, xmm0);
+            pxor(xmm4, xmm7);
+            psubw(xmm0, xmm5);
+            // Adding the low carry can only wrap a middle part that was 0xFFFF
+            zero(xmm1);
+            pcmpeqw(xmm1, xmm0);
+            pand(xmm1, xmm5);
+            por(xmm4, xmm1);
+            paddw(xmm3, xword[accumulator + offsetof(Accumulator, high)]);
+            psubw(xmm3, xmm4);
+            movdqa(xmm4, xmm0);
+            movdqa(xmm5, xmm6);
+            store_accumulator(accumulator);
+        }
+
+        // high:middle as a signed 32-bit value, saturated to 16 bits
+        void clamp_signed()
+        {
+            movdqa(xmm1, xmm4);
+            punpcklwd(xmm1, xmm3);
+            movdqa(xmm2, xmm4);
+            punpckhwd(xmm2, xmm3);
+            packssdw(xmm1, xmm2);
+        }
+
+        // Negative values become 0 and anything above 0x7FFF becomes 0xFFFF
+        void clamp_unsigned()
+        {
+            movdqa(xmm1, xmm4);
+            punpcklwd(xmm1, xmm3);
+            movdqa(xmm2, xmm4);
+            punpckhwd(xmm2, xmm3);
+            packusdw(xmm1, xmm2);
+            movdqa(xmm2, xmm1);
+            psraw(xmm2, 15);
+            por(xmm1, xmm2);
+        }
+
+        // The low part if high:middle is just a sign extension, otherwise 0 or 0xFFFF
+        // depending on the sign
+        void clamp_low()
+        {
+            movdqa(xmm0, xmm4);
+            psraw(xmm0, 15);
+            pcmpeqw(xmm0, xmm3);
+            movdqa(xmm1, xmm3);
+            psraw(xmm1, 15);
+            ones(xmm2);
+            pxor(xmm1, xmm2);
+            pblendvb(xmm1, xmm5);
+        }
+    };
+
+    RSPJit::RSPJit(RSP& rsp)
+        : rsp_(rsp), code_(std::make_unique<Emitter>()),
+          vector_ops_(__builtin_cpu_supports("sse4.1"))
+    {
+    }
+
+    RSPJit::~RSPJit() = default;
+
+    int RSPJit::Run()
+    {
+        uint32_t pc = rsp_.pc_ & 0xFFC;
+        Block& block = blocks_[pc >> 2];
+        if (!block.compiled || (block.stale && !is_unchanged(pc, block))) [[unlikely]]
+        {
+            compile(pc);
+        }
+        block.stale = false;
+        if (!block.func)
+        {
+            return 0;
+        }
+        return block.func(&rsp_);
+    }
+
+    void RSPJit::Reset()
+    {
+        code_->Reset();
+        for (auto& block : blocks_)
+        {
+            block = {};
+        }
+    }
+
+    void RSPJit::InvalidateRange(uint32_t address, uint32_t length)
+    {
+        if (length == 0)
+        {
+            return;
+        }
+        address &= 0xFFF;
+        if (length >= 0x1000)
+        {
+            invalidate_span(0, 0x1000);
+            return;
+        }
+        uint32_t end = address + length;
+        if (end > 0x1000)
+        {
+            invalidate_span(address, 0x1000);
+            invalidate_span(0, end - 0x1000);
+        }
+        else
+        {
+            invalidate_span(address, end);
+        }
+    }
+
+    void RSPJit::invalidate_span(uint32_t begin, uint32_t end)
+    {
+        // Blocks that start before the range can still reach into it
+        uint32_t first = begin < MaxBlockBytes ? 0 : (begin - MaxBlockBytes) & ~3u;
+        for (uint32_t pc = first; pc < end; pc += 4)
+        {
+            Block& block = blocks_[pc >> 2];
+            if (block.compiled && pc + block.code.size() * 4 > begin)
+            {
+                block.stale = true;
+            }
+        }
+    }
+
+    bool RSPJit::is_unchanged(uint32_t pc, const Block& block)
+    {
+        for (size_t i = 0; i < block.code.size(); i++)
+        {
+            uint32_t data;
+            memcpy(&data, &rsp_.mem_[0x1000 + pc + i * 4], sizeof(uint32_t));
+            if (hydra::bswap32(data) != block.code[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    RSPJit::BlockFunc RSPJit::compile(uint32_t pc)
+    {
+        auto fetch = [this](uint32_t address) {
+            uint32_t data;
+            memcpy(&data, &rsp_.mem_[0x1000 + address], sizeof(uint32_t));
+            return hydra::bswap32(data);
+        };
+
+        auto& cg = *code_;
+        if (cg.Size() + MaxBlockSize > CodeCacheSize)
+        {
+            Reset();
+        }
+
+        Block& block = blocks_[pc >> 2];
+        block.compiled = true;
+        block.stale = false;
+        block.func = nullptr;
+        block.code.clear();
+
+        // A branch in the last word would have its delay slot wrap around to the start of
+        // IMEM, and a branch in a delay slot needs the interpreter's pc handling
+        uint32_t first = fetch(pc);
+        if (classify(first) == InstructionKind::Branch)
+        {
+            block.code.push_back(first);
+            if (pc == 0xFFC)
+            {
+                return nullptr;
+            }
+            uint32_t second = fetch(pc + 4);
+            if (classify(second) == InstructionKind::Branch)
+            {
+                block.code.push_back(second);
+                return nullptr;
+            }
+            block.code.clear();
+        }
+
+        BlockFunc func = cg.Current<BlockFunc>();
+        Label epilogue;
+        epilogue_ = &epilogue;
+
+        cg.push(StatePointer);
+        cg.push(RegisterPointer);
+        // Keep the stack 16 byte aligned for the interpreter calls
+        cg.sub(rsp, 8);
+        cg.mov(StatePointer, arg1);
+        cg.lea(RegisterPointer, ptr[rsp_state(gpr_regs_)]);
+
+        int count = 0;
+        uint32_t address = pc;
+        bool ended = false;
+        while (count < MaxBlockInstructions && address < 0x1000)
+        {
+            uint32_t instruction = fetch(address);
+            InstructionKind kind = classify(instruction);
+
+            if (kind == InstructionKind::Branch)
+            {
+                if (address == 0xFFC)
+                {
+                    break;
+                }
+                uint32_t delay_slot = fetch(address + 4);
+                if (classify(delay_slot) == InstructionKind::Branch)
+                {
+                    break;
+                }
+                block.code.push_back(instruction);
+                block.code.push_back(delay_slot);
+                compile_branch(instruction, address);
+                if (!compile_instruction(delay_slot))
+                {
+                    compile_fallback(delay_slot);
+                }
+                exit_branch(count + 2);
+                ended = true;
+                break;
+            }
+
+            block.code.push_back(instruction);
+            if (kind == InstructionKind::EndsBlock || !compile_instruction(instruction))
+            {
+                compile_fallback(instruction);
+            }
+            count++;
+            address += 4;
+            if (kind == InstructionKind::EndsBlock)
+            {
+                break;
+            }
+        }
+
+        if (!ended)
+        {
+            exit_block(address & 0xFFF, count);
+        }
+
+        cg.Bind(epilogue);
+        cg.add(rsp, 8);
+        cg.pop(RegisterPointer);
+        cg.pop(StatePointer);
+        cg.ret();
+        epilogue_ = nullptr;
+
+        block.func = func;
+        return func;
+    }
+
+    bool RSPJit::compile_instruction(uint32_t data)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        uint32_t rs = instruction.RType.rs;
+        uint32_t rt = instruction.RType.rt;
+        uint32_t rd = instruction.RType.rd;
+        uint32_t sa = instruction.RType.sa;
+        uint32_t seimm = static_cast<int16_t>(instruction.IType.immediate);
+        uint32_t imm = instruction.IType.immediate;
+
+        switch (instruction.IType.op)
+        {
+            case 0b000000:
+                break;
+            case 0b001000: // ADDI
+            {
+                // Overflow is fatal, let the interpreter be the one to report it
+                Label overflow, done;
+                load_register(eax.Index(), rs);
+                cg.add(eax, seimm);
+                cg.jo(overflow);
+                store_register(rt, eax.Index());
+                cg.jmp(done);
+                cg.Bind(overflow);
+                compile_fallback(data);
+                cg.Bind(done);
+                return true;
+            }
+            case 0b001001: // ADDIU
+            case 0b001010: // SLTI
+            case 0b001011: // SLTIU
+            case 0b001100: // ANDI
+            case 0b001101: // ORI
+            case 0b001110: // XORI
+            case 0b001111: // LUI
+            {
+                if (rt == 0)
+                {
+                    return true;
+                }
+                if (instruction.IType.op == 0b001111)
+                {
+                    cg.mov(dword[RegisterPointer + rt * 4], imm << 16);
+                    return true;
+                }
+                load_register(eax.Index(), rs);
+                switch (instruction.IType.op)
+                {
+                    case 0b001001:
+                        cg.add(eax, seimm);
+                        break;
+                    case 0b001010:
+                        cg.cmp(eax, seimm);
+                        cg.setl(al);
+                        cg.movzx(eax, al);
+                        break;
+                    case 0b001011:
+                        cg.cmp(eax, seimm);
+                        cg.setb(al);
+                        cg.movzx(eax, al);
+                        break;
+                    case 0b001100:
+                        cg.and_(eax, imm);
+                        break;
+                    case 0b001101:
+                        cg.or_(eax, imm);
+                        break;
+                    case 0b001110:
+                        cg.xor_(eax, imm);
+                        break;
+                }
+                store_register(rt, eax.Index());
+                return true;
+            }
+            case 0b100000: // LB
+            case 0b100001: // LH
+            case 0b100011: // LW
+            case 0b100100: // LBU
+            case 0b100101: // LHU
+            case 0b100111: // LWU
+            case 0b101000: // SB
+            case 0b101001: // SH
+            case 0b101011: // SW
+                return compile_memory_access(data);
+            case 0b010010: // COP2
+            {
+                switch (instruction.WCType.base)
+                {
+                    case 0:
+                    case 2:
+                    case 4:
+                    case 6:
+                        return compile_vector_move(data);
+                }
+                return compile_vector(data);
+            }
+            case 0b110010: // LWC2
+            case 0b111010: // SWC2
+                return compile_vector_memory_access(data);
+            default:
+                return false;
+        }
+
+        // SPECIAL
+        switch (instruction.RType.func)
+        {
+            case 0b000000: // SLL
+            case 0b000010: // SRL
+            case 0b000011: // SRA
+            case 0b000100: // SLLV
+            case 0b000110: // SRLV
+            case 0b000111: // SRAV
+            case 0b100000: // ADD
+            case 0b100001: // ADDU
+            case 0b100010: // SUB
+            case 0b100011: // SUBU
+            case 0b100100: // AND
+            case 0b100101: // OR
+            case 0b100110: // XOR
+            case 0b100111: // NOR
+            case 0b101010: // SLT
+            case 0b101011: // SLTU
+                break;
+            default:
+                return false;
+        }
+
+        if (rd == 0)
+        {
+            // Also covers NOP (SLL r0, r0, 0)
+            return true;
+        }
+
+        switch (instruction.RType.func)
+        {
+            case 0b000000:
+                load_register(eax.Index(), rt);
+                cg.shl(eax, sa);
+                break;
+            case 0b000010:
+                load_register(eax.Index(), rt);
+                cg.shr(eax, sa);
+                break;
+            case 0b000011:
+                load_register(eax.Index(), rt);
+                cg.sar(eax, sa);
+                break;
+            case 0b000100:
+            case 0b000110:
+            case 0b000111:
+            {
+                // x86 masks the shift amount to 5 bits just like the RSP does
+                load_register(eax.Index(), rt);
+                load_register(ecx.Index(), rs);
+                if (instruction.RType.func == 0b000100)
+                {
+                    cg.shl(eax, cl);
+                }
+                else if (instruction.RType.func == 0b000110)
+                {
+                    cg.shr(eax, cl);
+                }
+                else
+                {
+                    cg.sar(eax, cl);
+                }
+                break;
+            }
+            case 0b100000:
+            case 0b100001:
+                // The RSP has no overflow exceptions, ADD is the same as ADDU
+                load_register(eax.Index(), rs);
+                load_register(ecx.Index(), rt);
+                cg.add(eax, ecx);
+                break;
+            case 0b100010:
+            case 0b100011:
+                load_register(eax.Index(), rs);
+                load_register(ecx.Index(), rt);
+                cg.sub(eax, ecx);
+                break;
+            case 0b100100:
+                load_register(eax.Index(), rs);
+                load_register(ecx.Index(), rt);
+                cg.and_(eax, ecx);
+                break;
+            case 0b100101:
+                load_register(eax.Index(), rs);
+                load_register(ecx.Index(), rt);
+                cg.or_(eax, ecx);
+                break;
+            case 0b100110:
+                load_register(eax.Index(), rs);
+                load_register(ecx.Index(), rt);
+                cg.xor_(eax, ecx);
+                break;
+            case 0b100111:
+                load_register(eax.Index(), rs);
+                load_register(ecx.Index(), rt);
+                cg.or_(eax, ecx);
+                cg.not_(eax);
+                break;
+            case 0b101010:
+            case 0b101011:
+                load_register(eax.Index(), rs);
+                load_register(ecx.Index(), rt);
+                cg.cmp(eax, ecx);
+                if (instruction.RType.func == 0b101010)
+                {
+                    cg.setl(al);
+                }
+                else
+                {
+                    cg.setb(al);
+                }
+                cg.movzx(eax, al);
+                break;
+        }
+        store_register(rd, eax.Index());
+        return true;
+    }
+
+    bool RSPJit::compile_memory_access(uint32_t data)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        uint32_t op = instruction.IType.op;
+        uint32_t rs = instruction.IType.rs;
+        uint32_t rt = instruction.IType.rt;
+        uint32_t seimm = static_cast<int16_t>(instruction.IType.immediate);
+        bool is_store = op & 0b001000;
+        // Bytes, halfwords and words, LW and LWU are the same thing on a 32-bit CPU
+        uint32_t size = (op & 0b11) == 0 ? 1 : (op & 0b11) == 1 ? 2 : 4;
+
+        if (!is_store && rt == 0)
+        {
+            // DMEM loads have no side effects
+            return true;
+        }
+
+        int32_t dmem = state_offset(rsp_, rsp_.mem_);
+        load_register(ecx.Index(), rs);
+        cg.add(ecx, seimm);
+        cg.and_(ecx, 0xFFF);
+
+        // Accesses that cross the end of DMEM wrap around byte by byte, which the
+        // interpreter handles
+        Label slow, done;
+        if (size > 1)
+        {
+            cg.cmp(ecx, 0x1000 - size);
+            cg.ja(slow);
+        }
+
+        if (is_store)
+        {
+            load_register(edx.Index(), rt);
+            switch (size)
+            {
+                case 1:
+                    cg.mov(byte[StatePointer + rcx + dmem], dl);
+                    break;
+                case 2:
+                    cg.rol(dx, 8);
+                    cg.mov(word[StatePointer + rcx + dmem], dx);
+                    break;
+                case 4:
+                    cg.bswap(edx);
+                    cg.mov(dword[StatePointer + rcx + dmem], edx);
+                    break;
+            }
+        }
+        else
+        {
+            bool is_signed = !(op & 0b000100);
+            switch (size)
+            {
+                case 1:
+                    if (is_signed)
+                    {
+                        cg.movsx(eax, byte[StatePointer + rcx + dmem]);
+                    }
+                    else
+                    {
+                        cg.movzx(eax, byte[StatePointer + rcx + dmem]);
+                    }
+                    break;
+                case 2:
+                    cg.movzx(eax, word[StatePointer + rcx + dmem]);
+                    cg.rol(ax, 8);
+                    if (is_signed)
+                    {
+                        cg.movsx(eax, ax);
+                    }
+                    else
+                    {
+                        cg.movzx(eax, ax);
+                    }
+                    break;
+                case 4:
+                    cg.mov(eax, dword[StatePointer + rcx + dmem]);
+                    cg.bswap(eax);
+                    break;
+            }
+            store_register(rt, eax.Index());
+        }
+
+        if (size > 1)
+        {
+            cg.jmp(done);
+            cg.Bind(slow);
+            compile_fallback(data);
+            cg.Bind(done);
+        }
+        return true;
+    }
+
+    bool RSPJit::compile_vector(uint32_t data)
+    {
+        if (!vector_ops_)
+        {
+            return false;
+        }
+
+        auto& cg = *code_;
+        VUInstruction instruction(data);
+        RegExp vd = rsp_state(vu_regs_[instruction.vd]);
+        RegExp accumulator = rsp_state(accumulator_);
+        RegExp accumulator_low = accumulator + offsetof(Accumulator, low);
+        RegExp vco = rsp_state(vco_);
+        RegExp vcc = rsp_state(vcc_);
+        RegExp vce = rsp_state(vce_);
+
+        switch (instruction.op)
+        {
+            case 3:  // VMULQ
+            case 11: // VMACQ
+            case 48: // VRCP
+            case 49: // VRCPL
+            case 50: // VRCPH
+            case 51: // VMOV
+            case 52: // VRSQ
+            case 53: // VRSQL
+            case 54: // VRSQH
+                // Not lane parallel, or rarely used enough to not be worth it
+                return false;
+            case 55: // VNOP
+            case 63: // VNULL
+                return true;
+            case 29: // VSAR
+            {
+                switch (instruction.element)
+                {
+                    case 0x8:
+                        cg.movdqa(xmm1, xword[accumulator + offsetof(Accumulator, high)]);
+                        break;
+                    case 0x9:
+                        cg.movdqa(xmm1, xword[accumulator + offsetof(Accumulator, middle)]);
+                        break;
+                    case 0xA:
+                        cg.movdqa(xmm1, xword[accumulator_low]);
+                        break;
+                    default:
+                        cg.zero(xmm1);
+                        break;
+                }
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            }
+        }
+
+        cg.movdqa(xmm1, xword[rsp_state(vu_regs_[instruction.vs])]);
+        cg.movdqa(xmm2, xword[rsp_state(vu_regs_[instruction.vt])]);
+        if (instruction.element >= 2)
+        {
+            cg.mov(rax, reinterpret_cast<uintptr_t>(shuffles[instruction.element].data()));
+            cg.pshufb(xmm2, xword[rax]);
+        }
+
+        switch (instruction.op)
+        {
+            case 0: // VMULF
+            case 1: // VMULU
+                cg.fraction_product(true);
+                cg.store_accumulator(accumulator);
+                if (instruction.op == 0)
+                {
+                    cg.clamp_signed();
+                }
+                else
+                {
+                    cg.clamp_unsigned();
+                }
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            case 4: // VMUDL
+                cg.movdqa(xmm5, xmm1);
+                cg.pmulhuw(xmm5, xmm2);
+                cg.zero(xmm3);
+                cg.zero(xmm4);
+                cg.store_accumulator(accumulator);
+                cg.movdqa(xword[vd], xmm5);
+                return true;
+            case 5: // VMUDM
+                cg.mixed_product(xmm1, xmm2);
+                cg.store_accumulator(accumulator);
+                // The product always fits, so clamping high:middle is a no-op
+                cg.movdqa(xword[vd], xmm4);
+                return true;
+            case 6: // VMUDN
+                cg.mixed_product(xmm2, xmm1);
+                cg.store_accumulator(accumulator);
+                cg.movdqa(xword[vd], xmm5);
+                return true;
+            case 7: // VMUDH
+                cg.movdqa(xmm3, xmm1);
+                cg.pmulhw(xmm3, xmm2);
+                cg.movdqa(xmm4, xmm1);
+                cg.pmullw(xmm4, xmm2);
+                cg.zero(xmm5);
+                cg.store_accumulator(accumulator);
+                cg.clamp_signed();
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            case 8: // VMACF
+            case 9: // VMACU
+                cg.fraction_product(false);
+                cg.accumulate(accumulator);
+                if (instruction.op == 8)
+                {
+                    cg.clamp_signed();
+                }
+                else
+                {
+                    cg.clamp_unsigned();
+                }
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            case 12: // VMADL
+                cg.movdqa(xmm5, xmm1);
+                cg.pmulhuw(xmm5, xmm2);
+                cg.zero(xmm3);
+                cg.zero(xmm4);
+                cg.accumulate(accumulator);
+                cg.clamp_low();
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            case 13: // VMADM
+                cg.mixed_product(xmm1, xmm2);
+                cg.accumulate(accumulator);
+                cg.clamp_signed();
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            case 14: // VMADN
+                cg.mixed_product(xmm2, xmm1);
+                cg.accumulate(accumulator);
+                cg.clamp_low();
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            case 15: // VMADH
+                cg.movdqa(xmm3, xmm1);
+                cg.pmulhw(xmm3, xmm2);
+                cg.movdqa(xmm4, xmm1);
+                cg.pmullw(xmm4, xmm2);
+                cg.zero(xmm5);
+                cg.accumulate(accumulator);
+                cg.clamp_signed();
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            case 16: // VADD
+            {
+                cg.movzx(eax, word[vco]);
+                cg.expand_mask(xmm3);
+                cg.movdqa(xmm4, xmm1);
+                cg.paddw(xmm4, xmm2);
+                cg.psubw(xmm4, xmm3);
+                cg.movdqa(xword[accumulator_low], xmm4);
+                // Adding the carry to the smaller operand can only saturate if both are 0x7FFF
+                cg.movdqa(xmm5, xmm1);
+                cg.pminsw(xmm5, xmm2);
+                cg.psubsw(xmm5, xmm3);
+                cg.pmaxsw(xmm1, xmm2);
+                cg.paddsw(xmm1, xmm5);
+                cg.movdqa(xword[vd], xmm1);
+                cg.mov(word[vco], 0);
+                return true;
+            }
+            case 17: // VSUB
+            {
+                cg.movzx(eax, word[vco]);
+                cg.expand_mask(xmm3);
+                cg.movdqa(xmm4, xmm2);
+                cg.psubw(xmm4, xmm3);
+                cg.movdqa(xmm5, xmm2);
+                cg.psubsw(xmm5, xmm3);
+                // 0x7FFF + 1 gets subtracted in two steps
+                cg.movdqa(xmm6, xmm5);
+                cg.pcmpgtw(xmm6, xmm4);
+                cg.movdqa(xmm7, xmm1);
+                cg.psubw(xmm7, xmm4);
+                cg.movdqa(xword[accumulator_low], xmm7);
+                cg.psubsw(xmm1, xmm5);
+                cg.paddsw(xmm1, xmm6);
+                cg.movdqa(xword[vd], xmm1);
+                cg.mov(word[vco], 0);
+                return true;
+            }
+            case 19: // VABS
+            {
+                cg.movdqa(xmm3, xmm2);
+                cg.psignw(xmm3, xmm1);
+                cg.movdqa(xword[accumulator_low], xmm3);
+                // -0x8000 stays 0x8000 in the accumulator but is clamped in vd
+                cg.psraw(xmm1, 15);
+                cg.load_constant(xmm4, sign_bits.data());
+                cg.pcmpeqw(xmm4, xmm2);
+                cg.pand(xmm1, xmm4);
+                cg.pxor(xmm1, xmm3);
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            }
+            case 20: // VADDC
+            {
+                cg.movdqa(xmm3, xmm1);
+                cg.paddw(xmm3, xmm2);
+                cg.movdqa(xmm4, xmm3);
+                cg.pminuw(xmm4, xmm1);
+                cg.pcmpeqw(xmm4, xmm1);
+                cg.ones(xmm5);
+                cg.pxor(xmm4, xmm5);
+                cg.zero(xmm5);
+                cg.pack_mask(xmm4, xmm5);
+                cg.mov(word[vco], ax);
+                cg.movdqa(xmm1, xmm3);
+                break;
+            }
+            case 21: // VSUBC
+            {
+                cg.movdqa(xmm3, xmm1);
+                cg.psubw(xmm3, xmm2);
+                cg.ones(xmm6);
+                cg.movdqa(xmm4, xmm1);
+                cg.pmaxuw(xmm4, xmm2);
+                cg.pcmpeqw(xmm4, xmm1);
+                cg.pxor(xmm4, xmm6);
+                cg.movdqa(xmm5, xmm1);
+                cg.pcmpeqw(xmm5, xmm2);
+                cg.pxor(xmm5, xmm6);
+                cg.pack_mask(xmm4, xmm5);
+                cg.mov(word[vco], ax);
+                cg.movdqa(xmm1, xmm3);
+                break;
+            }
+            case 32: // VLT
+            case 35: // VGE
+            {
+                cg.movzx(eax, word[vco]);
+                cg.mov(edx, eax);
+                cg.shr(edx, 8);
+                cg.and_(eax, edx);
+                cg.expand_mask(xmm3);
+                cg.movdqa(xmm4, xmm1);
+                cg.pcmpeqw(xmm4, xmm2);
+                if (instruction.op == 32)
+                {
+                    cg.pand(xmm3, xmm4);
+                    cg.movdqa(xmm0, xmm2);
+                    cg.pcmpgtw(xmm0, xmm1);
+                }
+                else
+                {
+                    cg.pandn(xmm3, xmm4);
+                    cg.movdqa(xmm0, xmm1);
+                    cg.pcmpgtw(xmm0, xmm2);
+                }
+                cg.por(xmm0, xmm3);
+                cg.movdqa(xmm5, xmm0);
+                cg.zero(xmm6);
+                cg.pack_mask(xmm5, xmm6);
+                cg.mov(word[vcc], ax);
+                cg.movdqa(xmm3, xmm2);
+                cg.pblendvb(xmm3, xmm1);
+                cg.movdqa(xmm1, xmm3);
+                cg.mov(word[vco], 0);
+                break;
+            }
+            case 33: // VEQ
+            case 34: // VNE
+            {
+                cg.movzx(eax, word[vco]);
+                cg.shr(eax, 8);
+                cg.expand_mask(xmm3);
+                cg.movdqa(xmm4, xmm1);
+                cg.pcmpeqw(xmm4, xmm2);
+                if (instruction.op == 33)
+                {
+                    cg.pandn(xmm3, xmm4);
+                    // Equal lanes pick vs, which is the same thing
+                    cg.movdqa(xmm1, xmm2);
+                }
+                else
+                {
+                    cg.ones(xmm5);
+                    cg.pxor(xmm4, xmm5);
+                    cg.por(xmm3, xmm4);
+                }
+                cg.zero(xmm5);
+                cg.pack_mask(xmm3, xmm5);
+                cg.mov(word[vcc], ax);
+                cg.mov(word[vco], 0);
+                break;
+            }
+            case 36: // VCL
+            {
+                cg.ones(xmm15);
+                cg.zero(xmm14);
+                cg.movzx(eax, word[vco]);
+                cg.expand_mask(xmm3);
+                cg.movzx(eax, word[vco]);
+                cg.shr(eax, 8);
+                cg.expand_mask(xmm4);
+                cg.movdqa(xmm5, xmm1);
+                cg.paddw(xmm5, xmm2);
+                // No carry out of vs + vt
+                cg.movdqa(xmm6, xmm5);
+                cg.pminuw(xmm6, xmm1);
+                cg.pcmpeqw(xmm6, xmm1);
+                cg.movdqa(xmm7, xmm5);
+                cg.pcmpeqw(xmm7, xmm14);
+                cg.movdqa(xmm8, xmm7);
+                cg.pand(xmm8, xmm6);
+                cg.movdqa(xmm9, xmm7);
+                cg.por(xmm9, xmm6);
+                cg.movzx(eax, byte[vce]);
+                cg.expand_mask(xmm0);
+                cg.pblendvb(xmm8, xmm9);
+                cg.movdqa(xmm9, xmm1);
+                cg.pmaxuw(xmm9, xmm2);
+                cg.pcmpeqw(xmm9, xmm1);
+
+                // Only the lanes without the flags set get their vcc bit recomputed
+                cg.movzx(eax, word[vcc]);
+                cg.expand_mask(xmm10);
+                cg.movdqa(xmm0, xmm4);
+                cg.pandn(xmm0, xmm3);
+                cg.pblendvb(xmm10, xmm8);
+                cg.movzx(eax, word[vcc]);
+                cg.shr(eax, 8);
+                cg.expand_mask(xmm11);
+                cg.movdqa(xmm0, xmm3);
+                cg.por(xmm0, xmm4);
+                cg.pxor(xmm0, xmm15);
+                cg.pblendvb(xmm11, xmm9);
+
+                cg.movdqa(xmm12, xmm1);
+                cg.movdqa(xmm0, xmm11);
+                cg.pblendvb(xmm12, xmm2);
+                cg.movdqa(xmm13, xmm14);
+                cg.psubw(xmm13, xmm2);
+                cg.movdqa(xmm0, xmm10);
+                cg.pblendvb(xmm1, xmm13);
+                cg.movdqa(xmm0, xmm3);
+                cg.pblendvb(xmm12, xmm1);
+                cg.movdqa(xmm1, xmm12);
+
+                cg.pack_mask(xmm10, xmm11);
+                cg.mov(word[vcc], ax);
+                cg.mov(word[vco], 0);
+                cg.mov(byte[vce], 0);
+                break;
+            }
+            case 37: // VCH
+            {
+                cg.ones(xmm15);
+                cg.movdqa(xmm3, xmm1);
+                cg.pxor(xmm3, xmm2);
+                cg.psraw(xmm3, 15);
+                cg.movdqa(xmm4, xmm1);
+                cg.paddw(xmm4, xmm2);
+                cg.movdqa(xmm5, xmm1);
+                cg.psubw(xmm5, xmm2);
+                // sum <= 0
+                cg.movdqa(xmm6, xmm15);
+                cg.psrlw(xmm6, 15);
+                cg.pcmpgtw(xmm6, xmm4);
+                cg.movdqa(xmm7, xmm5);
+                cg.psraw(xmm7, 15);
+                cg.pxor(xmm7, xmm15);
+                cg.movdqa(xmm8, xmm2);
+                cg.psraw(xmm8, 15);
+                cg.movdqa(xmm9, xmm4);
+                cg.pcmpeqw(xmm9, xmm15);
+
+                cg.movdqa(xmm0, xmm3);
+                cg.movdqa(xmm10, xmm8);
+                cg.pblendvb(xmm10, xmm6);
+                cg.movdqa(xmm11, xmm7);
+                cg.pblendvb(xmm11, xmm8);
+                cg.zero(xmm14);
+                cg.movdqa(xmm12, xmm5);
+                cg.pcmpeqw(xmm12, xmm14);
+                cg.pxor(xmm12, xmm15);
+                cg.movdqa(xmm13, xmm4);
+                cg.pcmpeqw(xmm13, xmm14);
+                cg.por(xmm13, xmm9);
+                cg.pxor(xmm13, xmm15);
+                cg.pblendvb(xmm12, xmm13);
+
+                cg.psubw(xmm14, xmm2);
+                cg.movdqa(xmm0, xmm6);
+                cg.movdqa(xmm8, xmm1);
+                cg.pblendvb(xmm8, xmm14);
+                cg.movdqa(xmm0, xmm7);
+                cg.movdqa(xmm13, xmm1);
+                cg.pblendvb(xmm13, xmm2);
+                cg.movdqa(xmm0, xmm3);
+                cg.pblendvb(xmm13, xmm8);
+                cg.movdqa(xmm1, xmm13);
+
+                cg.pand(xmm9, xmm3);
+                cg.zero(xmm14);
+                cg.pack_mask(xmm9, xmm14);
+                cg.mov(byte[vce], al);
+                cg.pack_mask(xmm10, xmm11);
+                cg.mov(word[vcc], ax);
+                cg.pack_mask(xmm3, xmm12);
+                cg.mov(word[vco], ax);
+                break;
+            }
+            case 38: // VCR
+            {
+                cg.ones(xmm15);
+                cg.movdqa(xmm3, xmm1);
+                cg.pxor(xmm3, xmm2);
+                cg.psraw(xmm3, 15);
+                cg.movdqa(xmm4, xmm1);
+                cg.por(xmm4, xmm3);
+                cg.movdqa(xmm5, xmm2);
+                cg.pcmpgtw(xmm5, xmm4);
+                cg.pxor(xmm5, xmm15);
+                cg.movdqa(xmm6, xmm1);
+                cg.pand(xmm6, xmm3);
+                cg.paddw(xmm6, xmm2);
+                cg.psraw(xmm6, 15);
+                cg.movdqa(xmm0, xmm3);
+                cg.movdqa(xmm7, xmm5);
+                cg.pblendvb(xmm7, xmm6);
+                cg.movdqa(xmm8, xmm2);
+                cg.pxor(xmm8, xmm3);
+                cg.movdqa(xmm0, xmm7);
+                cg.pblendvb(xmm1, xmm8);
+                cg.pack_mask(xmm6, xmm5);
+                cg.mov(word[vcc], ax);
+                cg.mov(word[vco], 0);
+                cg.mov(byte[vce], 0);
+                break;
+            }
+            case 39: // VMRG
+            {
+                cg.movzx(eax, word[vcc]);
+                cg.expand_mask(xmm0);
+                cg.movdqa(xmm3, xmm2);
+                cg.pblendvb(xmm3, xmm1);
+                cg.movdqa(xmm1, xmm3);
+                cg.mov(word[vco], 0);
+                break;
+            }
+            case 40: // VAND
+            case 41: // VNAND
+                cg.pand(xmm1, xmm2);
+                break;
+            case 42: // VOR
+            case 43: // VNOR
+                cg.por(xmm1, xmm2);
+                break;
+            case 44: // VXOR
+            case 45: // VNXOR
+                cg.pxor(xmm1, xmm2);
+                break;
+            default:
+            {
+                // VZERO and everything that's mapped to it
+                cg.paddw(xmm1, xmm2);
+                cg.movdqa(xword[accumulator_low], xmm1);
+                cg.zero(xmm1);
+                cg.movdqa(xword[vd], xmm1);
+                return true;
+            }
+        }
+
+        if (instruction.op >= 40 && (instruction.op & 1))
+        {
+            cg.ones(xmm2);
+            cg.pxor(xmm1, xmm2);
+        }
+        // Everything that gets here leaves its result in both vd and the low accumulator part
+        cg.movdqa(xword[accumulator_low], xmm1);
+        cg.movdqa(xword[vd], xmm1);
+        return true;
+    }
+
+    bool RSPJit::compile_vector_move(uint32_t data)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        uint32_t rt = instruction.WCType.vt;
+        uint32_t element = instruction.WCType.element;
+        RegExp vs = rsp_state(vu_regs_[instruction.WCType.opcode]);
+        int control = instruction.WCType.opcode & 0b11;
+        RegExp flags = control == 0 ? rsp_state(vco_) : control == 1 ? rsp_state(vcc_)
+                                                                     : rsp_state(vce_);
+
+        switch (instruction.WCType.base)
+        {
+            case 0: // MFC2
+            {
+                // Odd elements straddle two lanes
+                if (element & 1)
+                {
+                    return false;
+                }
+                if (rt != 0)
+                {
+                    cg.movsx(eax, word[vs + element]);
+                    store_register(rt, eax.Index());
+                }
+                return true;
+            }
+            case 2: // CFC2
+            {
+                if (rt != 0)
+                {
+                    if (control < 2)
+                    {
+                        cg.movsx(eax, word[flags]);
+                    }
+                    else
+                    {
+                        cg.movzx(eax, byte[flags]);
+                    }
+                    store_register(rt, eax.Index());
+                }
+                return true;
+            }
+            case 4: // MTC2
+            {
+                if (element & 1)
+                {
+                    return false;
+                }
+                load_register(eax.Index(), rt);
+                cg.mov(word[vs + element], ax);
+                return true;
+            }
+            case 6: // CTC2
+            {
+                load_register(eax.Index(), rt);
+                if (control < 2)
+                {
+                    cg.mov(word[flags], ax);
+                }
+                else
+                {
+                    cg.mov(byte[flags], al);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RSPJit::compile_vector_memory_access(uint32_t data)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        bool is_store = instruction.WCType.op == 0b111010;
+        uint32_t element = instruction.WCType.element;
+        uint32_t size;
+        switch (instruction.WCType.opcode)
+        {
+            case 0x0: // LBV, SBV
+                size = 1;
+                break;
+            case 0x1: // LSV, SSV
+                size = 2;
+                break;
+            case 0x2: // LLV, SLV
+                size = 4;
+                break;
+            case 0x3: // LDV, SDV
+                size = 8;
+                break;
+            case 0x4: // LQV, SQV
+                size = 16;
+                break;
+            default:
+                return false;
+        }
+
+        // Only the accesses that stay within the register are done here. Odd elements straddle
+        // lanes, the rest wrap around or drop bytes, and LQV and SQV stop at the 16 byte
+        // boundary so only a whole register from an aligned address is simple
+        if (size > 1 && (element & 1))
+        {
+            return false;
+        }
+        if (size == 16 ? element != 0 : element + size > 16)
+        {
+            return false;
+        }
+        if (size > 2 && !vector_ops_)
+        {
+            return false;
+        }
+
+        int32_t offset = (static_cast<int8_t>(instruction.WCType.offset << 1) >> 1) *
+                         static_cast<int32_t>(size);
+        int32_t dmem = state_offset(rsp_, rsp_.mem_);
+        RegExp vt = rsp_state(vu_regs_[instruction.WCType.vt]) + element;
+        load_register(ecx.Index(), instruction.WCType.base);
+        cg.add(ecx, offset);
+        cg.and_(ecx, 0xFFF);
+
+        Label slow, done;
+        if (size == 16)
+        {
+            cg.test(ecx, 0xF);
+            cg.jnz(slow);
+        }
+        else if (size > 1)
+        {
+            cg.cmp(ecx, 0x1000 - size);
+            cg.ja(slow);
+        }
+
+        Address memory = xword[StatePointer + rcx + dmem];
+        switch (size)
+        {
+            case 1:
+            {
+                // Big endian byte e of the register is at host byte e ^ 1
+                RegExp lane = rsp_state(vu_regs_[instruction.WCType.vt]) + (element ^ 1);
+                if (is_store)
+                {
+                    cg.mov(al, byte[lane]);
+                    cg.mov(byte[StatePointer + rcx + dmem], al);
+                }
+                else
+                {
+                    cg.mov(al, byte[StatePointer + rcx + dmem]);
+                    cg.mov(byte[lane], al);
+                }
+                break;
+            }
+            case 2:
+            {
+                if (is_store)
+                {
+                    cg.movzx(eax, word[vt]);
+                    cg.rol(ax, 8);
+                    cg.mov(word[StatePointer + rcx + dmem], ax);
+                }
+                else
+                {
+                    cg.movzx(eax, word[StatePointer + rcx + dmem]);
+                    cg.rol(ax, 8);
+                    cg.mov(word[vt], ax);
+                }
+                break;
+            }
+            default:
+            {
+                auto load = [&](const Address& from) {
+                    switch (size)
+                    {
+                        case 4:
+                            return cg.movd(xmm1, from);
+                        case 8:
+                            return cg.movq(xmm1, from);
+                        default:
+                            return cg.movdqu(xmm1, from);
+                    }
+                };
+                auto store = [&](const Address& to) {
+                    switch (size)
+                    {
+                        case 4:
+                            return cg.movd(to, xmm1);
+                        case 8:
+                            return cg.movq(to, xmm1);
+                        default:
+                            return cg.movdqu(to, xmm1);
+                    }
+                };
+                load(is_store ? xword[vt] : memory);
+                cg.mov(rax, reinterpret_cast<uintptr_t>(byte_swap.data()));
+                cg.pshufb(xmm1, xword[rax]);
+                store(is_store ? memory : xword[vt]);
+                break;
+            }
+        }
+
+        if (size > 1)
+        {
+            cg.jmp(done);
+            cg.Bind(slow);
+            compile_fallback(data);
+            cg.Bind(done);
+        }
+        return true;
+    }
+
+    void RSPJit::compile_branch(uint32_t data, uint32_t address)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        uint32_t rs = instruction.RType.rs;
+        uint32_t rt = instruction.RType.rt;
+        uint32_t rd = instruction.RType.rd;
+        int32_t seoffset = static_cast<int16_t>(instruction.IType.immediate) * 4;
+        uint32_t target = (address + 4 + seoffset) & 0xFFC;
+        uint32_t fallthrough = (address + 8) & 0xFFF;
+        uint32_t link = address + 8;
+
+        Condition condition = Condition::Greater;
+        bool compare_rt = false;
+        bool links = false;
+        switch (instruction.IType.op)
+        {
+            case 0b000000:
+            {
+                // JR and JALR, rs is read before rd is linked
+                load_register(eax.Index(), rs);
+                cg.and_(eax, 0xFFC);
+                cg.mov(dword[rsp_state(next_pc_)], eax);
+                if (instruction.RType.func == 0b001001 && rd != 0)
+                {
+                    cg.mov(dword[RegisterPointer + rd * 4], link);
+                }
+                return;
+            }
+            case 0b000010:
+            case 0b000011:
+            {
+                cg.mov(dword[rsp_state(next_pc_)], (instruction.JType.target << 2) & 0xFFC);
+                if (instruction.IType.op == 0b000011)
+                {
+                    cg.mov(dword[RegisterPointer + 31 * 4], link);
+                }
+                return;
+            }
+            case 0b000001:
+            {
+                condition = (rt & 1) ? Condition::GreaterEqual : Condition::Less;
+                links = rt & 0b10000;
+                break;
+            }
+            case 0b000100:
+                condition = Condition::Equal;
+                compare_rt = true;
+                break;
+            case 0b000101:
+                condition = Condition::NotEqual;
+                compare_rt = true;
+                break;
+            case 0b000110:
+                condition = Condition::LessEqual;
+                break;
+            case 0b000111:
+                condition = Condition::Greater;
+                break;
+        }
+
+        load_register(eax.Index(), rs);
+        if (compare_rt)
+        {
+            load_register(ecx.Index(), rt);
+            cg.cmp(eax, ecx);
+        }
+        else
+        {
+            cg.test(eax, eax);
+        }
+        cg.mov(ecx, fallthrough);
+        cg.mov(edx, target);
+        cg.cmov(condition, ecx, edx);
+        cg.mov(dword[rsp_state(next_pc_)], ecx);
+        if (links)
+        {
+            // BLTZAL and BGEZAL link whether they're taken or not
+            cg.mov(dword[RegisterPointer + 31 * 4], link);
+        }
+    }
+
+    void RSPJit::compile_fallback(uint32_t data)
+    {
+        auto& cg = *code_;
+        Instruction instruction{.full = data};
+        // Skip the decode tables and call the handler for this exact instruction
+        RSP::func_ptr handler = RSP::instruction_table_[instruction.IType.op];
+        switch (instruction.IType.op)
+        {
+            case 0b000000:
+                handler = RSP::special_table_[instruction.RType.func];
+                break;
+            case 0b000001:
+                handler = RSP::regimm_table_[instruction.RType.rt];
+                break;
+            case 0b010010:
+            {
+                switch (instruction.WCType.base)
+                {
+                    case 0:
+                        handler = &lut_wrapper<&RSP::MFC2>;
+                        break;
+                    case 2:
+                        handler = &lut_wrapper<&RSP::CFC2>;
+                        break;
+                    case 4:
+                        handler = &lut_wrapper<&RSP::MTC2>;
+                        break;
+                    case 6:
+                        handler = &lut_wrapper<&RSP::CTC2>;
+                        break;
+                    default:
+                        handler = rsp_.vu_table_[instruction.FType.func];
+                        break;
+                }
+                break;
+            }
+            case 0b110010:
+            case 0b111010:
+            {
+                bool is_store = instruction.IType.op == 0b111010;
+                switch (instruction.WCType.opcode)
+                {
+                    case 0x0:
+                        handler = is_store ? &lut_wrapper<&RSP::SBV> : &lut_wrapper<&RSP::LBV>;
+                        break;
+                    case 0x1:
+                        handler = is_store ? &lut_wrapper<&RSP::SSV> : &lut_wrapper<&RSP::LSV>;
+                        break;
+                    case 0x2:
+                        handler = is_store ? &lut_wrapper<&RSP::SLV> : &lut_wrapper<&RSP::LLV>;
+                        break;
+                    case 0x3:
+                        handler = is_store ? &lut_wrapper<&RSP::SDV> : &lut_wrapper<&RSP::LDV>;
+                        break;
+                    case 0x4:
+                        handler = is_store ? &lut_wrapper<&RSP::SQV> : &lut_wrapper<&RSP::LQV>;
+                        break;
+                    case 0x5:
+                        handler = is_store ? &lut_wrapper<&RSP::SRV> : &lut_wrapper<&RSP::LRV>;
+                        break;
+                    case 0x6:
+                        handler = is_store ? &lut_wrapper<&RSP::SPV> : &lut_wrapper<&RSP::LPV>;
+                        break;
+                    case 0x7:
+                        handler = is_store ? &lut_wrapper<&RSP::SUV> : &lut_wrapper<&RSP::LUV>;
+                        break;
+                    case 0xB:
+                        handler = is_store ? &lut_wrapper<&RSP::STV> : &lut_wrapper<&RSP::LTV>;
+                        break;
+                }
+                break;
+            }
+        }
+        // Same thing RSP::Tick does before executing an instruction
+        cg.mov(dword[rsp_state(instruction_)], data);
+        cg.mov(dword[RegisterPointer], 0);
+        cg.mov(arg1, StatePointer);
+        cg.mov(rax, reinterpret_cast<uintptr_t>(handler));
+        cg.call(rax);
+    }
+
+    void RSPJit::load_register(int index, int guest)
+    {
+        auto& cg = *code_;
+        if (guest == 0)
+        {
+            cg.xor_(Reg32(index), Reg32(index));
+        }
+        else
+        {
+            cg.mov(Reg32(index), dword[RegisterPointer + guest * 4]);
+        }
+    }
+
+    void RSPJit::store_register(int guest, int index)
+    {
+        // r0 is zeroed before every instruction, so writes to it are never seen
+        if (guest != 0)
+        {
+            code_->mov(dword[RegisterPointer + guest * 4], Reg32(index));
+        }
+    }
+
+    void RSPJit::exit_block(uint32_t next, int count)
+    {
+        auto& cg = *code_;
+        cg.mov(dword[rsp_state(pc_)], next);
+        cg.mov(dword[rsp_state(next_pc_)], (next + 4) & 0xFFF);
+        cg.mov(eax, count);
+        cg.jmp(*epilogue_);
+    }
+
+    void RSPJit::exit_branch(int count)
+    {
+        auto& cg = *code_;
+        // next_pc_ was set by the branch, the delay slot can't have touched it
+        cg.mov(eax, dword[rsp_state(next_pc_)]);
+        cg.mov(dword[rsp_state(pc_)], eax);
+        cg.add(eax, 4);
+        cg.and_(eax, 0xFFF);
+        cg.mov(dword[rsp_state(next_pc_)], eax);
+        cg.mov(eax, count);
+        cg.jmp(*epilogue_);
+    }
+} // namespace hydra::N64
+
+#undef rsp_state
+#else
+namespace hydra::N64
+{
+    struct RSPJit::Emitter
+    {};
+
+    RSPJit::RSPJit(RSP& rsp) : rsp_(rsp)
+    {
+        Logger::Warn("The RSP dynarec is only available on x86-64");
+    }
+
+    RSPJit::~RSPJit() = default;
+
+    int RSPJit::Run()
+    {
+        return 0;
+    }
+
+    void RSPJit::Reset() {}
+
+    void RSPJit::InvalidateRange(uint32_t, uint32_t) {}
+} // namespace hydra::N64
+#endif
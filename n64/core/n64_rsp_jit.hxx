@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <n64/core/n64_cpu_jit.hxx>
+#include <vector>
+
+namespace hydra::N64
+{
+    class RSP;
+
+    enum class RSPBackend { Interpreter, Dynarec };
+
+    /**
+        Block based x86-64 recompiler for the RSP
+
+        Blocks are keyed by their IMEM address. A block ends after the delay slot of its first
+        branch, after an instruction that can halt the RSP or start a DMA (BREAK, MTC0) or at the
+        end of IMEM. The scalar unit, branches and DMEM loads and stores are emitted natively and
+        work on the registers in memory. So are the lane parallel vector ops, the moves to and
+        from COP2 and the vector loads and stores that stay within one register, with the same
+        SSE4.1 sequences as n64_rsp_vu_sse.cxx. Everything else (VRCP and friends, VMOV, the
+        packed and transposed loads and stores, or a host without SSE4.1) calls the interpreter
+        handler for that exact instruction without going through the decode tables.
+
+        Writes to IMEM only mark the blocks they overlap as stale. Microcode gets swapped in
+        every frame, so a stale block is compared against the code it was compiled from before
+        it's thrown away.
+    */
+    class RSPJit final
+    {
+    public:
+        RSPJit(RSP& rsp);
+        ~RSPJit();
+
+        // Runs the block at the current pc and returns how many instructions it executed,
+        // or 0 if the code at pc can't be recompiled and should be interpreted instead
+        int Run();
+        void Reset();
+        // Takes offsets into IMEM, wraps around like the DMA does
+        void InvalidateRange(uint32_t address, uint32_t length);
+
+    private:
+        using BlockFunc = int (*)(RSP*);
+        struct Emitter;
+
+        struct Block
+        {
+            BlockFunc func = nullptr;
+            bool compiled = false;
+            bool stale = false;
+            // The instructions the block was compiled from
+            std::vector<uint32_t> code;
+        };
+
+        RSP& rsp_;
+        std::unique_ptr<Emitter> code_;
+        x64::Label* epilogue_ = nullptr;
+        // Whether the host can run the emitted vector ops
+        bool vector_ops_ = false;
+        std::array<Block, 0x400> blocks_;
+
+        BlockFunc compile(uint32_t pc);
+        bool is_unchanged(uint32_t pc, const Block& block);
+        void invalidate_span(uint32_t begin, uint32_t end);
+        bool compile_instruction(uint32_t instruction);
+        bool compile_memory_access(uint32_t instruction);
+        bool compile_vector(uint32_t instruction);
+        bool compile_vector_move(uint32_t instruction);
+        bool compile_vector_memory_access(uint32_t instruction);
+        void compile_branch(uint32_t instruction, uint32_t address);
+        void compile_fallback(uint32_t instruction);
+        void load_register(int index, int guest);
+        void store_register(int guest, int index);
+        void exit_block(uint32_t next, int count);
+        void exit_branch(int count);
+    };
+} // namespace hydra::N64
@@ -60,6 +60,10 @@ namespace hydra::N64
     {
         auto jump_addr = rsreg.UW;
         branch_to(jump_addr);
+        if constexpr (RSP_PROFILING)
+        {
+            profiler_.Return(next_pc_);
+        }
     }
 
     void RSP::s_JALR()
@@ -67,6 +71,10 @@ namespace hydra::N64
         auto jump_addr = rsreg.UW;
         link_register(instruction_.RType.rd);
         branch_to(jump_addr);
+        if constexpr (RSP_PROFILING)
+        {
+            profiler_.Call(next_pc_, rdreg.UW & 0xFFF);
+        }
     }
 
     void RSP::s_ADDU()
@@ -160,6 +168,10 @@ namespace hydra::N64
     {
         link_register(31);
         J();
+        if constexpr (RSP_PROFILING)
+        {
+            profiler_.Call(next_pc_, gpr_regs_[31].UW & 0xFFF);
+        }
     }
 
     void RSP::BEQ()
@@ -279,7 +291,7 @@ namespace hydra::N64
                 return CTC2();
             default:
             {
-                (vu_instruction_table_[instruction_.FType.func])(this);
+                (vu_table_[instruction_.FType.func])(this);
                 break;
             }
         }
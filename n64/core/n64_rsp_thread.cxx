@@ -0,0 +1,141 @@
+#include <n64/core/n64_rdp.hxx>
+#include <n64/core/n64_rsp.hxx>
+#include <n64/core/n64_rsp_thread.hxx>
+
+namespace hydra::N64
+{
+    RSPThread::RSPThread(RSP& rsp) : rsp_(rsp)
+    {
+        rdram_written_ = [this](uint32_t address, uint32_t length) {
+            // DMAs write row by row, consecutive rows are kept as one range
+            if (!rdram_writes_.empty())
+            {
+                auto& last = rdram_writes_.back();
+                if (last.first + last.second == address)
+                {
+                    last.second += length;
+                    return;
+                }
+            }
+            rdram_writes_.emplace_back(address, length);
+        };
+        thread_ = std::thread([this]() { loop(); });
+    }
+
+    RSPThread::~RSPThread()
+    {
+        Sync();
+        stop_ = true;
+        started_.fetch_add(1, std::memory_order_release);
+        started_.notify_one();
+        thread_.join();
+    }
+
+    void RSPThread::Run(int instructions)
+    {
+        Sync();
+        if (rsp_.status_.halt)
+        {
+            return;
+        }
+        begin_slice();
+        instructions_ = instructions;
+        running_ = true;
+        started_.fetch_add(1, std::memory_order_release);
+        started_.notify_one();
+    }
+
+    void RSPThread::Sync()
+    {
+        if (!running_)
+        {
+            return;
+        }
+        uint32_t slice = started_.load(std::memory_order_relaxed);
+        uint32_t finished = finished_.load(std::memory_order_acquire);
+        while (finished != slice)
+        {
+            finished_.wait(finished, std::memory_order_acquire);
+            finished = finished_.load(std::memory_order_acquire);
+        }
+        running_ = false;
+        end_slice();
+    }
+
+    void RSPThread::loop()
+    {
+        uint32_t slice = 0;
+        while (true)
+        {
+            started_.wait(slice, std::memory_order_acquire);
+            slice = started_.load(std::memory_order_acquire);
+            if (stop_)
+            {
+                return;
+            }
+            rsp_.Run(instructions_);
+            finished_.store(slice, std::memory_order_release);
+            finished_.notify_one();
+        }
+    }
+
+    void RSPThread::begin_slice()
+    {
+        real_mi_interrupt_ = rsp_.mi_interrupt_;
+        mi_interrupt_before_ = real_mi_interrupt_ ? *real_mi_interrupt_ : MIInterrupt{};
+        mi_interrupt_ = mi_interrupt_before_;
+        rsp_.mi_interrupt_ = &mi_interrupt_;
+        std::swap(rsp_.rdram_written_, rdram_written_);
+
+        RDP* rdp = rsp_.rdp_ptr_;
+        if (rdp)
+        {
+            real_rdp_mi_interrupt_ = rdp->mi_interrupt_;
+            real_dirty_map_ = rdp->dirty_map_;
+            rdp->mi_interrupt_ = &mi_interrupt_;
+            if (real_dirty_map_)
+            {
+                rdp->dirty_map_ = &dirty_map_;
+            }
+        }
+    }
+
+    void RSPThread::end_slice()
+    {
+        rsp_.mi_interrupt_ = real_mi_interrupt_;
+        std::swap(rsp_.rdram_written_, rdram_written_);
+
+        RDP* rdp = rsp_.rdp_ptr_;
+        if (rdp)
+        {
+            rdp->mi_interrupt_ = real_rdp_mi_interrupt_;
+            rdp->dirty_map_ = real_dirty_map_;
+            if (real_dirty_map_)
+            {
+                real_dirty_map_->Merge(dirty_map_);
+            }
+        }
+
+        // Only the bits the slice changed, the CPU may have acknowledged an interrupt meanwhile
+        if (real_mi_interrupt_)
+        {
+            if (mi_interrupt_.SP != mi_interrupt_before_.SP)
+            {
+                real_mi_interrupt_->SP = mi_interrupt_.SP;
+            }
+            if (mi_interrupt_.DP != mi_interrupt_before_.DP)
+            {
+                real_mi_interrupt_->DP = mi_interrupt_.DP;
+            }
+        }
+
+        if (rsp_.rdram_written_)
+        {
+            for (auto [address, length] : rdram_writes_)
+            {
+                rsp_.rdram_written_(address, length);
+            }
+        }
+        rdram_writes_.clear();
+    }
+} // namespace hydra::N64
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <n64/core/n64_rdram.hxx>
+#include <n64/core/n64_types.hxx>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hydra::N64
+{
+    class RSP;
+
+    /**
+        Runs the RSP on a host thread of its own
+
+        The RSP still advances in slices scheduled by the CPU, but a slice runs on the RSP thread
+        while the CPU thread carries on. The CPU thread waits for the slice in flight before
+        touching anything the RSP owns (SP and DP registers, IMEM writes), before any RDRAM
+        access and before starting the next slice. The slice's DMAs and the RDP rendering inline
+        on the RSP thread can touch any address at any point, so checking which pages they
+        touched would race with the copies themselves.
+
+        What the RSP does to state owned by the CPU thread (MI interrupts, the RDRAM dirty map,
+        code invalidation) is collected during the slice and applied when it's waited for, so
+        the CPU sees the effects of a slice at the same point no matter how the host schedules
+        the two threads.
+    */
+    class RSPThread final
+    {
+    public:
+        RSPThread(RSP& rsp);
+        ~RSPThread();
+
+        // Waits for the slice in flight and starts the next one, unless the RSP is halted
+        void Run(int instructions);
+        // Waits for the slice in flight and applies its side effects
+        void Sync();
+
+    private:
+        RSP& rsp_;
+        std::thread thread_;
+        // Slices started by the CPU thread and finished by the RSP thread
+        std::atomic<uint32_t> started_{0};
+        std::atomic<uint32_t> finished_{0};
+        int instructions_ = 0;
+        bool stop_ = false;
+        bool running_ = false;
+
+        // What the RSP and RDP point to while a slice runs
+        MIInterrupt mi_interrupt_{};
+        MIInterrupt mi_interrupt_before_{};
+        RDRAMDirtyMap dirty_map_;
+        std::vector<std::pair<uint32_t, uint32_t>> rdram_writes_;
+        std::function<void(uint32_t, uint32_t)> rdram_written_;
+
+        // What they point to the rest of the time
+        MIInterrupt* real_mi_interrupt_ = nullptr;
+        MIInterrupt* real_rdp_mi_interrupt_ = nullptr;
+        RDRAMDirtyMap* real_dirty_map_ = nullptr;
+
+        void loop();
+        void begin_slice();
+        void end_slice();
+    };
+} // namespace hydra::N64
@@ -562,7 +562,8 @@ namespace hydra::N64
         for (int i = 0; i < 16; i += 2)
         {
             uint8_t b = (lane + i) & 0xF;
-            set_lane(reg + b / 2, i, load_halfword(address + b) & 0xFFF);
+            // The register wraps around inside its group of 8
+            set_lane((reg & ~7) | ((reg + b / 2) & 7), i, load_halfword(address + b) & 0xFFF);
         }
     }
 
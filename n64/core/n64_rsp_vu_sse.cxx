@@ -0,0 +1,576 @@
+#include <n64/core/n64_rsp.hxx>
+
+#if HYDRA_SIMD_AVAILABLE
+#include <smmintrin.h>
+
+// SSE4.1 versions of the lane parallel vector unit instructions. They have to match the scalar
+// ones in n64_rsp_vu.cxx bit for bit, n64_rsp_qa checks every op and element against them.
+//
+// The 48-bit accumulator lanes are added as three 16-bit vectors, with the carries out of the
+// low and middle parts worked out by unsigned compares. The flag registers are expanded from
+// their packed bits into all-ones/all-zeroes lanes and packed back with movemask.
+
+namespace
+{
+    using hydra::N64::VectorRegister;
+
+    struct Parts
+    {
+        __m128i high, middle, low;
+    };
+
+    // pshufb masks for the 16 vt element selectors, same as the elements table in
+    // n64_rsp_vu.cxx
+    constexpr std::array<std::array<uint8_t, 16>, 16> make_shuffles()
+    {
+        std::array<std::array<uint8_t, 16>, 16> shuffles{};
+        for (int element = 0; element < 16; element++)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                int lane;
+                if (element < 2)
+                {
+                    lane = i;
+                }
+                else if (element < 4)
+                {
+                    lane = (i & ~1) | (element & 1);
+                }
+                else if (element < 8)
+                {
+                    lane = (i & ~3) | (element & 3);
+                }
+                else
+                {
+                    lane = element & 7;
+                }
+                shuffles[element][i * 2] = lane * 2;
+                shuffles[element][i * 2 + 1] = lane * 2 + 1;
+            }
+        }
+        return shuffles;
+    }
+
+    alignas(16) constexpr std::array<std::array<uint8_t, 16>, 16> shuffles = make_shuffles();
+
+    inline __m128i load(const VectorRegister& reg)
+    {
+        return _mm_load_si128(reinterpret_cast<const __m128i*>(reg.data()));
+    }
+
+    inline void store(VectorRegister& reg, __m128i value)
+    {
+        _mm_store_si128(reinterpret_cast<__m128i*>(reg.data()), value);
+    }
+
+    inline __m128i load_shuffled(const VectorRegister& reg, int element)
+    {
+        __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(shuffles[element].data()));
+        return _mm_shuffle_epi8(load(reg), mask);
+    }
+
+    inline __m128i ones()
+    {
+        return _mm_set1_epi32(-1);
+    }
+
+    inline __m128i bit_not(__m128i value)
+    {
+        return _mm_xor_si128(value, ones());
+    }
+
+    // Bit i of the flags becomes lane i of the mask
+    inline __m128i expand_mask(uint8_t flags)
+    {
+        const __m128i lane_bits = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+        return _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(flags), lane_bits), lane_bits);
+    }
+
+    inline uint8_t pack_mask(__m128i mask)
+    {
+        return _mm_movemask_epi8(_mm_packs_epi16(mask, _mm_setzero_si128()));
+    }
+
+    inline uint16_t pack_mask(__m128i low, __m128i high)
+    {
+        return pack_mask(low) | (pack_mask(high) << 8);
+    }
+
+    // All ones where sum = a + b wrapped around
+    inline __m128i carry_mask(__m128i sum, __m128i a)
+    {
+        return bit_not(_mm_cmpeq_epi16(_mm_min_epu16(sum, a), a));
+    }
+
+    inline Parts load(const hydra::N64::Accumulator& accumulator)
+    {
+        return {load(accumulator.high), load(accumulator.middle), load(accumulator.low)};
+    }
+
+    inline void store(hydra::N64::Accumulator& accumulator, const Parts& parts)
+    {
+        store(accumulator.high, parts.high);
+        store(accumulator.middle, parts.middle);
+        store(accumulator.low, parts.low);
+    }
+
+    inline Parts accumulate(hydra::N64::Accumulator& accumulator, const Parts& addend)
+    {
+        Parts acc = load(accumulator);
+        __m128i low = _mm_add_epi16(acc.low, addend.low);
+        __m128i low_carry = carry_mask(low, addend.low);
+        __m128i middle = _mm_add_epi16(acc.middle, addend.middle);
+        __m128i middle_carry = carry_mask(middle, addend.middle);
+        middle = _mm_sub_epi16(middle, low_carry);
+        // Adding the low carry can only wrap a middle part that was 0xFFFF
+        middle_carry = _mm_or_si128(
+            middle_carry,
+            _mm_and_si128(low_carry, _mm_cmpeq_epi16(middle, _mm_setzero_si128())));
+        __m128i high = _mm_sub_epi16(_mm_add_epi16(acc.high, addend.high), middle_carry);
+        Parts result = {high, middle, low};
+        store(accumulator, result);
+        return result;
+    }
+
+    // high:middle as a signed 32-bit value, saturated to 16 bits
+    inline __m128i clamp_signed(const Parts& acc)
+    {
+        return _mm_packs_epi32(_mm_unpacklo_epi16(acc.middle, acc.high),
+                               _mm_unpackhi_epi16(acc.middle, acc.high));
+    }
+
+    // Negative values become 0 and anything above 0x7FFF becomes 0xFFFF
+    inline __m128i clamp_unsigned(const Parts& acc)
+    {
+        __m128i value = _mm_packus_epi32(_mm_unpacklo_epi16(acc.middle, acc.high),
+                                         _mm_unpackhi_epi16(acc.middle, acc.high));
+        return _mm_or_si128(value, _mm_srai_epi16(value, 15));
+    }
+
+    // The low part if high:middle is just a sign extension, otherwise 0 or 0xFFFF depending on
+    // the sign
+    inline __m128i clamp_low(const Parts& acc)
+    {
+        __m128i sign_extension = _mm_cmpeq_epi16(acc.high, _mm_srai_epi16(acc.middle, 15));
+        __m128i clamped = bit_not(_mm_srai_epi16(acc.high, 15));
+        return _mm_blendv_epi8(clamped, acc.low, sign_extension);
+    }
+
+    // 2 * vs * vt, rounded by 0x8000 when round is set
+    inline Parts fraction_product(__m128i vs, __m128i vt, bool round)
+    {
+        __m128i lo = _mm_mullo_epi16(vs, vt);
+        __m128i hi = _mm_mulhi_epi16(vs, vt);
+        __m128i low = _mm_slli_epi16(lo, 1);
+        __m128i middle = _mm_or_si128(_mm_slli_epi16(hi, 1), _mm_srli_epi16(lo, 15));
+        // Only 0x8000 * 0x8000 doesn't fit in 32 bits after doubling
+        __m128i high = _mm_srai_epi16(hi, 15);
+        if (round)
+        {
+            middle = _mm_add_epi16(middle, _mm_srli_epi16(low, 15));
+            low = _mm_xor_si128(low, _mm_set1_epi16(static_cast<int16_t>(0x8000)));
+            __m128i overflow = _mm_and_si128(_mm_cmpeq_epi16(vs, vt),
+                                             _mm_cmpeq_epi16(vs, _mm_set1_epi16(INT16_MIN)));
+            high = _mm_andnot_si128(overflow, _mm_srai_epi16(middle, 15));
+        }
+        return {high, middle, low};
+    }
+
+    // Signed vs times unsigned vt
+    inline Parts mixed_product(__m128i vs, __m128i vt)
+    {
+        __m128i middle = _mm_add_epi16(_mm_mulhi_epi16(vs, vt),
+                                       _mm_and_si128(_mm_srai_epi16(vt, 15), vs));
+        return {_mm_srai_epi16(middle, 15), middle, _mm_mullo_epi16(vs, vt)};
+    }
+} // namespace
+
+namespace hydra::N64
+{
+#define vuinstr (VUInstruction(instruction_.full))
+
+    void RSP::sse_VMULF()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = fraction_product(vs, vt, true);
+        store(accumulator_, acc);
+        store(get_vd(), clamp_signed(acc));
+    }
+
+    void RSP::sse_VMULU()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = fraction_product(vs, vt, true);
+        store(accumulator_, acc);
+        store(get_vd(), clamp_unsigned(acc));
+    }
+
+    void RSP::sse_VMUDL()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i low = _mm_mulhi_epu16(vs, vt);
+        store(accumulator_, {_mm_setzero_si128(), _mm_setzero_si128(), low});
+        store(get_vd(), low);
+    }
+
+    void RSP::sse_VMUDM()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = mixed_product(vs, vt);
+        store(accumulator_, acc);
+        // The product always fits, so clamping high:middle is a no-op
+        store(get_vd(), acc.middle);
+    }
+
+    void RSP::sse_VMUDN()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = mixed_product(vt, vs);
+        store(accumulator_, acc);
+        store(get_vd(), acc.low);
+    }
+
+    void RSP::sse_VMUDH()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = {_mm_mulhi_epi16(vs, vt), _mm_mullo_epi16(vs, vt), _mm_setzero_si128()};
+        store(accumulator_, acc);
+        store(get_vd(), clamp_signed(acc));
+    }
+
+    void RSP::sse_VMACF()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = accumulate(accumulator_, fraction_product(vs, vt, false));
+        store(get_vd(), clamp_signed(acc));
+    }
+
+    void RSP::sse_VMACU()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = accumulate(accumulator_, fraction_product(vs, vt, false));
+        store(get_vd(), clamp_unsigned(acc));
+    }
+
+    void RSP::sse_VMADL()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = accumulate(accumulator_, {_mm_setzero_si128(), _mm_setzero_si128(),
+                                              _mm_mulhi_epu16(vs, vt)});
+        store(get_vd(), clamp_low(acc));
+    }
+
+    void RSP::sse_VMADM()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = accumulate(accumulator_, mixed_product(vs, vt));
+        store(get_vd(), clamp_signed(acc));
+    }
+
+    void RSP::sse_VMADN()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = accumulate(accumulator_, mixed_product(vt, vs));
+        store(get_vd(), clamp_low(acc));
+    }
+
+    void RSP::sse_VMADH()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        Parts acc = accumulate(accumulator_, {_mm_mulhi_epi16(vs, vt), _mm_mullo_epi16(vs, vt),
+                                              _mm_setzero_si128()});
+        store(get_vd(), clamp_signed(acc));
+    }
+
+    void RSP::sse_VADD()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i carry = expand_mask(*vco_);
+        store(accumulator_.low, _mm_sub_epi16(_mm_add_epi16(vs, vt), carry));
+        // Adding the carry to the smaller operand can only saturate if both are 0x7FFF
+        __m128i min = _mm_subs_epi16(_mm_min_epi16(vs, vt), carry);
+        store(get_vd(), _mm_adds_epi16(min, _mm_max_epi16(vs, vt)));
+        vco_.Clear();
+    }
+
+    void RSP::sse_VSUB()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i carry = expand_mask(*vco_);
+        __m128i vt_carry = _mm_sub_epi16(vt, carry);
+        __m128i vt_carry_clamped = _mm_subs_epi16(vt, carry);
+        // 0x7FFF + 1 gets subtracted in two steps
+        __m128i overflow = _mm_cmpgt_epi16(vt_carry_clamped, vt_carry);
+        store(accumulator_.low, _mm_sub_epi16(vs, vt_carry));
+        store(get_vd(), _mm_adds_epi16(_mm_subs_epi16(vs, vt_carry_clamped), overflow));
+        vco_.Clear();
+    }
+
+    void RSP::sse_VADDC()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i sum = _mm_add_epi16(vs, vt);
+        *vco_ = pack_mask(carry_mask(sum, vs));
+        store(accumulator_.low, sum);
+        store(get_vd(), sum);
+    }
+
+    void RSP::sse_VSUBC()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i difference = _mm_sub_epi16(vs, vt);
+        __m128i borrow = bit_not(_mm_cmpeq_epi16(_mm_max_epu16(vs, vt), vs));
+        __m128i not_equal = bit_not(_mm_cmpeq_epi16(vs, vt));
+        *vco_ = pack_mask(borrow, not_equal);
+        store(accumulator_.low, difference);
+        store(get_vd(), difference);
+    }
+
+    void RSP::sse_VEQ()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i test = _mm_andnot_si128(expand_mask(*vco_ >> 8), _mm_cmpeq_epi16(vs, vt));
+        *vcc_ = pack_mask(test);
+        // Equal lanes pick vs, which is the same thing
+        store(accumulator_.low, vt);
+        store(get_vd(), vt);
+        vco_.Clear();
+    }
+
+    void RSP::sse_VNE()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i test = _mm_or_si128(bit_not(_mm_cmpeq_epi16(vs, vt)), expand_mask(*vco_ >> 8));
+        *vcc_ = pack_mask(test);
+        store(accumulator_.low, vs);
+        store(get_vd(), vs);
+        vco_.Clear();
+    }
+
+    void RSP::sse_VGE()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i both = expand_mask(*vco_ & (*vco_ >> 8));
+        __m128i test = _mm_or_si128(_mm_cmpgt_epi16(vs, vt),
+                                    _mm_andnot_si128(both, _mm_cmpeq_epi16(vs, vt)));
+        *vcc_ = pack_mask(test);
+        __m128i result = _mm_blendv_epi8(vt, vs, test);
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+        vco_.Clear();
+    }
+
+    void RSP::sse_VLT()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i both = expand_mask(*vco_ & (*vco_ >> 8));
+        __m128i test = _mm_or_si128(_mm_cmpgt_epi16(vt, vs),
+                                    _mm_and_si128(both, _mm_cmpeq_epi16(vs, vt)));
+        *vcc_ = pack_mask(test);
+        __m128i result = _mm_blendv_epi8(vt, vs, test);
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+        vco_.Clear();
+    }
+
+    void RSP::sse_VCH()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i zero = _mm_setzero_si128();
+        __m128i sign = _mm_srai_epi16(_mm_xor_si128(vs, vt), 15);
+        __m128i sum = _mm_add_epi16(vs, vt);
+        __m128i difference = _mm_sub_epi16(vs, vt);
+        __m128i le = _mm_cmpgt_epi16(_mm_set1_epi16(1), sum);
+        __m128i ge = bit_not(_mm_srai_epi16(difference, 15));
+        __m128i vt_negative = _mm_srai_epi16(vt, 15);
+        __m128i sum_minus_one = _mm_cmpeq_epi16(sum, ones());
+
+        __m128i vcc_low = _mm_blendv_epi8(vt_negative, le, sign);
+        __m128i vcc_high = _mm_blendv_epi8(ge, vt_negative, sign);
+        __m128i vco_high = _mm_blendv_epi8(
+            bit_not(_mm_cmpeq_epi16(difference, zero)),
+            bit_not(_mm_or_si128(_mm_cmpeq_epi16(sum, zero), sum_minus_one)), sign);
+        __m128i result = _mm_blendv_epi8(_mm_blendv_epi8(vs, vt, ge),
+                                         _mm_blendv_epi8(vs, _mm_sub_epi16(zero, vt), le), sign);
+
+        *vcc_ = pack_mask(vcc_low, vcc_high);
+        *vco_ = pack_mask(sign, vco_high);
+        *vce_ = pack_mask(_mm_and_si128(sign, sum_minus_one));
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+    }
+
+    void RSP::sse_VCR()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i sign = _mm_srai_epi16(_mm_xor_si128(vs, vt), 15);
+        __m128i ge = bit_not(_mm_cmpgt_epi16(vt, _mm_or_si128(vs, sign)));
+        __m128i le = _mm_srai_epi16(_mm_add_epi16(_mm_and_si128(vs, sign), vt), 15);
+        __m128i check = _mm_blendv_epi8(ge, le, sign);
+        __m128i result = _mm_blendv_epi8(vs, _mm_xor_si128(vt, sign), check);
+
+        *vcc_ = pack_mask(le, ge);
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+        vco_.Clear();
+        vce_.Clear();
+    }
+
+    void RSP::sse_VCL()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i vco_low = expand_mask(*vco_);
+        __m128i vco_high = expand_mask(*vco_ >> 8);
+        __m128i sum = _mm_add_epi16(vs, vt);
+        __m128i no_carry = bit_not(carry_mask(sum, vs));
+        __m128i sum_zero = _mm_cmpeq_epi16(sum, _mm_setzero_si128());
+        __m128i le = _mm_blendv_epi8(_mm_and_si128(sum_zero, no_carry),
+                                     _mm_or_si128(sum_zero, no_carry), expand_mask(*vce_));
+        __m128i ge = _mm_cmpeq_epi16(_mm_max_epu16(vs, vt), vs);
+
+        // Only the lanes without the flags set get their vcc bit recomputed
+        __m128i vcc_low = _mm_blendv_epi8(expand_mask(*vcc_), le,
+                                          _mm_andnot_si128(vco_high, vco_low));
+        __m128i vcc_high = _mm_blendv_epi8(expand_mask(*vcc_ >> 8), ge,
+                                           bit_not(_mm_or_si128(vco_low, vco_high)));
+        __m128i result = _mm_blendv_epi8(
+            _mm_blendv_epi8(vs, vt, vcc_high),
+            _mm_blendv_epi8(vs, _mm_sub_epi16(_mm_setzero_si128(), vt), vcc_low), vco_low);
+
+        *vcc_ = pack_mask(vcc_low, vcc_high);
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+        vco_.Clear();
+        vce_.Clear();
+    }
+
+    void RSP::sse_VMRG()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i result = _mm_blendv_epi8(vt, vs, expand_mask(*vcc_));
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+        vco_.Clear();
+    }
+
+    void RSP::sse_VABS()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i result = _mm_sign_epi16(vt, vs);
+        // -0x8000 stays 0x8000 in the accumulator but is clamped in vd
+        __m128i edge_case = _mm_and_si128(_mm_srai_epi16(vs, 15),
+                                          _mm_cmpeq_epi16(vt, _mm_set1_epi16(INT16_MIN)));
+        store(accumulator_.low, result);
+        store(get_vd(), _mm_xor_si128(result, edge_case));
+    }
+
+    void RSP::sse_VZERO()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        store(accumulator_.low, _mm_add_epi16(vs, vt));
+        store(get_vd(), _mm_setzero_si128());
+    }
+
+    void RSP::sse_VSAR()
+    {
+        switch (vuinstr.element)
+        {
+            case 0x8:
+                store(get_vd(), load(accumulator_.high));
+                break;
+            case 0x9:
+                store(get_vd(), load(accumulator_.middle));
+                break;
+            case 0xA:
+                store(get_vd(), load(accumulator_.low));
+                break;
+            default:
+                store(get_vd(), _mm_setzero_si128());
+                break;
+        }
+    }
+
+    void RSP::sse_VAND()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i result = _mm_and_si128(vs, vt);
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+    }
+
+    void RSP::sse_VNAND()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i result = bit_not(_mm_and_si128(vs, vt));
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+    }
+
+    void RSP::sse_VOR()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i result = _mm_or_si128(vs, vt);
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+    }
+
+    void RSP::sse_VNOR()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i result = bit_not(_mm_or_si128(vs, vt));
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+    }
+
+    void RSP::sse_VXOR()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i result = _mm_xor_si128(vs, vt);
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+    }
+
+    void RSP::sse_VNXOR()
+    {
+        __m128i vs = load(get_vs());
+        __m128i vt = load_shuffled(get_vt(), vuinstr.element);
+        __m128i result = bit_not(_mm_xor_si128(vs, vt));
+        store(accumulator_.low, result);
+        store(get_vd(), result);
+    }
+
+#undef vuinstr
+} // namespace hydra::N64
+#endif
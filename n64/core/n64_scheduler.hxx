@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace hydra::N64
+{
+    enum class EventType {
+        VIHalfline,
+        Compare,
+        AISample,
+        PIDMA,
+        SIDMA,
+        SPDMA,
+        RSPSlice,
+    };
+
+    /**
+        Min-heap of timed events, in CPU cycles
+
+        The CPU runs uninterrupted until the earliest deadline, then every event that is due is
+        popped and handled. Each event type is queued at most once, scheduling it again moves it.
+    */
+    class Scheduler final
+    {
+    public:
+        void Reset()
+        {
+            now_ = 0;
+            events_.clear();
+        }
+
+        uint64_t Now() const
+        {
+            return now_;
+        }
+
+        void Advance(uint64_t cycles)
+        {
+            now_ += cycles;
+        }
+
+        uint64_t NextDeadline() const
+        {
+            return events_.empty() ? std::numeric_limits<uint64_t>::max() : events_.front().time;
+        }
+
+        void Schedule(EventType type, uint64_t delay)
+        {
+            Deschedule(type);
+            events_.push_back({now_ + delay, type});
+            std::push_heap(events_.begin(), events_.end(), std::greater<>{});
+        }
+
+        void Deschedule(EventType type)
+        {
+            auto it = std::find_if(events_.begin(), events_.end(),
+                                   [type](const Event& event) { return event.type == type; });
+            if (it != events_.end())
+            {
+                events_.erase(it);
+                std::make_heap(events_.begin(), events_.end(), std::greater<>{});
+            }
+        }
+
+        bool IsScheduled(EventType type) const
+        {
+            return std::any_of(events_.begin(), events_.end(),
+                               [type](const Event& event) { return event.type == type; });
+        }
+
+        // Pops the earliest event if it is due
+        bool Pop(EventType& type)
+        {
+            if (events_.empty() || events_.front().time > now_)
+            {
+                return false;
+            }
+            std::pop_heap(events_.begin(), events_.end(), std::greater<>{});
+            type = events_.back().type;
+            events_.pop_back();
+            return true;
+        }
+
+    private:
+        struct Event
+        {
+            uint64_t time;
+            EventType type;
+
+            bool operator>(const Event& other) const
+            {
+                return time > other.time;
+            }
+        };
+
+        uint64_t now_ = 0;
+        std::vector<Event> events_;
+    };
+} // namespace hydra::N64
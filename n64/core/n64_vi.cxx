@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <compatibility.hxx>
+#include <cstring>
 #include <fmt/format.h>
 #include <log.hxx>
 #include <n64/core/n64_addresses.hxx>
 #include <n64/core/n64_types.hxx>
 #include <n64/core/n64_vi.hxx>
+#include <n64/core/n64_vi_convert.hxx>
 
 namespace hydra::N64
 {
@@ -14,71 +17,122 @@ namespace hydra::N64
 
     bool Vi::Redraw()
     {
-        auto new_width = vi_h_end_ - vi_h_start_;
-        auto new_height = (vi_v_end_ - vi_v_start_) / 2;
-        new_width *= vi_x_scale_ ? vi_x_scale_ : 512;
-        new_height *= vi_y_scale_ ? vi_y_scale_ : 512;
-        if (new_width == 0 || new_height == 0 || !memory_ptr_ || pixel_mode_ == 0)
+        // How far the VI moves through the framebuffer for every pixel on the screen, in 2.10
+        // fixed point
+        uint32_t x_scale = vi_x_scale_ ? vi_x_scale_ : 512;
+        uint32_t y_scale = vi_y_scale_ ? vi_y_scale_ : 512;
+        int screen_width = vi_h_end_ > vi_h_start_ ? vi_h_end_ - vi_h_start_ : 0;
+        int screen_height = vi_v_end_ > vi_v_start_ ? (vi_v_end_ - vi_v_start_) / 2 : 0;
+        int source_width = (screen_width * x_scale) >> 10;
+        int source_height = (screen_height * y_scale) >> 10;
+
+        // Framebuffers bigger than the screen are shown whole instead of dropping pixels
+        int width = std::max(screen_width, source_width);
+        int height = std::max(screen_height, source_height);
+        uint32_t x_step = source_width >= screen_width ? 1024 : x_scale;
+        uint32_t y_step = source_height >= screen_height ? 1024 : y_scale;
+        // What is actually read, the last pixel may be past the scaled size
+        int read_width = width ? (((width - 1) * x_step) >> 10) + 1 : 0;
+        int read_height = height ? (((height - 1) * y_step) >> 10) + 1 : 0;
+        uint32_t pixel_bytes = pixel_mode_ == 0b11 ? 4 : 2;
+        uint64_t read_end =
+            vi_origin_ + (static_cast<uint64_t>(read_height - 1) * vi_width_ + read_width) *
+                             pixel_bytes;
+
+        // Mode 1 is reserved
+        if (source_width == 0 || source_height == 0 || !memory_ptr_ || pixel_mode_ < 0b10 ||
+            read_end > RDRAM_EXPANSION_SIZE)
         {
             if (!blacked_out_)
             {
                 std::fill(framebuffer_.begin(), framebuffer_.end(), 0);
                 blacked_out_ = true;
+                drawn_memory_ptr_ = nullptr;
             }
             return true;
         }
         blacked_out_ = false;
-        new_width >>= 10;
-        new_height >>= 10;
-        width_ = new_width;
-        height_ = new_height;
+        if (is_unchanged(width, height, x_step, y_step, read_end - vi_origin_))
+        {
+            return true;
+        }
+        width_ = width;
+        height_ = height;
         size_t new_size = width_ * height_ * 4;
         if (framebuffer_.size() != new_size)
         {
             framebuffer_.resize(new_size);
         }
-        switch (pixel_mode_)
+
+        // Rows are converted straight into the framebuffer when there's nothing to scale,
+        // otherwise into row_ first
+        if (x_step != 1024)
         {
-            case 0b11:
+            row_.resize(read_width);
+            columns_.resize(width_);
+            for (int x = 0; x < width_; x++)
             {
-                for (int y = 0; y < height_; y++)
-                {
-                    for (int x = 0; x < width_; x++)
-                    {
-                        uint32_t color =
-                            (reinterpret_cast<uint32_t*>(memory_ptr_))[(y * vi_width_) + x];
-                        set_pixel(x, y, color);
-                    }
-                }
-                break;
+                columns_[x] = (x * x_step) >> 10;
             }
-            case 0b10:
+        }
+        uint32_t* dst = reinterpret_cast<uint32_t*>(framebuffer_.data());
+        int last_row = -1;
+        for (int y = 0; y < height_; y++, dst += width_)
+        {
+            int row = (y * y_step) >> 10;
+            if (row == last_row)
             {
-                for (int y = 0; y < height_; y++)
-                {
-                    for (int x = 0; x < width_; x++)
-                    {
-                        uint16_t color_temp =
-                            (reinterpret_cast<uint16_t*>(memory_ptr_))[(y * vi_width_) + x];
-                        uint8_t r = (color_temp >> 11) & 0x1F;
-                        uint8_t g = (color_temp >> 6) & 0x1F;
-                        uint8_t b = (color_temp >> 1) & 0x1F;
-                        r = (r << 3) | (r >> 2);
-                        g = (g << 3) | (g >> 2);
-                        b = (b << 3) | (b >> 2);
-                        uint32_t color = 0xffu << 24 | b << 16 | g << 8 | r;
-                        set_pixel(x, y, color);
-                    }
-                }
-                break;
+                std::memcpy(dst, dst - width_, width_ * 4);
+                continue;
+            }
+            last_row = row;
+
+            const uint8_t* src = memory_ptr_ + row * vi_width_ * pixel_bytes;
+            uint32_t* converted = x_step == 1024 ? dst : row_.data();
+            if (pixel_mode_ == 0b11)
+            {
+                vi_convert_row32(src, converted, read_width);
+            }
+            else
+            {
+                vi_convert_row16(src, converted, read_width);
+            }
+
+            if (x_step == 512)
+            {
+                vi_double_row(converted, dst, width_);
+            }
+            else if (x_step != 1024)
+            {
+                vi_resample_row(converted, dst, columns_.data(), width_);
             }
-            default:
-                break;
         }
         framebuffer_ptr_ = framebuffer_.data();
         return true;
     }
 
+    bool Vi::is_unchanged(int width, int height, uint32_t x_step, uint32_t y_step,
+                          uint32_t bytes)
+    {
+        // The same size can come from a different scale, which reads other pixels
+        bool same_layout = drawn_memory_ptr_ == memory_ptr_ && drawn_vi_width_ == vi_width_ &&
+                           drawn_pixel_mode_ == pixel_mode_ && drawn_x_step_ == x_step &&
+                           drawn_y_step_ == y_step && width_ == width && height_ == height &&
+                           framebuffer_ptr_;
+        drawn_memory_ptr_ = memory_ptr_;
+        drawn_vi_width_ = vi_width_;
+        drawn_pixel_mode_ = pixel_mode_;
+        drawn_x_step_ = x_step;
+        drawn_y_step_ = y_step;
+        if (!dirty_map_)
+        {
+            return false;
+        }
+        // Cleared even when redrawing anyway, so the next frame only sees newer writes
+        bool dirty = dirty_map_->TestAndClear(DirtyConsumer::Framebuffer, vi_origin_, bytes);
+        return same_layout && !dirty;
+    }
+
     uint32_t Vi::ReadWord(uint32_t addr)
     {
         switch (addr)
@@ -173,6 +227,7 @@ namespace hydra::N64
             case VI_ORIGIN:
             {
                 data &= 0x00FFFFFF;
+                vi_origin_ = data;
                 memory_ptr_ = &rdram_ptr_[data];
                 vis_counter_ += 1;
                 break;
@@ -231,9 +286,4 @@ namespace hydra::N64
             }
         }
     }
-
-    void Vi::set_pixel(int x, int y, uint32_t color)
-    {
-        memcpy(&framebuffer_[(x + y * width_) * 4], &color, 4);
-    }
 } // namespace hydra::N64
\ No newline at end of file
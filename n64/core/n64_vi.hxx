@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <n64/core/n64_rdram.hxx>
 #include <vector>
 
 namespace hydra::N64
@@ -36,6 +37,11 @@ namespace hydra::N64
             mi_interrupt_ = mi_interrupt;
         }
 
+        void SetDirtyMap(RDRAMDirtyMap* dirty_map)
+        {
+            dirty_map_ = dirty_map;
+        }
+
     private:
         uint32_t vi_ctrl_ = 0;
         uint32_t vi_origin_ = 0;
@@ -60,16 +66,27 @@ namespace hydra::N64
         int num_halflines_ = 262;
         int cycles_per_halfline_ = 1000;
         bool blacked_out_ = false;
+        // What the framebuffer was last converted from, so an unchanged one can be skipped
+        uint8_t* drawn_memory_ptr_ = nullptr;
+        uint32_t drawn_vi_width_ = 0;
+        uint8_t drawn_pixel_mode_ = 0;
+        uint32_t drawn_x_step_ = 0;
+        uint32_t drawn_y_step_ = 0;
 
         uint8_t pixel_mode_ = 0;
         std::vector<uint8_t> framebuffer_;
+        // A converted framebuffer row and the pixel of it every column shows, when scaling
+        std::vector<uint32_t> row_;
+        std::vector<uint16_t> columns_;
         std::vector<uint8_t> framebuffer_black_;
         uint8_t* framebuffer_ptr_ = nullptr;
         uint8_t* memory_ptr_ = nullptr;
         uint8_t* rdram_ptr_ = nullptr;
         MIInterrupt* mi_interrupt_ = nullptr;
+        RDRAMDirtyMap* dirty_map_ = nullptr;
 
-        inline void set_pixel(int x, int y, uint32_t color);
+        bool is_unchanged(int width, int height, uint32_t x_step, uint32_t y_step,
+                          uint32_t bytes);
         friend class hydra::N64::RCP;
         friend class hydra::N64::CPU;
         friend class hydra::N64::CPUBus;
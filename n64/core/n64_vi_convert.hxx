@@ -0,0 +1,102 @@
+#pragma once
+
+#include <compatibility.hxx>
+#include <cstdint>
+#include <cstring>
+
+namespace hydra::N64
+{
+    // The RDP keeps framebuffer pixels in host order, so a 16-bit pixel is RGBA5551 in a
+    // uint16_t and a 32-bit one already is the RGBA8888 the frontend wants
+    inline uint32_t vi_expand_5551(uint16_t color)
+    {
+        uint32_t r = (color >> 11) & 0x1F;
+        uint32_t g = (color >> 6) & 0x1F;
+        uint32_t b = (color >> 1) & 0x1F;
+        r = (r << 3) | (r >> 2);
+        g = (g << 3) | (g >> 2);
+        b = (b << 3) | (b >> 2);
+        return 0xffu << 24 | b << 16 | g << 8 | r;
+    }
+
+    inline void vi_convert_row16_scalar(const uint8_t* src, uint32_t* dst, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            uint16_t color;
+            std::memcpy(&color, src + i * 2, sizeof(color));
+            dst[i] = vi_expand_5551(color);
+        }
+    }
+
+#if HYDRA_SIMD_AVAILABLE
+    // The channels of 8 pixels expanded in 16-bit lanes, then interleaved into RG and BA pairs
+    inline void vi_convert_row16_sse(const uint8_t* src, uint32_t* dst, int count)
+    {
+        const __m128i mask = _mm_set1_epi16(0x1F);
+        const __m128i alpha = _mm_set1_epi16(static_cast<int16_t>(0xFF00));
+        int i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i colors = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+            __m128i r = _mm_srli_epi16(colors, 11);
+            __m128i g = _mm_and_si128(_mm_srli_epi16(colors, 6), mask);
+            __m128i b = _mm_and_si128(_mm_srli_epi16(colors, 1), mask);
+            r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+            g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+            b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+            __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+            __m128i ba = _mm_or_si128(b, alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(rg, ba));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4),
+                             _mm_unpackhi_epi16(rg, ba));
+        }
+        vi_convert_row16_scalar(src + i * 2, dst + i, count - i);
+    }
+#endif
+
+    inline void vi_convert_row16(const uint8_t* src, uint32_t* dst, int count)
+    {
+#if HYDRA_SIMD_AVAILABLE
+        vi_convert_row16_sse(src, dst, count);
+#else
+        vi_convert_row16_scalar(src, dst, count);
+#endif
+    }
+
+    inline void vi_convert_row32(const uint8_t* src, uint32_t* dst, int count)
+    {
+        std::memcpy(dst, src, count * sizeof(uint32_t));
+    }
+
+    // Every pixel twice, which is what the usual 320 pixel wide framebuffers on a 640 pixel
+    // wide screen come down to. count is in destination pixels
+    inline void vi_double_row(const uint32_t* src, uint32_t* dst, int count)
+    {
+        int i = 0;
+#if HYDRA_SIMD_AVAILABLE
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i / 2));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                             _mm_unpacklo_epi32(pixels, pixels));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4),
+                             _mm_unpackhi_epi32(pixels, pixels));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] = src[i / 2];
+        }
+    }
+
+    // Any other scale, columns holds the source pixel of every destination pixel
+    inline void vi_resample_row(const uint32_t* src, uint32_t* dst, const uint16_t* columns,
+                                int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            dst[i] = src[columns[i]];
+        }
+    }
+} // namespace hydra::N64
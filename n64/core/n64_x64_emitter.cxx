@@ -0,0 +1,580 @@
+#include <n64/core/n64_x64_emitter.hxx>
+
+#if N64_JIT_AVAILABLE
+#include <cstring>
+#include <log.hxx>
+#include <sys/mman.h>
+
+namespace
+{
+    bool fits_int8(int64_t value)
+    {
+        return value == static_cast<int8_t>(value);
+    }
+
+    bool fits_int32(int64_t value)
+    {
+        return value == static_cast<int32_t>(value);
+    }
+
+    uint8_t size_prefix(const hydra::N64::x64::Reg& reg)
+    {
+        return reg.bits == 16 ? 0x66 : 0;
+    }
+
+    uint8_t size_prefix(uint16_t bits)
+    {
+        return bits == 16 ? 0x66 : 0;
+    }
+} // namespace
+
+namespace hydra::N64::x64
+{
+    Emitter::Emitter(size_t capacity) : capacity_(capacity)
+    {
+        void* code = mmap(nullptr, capacity, PROT_READ | PROT_WRITE | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED)
+        {
+            Logger::Fatal("Emitter: Failed to map {} bytes of executable memory", capacity);
+        }
+        code_ = static_cast<uint8_t*>(code);
+    }
+
+    Emitter::~Emitter()
+    {
+        munmap(code_, capacity_);
+    }
+
+    void Emitter::Bind(Label& label)
+    {
+        label.offset_ = size_;
+        for (size_t use : label.uses_)
+        {
+            int32_t displacement = static_cast<int32_t>(size_ - (use + 4));
+            memcpy(code_ + use, &displacement, sizeof(int32_t));
+        }
+        label.uses_.clear();
+    }
+
+    void Emitter::db(uint8_t value)
+    {
+        if (size_ == capacity_) [[unlikely]]
+        {
+            Logger::Fatal("Emitter: Out of code space");
+        }
+        code_[size_++] = value;
+    }
+
+    void Emitter::dd(uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            db(value >> (i * 8));
+        }
+    }
+
+    void Emitter::dq(uint64_t value)
+    {
+        dd(value);
+        dd(value >> 32);
+    }
+
+    void Emitter::opcode(uint32_t value)
+    {
+        // Multi byte opcodes always start with 0x0F, so the length can't be ambiguous
+        if (value > 0xFFFF)
+        {
+            db(value >> 16);
+        }
+        if (value > 0xFF)
+        {
+            db(value >> 8);
+        }
+        db(value);
+    }
+
+    void Emitter::op_rr(uint8_t prefix, bool w, uint32_t value, int reg, int rm, bool force_rex)
+    {
+        if (prefix)
+        {
+            db(prefix);
+        }
+        uint8_t rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+        if (rex != 0x40 || force_rex)
+        {
+            db(rex);
+        }
+        opcode(value);
+        db(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void Emitter::op_rm(uint8_t prefix, bool w, uint32_t value, int reg, const RegExp& mem,
+                        bool force_rex)
+    {
+        if (mem.base < 0 || mem.index == 4) [[unlikely]]
+        {
+            Logger::Fatal("Emitter: Unsupported memory operand");
+        }
+        if (prefix)
+        {
+            db(prefix);
+        }
+        int index = mem.index >= 0 ? mem.index : 0;
+        uint8_t rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((mem.base & 8) >> 3);
+        if (rex != 0x40 || force_rex)
+        {
+            db(rex);
+        }
+        opcode(value);
+
+        // rbp and r13 as a base always need a displacement, rsp and r12 always need a SIB byte
+        int mod;
+        if (mem.disp == 0 && (mem.base & 7) != 5)
+        {
+            mod = 0;
+        }
+        else if (fits_int8(mem.disp))
+        {
+            mod = 1;
+        }
+        else
+        {
+            mod = 2;
+        }
+        bool sib = mem.index >= 0 || (mem.base & 7) == 4;
+        db((mod << 6) | ((reg & 7) << 3) | (sib ? 4 : (mem.base & 7)));
+        if (sib)
+        {
+            int scale = mem.scale == 8 ? 3 : mem.scale == 4 ? 2 : mem.scale == 2 ? 1 : 0;
+            int sib_index = mem.index >= 0 ? (mem.index & 7) : 4;
+            db((scale << 6) | (sib_index << 3) | (mem.base & 7));
+        }
+        if (mod == 1)
+        {
+            db(mem.disp);
+        }
+        else if (mod == 2)
+        {
+            dd(mem.disp);
+        }
+    }
+
+    void Emitter::mov(const Reg& dst, const Reg& src)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, dst.bits == 8 ? 0x88 : 0x89, src.index, dst.index,
+              dst.NeedsRex() || src.NeedsRex());
+    }
+
+    void Emitter::mov(const Reg& dst, const Address& src)
+    {
+        op_rm(size_prefix(dst), dst.bits == 64, dst.bits == 8 ? 0x8A : 0x8B, dst.index, src.exp,
+              dst.NeedsRex());
+    }
+
+    void Emitter::mov(const Address& dst, const Reg& src)
+    {
+        op_rm(size_prefix(src), src.bits == 64, src.bits == 8 ? 0x88 : 0x89, src.index, dst.exp,
+              src.NeedsRex());
+    }
+
+    void Emitter::mov(const Reg& dst, uint64_t imm)
+    {
+        int64_t value = static_cast<int64_t>(imm);
+        if (dst.bits == 64 && fits_int32(value))
+        {
+            op_rr(0, true, 0xC7, 0, dst.index, false);
+            dd(imm);
+            return;
+        }
+        // Writing the 32-bit register clears the upper half, which covers zero extended values
+        bool wide = dst.bits == 64 && (imm >> 32) != 0;
+        if (size_prefix(dst))
+        {
+            db(0x66);
+        }
+        uint8_t rex = 0x40 | (wide << 3) | ((dst.index & 8) >> 3);
+        if (rex != 0x40 || dst.NeedsRex())
+        {
+            db(rex);
+        }
+        db((dst.bits == 8 ? 0xB0 : 0xB8) + (dst.index & 7));
+        switch (dst.bits)
+        {
+            case 8:
+                db(imm);
+                break;
+            case 16:
+                db(imm);
+                db(imm >> 8);
+                break;
+            default:
+                if (wide)
+                {
+                    dq(imm);
+                }
+                else
+                {
+                    dd(imm);
+                }
+                break;
+        }
+    }
+
+    void Emitter::mov(const Address& dst, uint64_t imm)
+    {
+        op_rm(size_prefix(dst.bits), dst.bits == 64, dst.bits == 8 ? 0xC6 : 0xC7, 0, dst.exp,
+              false);
+        switch (dst.bits)
+        {
+            case 8:
+                db(imm);
+                break;
+            case 16:
+                db(imm);
+                db(imm >> 8);
+                break;
+            default:
+                dd(imm);
+                break;
+        }
+    }
+
+    void Emitter::movsxd(const Reg64& dst, const Reg32& src)
+    {
+        op_rr(0, true, 0x63, dst.index, src.index, false);
+    }
+
+    void Emitter::movsx(const Reg& dst, const Reg& src)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, src.bits == 8 ? 0x0FBE : 0x0FBF, dst.index,
+              src.index, src.NeedsRex());
+    }
+
+    void Emitter::movsx(const Reg& dst, const Address& src)
+    {
+        op_rm(size_prefix(dst), dst.bits == 64, src.bits == 8 ? 0x0FBE : 0x0FBF, dst.index,
+              src.exp, false);
+    }
+
+    void Emitter::movzx(const Reg& dst, const Reg& src)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, src.bits == 8 ? 0x0FB6 : 0x0FB7, dst.index,
+              src.index, src.NeedsRex());
+    }
+
+    void Emitter::movzx(const Reg& dst, const Address& src)
+    {
+        op_rm(size_prefix(dst), dst.bits == 64, src.bits == 8 ? 0x0FB6 : 0x0FB7, dst.index,
+              src.exp, false);
+    }
+
+    void Emitter::lea(const Reg& dst, const Address& src)
+    {
+        op_rm(0, dst.bits == 64, 0x8D, dst.index, src.exp, false);
+    }
+
+    void Emitter::alu(int n, const Reg& dst, const Reg& src)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, n * 8 + (dst.bits == 8 ? 0 : 1), src.index,
+              dst.index, dst.NeedsRex() || src.NeedsRex());
+    }
+
+    void Emitter::alu(int n, const Reg& dst, const Address& src)
+    {
+        op_rm(size_prefix(dst), dst.bits == 64, n * 8 + (dst.bits == 8 ? 2 : 3), dst.index,
+              src.exp, dst.NeedsRex());
+    }
+
+    void Emitter::alu(int n, const Address& dst, const Reg& src)
+    {
+        op_rm(size_prefix(src), src.bits == 64, n * 8 + (src.bits == 8 ? 0 : 1), src.index,
+              dst.exp, src.NeedsRex());
+    }
+
+    void Emitter::alu(int n, const Reg& dst, int64_t imm)
+    {
+        if (dst.bits == 8)
+        {
+            op_rr(0, false, 0x80, n, dst.index, dst.NeedsRex());
+            db(imm);
+            return;
+        }
+        if (dst.bits == 32)
+        {
+            // Unsigned 32-bit values are fine here, only the low 32 bits are used
+            imm = static_cast<int32_t>(imm);
+        }
+        bool short_form = fits_int8(imm);
+        op_rr(size_prefix(dst), dst.bits == 64, short_form ? 0x83 : 0x81, n, dst.index, false);
+        if (short_form)
+        {
+            db(imm);
+        }
+        else if (dst.bits == 16)
+        {
+            db(imm);
+            db(imm >> 8);
+        }
+        else
+        {
+            dd(imm);
+        }
+    }
+
+    void Emitter::alu(int n, const Address& dst, int64_t imm)
+    {
+        if (dst.bits == 8)
+        {
+            op_rm(0, false, 0x80, n, dst.exp, false);
+            db(imm);
+            return;
+        }
+        if (dst.bits == 32)
+        {
+            imm = static_cast<int32_t>(imm);
+        }
+        bool short_form = fits_int8(imm);
+        op_rm(size_prefix(dst.bits), dst.bits == 64, short_form ? 0x83 : 0x81, n, dst.exp,
+              false);
+        if (short_form)
+        {
+            db(imm);
+        }
+        else if (dst.bits == 16)
+        {
+            db(imm);
+            db(imm >> 8);
+        }
+        else
+        {
+            dd(imm);
+        }
+    }
+
+    void Emitter::shift(int n, const Reg& dst, int imm)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, dst.bits == 8 ? 0xC0 : 0xC1, n, dst.index,
+              dst.NeedsRex());
+        db(imm);
+    }
+
+    void Emitter::shift_cl(int n, const Reg& dst)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, dst.bits == 8 ? 0xD2 : 0xD3, n, dst.index,
+              dst.NeedsRex());
+    }
+
+    void Emitter::not_(const Reg& dst)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, dst.bits == 8 ? 0xF6 : 0xF7, 2, dst.index,
+              dst.NeedsRex());
+    }
+
+    void Emitter::test(const Reg& dst, const Reg& src)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, dst.bits == 8 ? 0x84 : 0x85, src.index,
+              dst.index, dst.NeedsRex() || src.NeedsRex());
+    }
+
+    void Emitter::test(const Reg& dst, int64_t imm)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, dst.bits == 8 ? 0xF6 : 0xF7, 0, dst.index,
+              dst.NeedsRex());
+        switch (dst.bits)
+        {
+            case 8:
+                db(imm);
+                break;
+            case 16:
+                db(imm);
+                db(imm >> 8);
+                break;
+            default:
+                dd(imm);
+                break;
+        }
+    }
+
+    void Emitter::bswap(const Reg& dst)
+    {
+        uint8_t rex = 0x40 | ((dst.bits == 64) << 3) | ((dst.index & 8) >> 3);
+        if (rex != 0x40)
+        {
+            db(rex);
+        }
+        db(0x0F);
+        db(0xC8 + (dst.index & 7));
+    }
+
+    void Emitter::bts(const Address& dst, const Reg64& bit)
+    {
+        op_rm(0, true, 0x0FAB, bit.index, dst.exp, false);
+    }
+
+    void Emitter::setcc(Cond cond, const Reg8& dst)
+    {
+        op_rr(0, false, 0x0F90 + static_cast<uint8_t>(cond), 0, dst.index, dst.NeedsRex());
+    }
+
+    void Emitter::cmovcc(Cond cond, const Reg& dst, const Reg& src)
+    {
+        op_rr(size_prefix(dst), dst.bits == 64, 0x0F40 + static_cast<uint8_t>(cond), dst.index,
+              src.index, false);
+    }
+
+    void Emitter::rel32(Label& label)
+    {
+        if (label.offset_ != Label::UNBOUND)
+        {
+            dd(static_cast<int32_t>(label.offset_ - (size_ + 4)));
+        }
+        else
+        {
+            label.uses_.push_back(size_);
+            dd(0);
+        }
+    }
+
+    void Emitter::jcc(Cond cond, Label& label)
+    {
+        db(0x0F);
+        db(0x80 + static_cast<uint8_t>(cond));
+        rel32(label);
+    }
+
+    void Emitter::jmp(Label& label)
+    {
+        db(0xE9);
+        rel32(label);
+    }
+
+    void Emitter::call(const Reg64& target)
+    {
+        op_rr(0, false, 0xFF, 2, target.index, false);
+    }
+
+    void Emitter::push(const Reg64& reg)
+    {
+        if (reg.index & 8)
+        {
+            db(0x41);
+        }
+        db(0x50 + (reg.index & 7));
+    }
+
+    void Emitter::pop(const Reg64& reg)
+    {
+        if (reg.index & 8)
+        {
+            db(0x41);
+        }
+        db(0x58 + (reg.index & 7));
+    }
+
+    void Emitter::ret()
+    {
+        db(0xC3);
+    }
+
+    void Emitter::sse(uint8_t prefix, uint32_t value, int reg, int rm)
+    {
+        op_rr(prefix, false, value, reg, rm, false);
+    }
+
+    void Emitter::sse(uint8_t prefix, uint32_t value, int reg, const Address& mem)
+    {
+        op_rm(prefix, false, value, reg, mem.exp, false);
+    }
+
+    void Emitter::movdqa(const Xmm& dst, const Xmm& src)
+    {
+        sse(0x66, 0x0F6F, dst.index, src.index);
+    }
+
+    void Emitter::movdqa(const Xmm& dst, const Address& src)
+    {
+        sse(0x66, 0x0F6F, dst.index, src);
+    }
+
+    void Emitter::movdqa(const Address& dst, const Xmm& src)
+    {
+        sse(0x66, 0x0F7F, src.index, dst);
+    }
+
+    void Emitter::movdqu(const Xmm& dst, const Address& src)
+    {
+        sse(0xF3, 0x0F6F, dst.index, src);
+    }
+
+    void Emitter::movdqu(const Address& dst, const Xmm& src)
+    {
+        sse(0xF3, 0x0F7F, src.index, dst);
+    }
+
+    void Emitter::movq(const Xmm& dst, const Address& src)
+    {
+        sse(0xF3, 0x0F7E, dst.index, src);
+    }
+
+    void Emitter::movq(const Address& dst, const Xmm& src)
+    {
+        sse(0x66, 0x0FD6, src.index, dst);
+    }
+
+    void Emitter::movd(const Xmm& dst, const Reg32& src)
+    {
+        sse(0x66, 0x0F6E, dst.index, src.index);
+    }
+
+    void Emitter::movd(const Xmm& dst, const Address& src)
+    {
+        sse(0x66, 0x0F6E, dst.index, src);
+    }
+
+    void Emitter::movd(const Reg32& dst, const Xmm& src)
+    {
+        sse(0x66, 0x0F7E, src.index, dst.index);
+    }
+
+    void Emitter::movd(const Address& dst, const Xmm& src)
+    {
+        sse(0x66, 0x0F7E, src.index, dst);
+    }
+
+    void Emitter::pmovmskb(const Reg32& dst, const Xmm& src)
+    {
+        sse(0x66, 0x0FD7, dst.index, src.index);
+    }
+
+    void Emitter::pshuflw(const Xmm& dst, const Xmm& src, uint8_t order)
+    {
+        sse(0xF2, 0x0F70, dst.index, src.index);
+        db(order);
+    }
+
+    void Emitter::pshufd(const Xmm& dst, const Xmm& src, uint8_t order)
+    {
+        sse(0x66, 0x0F70, dst.index, src.index);
+        db(order);
+    }
+
+    void Emitter::psraw(const Xmm& dst, uint8_t imm)
+    {
+        sse(0x66, 0x0F71, 4, dst.index);
+        db(imm);
+    }
+
+    void Emitter::psrlw(const Xmm& dst, uint8_t imm)
+    {
+        sse(0x66, 0x0F71, 2, dst.index);
+        db(imm);
+    }
+
+    void Emitter::psllw(const Xmm& dst, uint8_t imm)
+    {
+        sse(0x66, 0x0F71, 6, dst.index);
+        db(imm);
+    }
+} // namespace hydra::N64::x64
+#endif
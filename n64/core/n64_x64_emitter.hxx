@@ -0,0 +1,406 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The recompilers need an x86-64 host and an RWX mapping from mmap
+#if defined(__x86_64__) && !defined(_WIN32)
+#define N64_JIT_AVAILABLE 1
+#else
+#define N64_JIT_AVAILABLE 0
+#endif
+
+namespace hydra::N64::x64
+{
+    struct Reg
+    {
+        uint8_t index;
+        uint8_t bits;
+
+        constexpr int Index() const
+        {
+            return index;
+        }
+
+        // spl, bpl, sil and dil only exist with a REX prefix
+        constexpr bool NeedsRex() const
+        {
+            return bits == 8 && index >= 4;
+        }
+    };
+
+    struct Reg8 : Reg
+    {
+        constexpr explicit Reg8(int i) : Reg{static_cast<uint8_t>(i), 8} {}
+    };
+
+    struct Reg16 : Reg
+    {
+        constexpr explicit Reg16(int i) : Reg{static_cast<uint8_t>(i), 16} {}
+    };
+
+    struct Reg32 : Reg
+    {
+        constexpr explicit Reg32(int i) : Reg{static_cast<uint8_t>(i), 32} {}
+    };
+
+    struct Reg64 : Reg
+    {
+        constexpr explicit Reg64(int i) : Reg{static_cast<uint8_t>(i), 64} {}
+
+        constexpr Reg32 To32() const
+        {
+            return Reg32(index);
+        }
+
+        constexpr Reg16 To16() const
+        {
+            return Reg16(index);
+        }
+
+        constexpr Reg8 To8() const
+        {
+            return Reg8(index);
+        }
+    };
+
+    struct Xmm
+    {
+        uint8_t index;
+
+        constexpr explicit Xmm(int i) : index(static_cast<uint8_t>(i)) {}
+
+        constexpr int Index() const
+        {
+            return index;
+        }
+    };
+
+    // base + index * scale + disp, base is always there
+    struct RegExp
+    {
+        int8_t base = -1;
+        int8_t index = -1;
+        uint8_t scale = 1;
+        int32_t disp = 0;
+
+        constexpr RegExp() = default;
+
+        constexpr RegExp(const Reg64& reg) : base(reg.index) {}
+    };
+
+    constexpr RegExp operator+(const RegExp& exp, int32_t disp)
+    {
+        RegExp result = exp;
+        result.disp += disp;
+        return result;
+    }
+
+    constexpr RegExp operator+(const Reg64& reg, int32_t disp)
+    {
+        return RegExp(reg) + disp;
+    }
+
+    constexpr RegExp operator+(const RegExp& exp, const Reg64& index)
+    {
+        RegExp result = exp;
+        result.index = index.index;
+        return result;
+    }
+
+    constexpr RegExp operator+(const Reg64& base, const Reg64& index)
+    {
+        return RegExp(base) + index;
+    }
+
+    struct Address
+    {
+        RegExp exp;
+        uint16_t bits;
+    };
+
+    struct AddressFrame
+    {
+        uint16_t bits;
+
+        constexpr Address operator[](const RegExp& exp) const
+        {
+            return {exp, bits};
+        }
+    };
+
+    // Sized memory operands, `ptr` is for lea where the size doesn't matter
+    constexpr AddressFrame ptr{0}, byte{8}, word{16}, dword{32}, qword{64}, xword{128};
+
+    constexpr Reg64 rax(0), rcx(1), rdx(2), rbx(3), rsp(4), rbp(5), rsi(6), rdi(7), r8(8), r9(9),
+        r10(10), r11(11), r12(12), r13(13), r14(14), r15(15);
+    constexpr Reg32 eax(0), ecx(1), edx(2), ebx(3), esp(4), ebp(5), esi(6), edi(7);
+    constexpr Reg16 ax(0), cx(1), dx(2);
+    constexpr Reg8 al(0), cl(1), dl(2);
+    constexpr Xmm xmm0(0), xmm1(1), xmm2(2), xmm3(3), xmm4(4), xmm5(5), xmm6(6), xmm7(7), xmm8(8),
+        xmm9(9), xmm10(10), xmm11(11), xmm12(12), xmm13(13), xmm14(14), xmm15(15);
+
+    enum class Cond : uint8_t {
+        O = 0x0,
+        B = 0x2,
+        AE = 0x3,
+        E = 0x4,
+        NE = 0x5,
+        BE = 0x6,
+        A = 0x7,
+        S = 0x8,
+        L = 0xC,
+        GE = 0xD,
+        LE = 0xE,
+        G = 0xF,
+    };
+
+    class Label
+    {
+    public:
+        Label() = default;
+        Label(const Label&) = delete;
+        Label& operator=(const Label&) = delete;
+
+    private:
+        static constexpr size_t UNBOUND = ~size_t(0);
+        size_t offset_ = UNBOUND;
+        // Where the rel32 of every jump emitted before the label was bound sits
+        std::vector<size_t> uses_;
+        friend class Emitter;
+    };
+
+    /**
+        Minimal x86-64 assembler for the recompilers
+
+        Covers the integer and SSE4.1 instructions they emit and nothing else. All jumps to
+        labels are rel32 and get patched when the label is bound. Code goes into one RWX
+        mapping, so blocks can be patched in place after they were emitted.
+    */
+    class Emitter
+    {
+    public:
+        explicit Emitter(size_t capacity);
+        ~Emitter();
+        Emitter(const Emitter&) = delete;
+        Emitter& operator=(const Emitter&) = delete;
+
+        template <class T>
+        T Current() const
+        {
+            return reinterpret_cast<T>(code_ + size_);
+        }
+
+        size_t Size() const
+        {
+            return size_;
+        }
+
+        // Throws away everything that was emitted
+        void Reset()
+        {
+            size_ = 0;
+        }
+
+        void Bind(Label& label);
+
+        void mov(const Reg& dst, const Reg& src);
+        void mov(const Reg& dst, const Address& src);
+        void mov(const Address& dst, const Reg& src);
+        void mov(const Reg& dst, uint64_t imm);
+        void mov(const Address& dst, uint64_t imm);
+        void movsxd(const Reg64& dst, const Reg32& src);
+        void movsx(const Reg& dst, const Reg& src);
+        void movsx(const Reg& dst, const Address& src);
+        void movzx(const Reg& dst, const Reg& src);
+        void movzx(const Reg& dst, const Address& src);
+        void lea(const Reg& dst, const Address& src);
+
+#define ALU_OP(name, n)                                                                           \
+    void name(const Reg& dst, const Reg& src)                                                     \
+    {                                                                                             \
+        alu(n, dst, src);                                                                         \
+    }                                                                                             \
+    void name(const Reg& dst, const Address& src)                                                 \
+    {                                                                                             \
+        alu(n, dst, src);                                                                         \
+    }                                                                                             \
+    void name(const Address& dst, const Reg& src)                                                 \
+    {                                                                                             \
+        alu(n, dst, src);                                                                         \
+    }                                                                                             \
+    void name(const Reg& dst, int64_t imm)                                                        \
+    {                                                                                             \
+        alu(n, dst, imm);                                                                         \
+    }                                                                                             \
+    void name(const Address& dst, int64_t imm)                                                    \
+    {                                                                                             \
+        alu(n, dst, imm);                                                                         \
+    }
+        ALU_OP(add, 0)
+        ALU_OP(or_, 1)
+        ALU_OP(and_, 4)
+        ALU_OP(sub, 5)
+        ALU_OP(xor_, 6)
+        ALU_OP(cmp, 7)
+#undef ALU_OP
+
+        void rol(const Reg& dst, int imm)
+        {
+            shift(0, dst, imm);
+        }
+
+        void shl(const Reg& dst, int imm)
+        {
+            shift(4, dst, imm);
+        }
+
+        void shr(const Reg& dst, int imm)
+        {
+            shift(5, dst, imm);
+        }
+
+        void sar(const Reg& dst, int imm)
+        {
+            shift(7, dst, imm);
+        }
+
+        // By cl
+        void shl(const Reg& dst, const Reg8&)
+        {
+            shift_cl(4, dst);
+        }
+
+        void shr(const Reg& dst, const Reg8&)
+        {
+            shift_cl(5, dst);
+        }
+
+        void sar(const Reg& dst, const Reg8&)
+        {
+            shift_cl(7, dst);
+        }
+
+        void not_(const Reg& dst);
+        void test(const Reg& dst, const Reg& src);
+        void test(const Reg& dst, int64_t imm);
+        void bswap(const Reg& dst);
+        void bts(const Address& dst, const Reg64& bit);
+        void setcc(Cond cond, const Reg8& dst);
+        void cmovcc(Cond cond, const Reg& dst, const Reg& src);
+        void jcc(Cond cond, Label& label);
+        void jmp(Label& label);
+        void call(const Reg64& target);
+        void push(const Reg64& reg);
+        void pop(const Reg64& reg);
+        void ret();
+
+#define COND_OPS(suffix, cond)                                                                    \
+    void j##suffix(Label& label)                                                                  \
+    {                                                                                             \
+        jcc(cond, label);                                                                         \
+    }                                                                                             \
+    void set##suffix(const Reg8& dst)                                                             \
+    {                                                                                             \
+        setcc(cond, dst);                                                                         \
+    }                                                                                             \
+    void cmov##suffix(const Reg& dst, const Reg& src)                                             \
+    {                                                                                             \
+        cmovcc(cond, dst, src);                                                                   \
+    }
+        COND_OPS(o, Cond::O)
+        COND_OPS(b, Cond::B)
+        COND_OPS(ae, Cond::AE)
+        COND_OPS(e, Cond::E)
+        COND_OPS(z, Cond::E)
+        COND_OPS(ne, Cond::NE)
+        COND_OPS(nz, Cond::NE)
+        COND_OPS(be, Cond::BE)
+        COND_OPS(a, Cond::A)
+        COND_OPS(l, Cond::L)
+        COND_OPS(ge, Cond::GE)
+        COND_OPS(le, Cond::LE)
+        COND_OPS(g, Cond::G)
+#undef COND_OPS
+
+        // SSE, all of them work on whole registers
+        void movdqa(const Xmm& dst, const Xmm& src);
+        void movdqa(const Xmm& dst, const Address& src);
+        void movdqa(const Address& dst, const Xmm& src);
+        void movdqu(const Xmm& dst, const Address& src);
+        void movdqu(const Address& dst, const Xmm& src);
+        void movq(const Xmm& dst, const Address& src);
+        void movq(const Address& dst, const Xmm& src);
+        void movd(const Xmm& dst, const Reg32& src);
+        void movd(const Xmm& dst, const Address& src);
+        void movd(const Reg32& dst, const Xmm& src);
+        void movd(const Address& dst, const Xmm& src);
+        void pmovmskb(const Reg32& dst, const Xmm& src);
+        void pshuflw(const Xmm& dst, const Xmm& src, uint8_t order);
+        void pshufd(const Xmm& dst, const Xmm& src, uint8_t order);
+        void psraw(const Xmm& dst, uint8_t imm);
+        void psrlw(const Xmm& dst, uint8_t imm);
+        void psllw(const Xmm& dst, uint8_t imm);
+
+#define SSE_OP(name, opcode)                                                                      \
+    void name(const Xmm& dst, const Xmm& src)                                                     \
+    {                                                                                             \
+        sse(0x66, opcode, dst.index, src.index);                                                  \
+    }                                                                                             \
+    void name(const Xmm& dst, const Address& src)                                                 \
+    {                                                                                             \
+        sse(0x66, opcode, dst.index, src);                                                        \
+    }
+        SSE_OP(paddw, 0x0FFD)
+        SSE_OP(psubw, 0x0FF9)
+        SSE_OP(paddsw, 0x0FED)
+        SSE_OP(psubsw, 0x0FE9)
+        SSE_OP(pand, 0x0FDB)
+        SSE_OP(pandn, 0x0FDF)
+        SSE_OP(por, 0x0FEB)
+        SSE_OP(pxor, 0x0FEF)
+        SSE_OP(pcmpeqw, 0x0F75)
+        SSE_OP(pcmpgtw, 0x0F65)
+        SSE_OP(pminsw, 0x0FEA)
+        SSE_OP(pmaxsw, 0x0FEE)
+        SSE_OP(pminuw, 0x0F383A)
+        SSE_OP(pmaxuw, 0x0F383E)
+        SSE_OP(pmullw, 0x0FD5)
+        SSE_OP(pmulhw, 0x0FE5)
+        SSE_OP(pmulhuw, 0x0FE4)
+        SSE_OP(packsswb, 0x0F63)
+        SSE_OP(packssdw, 0x0F6B)
+        SSE_OP(packusdw, 0x0F382B)
+        SSE_OP(punpcklwd, 0x0F61)
+        SSE_OP(punpckhwd, 0x0F69)
+        SSE_OP(pshufb, 0x0F3800)
+        SSE_OP(psignw, 0x0F3809)
+        // Picks src where xmm0 has the top bit set
+        SSE_OP(pblendvb, 0x0F3810)
+#undef SSE_OP
+
+    private:
+        uint8_t* code_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_;
+
+        void db(uint8_t value);
+        void dd(uint32_t value);
+        void dq(uint64_t value);
+        void opcode(uint32_t value);
+        void op_rr(uint8_t prefix, bool w, uint32_t value, int reg, int rm, bool force_rex);
+        void op_rm(uint8_t prefix, bool w, uint32_t value, int reg, const RegExp& mem,
+                   bool force_rex);
+        void alu(int n, const Reg& dst, const Reg& src);
+        void alu(int n, const Reg& dst, const Address& src);
+        void alu(int n, const Address& dst, const Reg& src);
+        void alu(int n, const Reg& dst, int64_t imm);
+        void alu(int n, const Address& dst, int64_t imm);
+        void shift(int n, const Reg& dst, int imm);
+        void shift_cl(int n, const Reg& dst);
+        void sse(uint8_t prefix, uint32_t value, int reg, int rm);
+        void sse(uint8_t prefix, uint32_t value, int reg, const Address& mem);
+        void rel32(Label& label);
+    };
+} // namespace hydra::N64::x64
@@ -93,6 +93,58 @@ namespace hydra::N64
             }
         }
 
+        auto& user_data = EmulatorSettings::GetEmulatorData(EmuType::N64).UserData;
+        if (user_data.Has("CPUBackend"))
+        {
+            auto backend = user_data.Get("CPUBackend");
+            if (backend == "Dynarec")
+            {
+                n64_impl_.SetCPUBackend(CPUBackend::Dynarec);
+            }
+            else if (backend == "CachedInterpreter")
+            {
+                n64_impl_.SetCPUBackend(CPUBackend::CachedInterpreter);
+            }
+        }
+        if (user_data.Has("RSPBackend") && user_data.Get("RSPBackend") == "Dynarec")
+        {
+            n64_impl_.SetRSPBackend(RSPBackend::Dynarec);
+        }
+        // Before fastmem, which maps however much RDRAM there is
+        if (user_data.Has("ExpansionPak"))
+        {
+            n64_impl_.SetExpansionPak(user_data.Get("ExpansionPak") == "true");
+        }
+        if (user_data.Has("Fastmem"))
+        {
+            n64_impl_.SetFastmem(user_data.Get("Fastmem") == "true");
+        }
+        if (user_data.Has("IdleLoopDetection"))
+        {
+            n64_impl_.SetIdleLoopDetection(user_data.Get("IdleLoopDetection") == "true");
+        }
+        if (user_data.Has("RSPHLE"))
+        {
+            n64_impl_.SetRSPHLE(user_data.Get("RSPHLE") == "true");
+        }
+        if (user_data.Has("RSPThread"))
+        {
+            n64_impl_.SetRSPThread(user_data.Get("RSPThread") == "true");
+        }
+        if (user_data.Has("RDPThreads"))
+        {
+            n64_impl_.SetRDPThreads(std::stoi(user_data.Get("RDPThreads")));
+        }
+        if (user_data.Has("RDPThread"))
+        {
+            n64_impl_.SetRDPThread(user_data.Get("RDPThread") == "true");
+        }
+        // Traces only replay from the RDP's reset state, so they start before the game runs
+        if (user_data.Has("RDPTrace") && !user_data.Get("RDPTrace").empty())
+        {
+            n64_impl_.StartRDPTrace(user_data.Get("RDPTrace"));
+        }
+
         width_ = 640;
         height_ = 480;
     }
@@ -26,6 +26,8 @@ private:
     std::array<uint32_t*, VI_NUM_REG> vi_regs_ = {};
     std::array<uint32_t*, DP_NUM_REG> dp_regs_ = {};
     uint32_t mi_interrupt_ = 0;
+
+    friend struct AngrylionReplayer;
 };
 
 std::unique_ptr<AngrylionReplayerImpl> AngrylionReplayer::impl_;
@@ -54,6 +56,22 @@ Framebuffer AngrylionReplayer::GetFramebuffer()
     return framebuffer_;
 }
 
+void AngrylionReplayer::WriteRDRAM(uint32_t address, const uint8_t* data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        impl_->rdram_[(address + i) ^ 3] = data[i];
+    }
+}
+
+void AngrylionReplayer::ReadRDRAM(uint32_t address, uint8_t* data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        data[i] = impl_->rdram_[(address + i) ^ 3];
+    }
+}
+
 void AngrylionReplayer::Cleanup()
 {
     AngrylionReplayer::impl_.reset();
@@ -27,6 +27,9 @@ struct AngrylionReplayer
     static void Init();
     static void RunCommand(const std::vector<uint64_t>& command);
     static Framebuffer GetFramebuffer();
+    // RDRAM in the big endian byte order hydra keeps it in, angrylion keeps it word swapped
+    static void WriteRDRAM(uint32_t address, const uint8_t* data, uint32_t size);
+    static void ReadRDRAM(uint32_t address, uint8_t* data, uint32_t size);
     static void Cleanup();
 
     static std::unique_ptr<AngrylionReplayerImpl> impl_;
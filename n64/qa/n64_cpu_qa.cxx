@@ -0,0 +1,808 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <n64/core/n64_cartridge.hxx>
+#include <n64/core/n64_impl.hxx>
+#include <n64/core/n64_profiler.hxx>
+#include <random>
+
+// Runs random VR4300 code on the interpreter and on the recompiler in lockstep, comparing the
+// state after every block, once with the plain memory path and once with fastmem. The
+// interpreter is also compared against itself using fastmem. Short hand written programs cover
+// idle loop skipping, self modifying code and the TLB cache, cartridge images are loaded in every
+// byte order and the profiler's collapsed stacks are checked.
+
+namespace hydra::N64
+{
+    class QA
+    {
+    public:
+        static constexpr int SEEDS = 32;
+        static constexpr int STEPS = 4000;
+
+        static constexpr uint64_t ENTRY = 0xFFFF'FFFF'8000'1000;
+        static constexpr uint32_t CODE_SIZE = 0x1000;
+        static constexpr uint32_t DATA_ADDRESS = 0x4000;
+        static constexpr uint32_t DATA_SIZE = 0x1000;
+
+        // Bases for the loads and stores, no instruction ever writes them or k0 and k1
+        static constexpr int CODE_BASE = 22;
+        static constexpr int DMEM_BASE = 23;
+        static constexpr int KSEG0_BASE = 24;
+        static constexpr int KSEG1_BASE = 25;
+        static constexpr int K0 = 26;
+        static constexpr int K1 = 27;
+
+        static void Setup(N64& n64, uint32_t seed, CPUBackend backend, bool fastmem)
+        {
+            std::mt19937 rng(seed);
+            n64.Reset();
+            n64.SetCPUBackend(backend);
+            n64.SetFastmem(fastmem);
+            CPU& cpu = n64.cpu_;
+            uint8_t* rdram = cpu.cpubus_.rdram_.data();
+            std::memset(rdram, 0, 0x8000);
+            for (uint32_t address = 0; address < CODE_SIZE; address += 4)
+            {
+                write_word(rdram, 0x1000 + address, random_instruction(rng));
+            }
+            // Running or branching off the end of the code goes back to the start
+            for (uint32_t address = 0; address < 0x80; address += 8)
+            {
+                write_word(rdram, 0x1000 + CODE_SIZE + address, jump(ENTRY));
+            }
+            // Exceptions skip the instruction that raised them
+            const std::array<uint32_t, 4> handler = {
+                0x401A'7000, // mfc0 k0, EPC
+                0x275A'0004, // addiu k0, k0, 4
+                0x409A'7000, // mtc0 k0, EPC
+                0x4200'0018, // eret
+            };
+            for (size_t i = 0; i < handler.size(); i++)
+            {
+                write_word(rdram, 0x180 + i * 4, handler[i]);
+            }
+            for (uint32_t address = 0; address < DATA_SIZE; address++)
+            {
+                rdram[DATA_ADDRESS + address] = rng();
+            }
+            for (auto& reg : cpu.gpr_regs_)
+            {
+                uint64_t value = (static_cast<uint64_t>(rng()) << 32) | rng();
+                // Sign extended 32-bit values are what most code works with
+                reg.UD = rng() % 2 ? static_cast<int32_t>(value) : value;
+            }
+            cpu.gpr_regs_[0].UD = 0;
+            cpu.gpr_regs_[CODE_BASE].UD = 0xFFFF'FFFF'8000'1000;
+            cpu.gpr_regs_[DMEM_BASE].UD = 0xFFFF'FFFF'A400'0000;
+            cpu.gpr_regs_[KSEG0_BASE].UD = 0xFFFF'FFFF'8000'0000 | DATA_ADDRESS;
+            cpu.gpr_regs_[KSEG1_BASE].UD = 0xFFFF'FFFF'A000'0000 | DATA_ADDRESS;
+            cpu.hi_ = rng();
+            cpu.lo_ = rng();
+            cpu.pc_ = ENTRY;
+            cpu.next_pc_ = ENTRY + 4;
+            cpu.was_branch_ = false;
+            cpu.prev_branch_ = false;
+        }
+
+        static bool HasJit(N64& n64)
+        {
+            return n64.cpu_.jit_ != nullptr;
+        }
+
+        static bool HasFastmem(N64& n64)
+        {
+            return n64.cpubus_.fastmem_ != nullptr;
+        }
+
+        static int Tick(N64& n64)
+        {
+            return n64.cpu_.Tick();
+        }
+
+        // Calls a function that sets v0, rewrites its first instruction and calls it again, so
+        // the page it's on has to be decoded or recompiled again
+        static void SetupSelfModifying(N64& n64, CPUBackend backend)
+        {
+            n64.Reset();
+            n64.SetCPUBackend(backend);
+            CPU& cpu = n64.cpu_;
+            uint8_t* rdram = cpu.cpubus_.rdram_.data();
+            std::memset(rdram, 0, 0x8000);
+            const std::array<uint32_t, 10> code = {
+                0x3C08'2402, // lui t0, 0x2402
+                0x3508'1234, // ori t0, t0, 0x1234, which is addiu v0, zero, 0x1234
+                0x0C00'0410, // jal 0x80001040
+                0x0000'0000, // nop
+                0x0040'4825, // or t1, v0, zero
+                0xAEC8'0040, // sw t0, 0x40(s6)
+                0x0C00'0410, // jal 0x80001040
+                0x0000'0000, // nop
+                0x1000'FFFF, // b .
+                0x0000'0000, // nop
+            };
+            for (size_t i = 0; i < code.size(); i++)
+            {
+                write_word(rdram, 0x1000 + i * 4, code[i]);
+            }
+            write_word(rdram, 0x1040, 0x2402'0001); // addiu v0, zero, 1
+            write_word(rdram, 0x1044, 0x03E0'0008); // jr ra
+            write_word(rdram, 0x1048, 0x0000'0000); // nop
+            for (auto& reg : cpu.gpr_regs_)
+            {
+                reg.UD = 0;
+            }
+            cpu.hi_ = 0;
+            cpu.lo_ = 0;
+            cpu.gpr_regs_[CODE_BASE].UD = ENTRY;
+            cpu.pc_ = ENTRY;
+            cpu.next_pc_ = ENTRY + 4;
+            cpu.was_branch_ = false;
+            cpu.prev_branch_ = false;
+        }
+
+        // Maps virtual page 0 and reads it, rewrites the entry with TLBWI, then maps it again
+        // for ASID 1 and switches ASIDs back and forth, reading the page after each change
+        static void SetupTLB(N64& n64)
+        {
+            n64.Reset();
+            n64.SetCPUBackend(CPUBackend::Interpreter);
+            CPU& cpu = n64.cpu_;
+            uint8_t* rdram = cpu.cpubus_.rdram_.data();
+            std::memset(rdram, 0, 0x8000);
+            const std::array<uint32_t, 20> code = {
+                0x4080'2800, // mtc0 zero, PageMask
+                0x4080'0000, // mtc0 zero, Index
+                0x4084'5000, // mtc0 a0, EntryHi
+                0x4085'1000, // mtc0 a1, EntryLo0
+                0x4086'1800, // mtc0 a2, EntryLo1
+                0x4200'0002, // tlbwi
+                0x8C10'0000, // lw s0, 0(zero)
+                0x8C11'0004, // lw s1, 4(zero)
+                0x4087'1000, // mtc0 a3, EntryLo0
+                0x4200'0002, // tlbwi
+                0x8C12'0000, // lw s2, 0(zero)
+                0x4088'5000, // mtc0 t0, EntryHi
+                0x4089'1000, // mtc0 t1, EntryLo0
+                0x408A'0000, // mtc0 t2, Index
+                0x4200'0002, // tlbwi
+                0x8C13'0000, // lw s3, 0(zero)
+                0x4084'5000, // mtc0 a0, EntryHi
+                0x8C14'0000, // lw s4, 0(zero)
+                0x1000'FFFF, // b .
+                0x0000'0000, // nop
+            };
+            for (size_t i = 0; i < code.size(); i++)
+            {
+                write_word(rdram, 0x1000 + i * 4, code[i]);
+            }
+            write_word(rdram, 0x4000, 0x1111'1111);
+            write_word(rdram, 0x4004, 0x2222'2222);
+            write_word(rdram, 0x5000, 0x3333'3333);
+            write_word(rdram, 0x6000, 0x4444'4444);
+            for (auto& reg : cpu.gpr_regs_)
+            {
+                reg.UD = 0;
+            }
+            // EntryLo is PFN << 6 | C << 3 | D << 2 | V << 1, the entries aren't global
+            cpu.gpr_regs_[4].UD = 0;     // ASID 0
+            cpu.gpr_regs_[5].UD = 0x11E; // 0x4000
+            cpu.gpr_regs_[6].UD = 0;     // The odd page is invalid
+            cpu.gpr_regs_[7].UD = 0x15E; // 0x5000
+            cpu.gpr_regs_[8].UD = 1;     // ASID 1
+            cpu.gpr_regs_[9].UD = 0x19E; // 0x6000
+            cpu.gpr_regs_[10].UD = 1;    // Index 1
+            cpu.pc_ = ENTRY;
+            cpu.next_pc_ = ENTRY + 4;
+            cpu.was_branch_ = false;
+            cpu.prev_branch_ = false;
+        }
+
+        // A loop polling VI_V_CURRENT and MI_INTR until the VI interrupt, which the handler takes
+        // note of, then Count is read and the CPU spins on a branch to itself
+        static void SetupPolling(N64& n64, CPUBackend backend, bool idle_loop_detection)
+        {
+            n64.Reset();
+            n64.SetCPUBackend(backend);
+            n64.SetIdleLoopDetection(idle_loop_detection);
+            CPU& cpu = n64.cpu_;
+            uint8_t* rdram = cpu.cpubus_.rdram_.data();
+            std::memset(rdram, 0, 0x8000);
+            const std::array<uint32_t, 9> code = {
+                0x3C08'A440, // lui t0, 0xA440
+                0x3C0B'A430, // lui t3, 0xA430
+                0x8D09'0010, // lw t1, 0x10(t0), VI_V_CURRENT
+                0x8D6A'0008, // lw t2, 0x8(t3), MI_INTR
+                0x1140'FFFD, // beqz t2, -3
+                0x0129'6021, // addu t4, t1, t1
+                0x4012'4800, // mfc0 s2, Count
+                0x1000'FFFF, // b .
+                0x0000'0000, // nop
+            };
+            for (size_t i = 0; i < code.size(); i++)
+            {
+                write_word(rdram, 0x1000 + i * 4, code[i]);
+            }
+            const std::array<uint32_t, 6> handler = {
+                0x4010'4800, // mfc0 s0, Count
+                0x4011'7000, // mfc0 s1, EPC
+                0x3C1A'3400, // lui k0, 0x3400
+                0x409A'6000, // mtc0 k0, Status, interrupts off
+                0x4200'0018, // eret
+                0x0000'0000, // nop
+            };
+            for (size_t i = 0; i < handler.size(); i++)
+            {
+                write_word(rdram, 0x180 + i * 4, handler[i]);
+            }
+            for (auto& reg : cpu.gpr_regs_)
+            {
+                reg.UD = 0;
+            }
+            cpu.hi_ = 0;
+            cpu.lo_ = 0;
+            cpu.cp0_regs_[CP0_STATUS].UD = 0x3400'0401; // IE and the MI interrupt line
+            cpu.cpubus_.mi_mask_ = 1 << 3;              // VI
+            n64.rcp_.vi_.WriteWord(VI_V_INTR, 0x20);
+            cpu.pc_ = ENTRY;
+            cpu.next_pc_ = ENTRY + 4;
+            cpu.was_branch_ = false;
+            cpu.prev_branch_ = false;
+        }
+
+        // Runs the CPU and the events like N64::Update does, returns how many times Tick was
+        // called
+        static int RunUntil(N64& n64, uint64_t time)
+        {
+            Scheduler& scheduler = n64.cpubus_.scheduler_;
+            int ticks = 0;
+            while (scheduler.Now() < time)
+            {
+                while (scheduler.Now() < scheduler.NextDeadline())
+                {
+                    scheduler.Advance(n64.cpu_.Tick());
+                    ticks++;
+                }
+                EventType type;
+                while (scheduler.Pop(type))
+                {
+                    n64.handle_event(type);
+                }
+            }
+            return ticks;
+        }
+
+        static uint64_t GetRegister(N64& n64, int reg)
+        {
+            return n64.cpu_.gpr_regs_[reg].UD;
+        }
+
+        static uint64_t GetTime(N64& n64)
+        {
+            return n64.cpubus_.time_;
+        }
+
+        static testing::AssertionResult SameState(N64& expected_n64, N64& actual_n64)
+        {
+            CPU& expected = expected_n64.cpu_;
+            CPU& actual = actual_n64.cpu_;
+            if (expected.pc_ != actual.pc_ || expected.next_pc_ != actual.next_pc_)
+            {
+                return testing::AssertionFailure()
+                       << std::hex << "pc " << expected.pc_ << "/" << expected.next_pc_ << " vs "
+                       << actual.pc_ << "/" << actual.next_pc_;
+            }
+            // r0 is only zeroed when the next instruction starts
+            for (int i = 1; i < 32; i++)
+            {
+                if (expected.gpr_regs_[i].UD != actual.gpr_regs_[i].UD)
+                {
+                    return testing::AssertionFailure()
+                           << std::hex << "r" << std::dec << i << std::hex << " "
+                           << expected.gpr_regs_[i].UD << " vs " << actual.gpr_regs_[i].UD;
+                }
+            }
+            if (expected.hi_ != actual.hi_ || expected.lo_ != actual.lo_)
+            {
+                return testing::AssertionFailure() << "hi/lo differ";
+            }
+            for (int i = 0; i < 32; i++)
+            {
+                if (expected.cp0_regs_[i].UD != actual.cp0_regs_[i].UD)
+                {
+                    return testing::AssertionFailure()
+                           << "cop0 register " << i << " " << std::hex << expected.cp0_regs_[i].UD
+                           << " vs " << actual.cp0_regs_[i].UD;
+                }
+            }
+            if (expected.llbit_ != actual.llbit_)
+            {
+                return testing::AssertionFailure() << "llbit differs";
+            }
+            if (std::memcmp(expected.cpubus_.rdram_.data(), actual.cpubus_.rdram_.data(),
+                            0x8000) != 0)
+            {
+                return testing::AssertionFailure() << "RDRAM differs";
+            }
+            if (std::memcmp(expected_n64.rcp_.rsp_.mem_.data(), actual_n64.rcp_.rsp_.mem_.data(),
+                            0x1000) != 0)
+            {
+                return testing::AssertionFailure() << "DMEM differs";
+            }
+            return testing::AssertionSuccess();
+        }
+
+    private:
+        static void write_word(uint8_t* rdram, uint32_t address, uint32_t value)
+        {
+            uint32_t word = hydra::bswap32(value);
+            std::memcpy(&rdram[address], &word, sizeof(word));
+        }
+
+        static uint32_t r_type(uint32_t rs, uint32_t rt, uint32_t rd, uint32_t sa, uint32_t func)
+        {
+            return (rs << 21) | (rt << 16) | (rd << 11) | (sa << 6) | func;
+        }
+
+        static uint32_t i_type(uint32_t op, uint32_t rs, uint32_t rt, uint32_t immediate)
+        {
+            return (op << 26) | (rs << 21) | (rt << 16) | (immediate & 0xFFFF);
+        }
+
+        static uint32_t jump(uint64_t target)
+        {
+            return (0x02 << 26) | ((target >> 2) & 0x3FF'FFFF);
+        }
+
+        static uint32_t random_instruction(std::mt19937& rng)
+        {
+            constexpr std::array<uint32_t, 34> alu = {
+                0x00, 0x02, 0x03, 0x04, 0x06, 0x07, 0x10, 0x11, 0x12, 0x13, 0x14, 0x16,
+                0x17, 0x18, 0x19, 0x1A, 0x1B, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26,
+                0x27, 0x2A, 0x2B, 0x2C, 0x2D, 0x2F, 0x38, 0x3A, 0x3B, 0x3C};
+            constexpr std::array<uint32_t, 10> immediates = {0x08, 0x09, 0x0A, 0x0B, 0x0C,
+                                                             0x0D, 0x0E, 0x0F, 0x18, 0x19};
+            // LB, LH, LW, LBU, LHU, LWU, LD and SB, SH, SW, SD with the access size of each
+            constexpr std::array<std::pair<uint32_t, uint32_t>, 7> loads = {
+                {{0x20, 1}, {0x21, 2}, {0x23, 4}, {0x24, 1}, {0x25, 2}, {0x27, 4}, {0x37, 8}}};
+            constexpr std::array<std::pair<uint32_t, uint32_t>, 4> stores = {
+                {{0x28, 1}, {0x29, 2}, {0x2B, 4}, {0x3F, 8}}};
+            auto random_source = [&rng]() -> uint32_t {
+                // r0 often enough to hit the special cases for it
+                return rng() % 4 == 0 ? 0 : rng() & 31;
+            };
+            auto random_destination = [&rng]() -> uint32_t {
+                uint32_t reg = rng() & 31;
+                return reg >= CODE_BASE && reg <= K1 ? 0 : reg;
+            };
+            uint32_t kind = rng() % 100;
+            if (kind < 35)
+            {
+                return r_type(random_source(), random_source(), random_destination(), rng() & 31,
+                              alu[rng() % alu.size()]);
+            }
+            if (kind < 50)
+            {
+                return i_type(immediates[rng() % immediates.size()], random_source(),
+                              random_destination(), rng());
+            }
+            if (kind < 53)
+            {
+                // MULT, MULTU, DIV, DIVU and the 64-bit versions
+                return r_type(random_source(), random_source(), 0, 0, 0x18 + rng() % 8);
+            }
+            if (kind < 75)
+            {
+                bool store = rng() % 3 == 0;
+                auto [op, size] =
+                    store ? stores[rng() % stores.size()] : loads[rng() % loads.size()];
+                uint32_t offset = (rng() % 0xFF8) & ~(size - 1);
+                uint32_t base;
+                uint32_t where = rng() % 16;
+                if (where == 0 && store)
+                {
+                    // Clearing code makes the recompiler throw away blocks, maybe the current one
+                    return i_type(op, CODE_BASE, 0, offset);
+                }
+                else if (where < 4)
+                {
+                    // Not RDRAM, so fastmem has to fault and patch the access
+                    base = DMEM_BASE;
+                }
+                else
+                {
+                    base = where & 1 ? KSEG0_BASE : KSEG1_BASE;
+                }
+                if (rng() % 32 == 0)
+                {
+                    // Address error exception
+                    offset |= 1;
+                }
+                return i_type(op, base, store ? random_source() : random_destination(), offset);
+            }
+            if (kind < 90)
+            {
+                // Short branches, so that loops happen
+                constexpr std::array<uint32_t, 8> branches = {0x04, 0x05, 0x06, 0x07,
+                                                              0x14, 0x15, 0x16, 0x17};
+                uint32_t offset = static_cast<uint32_t>(static_cast<int>(rng() % 32) - 16);
+                if (rng() % 3 == 0)
+                {
+                    constexpr std::array<uint32_t, 6> regimm = {0x00, 0x01, 0x02,
+                                                                0x03, 0x11, 0x13};
+                    return i_type(0x01, random_source(), regimm[rng() % regimm.size()], offset);
+                }
+                return i_type(branches[rng() % branches.size()], random_source(),
+                              random_source(), offset);
+            }
+            if (kind < 93)
+            {
+                // J and JAL somewhere in the code
+                uint64_t target = ENTRY + (rng() % (CODE_SIZE / 4)) * 4;
+                return jump(target) | ((rng() & 1) << 26);
+            }
+            if (kind < 96)
+            {
+                // MFC0 of Count, BadVAddr and EPC
+                constexpr std::array<uint32_t, 3> cop0 = {9, 8, 14};
+                return (0x10 << 26) | (random_destination() << 16) |
+                       (cop0[rng() % cop0.size()] << 11);
+            }
+            return 0; // NOP
+        }
+    };
+} // namespace hydra::N64
+
+using hydra::N64::CPUBackend;
+using hydra::N64::QA;
+
+namespace
+{
+    void run_lockstep(CPUBackend backend, bool fastmem)
+    {
+        bool should_draw = false;
+        auto expected = std::make_unique<hydra::N64::N64>(should_draw);
+        auto actual = std::make_unique<hydra::N64::N64>(should_draw);
+        QA::Setup(*actual, 0, backend, fastmem);
+        if (backend == CPUBackend::Dynarec && !QA::HasJit(*actual))
+        {
+            GTEST_SKIP() << "Built without the recompiler";
+        }
+        if (fastmem && !QA::HasFastmem(*actual))
+        {
+            GTEST_SKIP() << "Fastmem is not supported on this host";
+        }
+
+        for (uint32_t seed = 0; seed < QA::SEEDS; seed++)
+        {
+            QA::Setup(*expected, seed, CPUBackend::Interpreter, false);
+            QA::Setup(*actual, seed, backend, fastmem);
+            for (int step = 0; step < QA::STEPS; step++)
+            {
+                int executed = QA::Tick(*actual);
+                for (int i = 0; i < executed; i++)
+                {
+                    QA::Tick(*expected);
+                }
+                ASSERT_TRUE(QA::SameState(*expected, *actual))
+                    << "seed " << seed << " step " << step;
+            }
+        }
+    }
+} // namespace
+
+TEST(CPUJit, MatchesInterpreter)
+{
+    run_lockstep(CPUBackend::Dynarec, false);
+}
+
+TEST(CPUJit, MatchesInterpreterWithFastmem)
+{
+    run_lockstep(CPUBackend::Dynarec, true);
+}
+
+TEST(CPUCachedInterpreter, MatchesInterpreter)
+{
+    run_lockstep(CPUBackend::CachedInterpreter, false);
+}
+
+TEST(CPUInterpreter, SameWithFastmem)
+{
+    run_lockstep(CPUBackend::Interpreter, true);
+}
+
+namespace
+{
+    void run_self_modifying(CPUBackend backend)
+    {
+        bool should_draw = false;
+        auto expected = std::make_unique<hydra::N64::N64>(should_draw);
+        auto actual = std::make_unique<hydra::N64::N64>(should_draw);
+        QA::SetupSelfModifying(*expected, CPUBackend::Interpreter);
+        QA::SetupSelfModifying(*actual, backend);
+        if (backend == CPUBackend::Dynarec && !QA::HasJit(*actual))
+        {
+            GTEST_SKIP() << "Built without the recompiler";
+        }
+        for (int step = 0; step < 32; step++)
+        {
+            int executed = QA::Tick(*actual);
+            for (int i = 0; i < executed; i++)
+            {
+                QA::Tick(*expected);
+            }
+            ASSERT_TRUE(QA::SameState(*expected, *actual)) << "step " << step;
+        }
+        // t1 has what the function returned before it was rewritten, v0 what it does after
+        EXPECT_EQ(QA::GetRegister(*actual, 9), 1u);
+        EXPECT_EQ(QA::GetRegister(*actual, 2), 0x1234u);
+    }
+} // namespace
+
+TEST(CPUCachedInterpreter, SeesSelfModifyingCode)
+{
+    run_self_modifying(CPUBackend::CachedInterpreter);
+}
+
+TEST(CPUJit, SeesSelfModifyingCode)
+{
+    run_self_modifying(CPUBackend::Dynarec);
+}
+
+namespace
+{
+    void run_polling(CPUBackend backend)
+    {
+        bool should_draw = false;
+        auto expected = std::make_unique<hydra::N64::N64>(should_draw);
+        auto actual = std::make_unique<hydra::N64::N64>(should_draw);
+        QA::SetupPolling(*expected, backend, false);
+        QA::SetupPolling(*actual, backend, true);
+        if (backend == CPUBackend::Dynarec && !QA::HasJit(*actual))
+        {
+            GTEST_SKIP() << "Built without the recompiler";
+        }
+        // The VI interrupt is raised on the 17th halfline, around 100000 cycles in
+        constexpr uint64_t end = 200'000;
+        int expected_ticks = QA::RunUntil(*expected, end);
+        int actual_ticks = QA::RunUntil(*actual, end);
+        // s0 and s1 are Count and EPC when the interrupt was taken, s2 Count after the loop
+        ASSERT_NE(QA::GetRegister(*expected, 16), 0u);
+        ASSERT_NE(QA::GetRegister(*expected, 18), 0u);
+        EXPECT_EQ(QA::GetRegister(*expected, 16), QA::GetRegister(*actual, 16));
+        EXPECT_EQ(QA::GetRegister(*expected, 17), QA::GetRegister(*actual, 17));
+        EXPECT_EQ(QA::GetRegister(*expected, 18), QA::GetRegister(*actual, 18));
+        EXPECT_EQ(QA::GetTime(*expected), QA::GetTime(*actual));
+        EXPECT_TRUE(QA::SameState(*expected, *actual));
+        // Most of the polling should have been skipped
+        EXPECT_LT(actual_ticks, expected_ticks / 4);
+    }
+} // namespace
+
+TEST(CPUIdleLoop, SameAsPollingInterpreter)
+{
+    run_polling(CPUBackend::Interpreter);
+}
+
+TEST(CPUIdleLoop, SameAsPollingCachedInterpreter)
+{
+    run_polling(CPUBackend::CachedInterpreter);
+}
+
+TEST(CPUIdleLoop, SameAsPollingJit)
+{
+    run_polling(CPUBackend::Dynarec);
+}
+
+TEST(CPUTLBCache, DropsStaleTranslations)
+{
+    bool should_draw = false;
+    auto n64 = std::make_unique<hydra::N64::N64>(should_draw);
+    QA::SetupTLB(*n64);
+    for (int i = 0; i < 32; i++)
+    {
+        QA::Tick(*n64);
+    }
+    EXPECT_EQ(QA::GetRegister(*n64, 16), 0x1111'1111u);
+    // The second word of the page comes from the cache
+    EXPECT_EQ(QA::GetRegister(*n64, 17), 0x2222'2222u);
+    // TLBWI replaced the translation
+    EXPECT_EQ(QA::GetRegister(*n64, 18), 0x3333'3333u);
+    // ASID 1 only sees the second entry and ASID 0 only the first
+    EXPECT_EQ(QA::GetRegister(*n64, 19), 0x4444'4444u);
+    EXPECT_EQ(QA::GetRegister(*n64, 20), 0x3333'3333u);
+    hydra::N64::TLBCacheStats stats = n64->GetTLBCacheStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 4u);
+}
+
+namespace
+{
+    namespace fs = std::filesystem;
+
+    // Word i of a native image, the first one is the PI configuration word every image has
+    uint32_t image_word(size_t i, uint32_t seed)
+    {
+        return i == 0 ? 0x8037'1240 : static_cast<uint32_t>(i * 0x0101'0101 + seed);
+    }
+
+    // Writes an image of size bytes in the byte order of the extension
+    void write_image(const fs::path& path, size_t size, uint32_t seed)
+    {
+        std::vector<uint8_t> bytes(size);
+        for (size_t i = 0; i < size / 4; i++)
+        {
+            uint32_t word = image_word(i, seed);
+            for (int j = 0; j < 4; j++)
+            {
+                bytes[i * 4 + j] = word >> (24 - j * 8);
+            }
+        }
+        for (size_t i = 0; i < size; i += 4)
+        {
+            if (path.extension() == ".v64")
+            {
+                std::swap(bytes[i], bytes[i + 1]);
+                std::swap(bytes[i + 2], bytes[i + 3]);
+            }
+            else if (path.extension() == ".n64")
+            {
+                std::reverse(bytes.begin() + i, bytes.begin() + i + 4);
+            }
+        }
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    uint32_t rom_word(hydra::N64::CartridgeRom& rom, size_t address)
+    {
+        const uint8_t* data = rom.Data() + address;
+        return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    }
+
+    // Converted copies of the images, which CartridgeRom keeps in the temporary directory
+    std::vector<fs::path> converted_images(const std::string& name)
+    {
+        std::vector<fs::path> paths;
+        std::error_code error;
+        for (const auto& entry :
+             fs::directory_iterator(fs::temp_directory_path() / "hydra", error))
+        {
+            if (entry.path().filename().string().starts_with(name + "-"))
+            {
+                paths.push_back(entry.path());
+            }
+        }
+        return paths;
+    }
+
+    class CartridgeRomTest : public testing::Test
+    {
+    protected:
+        fs::path directory_;
+
+        void SetUp() override
+        {
+            auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+            directory_ = fs::temp_directory_path() / ("hydra_qa_" + std::to_string(now));
+            fs::create_directories(directory_);
+        }
+
+        void TearDown() override
+        {
+            for (const char* name : {"cart.z64", "cart.v64", "cart.n64"})
+            {
+                for (const fs::path& path : converted_images(name))
+                {
+                    fs::remove(path);
+                }
+            }
+            fs::remove_all(directory_);
+        }
+    };
+} // namespace
+
+TEST_F(CartridgeRomTest, EveryByteOrder)
+{
+    constexpr size_t size = 0x3000;
+    for (const char* name : {"cart.z64", "cart.v64", "cart.n64"})
+    {
+        fs::path path = directory_ / name;
+        write_image(path, size, 7);
+        hydra::N64::CartridgeRom rom;
+        ASSERT_TRUE(rom.Load(path.string())) << name;
+        ASSERT_EQ(rom.ImageSize(), size) << name;
+        for (size_t i = 0; i < size / 4; i++)
+        {
+            ASSERT_EQ(rom_word(rom, i * 4), image_word(i, 7)) << name << " word " << i;
+        }
+    }
+}
+
+TEST_F(CartridgeRomTest, ReusesConvertedImage)
+{
+    if (!N64_MAPPED_ROM_AVAILABLE)
+    {
+        GTEST_SKIP() << "Images are converted in memory on this host";
+    }
+    constexpr size_t size = 0x3000;
+    fs::path path = directory_ / "cart.v64";
+    write_image(path, size, 7);
+    hydra::N64::CartridgeRom rom;
+    ASSERT_TRUE(rom.Load(path.string()));
+    std::vector<fs::path> converted = converted_images("cart.v64");
+    ASSERT_EQ(converted.size(), 1u);
+
+    // A marker in the converted copy shows up when it's loaded again instead of converted
+    {
+        std::fstream fs(converted[0], std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(0x100);
+        const char marker[] = {'\xDE', '\xAD', '\xBE', '\xEF'};
+        fs.write(marker, sizeof(marker));
+    }
+    ASSERT_TRUE(rom.Load(path.string()));
+    EXPECT_EQ(rom_word(rom, 0x100), 0xDEAD'BEEFu);
+
+    // A changed dump is converted again
+    write_image(path, size, 9);
+    fs::last_write_time(path, fs::last_write_time(converted[0]) + std::chrono::seconds(1));
+    ASSERT_TRUE(rom.Load(path.string()));
+    EXPECT_EQ(rom_word(rom, 0x100), image_word(0x40, 9));
+    EXPECT_EQ(converted_images("cart.v64").size(), 2u);
+}
+
+TEST_F(CartridgeRomTest, ZeroPastTheEnd)
+{
+    hydra::N64::CartridgeRom rom;
+    fs::path large = directory_ / "cart.z64";
+    write_image(large, 0x5000, 7);
+    ASSERT_TRUE(rom.Load(large.string()));
+
+    // Nothing of the larger image is left past the end of the smaller one
+    fs::path small = directory_ / "cart.n64";
+    write_image(small, 0x3000, 9);
+    ASSERT_TRUE(rom.Load(small.string()));
+    EXPECT_EQ(rom_word(rom, 0x2FFC), image_word(0xBFF, 9));
+    for (size_t address = 0x3000; address < 0x6000; address += 4)
+    {
+        ASSERT_EQ(rom_word(rom, address), 0u) << std::hex << address;
+    }
+    EXPECT_EQ(rom_word(rom, hydra::N64::CART_ROM_SIZE - 4), 0u);
+}
+
+TEST(Profiler, FoldedStacksEndWithPc)
+{
+    hydra::N64::Profiler profiler("cpu", 1);
+    profiler.Tick(0xFFFF'FFFF'8000'1000, 0);
+    profiler.Call(0xFFFF'FFFF'8000'2000, 0xFFFF'FFFF'8000'1008);
+    profiler.Tick(0xFFFF'FFFF'8000'2010, 0);
+    profiler.Tick(0xFFFF'FFFF'8000'2010, 0);
+    profiler.Tick(0xFFFF'FFFF'8000'2014, 0);
+    profiler.Return(0xFFFF'FFFF'8000'1008);
+    profiler.Tick(0xFFFF'FFFF'8000'1008, 0);
+
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::filesystem::path prefix =
+        std::filesystem::temp_directory_path() / ("hydra_qa_profile_" + std::to_string(now));
+    ASSERT_TRUE(profiler.Dump(prefix.string()));
+    std::ifstream ifs(prefix.string() + ".folded");
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(ifs, line);)
+    {
+        lines.push_back(line);
+    }
+    std::filesystem::remove(prefix.string() + ".txt");
+    std::filesystem::remove(prefix.string() + ".folded");
+
+    std::vector<std::string> expected = {
+        "cpu;80001000 1",
+        "cpu;80001008 1",
+        "cpu;80002000;80002010 2",
+        "cpu;80002000;80002014 1",
+    };
+    EXPECT_EQ(lines, expected);
+}
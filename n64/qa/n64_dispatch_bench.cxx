@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <n64/core/n64_impl.hxx>
+
+// Instructions per second of the N64 CPU and RSP interpreters, on a small loop of ALU, shift
+// and memory instructions ending in a jump. Best of a few runs, as the numbers are noisy
+
+namespace hydra::N64
+{
+    class QA
+    {
+    public:
+        static constexpr uint64_t CPU_INSTRUCTIONS = 100'000'000;
+        static constexpr uint64_t RSP_INSTRUCTIONS = 100'000'000;
+        static constexpr int RSP_SLICE = 64;
+        static constexpr int RUNS = 3;
+
+        static double BenchCPU(N64& n64)
+        {
+            // clang-format off
+            constexpr std::array<uint32_t, 11> program = {
+                0x3C07'8000, // lui r7, 0x8000
+                0x34E7'2000, // ori r7, r7, 0x2000
+                0x2421'0001, // addiu r1, r1, 1
+                0x0041'1026, // xor r2, r2, r1
+                0x0001'1880, // sll r3, r1, 2
+                0x8CE4'0000, // lw r4, 0(r7)
+                0x0083'2021, // addu r4, r4, r3
+                0xACE4'0000, // sw r4, 0(r7)
+                0x0062'2825, // or r5, r3, r2
+                0x0800'0402, // j 0x80001008
+                0x00A1'3023, // subu r6, r5, r1
+            };
+            // clang-format on
+            CPU& cpu = n64.cpu_;
+            n64.Reset();
+            cpu.SetBackend(CPUBackend::Interpreter);
+            for (size_t i = 0; i < program.size(); i++)
+            {
+                cpu.store_word(0xFFFF'FFFF'8000'1000 + i * 4, program[i]);
+            }
+            cpu.pc_ = 0xFFFF'FFFF'8000'1000;
+            cpu.next_pc_ = cpu.pc_ + 4;
+
+            // Only the end of the run is scheduled, so the CPU runs uninterrupted
+            Scheduler& scheduler = n64.cpubus_.scheduler_;
+            scheduler.Reset();
+            scheduler.Schedule(EventType::SIDMA, CPU_INSTRUCTIONS);
+            auto start = std::chrono::steady_clock::now();
+            cpu.Run();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            return scheduler.Now() / elapsed.count();
+        }
+
+        static double BenchRSP(N64& n64)
+        {
+            // clang-format off
+            constexpr std::array<uint32_t, 9> program = {
+                0x2421'0001, // addiu r1, r1, 1
+                0x0041'1026, // xor r2, r2, r1
+                0x0001'1880, // sll r3, r1, 2
+                0x8C04'0000, // lw r4, 0(r0)
+                0x0083'2021, // addu r4, r4, r3
+                0xAC04'0000, // sw r4, 0(r0)
+                0x0062'2825, // or r5, r3, r2
+                0x0800'0000, // j 0
+                0x00A1'3023, // subu r6, r5, r1
+            };
+            // clang-format on
+            RSP& rsp = n64.rcp_.rsp_;
+            rsp.Reset();
+            for (size_t i = 0; i < program.size(); i++)
+            {
+                uint32_t word = hydra::bswap32(program[i]);
+                std::memcpy(&rsp.mem_[0x1000 + i * 4], &word, sizeof(word));
+            }
+            rsp.pc_ = 0;
+            rsp.next_pc_ = 4;
+            rsp.status_.halt = false;
+
+            // In slices, like the scheduler runs it
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < RSP_INSTRUCTIONS; i += RSP_SLICE)
+            {
+                rsp.Run(RSP_SLICE);
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            return RSP_INSTRUCTIONS / elapsed.count();
+        }
+
+        template <class Bench>
+        static double Best(Bench bench)
+        {
+            double best = 0;
+            for (int i = 0; i < RUNS; i++)
+            {
+                best = std::max(best, bench());
+            }
+            return best / 1e6;
+        }
+    };
+} // namespace hydra::N64
+
+int main()
+{
+    using hydra::N64::QA;
+    bool should_draw = false;
+    hydra::N64::N64 n64(should_draw);
+    printf("n64 cpu %8.2f MIPS\n", QA::Best([&] { return QA::BenchCPU(n64); }));
+    printf("n64 rsp %8.2f MIPS\n", QA::Best([&] { return QA::BenchRSP(n64); }));
+    return 0;
+}
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <n64/core/n64_rdp.hxx>
+#include <n64/core/n64_rdp_commands.hxx>
+#include <n64/core/n64_rdp_trace.hxx>
+#include <n64/qa/n64_angrylion_replayer.hxx>
+#include <new>
+#include <string>
+#include <vector>
+
+// Replays a trace written with the RDPTrace setting through the RDP, without the rest of the
+// emulator. Reports frames per second of the best of a few runs, heap allocations per frame,
+// where the time goes per command type and, with --angrylion, how many pixels of the color
+// image differ from angrylion's at the end of every frame
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace hydra::N64
+{
+    class QA
+    {
+    public:
+        static constexpr int RUNS = 3;
+
+        struct Options
+        {
+            uint32_t threads = 1;
+            bool rdp_thread = false;
+            bool angrylion = false;
+        };
+
+        QA(const RDPTraceReader& trace, const Options& options)
+            : trace_(trace), options_(options), rdram_(RDRAM_EXPANSION_SIZE)
+        {
+        }
+
+        // Frames per second of the whole trace, memory records included
+        double BenchReplay()
+        {
+            reset(options_.threads, options_.rdp_thread);
+            uint64_t before = allocations.load();
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& record : trace_.Records())
+            {
+                replay(record);
+            }
+            rdp_->Sync();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            allocations_ = allocations.load() - before;
+            return trace_.Frames() / elapsed.count();
+        }
+
+        uint64_t Allocations() const
+        {
+            return allocations_;
+        }
+
+        // Time spent in each command type, the RDP thread is left out so it counts at all
+        void ProfileCommands()
+        {
+            reset(options_.threads, false);
+            std::array<double, 64> seconds{};
+            std::array<uint64_t, 64> counts{};
+            for (const auto& record : trace_.Records())
+            {
+                if (record.type != RDPTraceRecordType::Command)
+                {
+                    replay(record);
+                    continue;
+                }
+                auto command = trace_.Command(record);
+                uint8_t type = (command[0] >> 56) & 0b111111;
+                auto start = std::chrono::steady_clock::now();
+                rdp_->SendCommand(command);
+                std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start;
+                seconds[type] += elapsed.count();
+                counts[type]++;
+            }
+
+            double total = 0;
+            for (double time : seconds)
+            {
+                total += time;
+            }
+            std::array<uint8_t, 64> types;
+            for (size_t i = 0; i < types.size(); i++)
+            {
+                types[i] = i;
+            }
+            std::sort(types.begin(), types.end(),
+                      [&](uint8_t a, uint8_t b) { return seconds[a] > seconds[b]; });
+            printf("%-26s %10s %10s %10s %6s\n", "command", "count", "total ms", "avg us", "%");
+            for (uint8_t type : types)
+            {
+                if (counts[type] == 0)
+                {
+                    continue;
+                }
+                printf("%-26s %10llu %10.2f %10.2f %6.2f\n", command_name(type),
+                       static_cast<unsigned long long>(counts[type]), seconds[type] * 1e3,
+                       seconds[type] * 1e6 / counts[type], seconds[type] * 100 / total);
+            }
+        }
+
+        // Pixels of the color image that differ from angrylion's, summed over the frames
+        uint64_t CompareAngrylion()
+        {
+            reset(options_.threads, options_.rdp_thread);
+            AngrylionReplayer::Init();
+            ColorImage image{};
+            std::vector<uint8_t> expected;
+            uint64_t mismatches = 0;
+            uint32_t frame = 0, bad_frames = 0;
+            for (const auto& record : trace_.Records())
+            {
+                replay(record);
+                switch (record.type)
+                {
+                    case RDPTraceRecordType::Command:
+                    {
+                        auto command = trace_.Command(record);
+                        track(image, command[0]);
+                        AngrylionReplayer::RunCommand({command.begin(), command.end()});
+                        break;
+                    }
+                    case RDPTraceRecordType::Memory:
+                    {
+                        AngrylionReplayer::WriteRDRAM(record.address, trace_.Memory(record).data(),
+                                                      record.size);
+                        break;
+                    }
+                    case RDPTraceRecordType::Frame:
+                    {
+                        rdp_->Sync();
+                        uint32_t pixel_bytes = std::max(image.bits / 8, 1u);
+                        uint32_t start = std::min(image.address, RDRAM_EXPANSION_SIZE);
+                        uint32_t size = std::min(image.width * image.height * pixel_bytes,
+                                                 RDRAM_EXPANSION_SIZE - start);
+                        expected.resize(size);
+                        AngrylionReplayer::ReadRDRAM(start, expected.data(), size);
+                        uint64_t pixels = 0;
+                        for (uint32_t i = 0; i + pixel_bytes <= size; i += pixel_bytes)
+                        {
+                            pixels += std::memcmp(&expected[i], &rdram_[start + i],
+                                                  pixel_bytes) != 0;
+                        }
+                        if (pixels != 0)
+                        {
+                            if (bad_frames++ == 0)
+                            {
+                                printf("first mismatch: frame %u, %llu pixels\n", frame,
+                                       static_cast<unsigned long long>(pixels));
+                            }
+                            mismatches += pixels;
+                        }
+                        frame++;
+                        break;
+                    }
+                }
+            }
+            AngrylionReplayer::Cleanup();
+            printf("angrylion: %u of %u frames differ\n", bad_frames, frame);
+            return mismatches;
+        }
+
+        template <class Func>
+        static double Best(Func&& func)
+        {
+            double best = 0;
+            for (int i = 0; i < RUNS; i++)
+            {
+                best = std::max(best, func());
+            }
+            return best;
+        }
+
+    private:
+        struct ColorImage
+        {
+            uint32_t address;
+            uint32_t width;
+            uint32_t height;
+            uint32_t bits;
+        };
+
+        const RDPTraceReader& trace_;
+        Options options_;
+        std::vector<uint8_t> rdram_;
+        std::unique_ptr<RDP> rdp_;
+        MIInterrupt mi_interrupt_{};
+        uint64_t allocations_ = 0;
+
+        void reset(uint32_t threads, bool rdp_thread)
+        {
+            rdp_.reset();
+            std::fill(rdram_.begin(), rdram_.end(), 0);
+            rdp_ = std::make_unique<RDP>();
+            rdp_->InstallBuses(rdram_.data(), nullptr);
+            rdp_->SetMIPtr(&mi_interrupt_);
+            rdp_->Reset();
+            rdp_->SetThreadCount(threads);
+            rdp_->SetThread(rdp_thread);
+        }
+
+        void replay(const RDPTraceReader::Record& record)
+        {
+            switch (record.type)
+            {
+                case RDPTraceRecordType::Command:
+                {
+                    rdp_->SendCommand(trace_.Command(record));
+                    break;
+                }
+                case RDPTraceRecordType::Memory:
+                {
+                    // The RDP thread may still be drawing where the game wrote
+                    rdp_->WaitFor(record.address, record.size, true);
+                    auto memory = trace_.Memory(record);
+                    std::copy(memory.begin(), memory.end(), rdram_.begin() + record.address);
+                    break;
+                }
+                case RDPTraceRecordType::Frame:
+                    break;
+            }
+        }
+
+        static void track(ColorImage& image, uint64_t word)
+        {
+            auto type = static_cast<RDPCommandType>((word >> 56) & 0b111111);
+            if (type == RDPCommandType::SetColorImage)
+            {
+                SetColorImageCommand color_image;
+                color_image.full = word;
+                image.address = color_image.dram_address;
+                image.width = color_image.width + 1;
+                image.bits = 4 << color_image.size;
+            }
+            else if (type == RDPCommandType::SetScissor)
+            {
+                SetScissorCommand scissor;
+                scissor.full = word;
+                image.height = scissor.YL >> 2;
+            }
+        }
+
+        static const char* command_name(uint8_t type)
+        {
+            switch (static_cast<RDPCommandType>(type))
+            {
+#define X(name, opcode, length) \
+    case RDPCommandType::name:  \
+        return #name;
+                RDP_COMMANDS
+#undef X
+                default:
+                    return "Unknown";
+            }
+        }
+    };
+} // namespace hydra::N64
+
+int main(int argc, char** argv)
+{
+    using hydra::N64::QA;
+    if (argc < 2)
+    {
+        printf("usage: %s <trace> [--threads N] [--rdp-thread] [--angrylion]\n", argv[0]);
+        return 1;
+    }
+
+    QA::Options options;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            options.threads = std::stoi(argv[++i]);
+        }
+        else if (arg == "--rdp-thread")
+        {
+            options.rdp_thread = true;
+        }
+        else if (arg == "--angrylion")
+        {
+            options.angrylion = true;
+        }
+        else
+        {
+            printf("unknown option %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    hydra::N64::RDPTraceReader trace;
+    if (!trace.Load(argv[1]))
+    {
+        return 1;
+    }
+    printf("%s: %zu records, %u frames\n", argv[1], trace.Records().size(), trace.Frames());
+
+    QA qa(trace, options);
+    printf("replay %10.2f frames/s\n", QA::Best([&] { return qa.BenchReplay(); }));
+    printf("allocations %.2f per frame\n",
+           static_cast<double>(qa.Allocations()) / std::max(trace.Frames(), 1u));
+    qa.ProfileCommands();
+    if (options.angrylion)
+    {
+        printf("angrylion: %llu pixels differ\n",
+               static_cast<unsigned long long>(qa.CompareAngrylion()));
+    }
+    return 0;
+}
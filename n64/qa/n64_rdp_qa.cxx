@@ -2,15 +2,150 @@
 #include <gtest/gtest.h>
 #include <n64/core/n64_rdp.hxx>
 #include <n64/core/n64_rdp_commands.hxx>
+#include <n64/core/n64_rdp_span.hxx>
+#include <n64/core/n64_vi_convert.hxx>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.hxx"
+#include <atomic>
+#include <compatibility.hxx>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
+#include <n64/core/n64_addresses.hxx>
 #include <n64/qa/n64_angrylion_replayer.hxx>
+#include <new>
+#include <random>
+#include <sstream>
 
 using namespace hydra::N64;
 
+// Every heap allocation the tests make, to catch the ones the RDP shouldn't
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+// Golden results are CRC32 digests of tiles of the framebuffer, so checking one is cheap and
+// thousands of cases fit in a text file. Reference images are only decoded to show which pixels
+// differ when a case fails
+constexpr int GOLDEN_TILE_WIDTH = 32;
+constexpr int GOLDEN_TILE_HEIGHT = 16;
+const std::string QA_DATA_DIRECTORY = "n64/qa/data/";
+
+struct GoldenCase
+{
+    std::string name;
+    std::vector<std::vector<uint64_t>> commands;
+    std::vector<uint32_t> digests;
+};
+
+void PrintTo(const GoldenCase& golden, std::ostream* os)
+{
+    *os << golden.name;
+}
+
+// Cases start with a "case <name>" line, followed by a "command <words>" line for every command
+// drawn on top of RDPTest::SetUp and a "digests <tiles>" line, all in hex
+static std::vector<GoldenCase> load_golden_cases()
+{
+    std::vector<GoldenCase> cases;
+    std::ifstream file(QA_DATA_DIRECTORY + "rdp_golden.txt");
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream words(line);
+        std::string key;
+        words >> key;
+        if (key == "case")
+        {
+            cases.emplace_back();
+            words >> cases.back().name;
+            continue;
+        }
+        if (cases.empty())
+        {
+            continue;
+        }
+
+        words >> std::hex;
+        if (key == "command")
+        {
+            std::vector<uint64_t> command;
+            uint64_t word;
+            while (words >> word)
+            {
+                command.push_back(word);
+            }
+            cases.back().commands.push_back(command);
+        }
+        else if (key == "digests")
+        {
+            uint32_t digest;
+            while (words >> digest)
+            {
+                cases.back().digests.push_back(digest);
+            }
+        }
+    }
+    return cases;
+}
+
+// A golden file line with the digests
+static std::string digests_line(const std::vector<uint32_t>& digests)
+{
+    std::ostringstream line;
+    line << "digests" << std::hex << std::setfill('0');
+    for (uint32_t digest : digests)
+    {
+        line << ' ' << std::setw(8) << digest;
+    }
+    return line.str();
+}
+
+// A row major digest per tile of an image of 32-bit pixels, a whole number of tiles big
+static std::vector<uint32_t> tile_digests(const uint8_t* pixels, int width, int height)
+{
+    std::vector<uint32_t> digests;
+    for (int tile_y = 0; tile_y < height; tile_y += GOLDEN_TILE_HEIGHT)
+    {
+        for (int tile_x = 0; tile_x < width; tile_x += GOLDEN_TILE_WIDTH)
+        {
+            uint32_t crc = 0xFFFFFFFF;
+            for (int y = tile_y; y < tile_y + GOLDEN_TILE_HEIGHT; y++)
+            {
+                const uint8_t* row = pixels + (y * width + tile_x) * 4;
+                for (int x = 0; x < GOLDEN_TILE_WIDTH * 4; x += 8)
+                {
+                    uint64_t data;
+                    std::memcpy(&data, row + x, sizeof(data));
+                    crc = hydra::crc32_u64(crc, data);
+                }
+            }
+            digests.push_back(~crc);
+        }
+    }
+    return digests;
+}
+
 class RDPTest : public testing::Test
 {
 protected:
@@ -18,59 +153,72 @@ protected:
     {
         std::fill(framebuffer.begin(), framebuffer.end(), 0);
         rdp.InstallBuses(framebuffer.data(), nullptr);
+        rdp.Reset();
 
         SetColorImageCommand color_image;
+        color_image.command = static_cast<uint64_t>(RDPCommandType::SetColorImage);
         color_image.dram_address = 0;
         color_image.width = my_width - 1;
         color_image.format = 0;
         color_image.size = 3;
-        rdp.SendCommand({color_image.full});
 
         SetFillColorCommand fill_color;
+        fill_color.command = static_cast<uint64_t>(RDPCommandType::SetFillColor);
         fill_color.color = 0xffffffff;
-        rdp.SendCommand({fill_color.full});
 
         SetOtherModesCommand other_modes;
+        other_modes.command = static_cast<uint64_t>(RDPCommandType::SetOtherModes);
         other_modes.cycle_type = 3;
-        rdp.SendCommand({other_modes.full});
 
         SetScissorCommand scissor;
+        scissor.command = static_cast<uint64_t>(RDPCommandType::SetScissor);
         scissor.XH = 0;
         scissor.YH = 0;
         scissor.XL = my_width << 2;
         scissor.YL = my_height << 2;
-        rdp.SendCommand({scissor.full});
+
+        setup_commands = {{color_image.full}, {fill_color.full}, {other_modes.full},
+                          {scissor.full}};
+        for (const auto& command : setup_commands)
+        {
+            rdp.SendCommand(command);
+        }
     }
 
     void TearDown() override {}
 
-    void VerifyFramebuffer(std::string path)
+    void VerifyFramebuffer(const std::string& name, const std::vector<uint32_t>& golden)
     {
-        if (!std::filesystem::exists(path))
+        std::vector<uint32_t> digests = tile_digests(framebuffer.data(), my_width, my_height);
+        if (digests == golden)
         {
-            FAIL();
+            return;
         }
 
-        int width, height, channels;
-        stbi_uc* data = stbi_load(path.c_str(), &width, &height, &channels, my_channels);
+        DumpPng("/tmp/" + name + ".png");
+        DumpDiff(name, golden, digests);
+        FAIL() << name << " doesn't match its golden digests, see /tmp/" << name
+               << "_diff.png. Its digests are:\n"
+               << digests_line(digests);
+    }
 
-        if (data == nullptr)
+    // What angrylion draws with the same commands on top of the same setup
+    std::vector<uint8_t> AngrylionFramebuffer(const std::vector<std::vector<uint64_t>>& commands)
+    {
+        AngrylionReplayer::Init();
+        for (const auto& command : setup_commands)
         {
-            FAIL();
+            AngrylionReplayer::RunCommand(command);
         }
-
-        if (my_width != width || my_height != height || my_channels != channels)
+        for (const auto& command : commands)
         {
-            FAIL();
-        }
-
-        for (size_t i = 0; i < framebuffer.size(); i++)
-        {
-            if (data[i] != framebuffer[i])
-            {
-                FAIL();
-            }
+            AngrylionReplayer::RunCommand(command);
         }
+        AngrylionReplayer::RunCommand({static_cast<uint64_t>(RDPCommandType::SyncFull) << 56});
+        std::vector<uint8_t> pixels(framebuffer.size());
+        AngrylionReplayer::ReadRDRAM(0, pixels.data(), pixels.size());
+        AngrylionReplayer::Cleanup();
+        return pixels;
     }
 
     void DumpPng(std::string path)
@@ -78,6 +226,36 @@ protected:
         stbi_write_png(path.c_str(), my_width, my_height, my_channels, framebuffer.data(), 0);
     }
 
+    // The pixels that differ from the reference image in white, or the tiles that differ when
+    // there is none, on top of a darkened framebuffer
+    void DumpDiff(const std::string& name, const std::vector<uint32_t>& golden,
+                  const std::vector<uint32_t>& digests)
+    {
+        int width, height, channels;
+        std::string reference = QA_DATA_DIRECTORY + name + ".png";
+        stbi_uc* data = stbi_load(reference.c_str(), &width, &height, &channels, my_channels);
+        bool pixels = data != nullptr && width == my_width && height == my_height;
+
+        std::vector<uint8_t> diff(framebuffer.size());
+        for (size_t i = 0; i < framebuffer.size(); i += my_channels)
+        {
+            size_t x = (i / my_channels) % my_width;
+            size_t y = (i / my_channels) / my_width;
+            size_t tile = (y / GOLDEN_TILE_HEIGHT) * (my_width / GOLDEN_TILE_WIDTH) +
+                          x / GOLDEN_TILE_WIDTH;
+            bool differs = pixels ? std::memcmp(data + i, &framebuffer[i], my_channels) != 0
+                                  : tile >= golden.size() || golden[tile] != digests[tile];
+            for (int channel = 0; channel < my_channels; channel++)
+            {
+                diff[i + channel] = differs ? 0xFF : framebuffer[i + channel] / 4;
+            }
+            diff[i + 3] = 0xFF;
+        }
+        stbi_image_free(data);
+        stbi_write_png(("/tmp/" + name + "_diff.png").c_str(), my_width, my_height, my_channels,
+                       diff.data(), 0);
+    }
+
     void PrintCommand(const std::vector<uint64_t> triangle)
     {
         EdgeCoefficientsCommand command;
@@ -106,42 +284,787 @@ protected:
     static constexpr int my_width = 320;
     static constexpr int my_height = 240;
     static constexpr int my_channels = 4;
+    static_assert(my_width % GOLDEN_TILE_WIDTH == 0 && my_height % GOLDEN_TILE_HEIGHT == 0);
 
     std::array<uint8_t, my_width * my_height * my_channels> framebuffer;
+    std::vector<std::vector<uint64_t>> setup_commands;
+    RDP rdp;
+};
+
+// Every case in rdp_golden.txt is a test of its own, so sharding spreads them over processes
+class RDPGolden : public RDPTest, public testing::WithParamInterface<GoldenCase>
+{
+};
+
+TEST_P(RDPGolden, Matches)
+{
+    const GoldenCase& golden = GetParam();
+    // The digests are angrylion's, so a case can't end up checking hydra against itself
+    std::vector<uint8_t> reference = AngrylionFramebuffer(golden.commands);
+    std::vector<uint32_t> reference_digests = tile_digests(reference.data(), my_width, my_height);
+    ASSERT_EQ(reference_digests, golden.digests)
+        << golden.name << " has golden digests that aren't what angrylion draws, which are:\n"
+        << digests_line(reference_digests);
+
+    for (const auto& command : golden.commands)
+    {
+        rdp.SendCommand(command);
+    }
+    VerifyFramebuffer(golden.name, golden.digests);
+}
+
+INSTANTIATE_TEST_SUITE_P(Data, RDPGolden, testing::ValuesIn(load_golden_cases()),
+                         [](const testing::TestParamInfo<GoldenCase>& param) {
+                             return param.param.name;
+                         });
+
+TEST(RDPDirtyMap, FillRectangle)
+{
+    std::vector<uint8_t> rdram(RDRAM_EXPANSION_SIZE);
     RDP rdp;
+    RDRAMDirtyMap dirty_map;
+    rdp.InstallBuses(rdram.data(), nullptr);
+    rdp.SetDirtyMap(&dirty_map);
+    // 16bpp color image at 0x100000, then an 8x8 fill rectangle at its top left
+    for (uint64_t command : {0x2d000000005003c0, 0x2f30000000000000, 0x3f18013f00100000,
+                             0x37000000ffff00ff, 0x3602002000000000})
+    {
+        rdp.SendCommand({command});
+    }
+    EXPECT_TRUE(dirty_map.IsDirty(DirtyConsumer::Framebuffer, 0x100000, 320 * 240 * 2));
+    std::vector<uint32_t> pages;
+    dirty_map.ForEachDirty(DirtyConsumer::Framebuffer,
+                           [&](uint32_t page) { pages.push_back(page); });
+    EXPECT_EQ(pages, std::vector<uint32_t>{0x100000 / RDRAMDirtyMap::PAGE_SIZE});
+    EXPECT_FALSE(dirty_map.IsDirty(DirtyConsumer::Framebuffer, 0, RDRAM_EXPANSION_SIZE));
+}
+
+// Shaded, depth tested triangles blended with the framebuffer under them and dithered with
+// noise, so any pixel rendered out of order or with the wrong noise shows up
+constexpr uint32_t TRIANGLES_COLOR_ADDRESS = 0x100000;
+constexpr uint32_t TRIANGLES_DEPTH_ADDRESS = 0x200000;
+constexpr uint32_t TRIANGLES_COLOR_SIZE = 320 * 240 * 4;
+constexpr uint32_t TRIANGLES_DEPTH_SIZE = 320 * 240 * 2;
+
+// A few large shaded triangles with depth into a 320x240 32bpp framebuffer
+static std::vector<std::vector<uint64_t>> random_triangles()
+{
+    constexpr uint32_t color_address = TRIANGLES_COLOR_ADDRESS;
+    constexpr uint32_t depth_address = TRIANGLES_DEPTH_ADDRESS;
+    std::vector<std::vector<uint64_t>> commands;
+
+    SetScissorCommand scissor;
+    scissor.command = static_cast<uint64_t>(RDPCommandType::SetScissor);
+    scissor.XL = 320 << 2;
+    scissor.YL = 240 << 2;
+    commands.push_back({scissor.full});
+
+    SetColorImageCommand color_image;
+    color_image.command = static_cast<uint64_t>(RDPCommandType::SetColorImage);
+    color_image.dram_address = color_address;
+    color_image.width = 320 - 1;
+    color_image.size = 3;
+    commands.push_back({color_image.full});
+    commands.push_back({static_cast<uint64_t>(RDPCommandType::SetZImage) << 56 | depth_address});
+
+    SetOtherModesCommand other_modes;
+    other_modes.command = static_cast<uint64_t>(RDPCommandType::SetOtherModes);
+    other_modes.z_compare_en = 1;
+    other_modes.z_update_en = 1;
+    other_modes.image_read_en = 1;
+    other_modes.b_m2a_0 = 1;
+    commands.push_back({other_modes.full});
+
+    SetCombineModeCommand combine_mode;
+    combine_mode.command = static_cast<uint64_t>(RDPCommandType::SetCombineMode);
+    combine_mode.sub_A_RGB_1 = 7;
+    combine_mode.sub_B_RGB_1 = 4;
+    combine_mode.mul_RGB_1 = 4;
+    combine_mode.add_RGB_1 = 4;
+    combine_mode.sub_A_Alpha_1 = 4;
+    combine_mode.sub_B_Alpha_1 = 7;
+    combine_mode.mul_Alpha_1 = 4;
+    combine_mode.add_Alpha_1 = 3;
+    commands.push_back({combine_mode.full});
+    commands.push_back({static_cast<uint64_t>(RDPCommandType::SetPrimitiveColor) << 56 |
+                        0x40808080});
+
+    std::mt19937_64 rng(0x6e36345f);
+    for (int i = 0; i < 4; i++)
+    {
+        EdgeCoefficientsCommand edges;
+        edges.command = static_cast<uint64_t>(RDPCommandType::TriangleShadeDepth);
+        edges.lft = i & 1;
+        edges.YH = (10 + i * 8) << 2;
+        edges.YM = edges.YH;
+        edges.YL = (230 - i * 4) << 2;
+        int32_t left = i & 1 ? 20 + i * 10 : 300 - i * 10;
+        int32_t right = i & 1 ? 280 - i * 10 : 10 + i * 10;
+        EdgeCoefficients edgel, edgeh, edgem;
+        edgel.X = right << 16;
+        edgel.slope = (i & 1 ? -1 : 1) << 16;
+        edgeh.X = left << 16;
+        edgeh.slope = 0;
+        edgem.full = edgeh.full;
+        std::vector<uint64_t> triangle = {edges.full, static_cast<uint64_t>(edgel.full),
+                                          static_cast<uint64_t>(edgeh.full),
+                                          static_cast<uint64_t>(edgem.full)};
+        for (int j = 0; j < 10; j++)
+        {
+            triangle.push_back(rng() & 0x00FF'00FF'00FF'00FF);
+        }
+        commands.push_back(triangle);
+    }
+    return commands;
+}
+
+// An RDP with RDRAM of its own, reset and with the depth buffer random_triangles() uses cleared
+struct TrianglesRDP
+{
+    std::vector<uint8_t> rdram;
+    std::unique_ptr<RDP> rdp;
+
+    explicit TrianglesRDP(uint32_t rdram_size = RDRAM_SIZE)
+        : rdram(rdram_size), rdp(std::make_unique<RDP>())
+    {
+        ClearDepth();
+        rdp->InstallBuses(rdram.data(), nullptr);
+        rdp->Reset();
+    }
+
+    void ClearDepth()
+    {
+        std::fill(rdram.begin() + TRIANGLES_DEPTH_ADDRESS,
+                  rdram.begin() + TRIANGLES_DEPTH_ADDRESS + TRIANGLES_DEPTH_SIZE, 0xFF);
+    }
+
+    void Send(const std::vector<std::vector<uint64_t>>& commands)
+    {
+        for (const auto& command : commands)
+        {
+            rdp->SendCommand(command);
+        }
+    }
 };
 
-#define TRIANGLE_TEST(name, ...)                        \
-    TEST_F(RDPTest, name)                               \
-    {                                                   \
-        std::vector<uint64_t> triangle = {__VA_ARGS__}; \
-        rdp.SendCommand(triangle);                      \
-        DumpPng("/tmp/" #name ".png");                  \
-        VerifyFramebuffer("data/" #name ".png");        \
+TEST(RDPThreads, MatchesSingleThreaded)
+{
+    auto commands = random_triangles();
+
+    std::vector<uint8_t> expected;
+    for (uint32_t threads : {1, 2, 3, 4, 8})
+    {
+        TrianglesRDP test;
+        test.rdp->SetThreadCount(threads);
+        test.Send(commands);
+        if (expected.empty())
+        {
+            expected = test.rdram;
+            // Make sure the triangles were drawn at all
+            auto color = expected.begin() + TRIANGLES_COLOR_ADDRESS;
+            ASSERT_NE(std::count(color, color + TRIANGLES_COLOR_SIZE, 0), TRIANGLES_COLOR_SIZE);
+        }
+        else
+        {
+            ASSERT_TRUE(test.rdram == expected) << threads << " threads";
+        }
+    }
+}
+
+TEST(RDPThread, MatchesInline)
+{
+    auto commands = random_triangles();
+
+    std::vector<uint8_t> expected;
+    for (bool threaded : {false, true})
+    {
+        TrianglesRDP test;
+        test.rdp->SetThread(threaded);
+        test.Send(commands);
+        ASSERT_EQ(test.rdp->IsPending(TRIANGLES_COLOR_ADDRESS, 4, false), threaded);
+        test.rdp->Sync();
+        ASSERT_FALSE(test.rdp->IsPending(TRIANGLES_COLOR_ADDRESS, 4, true));
+        if (expected.empty())
+        {
+            expected = test.rdram;
+        }
+        else
+        {
+            ASSERT_TRUE(test.rdram == expected);
+        }
+    }
+}
+
+TEST(RDPThread, LoadTLUTReadsEveryEntry)
+{
+    // A one texel wide image, so only the entry count says the palette crosses into the
+    // next page
+    constexpr uint32_t palette_address = RDRAMDirtyMap::PAGE_SIZE - 0x10;
+    std::vector<uint8_t> rdram(RDRAM_SIZE);
+    auto rdp = std::make_unique<RDP>();
+    rdp->InstallBuses(rdram.data(), nullptr);
+    rdp->Reset();
+    rdp->SetThread(true);
+    SetTextureImageCommand texture_image;
+    texture_image.full = 0x3Dull << 56;
+    texture_image.size = 2;
+    texture_image.DRAMAddress = palette_address;
+    rdp->SendCommand({texture_image.full});
+    LoadTileCommand load;
+    load.full = 0x30ull << 56;
+    load.tile = 7;
+    load.SH = 255 << 2;
+    rdp->SendCommand({load.full});
+    ASSERT_TRUE(rdp->IsPending(RDRAMDirtyMap::PAGE_SIZE + 0x100, 4, true));
+    ASSERT_FALSE(rdp->IsPending(RDRAMDirtyMap::PAGE_SIZE * 2, 4, true));
+    rdp->Sync();
+}
+
+TEST(RDPCommands, DecodeDoesNotAllocate)
+{
+    constexpr uint32_t list_address = 0x300000;
+    auto commands = random_triangles();
+
+    // The same commands as a display list in RDRAM, where the RSP would leave them
+    std::vector<uint8_t> list;
+    for (const auto& command : commands)
+    {
+        for (uint64_t word : command)
+        {
+            word = hydra::bswap64(word);
+            auto bytes = reinterpret_cast<const uint8_t*>(&word);
+            list.insert(list.end(), bytes, bytes + sizeof(word));
+        }
+    }
+
+    std::vector<uint8_t> expected;
+    for (int config = 0; config < 3; config++)
+    {
+        TrianglesRDP test;
+        auto& rdram = test.rdram;
+        auto& rdp = test.rdp;
+        if (config == 0)
+        {
+            test.Send(commands);
+            expected = rdram;
+            continue;
+        }
+        rdp->SetThreadCount(config == 1 ? 4 : 1);
+        rdp->SetThread(config == 2);
+
+        std::copy(list.begin(), list.end(), rdram.begin() + list_address);
+        auto run = [&]() {
+            rdp->WriteWord(DP_START, list_address);
+            rdp->WriteWord(DP_END, list_address + list.size());
+            rdp->Sync();
+        };
+        run();
+        ASSERT_TRUE(std::equal(expected.begin(), expected.begin() + list_address, rdram.begin()))
+            << "config " << config;
+
+        uint64_t before = allocations.load();
+        run();
+        ASSERT_EQ(allocations.load(), before) << "config " << config;
+    }
+}
+
+TEST(RDPScissor, MatchesUnclipped)
+{
+    constexpr uint32_t color_address = TRIANGLES_COLOR_ADDRESS;
+    constexpr uint32_t row = 320 * 4;
+    auto commands = random_triangles();
+    // Only shade, so that the rows above the scissor box don't step the noise
+    SetCombineModeCommand combine_mode;
+    combine_mode.full = commands[4][0];
+    combine_mode.sub_A_RGB_1 = 4;
+    commands[4][0] = combine_mode.full;
+
+    // The rows inside the box come out the same as when nothing is clipped, even though the
+    // edgewalker skips past the ones above it
+    std::vector<uint8_t> expected;
+    for (uint32_t top : {0, 100})
+    {
+        SetScissorCommand scissor;
+        scissor.full = commands[0][0];
+        scissor.YH = top << 2;
+        commands[0][0] = scissor.full;
+
+        TrianglesRDP test;
+        test.Send(commands);
+        if (expected.empty())
+        {
+            expected = test.rdram;
+            continue;
+        }
+        auto color = test.rdram.begin() + color_address;
+        ASSERT_EQ(std::count(color, color + top * row, 0), top * row);
+        ASSERT_TRUE(std::equal(color + top * row, color + 240 * row,
+                               expected.begin() + color_address + top * row));
+    }
+}
+
+TEST(RDPTrace, ReplayMatches)
+{
+    constexpr uint32_t color_address = TRIANGLES_COLOR_ADDRESS;
+    constexpr uint32_t depth_address = TRIANGLES_DEPTH_ADDRESS;
+    constexpr uint32_t depth_size = TRIANGLES_DEPTH_SIZE;
+    auto commands = random_triangles();
+    std::string path = (std::filesystem::temp_directory_path() / "hydra_rdp_trace.bin").string();
+
+    // Two frames, with the game clearing the buffers the RDP drew into in between
+    TrianglesRDP test(RDRAM_EXPANSION_SIZE);
+    auto& rdram = test.rdram;
+    ASSERT_TRUE(test.rdp->StartTrace(path));
+    for (int frame = 0; frame < 2; frame++)
+    {
+        if (frame != 0)
+        {
+            std::fill(rdram.begin() + color_address, rdram.begin() + color_address + 320 * 4,
+                      0x55);
+            test.ClearDepth();
+        }
+        test.Send(commands);
+        test.rdp->TraceFrame();
+    }
+    test.rdp->StopTrace();
+
+    RDPTraceReader trace;
+    ASSERT_TRUE(trace.Load(path));
+    std::filesystem::remove(path);
+    ASSERT_EQ(trace.Frames(), 2u);
+
+    std::vector<uint8_t> replayed(RDRAM_EXPANSION_SIZE);
+    auto replay = std::make_unique<RDP>();
+    replay->InstallBuses(replayed.data(), nullptr);
+    replay->Reset();
+    for (const auto& record : trace.Records())
+    {
+        if (record.type == RDPTraceRecordType::Command)
+        {
+            replay->SendCommand(trace.Command(record));
+        }
+        else if (record.type == RDPTraceRecordType::Memory)
+        {
+            auto memory = trace.Memory(record);
+            std::copy(memory.begin(), memory.end(), replayed.begin() + record.address);
+        }
+    }
+    ASSERT_TRUE(std::equal(rdram.begin() + color_address,
+                           rdram.begin() + color_address + TRIANGLES_COLOR_SIZE,
+                           replayed.begin() + color_address));
+    ASSERT_TRUE(std::equal(rdram.begin() + depth_address,
+                           rdram.begin() + depth_address + depth_size,
+                           replayed.begin() + depth_address));
+}
+
+namespace hydra::N64
+{
+    class QA
+    {
+    public:
+        // The texel cache of the mode against TMEM decoded from scratch
+        static bool TexelCacheMatches(RDP& rdp, TexelMode mode)
+        {
+            rdp.update_texel_cache(mode);
+            const auto& cache = rdp.texel_cache_[static_cast<size_t>(mode)];
+            for (uint32_t i = 0; i < cache.size(); i++)
+            {
+                Texel texel = rdp.decode_texel(mode, i);
+                if (cache[i].color != texel.color || cache[i].alpha != texel.alpha)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Draws with render_rows fetching texels and stepping the noise generator per pixel
+        // whether the combiner reads them or not, and with the blender always dividing, none
+        // of which can change what's drawn
+        static void UseGenericRenderRows(RDP& rdp)
+        {
+            rdp.pipeline_ |= PIPELINE_TEXTURE | PIPELINE_NOISE;
+            rdp.render_rows_ = RDP::get_render_rows(rdp.pipeline_);
+            std::fill(std::begin(rdp.blender_result_), std::end(rdp.blender_result_),
+                      RDP::BlenderResult::Blend);
+        }
+    };
+} // namespace hydra::N64
+
+// Loads of random sizes to random places in TMEM, with the cache of a random mode brought up
+// to date after each of them, so the others pile up loads before they're looked at
+TEST(RDPTexelCache, PartialLoadsMatchFullDecode)
+{
+    constexpr uint32_t texture_address = 0x300000;
+    std::vector<uint8_t> rdram(RDRAM_EXPANSION_SIZE);
+    std::mt19937 rng(0x74657863);
+    std::generate(rdram.begin() + texture_address, rdram.begin() + texture_address + 0x40000,
+                  [&rng] { return rng(); });
+    auto rdp = std::make_unique<RDP>();
+    rdp->InstallBuses(rdram.data(), nullptr);
+    rdp->Reset();
+    for (size_t mode = 0; mode < static_cast<size_t>(TexelMode::Count); mode++)
+    {
+        ASSERT_TRUE(QA::TexelCacheMatches(*rdp, static_cast<TexelMode>(mode)));
+    }
+
+    for (int i = 0; i < 300; i++)
+    {
+        bool block = i % 3 == 0;
+        uint8_t size = block ? 2 : 1 + rng() % 3;
+        SetTextureImageCommand image{};
+        image.full = static_cast<uint64_t>(RDPCommandType::SetTextureImage) << 56;
+        image.DRAMAddress = texture_address;
+        image.width = 256 - 1;
+        image.size = size;
+        rdp->SendCommand({image.full});
+
+        SetTileCommand tile{};
+        tile.full = static_cast<uint64_t>(RDPCommandType::SetTile) << 56;
+        tile.TMemAddress = rng() % 512;
+        tile.Line = 1 + rng() % 16;
+        tile.size = size;
+        rdp->SendCommand({tile.full});
+
+        if (block)
+        {
+            LoadBlockCommand load{};
+            load.full = static_cast<uint64_t>(RDPCommandType::LoadBlock) << 56;
+            load.SL = rng() % 500;
+            load.SH = load.SL + 1 + rng() % 500;
+            rdp->SendCommand({load.full});
+        }
+        else
+        {
+            LoadTileCommand load{};
+            load.full = static_cast<uint64_t>(RDPCommandType::LoadTile) << 56;
+            uint32_t x = rng() % 200, y = rng() % 200;
+            load.SL = x << 2;
+            load.SH = (x + rng() % 32) << 2;
+            load.TL = y << 2;
+            load.TH = (y + rng() % 8) << 2;
+            rdp->SendCommand({load.full});
+        }
+
+        auto mode = static_cast<TexelMode>(rng() % static_cast<uint32_t>(TexelMode::Count));
+        ASSERT_TRUE(QA::TexelCacheMatches(*rdp, mode))
+            << "mode " << static_cast<int>(mode) << " after load " << i;
     }
+}
+
+// Render modes, combiner and blender settings picked at random with triangles and rectangles
+// drawn in between, on top of random TMEM contents
+static std::vector<std::vector<uint64_t>> random_render_modes(std::mt19937_64& rng)
+{
+    constexpr uint32_t texture_address = 0x300000;
+    auto command = [](RDPCommandType type, uint64_t word) {
+        return std::vector<uint64_t>{static_cast<uint64_t>(type) << 56 |
+                                     (word & 0x00FF'FFFF'FFFF'FFFF)};
+    };
+    std::vector<std::vector<uint64_t>> commands;
+
+    SetScissorCommand scissor;
+    scissor.command = static_cast<uint64_t>(RDPCommandType::SetScissor);
+    scissor.XL = 320 << 2;
+    scissor.YL = 240 << 2;
+    commands.push_back({scissor.full});
+    commands.push_back(command(RDPCommandType::SetZImage, TRIANGLES_DEPTH_ADDRESS));
+
+    SetTextureImageCommand image{};
+    image.full = static_cast<uint64_t>(RDPCommandType::SetTextureImage) << 56;
+    image.DRAMAddress = texture_address;
+    image.width = 256 - 1;
+    image.size = 2;
+    commands.push_back({image.full});
+    SetTileCommand tile{};
+    tile.full = static_cast<uint64_t>(RDPCommandType::SetTile) << 56;
+    tile.Line = 8;
+    tile.format = rng() & 1 ? 0 : 3;
+    tile.size = 2;
+    commands.push_back({tile.full});
+    LoadBlockCommand load{};
+    load.full = static_cast<uint64_t>(RDPCommandType::LoadBlock) << 56;
+    load.SH = 2047;
+    commands.push_back({load.full});
+
+    for (auto type : {RDPCommandType::SetPrimitiveColor, RDPCommandType::SetEnvironmentColor,
+                      RDPCommandType::SetBlendColor, RDPCommandType::SetFogColor,
+                      RDPCommandType::SetFillColor, RDPCommandType::SetPrimDepth})
+    {
+        commands.push_back(command(type, rng() & 0xFFFF'FFFF));
+    }
+
+    // The first three set the render mode, combiner and color image up
+    for (int i = 0; i < 60; i++)
+    {
+        switch (i < 3 ? i : rng() % 6)
+        {
+            case 0:
+            {
+                // Copy mode only draws texture rectangles, which are left to other tests
+                SetOtherModesCommand other_modes;
+                other_modes.full = rng();
+                other_modes.command = static_cast<uint64_t>(RDPCommandType::SetOtherModes);
+                other_modes.cycle_type = std::array{0, 1, 3}[rng() % 3];
+                commands.push_back({other_modes.full});
+                break;
+            }
+            case 1:
+            {
+                commands.push_back(command(RDPCommandType::SetCombineMode, rng()));
+                break;
+            }
+            case 2:
+            {
+                SetColorImageCommand color_image;
+                color_image.command = static_cast<uint64_t>(RDPCommandType::SetColorImage);
+                color_image.dram_address = TRIANGLES_COLOR_ADDRESS;
+                color_image.width = 320 - 1;
+                color_image.size = 2 + rng() % 2;
+                commands.push_back({color_image.full});
+                break;
+            }
+            case 3:
+            case 4:
+            {
+                EdgeCoefficientsCommand edges;
+                edges.command = static_cast<uint64_t>(RDPCommandType::Triangle) | rng() % 8;
+                edges.lft = rng() & 1;
+                edges.YH = (rng() % 120) << 2;
+                edges.YM = edges.YH;
+                edges.YL = (120 + rng() % 120) << 2;
+                int32_t left = rng() % 320;
+                int32_t right = rng() % 320;
+                EdgeCoefficients edgel, edgeh, edgem;
+                edgel.X = right << 16;
+                edgel.slope = static_cast<int32_t>(rng() % 0x20000) - 0x10000;
+                edgeh.X = left << 16;
+                edgeh.slope = static_cast<int32_t>(rng() % 0x20000) - 0x10000;
+                edgem.full = edgeh.full;
+                std::vector<uint64_t> triangle = {edges.full, static_cast<uint64_t>(edgel.full),
+                                                  static_cast<uint64_t>(edgeh.full),
+                                                  static_cast<uint64_t>(edgem.full)};
+                int coefficients = (edges.command & 4 ? 8 : 0) + (edges.command & 2 ? 8 : 0) +
+                                   (edges.command & 1 ? 2 : 0);
+                for (int j = 0; j < coefficients; j++)
+                {
+                    triangle.push_back(rng() & 0x00FF'00FF'00FF'00FF);
+                }
+                commands.push_back(triangle);
+                break;
+            }
+            case 5:
+            {
+                RectangleCommand rectangle;
+                rectangle.full = 0;
+                rectangle.xh = (rng() % 320) << 2;
+                rectangle.yh = (rng() % 240) << 2;
+                rectangle.xl = rectangle.xh + (rng() % 64 << 2);
+                rectangle.yl = rectangle.yh + (rng() % 64 << 2);
+                if (rng() & 1)
+                {
+                    commands.push_back(command(RDPCommandType::Rectangle, rectangle.full));
+                }
+                else
+                {
+                    auto words = command(RDPCommandType::TextureRectangle, rectangle.full);
+                    words.push_back(rng() & 0x0FFF'0FFF'07FF'07FF);
+                    commands.push_back(words);
+                }
+                break;
+            }
+        }
+    }
+    return commands;
+}
+
+TEST(RDPRenderRows, SpecializedMatchesGeneric)
+{
+    constexpr uint32_t color_address = TRIANGLES_COLOR_ADDRESS;
+    constexpr uint32_t depth_address = TRIANGLES_DEPTH_ADDRESS;
+    constexpr uint32_t depth_size = TRIANGLES_DEPTH_SIZE;
+    std::mt19937_64 rng(0x726f7773);
+    for (int stream = 0; stream < 16; stream++)
+    {
+        auto commands = random_render_modes(rng);
+        TrianglesRDP specialized, generic;
+        auto& specialized_rdram = specialized.rdram;
+        auto& generic_rdram = generic.rdram;
+        std::generate(specialized_rdram.begin() + 0x300000, specialized_rdram.begin() + 0x301000,
+                      [&rng] { return rng(); });
+        std::copy(specialized_rdram.begin() + 0x300000, specialized_rdram.begin() + 0x301000,
+                  generic_rdram.begin() + 0x300000);
+
+        for (const auto& command : commands)
+        {
+            specialized.rdp->SendCommand(command);
+            generic.rdp->SendCommand(command);
+            QA::UseGenericRenderRows(*generic.rdp);
+        }
+
+        auto color = specialized_rdram.begin() + color_address;
+        ASSERT_NE(std::count(color, color + TRIANGLES_COLOR_SIZE, 0), TRIANGLES_COLOR_SIZE);
+        ASSERT_TRUE(std::equal(color, color + TRIANGLES_COLOR_SIZE,
+                               generic_rdram.begin() + color_address))
+            << "stream " << stream;
+        ASSERT_TRUE(std::equal(specialized_rdram.begin() + depth_address,
+                               specialized_rdram.begin() + depth_address + depth_size,
+                               generic_rdram.begin() + depth_address))
+            << "stream " << stream;
+    }
+}
 
-// TRIANGLE_TEST(Simple_Triangle, 0x088002a801180118, 0x00d20000ffff0000, 0x006e000000000000,
-//               0x006e000000000000);
+template <bool Shade, bool Depth, bool Texture>
+static void compare_span_kernels(std::mt19937& rng)
+{
+#if HYDRA_SIMD_AVAILABLE
+    auto random = [&rng](bool small) {
+        return small ? static_cast<int32_t>(rng() % 0x40000) - 0x20000
+                     : static_cast<int32_t>(rng());
+    };
+    for (int i = 0; i < 10000; i++)
+    {
+        // Small steps keep the attributes in range for a while, large ones hit the clamps and
+        // wrap around
+        bool small = i & 1;
+        SpanAttributes start, step;
+        for (int32_t* attribute : {&start.r, &start.g, &start.b, &start.a, &start.s, &start.t,
+                                   &start.w, &start.z})
+        {
+            *attribute = random(false);
+        }
+        for (int32_t* attribute :
+             {&step.r, &step.g, &step.b, &step.a, &step.s, &step.t, &step.w, &step.z})
+        {
+            *attribute = random(small);
+        }
+        if (i % 16 == 0)
+        {
+            // Divisors of zero
+            start.w = 0x7FFF;
+            step.w = 0x1000;
+        }
+        bool perspective = i & 2;
+        int count = rng() % (RDP_SPAN_CHUNK + 1);
+
+        SpanChunk expected{}, actual{};
+        bool expected_zero = interpolate_span_scalar<Shade, Depth, Texture>(
+            start, step, perspective, count, expected);
+        bool actual_zero =
+            interpolate_span_sse<Shade, Depth, Texture>(start, step, perspective, count, actual);
+        ASSERT_EQ(expected_zero, actual_zero);
+        ASSERT_EQ(std::memcmp(&expected, &actual, sizeof(SpanChunk)), 0)
+            << "start.w " << start.w << " step.w " << step.w << " perspective " << perspective;
+    }
+#else
+    (void)rng;
+#endif
+}
+
+TEST(RDPSpan, SIMDMatchesScalar)
+{
+    if (!HYDRA_SIMD_AVAILABLE)
+    {
+        GTEST_SKIP() << "Built without SSE4.1";
+    }
+
+    std::mt19937 rng(0);
+    compare_span_kernels<true, false, false>(rng);
+    compare_span_kernels<false, true, false>(rng);
+    compare_span_kernels<false, false, true>(rng);
+    compare_span_kernels<true, true, true>(rng);
+}
 
-// TRIANGLE_TEST(Simple_Triangle_Flipped, 0x080002a801180118, 0x006e000000010000,
-// 0x00d2000000000000,
-//               0x00d2000000000000);
+TEST(RDPSpan, FillRectangle)
+{
+    // Rows starting on odd and even pixels, and shorter and longer than a vector
+    for (uint32_t size : {2, 3})
+    {
+        for (auto [xh, xl] : {std::pair{0, 319}, std::pair{3, 6}, std::pair{5, 300},
+                              std::pair{7, 8}})
+        {
+            std::vector<uint8_t> rdram(RDRAM_SIZE);
+            auto rdp = std::make_unique<RDP>();
+            rdp->InstallBuses(rdram.data(), nullptr);
+            rdp->Reset();
 
-// TRIANGLE_TEST(Simple_Triangle_Using_YM, 0x08800300016c0118, 0x00d20000ffff0000,
-// 0x006e000000000000,
-//               0x006e00000004c000);
+            SetColorImageCommand color_image;
+            color_image.command = static_cast<uint64_t>(RDPCommandType::SetColorImage);
+            color_image.width = 320 - 1;
+            color_image.size = size;
+            rdp->SendCommand({color_image.full});
+            SetScissorCommand scissor;
+            scissor.command = static_cast<uint64_t>(RDPCommandType::SetScissor);
+            scissor.XL = 320 << 2;
+            scissor.YL = 240 << 2;
+            rdp->SendCommand({scissor.full});
+            SetOtherModesCommand other_modes;
+            other_modes.command = static_cast<uint64_t>(RDPCommandType::SetOtherModes);
+            other_modes.cycle_type = 3;
+            rdp->SendCommand({other_modes.full});
+            rdp->SendCommand(
+                {static_cast<uint64_t>(RDPCommandType::SetFillColor) << 56 | 0x11223344});
+            rdp->SendCommand({static_cast<uint64_t>(RDPCommandType::Rectangle) << 56 |
+                              static_cast<uint64_t>(xl) << 46 | 10ull << 34 |
+                              static_cast<uint64_t>(xh) << 14 | 8ull << 2});
 
-// TRIANGLE_TEST(Slopes_L_H_Intersect_Before_YM_YL, 0x088002a8016800f0, 0x00c80000ffff0000,
-//               0x005a000000010000, 0x00780000ffff0000);
+            // Whatever rows and columns the rectangle covers, the 16-bit fill color alternates
+            // between its halves with the pixel's x
+            uint32_t bytes = 4 << size >> 3;
+            int written = 0;
+            for (int y = 0; y < 12; y++)
+            {
+                for (int x = 0; x < 320; x++)
+                {
+                    uint32_t value = 0;
+                    std::memcpy(&value, &rdram[(y * 320 + x) * bytes], bytes);
+                    if (value == 0)
+                    {
+                        continue;
+                    }
+                    uint32_t expected = size == 3 ? 0x44332211 : (x & 1 ? 0x3344 : 0x1122);
+                    ASSERT_EQ(value, expected) << "x " << x << " y " << y << " size " << size;
+                    ASSERT_TRUE(y >= 8 && y <= 10 && x >= xh && x <= xl);
+                    written++;
+                }
+            }
+            ASSERT_GE(written, 2 * (xl - xh));
+        }
+    }
+}
 
-// TRIANGLE_TEST(Slopes_L_M_Intersect, 0x088002a8011800a0, 0x00d20000ffff0000, 0x006e00000000e000,
-//               0x006e00000004a000);
+TEST(VIConvert, SIMDMatchesScalar)
+{
+    if (!HYDRA_SIMD_AVAILABLE)
+    {
+        GTEST_SKIP() << "Built without SSE2";
+    }
 
-// TRIANGLE_TEST(Slopes_L_M_Intersect_Flipped, 0x080002a8011800a0, 0x006e000000010000,
-//               0x00d20000ffff8000, 0x00d20000fffb4000);
+    // Unaligned rows that don't end on a whole vector
+    std::mt19937 rng(0);
+    constexpr int count = 333;
+    std::vector<uint8_t> src(count * 2 + 1);
+    for (auto& byte : src)
+    {
+        byte = rng();
+    }
+    std::vector<uint32_t> expected(count), actual(count);
+    vi_convert_row16_scalar(src.data() + 1, expected.data(), count);
+#if HYDRA_SIMD_AVAILABLE
+    vi_convert_row16_sse(src.data() + 1, actual.data(), count);
+#endif
+    ASSERT_EQ(expected, actual);
 
-// TRIANGLE_TEST(Same_XH_XM_XL, 0x088002bc02bc0258, 0x00e1000000000000, 0x00e10000fffe0000,
-//               0x00e1000000000000);
+    std::vector<uint16_t> columns(count);
+    for (int i = 0; i < count; i++)
+    {
+        columns[i] = i / 2;
+    }
+    vi_resample_row(expected.data(), actual.data(), columns.data(), count);
+    std::vector<uint32_t> doubled(count);
+    vi_double_row(expected.data(), doubled.data(), count);
+    ASSERT_EQ(doubled, actual);
+}
 
 TEST(RDPCompare, test)
 {
@@ -273,7 +1196,7 @@ TEST(RDPCompare, test)
         AngrylionReplayer::RunCommand(command);
     }
     Framebuffer fb = AngrylionReplayer::GetFramebuffer();
-    std::ofstream file("tex.raw", std::ios::binary);
+    std::ofstream file("/tmp/tex.raw", std::ios::binary);
     file.write(reinterpret_cast<char*>(fb.pixels.data()), fb.pixels.size() * sizeof(uint32_t));
     AngrylionReplayer::Cleanup();
 }
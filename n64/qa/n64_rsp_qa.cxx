@@ -0,0 +1,1530 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <memory>
+#include <n64/core/n64_impl.hxx>
+#include <n64/core/n64_rdp.hxx>
+#include <n64/core/n64_rsp.hxx>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Runs random RSP code on the interpreter and on the recompiler in lockstep, comparing the
+// state after every block. The SIMD vector unit kernels are checked against the scalar ones the
+// same way, one instruction at a time. The HLE and RSP thread tests run small hand written
+// tasks, and the audio HLE is checked against the real microcode when a dump of it is in
+// n64/qa/data.
+
+namespace hydra::N64
+{
+    class QA
+    {
+    public:
+        static constexpr int SEEDS = 64;
+        static constexpr int STEPS = 5000;
+
+        static std::unique_ptr<RSP> MakeRSP(uint32_t seed)
+        {
+            std::mt19937 rng(seed);
+            auto rsp = std::make_unique<RSP>();
+            rsp->Reset();
+            rsp->status_.full = 0;
+            rsp->semaphore_ = false;
+            rsp->mem_addr_ = 0;
+            rsp->dma_imem_ = false;
+            rsp->rdram_addr_ = 0;
+            rsp->rd_len_ = 0;
+            rsp->wr_len_ = 0;
+            rsp->div_in_ = 0;
+            rsp->div_out_ = 0;
+            for (size_t i = 0; i < 0x1000; i++)
+            {
+                rsp->mem_[i] = rng();
+            }
+            for (uint32_t address = 0; address < 0x1000; address += 4)
+            {
+                uint32_t word = hydra::bswap32(random_instruction(rng));
+                std::memcpy(&rsp->mem_[0x1000 + address], &word, sizeof(word));
+            }
+            for (auto& reg : rsp->gpr_regs_)
+            {
+                // Small values now and then so the loads and stores don't all wrap around
+                reg.UW = rng() % 4 == 0 ? rng() & 0xFFF : rng() % 4 == 0 ? 0 : rng();
+            }
+            for (auto& reg : rsp->vu_regs_)
+            {
+                for (auto& lane : reg)
+                {
+                    lane = rng();
+                }
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                rsp->accumulator_[i].Set((static_cast<uint64_t>(rng()) << 32) | rng());
+            }
+            *rsp->vco_ = rng();
+            *rsp->vcc_ = rng();
+            *rsp->vce_ = rng();
+            rsp->div_in_ready_ = false;
+            return rsp;
+        }
+
+        // Same thing RSP::Run does with the recompiler on, one block at a time
+        static int StepRecompiled(RSP& rsp)
+        {
+            int executed = 0;
+            if (rsp.next_pc_ == ((rsp.pc_ + 4) & 0xFFF))
+            {
+                executed = rsp.jit_->Run();
+            }
+            if (executed == 0)
+            {
+                rsp.Tick();
+                executed = 1;
+            }
+            return executed;
+        }
+
+        static testing::AssertionResult SameState(RSP& expected, RSP& actual)
+        {
+            if (expected.pc_ != actual.pc_ || expected.next_pc_ != actual.next_pc_)
+            {
+                return testing::AssertionFailure()
+                       << "pc " << expected.pc_ << "/" << expected.next_pc_ << " vs " << actual.pc_
+                       << "/" << actual.next_pc_;
+            }
+            // r0 is only zeroed when the next instruction starts
+            for (int i = 1; i < 32; i++)
+            {
+                if (expected.gpr_regs_[i].UW != actual.gpr_regs_[i].UW)
+                {
+                    return testing::AssertionFailure()
+                           << "r" << i << " " << expected.gpr_regs_[i].UW << " vs "
+                           << actual.gpr_regs_[i].UW;
+                }
+            }
+            if (expected.vu_regs_ != actual.vu_regs_)
+            {
+                return testing::AssertionFailure() << "vector registers differ";
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                if (expected.accumulator_[i].Get() != actual.accumulator_[i].Get())
+                {
+                    return testing::AssertionFailure() << "accumulator lane " << i << " differs";
+                }
+            }
+            if (*expected.vco_ != *actual.vco_ || *expected.vcc_ != *actual.vcc_ ||
+                *expected.vce_ != *actual.vce_)
+            {
+                return testing::AssertionFailure() << "vector control registers differ";
+            }
+            if (expected.status_.full != actual.status_.full)
+            {
+                return testing::AssertionFailure() << "status differs";
+            }
+            if (std::memcmp(expected.mem_.data(), actual.mem_.data(), expected.mem_.size()) != 0)
+            {
+                return testing::AssertionFailure() << "memory differs";
+            }
+            return testing::AssertionSuccess();
+        }
+
+        static void SetBackend(RSP& rsp, RSPBackend backend)
+        {
+            rsp.SetBackend(backend);
+        }
+
+        static bool HasJit(RSP& rsp)
+        {
+            return rsp.jit_ != nullptr;
+        }
+
+        static void WriteIMEM(RSP& rsp, uint32_t address, const std::vector<uint32_t>& program)
+        {
+            for (size_t i = 0; i < program.size(); i++)
+            {
+                uint32_t word = hydra::bswap32(program[i]);
+                std::memcpy(&rsp.mem_[0x1000 + address + i * 4], &word, sizeof(word));
+            }
+        }
+
+        static void DMAToIMEM(RSP& rsp, uint8_t* rdram, uint32_t rdram_address,
+                              uint32_t imem_address, uint32_t length)
+        {
+            rsp.InstallBuses(rdram, nullptr);
+            rsp.write_hwio(RSPHWIO::Cache, 0x1000 | imem_address);
+            rsp.write_hwio(RSPHWIO::DramAddr, rdram_address);
+            rsp.write_hwio(RSPHWIO::RdLen, length - 1);
+        }
+
+        // length is the raw SP_RD_LEN/SP_WR_LEN value, with the row count and stride
+        static void DMA(RSP& rsp, bool to_rdram, uint32_t sp_address, uint32_t rdram_address,
+                        uint32_t length)
+        {
+            rsp.write_hwio(RSPHWIO::Cache, sp_address);
+            rsp.write_hwio(RSPHWIO::DramAddr, rdram_address);
+            rsp.write_hwio(to_rdram ? RSPHWIO::WrLen : RSPHWIO::RdLen, length);
+        }
+
+        static uint8_t* Memory(RSP& rsp)
+        {
+            return rsp.mem_.data();
+        }
+
+        static uint32_t GPR(RSP& rsp, int index)
+        {
+            return rsp.gpr_regs_[index].UW;
+        }
+
+        static void Jump(RSP& rsp, uint32_t pc)
+        {
+            rsp.pc_ = pc;
+            rsp.next_pc_ = pc + 4;
+            rsp.status_.halt = false;
+        }
+
+        static void Unhalt(RSP& rsp)
+        {
+            rsp.status_.halt = false;
+        }
+
+        static bool IsHalted(RSP& rsp)
+        {
+            return rsp.status_.halt;
+        }
+
+        static void SetVectorSIMD(RSP& rsp, bool enabled)
+        {
+            rsp.SetVectorSIMD(enabled);
+        }
+
+        static void WriteRDRAM32(std::vector<uint8_t>& rdram, uint32_t address, uint32_t value)
+        {
+            uint32_t word = hydra::bswap32(value);
+            std::memcpy(&rdram[address], &word, sizeof(word));
+        }
+
+        static void WriteRDRAM16(std::vector<uint8_t>& rdram, uint32_t address, int16_t value)
+        {
+            rdram[address] = static_cast<uint16_t>(value) >> 8;
+            rdram[address + 1] = static_cast<uint16_t>(value);
+        }
+
+        static uint16_t ReadRDRAM16(const std::vector<uint8_t>& rdram, uint32_t address)
+        {
+            return (rdram[address] << 8) | rdram[address + 1];
+        }
+
+        // Random taps after the first phase, which is what the HLE looks for
+        static std::array<int16_t, RESAMPLE_TABLE_ENTRIES> ResampleTable(std::mt19937& rng)
+        {
+            std::array<int16_t, RESAMPLE_TABLE_ENTRIES> table;
+            for (auto& tap : table)
+            {
+                tap = static_cast<int16_t>(rng() % 0x8000 - 0x4000);
+            }
+            constexpr std::array<int16_t, 4> first_phase = {0x0C39, 0x66AD, 0x0D46, -0x21};
+            std::copy(first_phase.begin(), first_phase.end(), table.begin());
+            return table;
+        }
+
+        // An ABI1 data segment: the words that identify it and a RESAMPLE table
+        static void WriteABI1Data(std::vector<uint8_t>& rdram, uint32_t address,
+                                  const std::array<int16_t, RESAMPLE_TABLE_ENTRIES>& table)
+        {
+            WriteRDRAM32(rdram, address, 0x0000'0001);
+            WriteRDRAM32(rdram, address + 0x28, 0x1E24'138C);
+            WriteRDRAM32(rdram, address + 0x30, 0xF000'0F00);
+            for (size_t i = 0; i < table.size(); i++)
+            {
+                WriteRDRAM16(rdram, address + 0x100 + i * 2, table[i]);
+            }
+        }
+
+        // What rspboot does before jumping to the microcode, which is linked to run from
+        // IMEM 0x080 with its data segment at the start of DMEM
+        static void BootMicrocode(RSP& rsp, const std::vector<uint8_t>& text,
+                                  const std::vector<uint8_t>& data,
+                                  const std::array<uint32_t, 16>& task)
+        {
+            std::memcpy(&rsp.mem_[0x1080], text.data(), std::min<size_t>(text.size(), 0xF80));
+            std::memcpy(&rsp.mem_[0], data.data(), std::min<size_t>(data.size(), 0xFC0));
+            for (size_t i = 0; i < task.size(); i++)
+            {
+                uint32_t word = hydra::bswap32(task[i]);
+                std::memcpy(&rsp.mem_[HLETask::DMEM_ADDRESS + i * 4], &word, sizeof(word));
+            }
+            Start(rsp, 0x080);
+        }
+
+        // Leaves an OSTask in DMEM and starts the RSP on it the way osSpTaskStartGo does
+        static void StartTask(RSP& rsp, const std::array<uint32_t, 16>& task)
+        {
+            for (size_t i = 0; i < task.size(); i++)
+            {
+                uint32_t word = hydra::bswap32(task[i]);
+                std::memcpy(&rsp.mem_[HLETask::DMEM_ADDRESS + i * 4], &word, sizeof(word));
+            }
+            rsp.pc_ = 0;
+            rsp.next_pc_ = 4;
+            rsp.status_.full = 0;
+            rsp.status_.halt = true;
+            RSPStatusWrite write;
+            write.full = 0;
+            write.clear_halt = true;
+            write.set_intr_break = true;
+            rsp.write_hwio(RSPHWIO::Status, write.full);
+        }
+
+        // Starts the RSP at pc the way the CPU does, through SP_PC and SP_STATUS
+        static void Start(RSP& rsp, uint32_t pc)
+        {
+            rsp.pc_ = pc;
+            rsp.next_pc_ = pc + 4;
+            RSPStatusWrite write;
+            write.full = 0;
+            write.clear_halt = true;
+            write.clear_broke = true;
+            write.set_intr_break = true;
+            rsp.write_hwio(RSPHWIO::Status, write.full);
+        }
+
+        static RSPStatus Status(RSP& rsp)
+        {
+            return rsp.status_;
+        }
+
+        static RSP& GetRSP(N64& n64)
+        {
+            return n64.rcp_.rsp_;
+        }
+
+        static uint32_t CPULoadWord(N64& n64, uint64_t vaddr)
+        {
+            return n64.cpu_.load_word(vaddr);
+        }
+
+        static void CPUStoreWord(N64& n64, uint64_t vaddr, uint32_t value)
+        {
+            n64.cpu_.store_word(vaddr, value);
+        }
+
+        static bool IsSliceScheduled(N64& n64)
+        {
+            return n64.cpubus_.scheduler_.IsScheduled(EventType::RSPSlice);
+        }
+
+        // Like the scheduler does when the slice is due
+        static void RunSlice(N64& n64)
+        {
+            n64.cpubus_.scheduler_.Deschedule(EventType::RSPSlice);
+            n64.handle_event(EventType::RSPSlice);
+        }
+
+        // Vector registers, accumulator and flags, with the values the clamping and carries
+        // care about showing up often
+        static void RandomizeVectorState(RSP& rsp, std::mt19937& rng)
+        {
+            constexpr std::array<uint16_t, 8> edges = {0x0000, 0x0001, 0x7FFF, 0x8000,
+                                                       0x8001, 0xFFFF, 0xFFFE, 0x4000};
+            auto random_lane = [&rng, &edges]() -> uint16_t {
+                return rng() % 3 == 0 ? edges[rng() % edges.size()] : rng();
+            };
+            for (auto& reg : rsp.vu_regs_)
+            {
+                for (auto& lane : reg)
+                {
+                    lane = random_lane();
+                }
+            }
+            for (int i = 0; i < 8; i++)
+            {
+                rsp.accumulator_.high[i] = random_lane();
+                rsp.accumulator_.middle[i] = random_lane();
+                rsp.accumulator_.low[i] = random_lane();
+            }
+            *rsp.vco_ = rng();
+            *rsp.vcc_ = rng();
+            *rsp.vce_ = rng();
+            rsp.div_in_ = rng();
+            rsp.div_out_ = rng();
+            rsp.div_in_ready_ = rng() & 1;
+        }
+
+        static void CopyVectorState(const RSP& from, RSP& to)
+        {
+            to.vu_regs_ = from.vu_regs_;
+            to.accumulator_.high = from.accumulator_.high;
+            to.accumulator_.middle = from.accumulator_.middle;
+            to.accumulator_.low = from.accumulator_.low;
+            to.vco_ = from.vco_;
+            to.vcc_ = from.vcc_;
+            to.vce_ = from.vce_;
+            to.div_in_ = from.div_in_;
+            to.div_out_ = from.div_out_;
+            to.div_in_ready_ = from.div_in_ready_;
+        }
+
+        static void ExecuteVector(RSP& rsp, uint32_t instruction)
+        {
+            rsp.instruction_.full = instruction;
+            rsp.COP2();
+        }
+
+        static testing::AssertionResult SameVectorState(RSP& expected, RSP& actual)
+        {
+            for (int reg = 0; reg < 32; reg++)
+            {
+                for (int lane = 0; lane < 8; lane++)
+                {
+                    if (expected.vu_regs_[reg][lane] != actual.vu_regs_[reg][lane])
+                    {
+                        return testing::AssertionFailure()
+                               << "v" << reg << " lane " << lane << " "
+                               << expected.vu_regs_[reg][lane] << " vs "
+                               << actual.vu_regs_[reg][lane];
+                    }
+                }
+            }
+            for (int lane = 0; lane < 8; lane++)
+            {
+                if (expected.accumulator_[lane].Get() != actual.accumulator_[lane].Get())
+                {
+                    return testing::AssertionFailure()
+                           << "accumulator lane " << lane << " " << std::hex
+                           << expected.accumulator_[lane].Get() << " vs "
+                           << actual.accumulator_[lane].Get();
+                }
+            }
+            for (int lane = 0; lane < 8; lane++)
+            {
+                if (expected.vco_.GetLow(lane) != actual.vco_.GetLow(lane) ||
+                    expected.vco_.GetHigh(lane) != actual.vco_.GetHigh(lane) ||
+                    expected.vcc_.GetLow(lane) != actual.vcc_.GetLow(lane) ||
+                    expected.vcc_.GetHigh(lane) != actual.vcc_.GetHigh(lane) ||
+                    expected.vce_.Get(lane) != actual.vce_.Get(lane))
+                {
+                    return testing::AssertionFailure() << "flags differ in lane " << lane;
+                }
+            }
+            if (expected.div_in_ != actual.div_in_ || expected.div_out_ != actual.div_out_ ||
+                expected.div_in_ready_ != actual.div_in_ready_)
+            {
+                return testing::AssertionFailure() << "divide state differs";
+            }
+            return testing::AssertionSuccess();
+        }
+
+    private:
+        static uint32_t r_type(uint32_t rs, uint32_t rt, uint32_t rd, uint32_t sa, uint32_t func)
+        {
+            return (rs << 21) | (rt << 16) | (rd << 11) | (sa << 6) | func;
+        }
+
+        static uint32_t i_type(uint32_t op, uint32_t rs, uint32_t rt, uint32_t immediate)
+        {
+            return (op << 26) | (rs << 21) | (rt << 16) | (immediate & 0xFFFF);
+        }
+
+        static uint32_t random_instruction(std::mt19937& rng)
+        {
+            constexpr std::array<uint32_t, 16> alu = {0x00, 0x02, 0x03, 0x04, 0x06, 0x07,
+                                                      0x20, 0x21, 0x22, 0x23, 0x24, 0x25,
+                                                      0x26, 0x27, 0x2A, 0x2B};
+            constexpr std::array<uint32_t, 7> immediates = {0x09, 0x0A, 0x0B, 0x0C,
+                                                            0x0D, 0x0E, 0x0F};
+            constexpr std::array<uint32_t, 9> memory = {0x20, 0x21, 0x23, 0x24, 0x25,
+                                                        0x27, 0x28, 0x29, 0x2B};
+            constexpr std::array<uint32_t, 9> vector_memory = {0x0, 0x1, 0x2, 0x3, 0x4,
+                                                               0x5, 0x6, 0x7, 0xB};
+            // Status is left alone as it raises interrupts
+            constexpr std::array<uint32_t, 5> cop0_writable = {0, 1, 5, 6, 7};
+            // r0 often enough to hit the special cases for it
+            uint32_t rs = rng() % 4 == 0 ? 0 : rng() & 31;
+            uint32_t rt = rng() % 4 == 0 ? 0 : rng() & 31;
+            uint32_t rd = rng() & 31;
+            uint32_t sa = rng() & 31;
+            uint32_t immediate = rng();
+            uint32_t kind = rng() % 100;
+            if (kind < 30)
+            {
+                return r_type(rs, rt, rd, sa, alu[rng() % alu.size()]);
+            }
+            if (kind < 45)
+            {
+                return i_type(immediates[rng() % immediates.size()], rs, rt, immediate);
+            }
+            if (kind < 47)
+            {
+                // ADDI from r0 can't overflow
+                return i_type(0x08, 0, rt, immediate);
+            }
+            if (kind < 60)
+            {
+                if (rng() % 4 == 0)
+                {
+                    // Right at the end of DMEM, where accesses wrap around
+                    immediate = 0xFFC + rng() % 4;
+                }
+                return i_type(memory[rng() % memory.size()], rs, rt, immediate);
+            }
+            if (kind < 70)
+            {
+                // Short branches, so that loops happen
+                constexpr std::array<uint32_t, 4> branches = {0x04, 0x05, 0x06, 0x07};
+                uint32_t offset = static_cast<uint32_t>(static_cast<int>(rng() % 32) - 16);
+                if (rng() % 3 == 0)
+                {
+                    constexpr std::array<uint32_t, 4> regimm = {0x00, 0x01, 0x10, 0x11};
+                    return i_type(0x01, rs, regimm[rng() % regimm.size()], offset);
+                }
+                return i_type(branches[rng() % branches.size()], rs, rt, offset);
+            }
+            if (kind < 73)
+            {
+                return ((0x02 + (rng() & 1)) << 26) | (rng() & 0x3FF'FFFF);
+            }
+            if (kind < 75)
+            {
+                return r_type(rs, 0, rd, 0, 0x08 + (rng() & 1));
+            }
+            if (kind < 85)
+            {
+                // Vector computational instructions
+                return (0x12 << 26) | (1 << 25) | ((rng() & 0xF) << 21) | (rt << 16) |
+                       (rd << 11) | (sa << 6) | (rng() & 0x3F);
+            }
+            if (kind < 89)
+            {
+                // MFC2, CFC2, MTC2 and CTC2
+                return (0x12 << 26) | ((rng() % 4 * 2) << 21) | (rt << 16) | (rd << 11) |
+                       ((rng() & 0xF) << 7);
+            }
+            if (kind < 97)
+            {
+                uint32_t op = rng() & 1 ? 0x32 : 0x3A;
+                // Element 0 often enough for whole register LQV and SQV
+                uint32_t element = rng() % 4 == 0 ? 0 : rng() & 0xF;
+                return (op << 26) | (rs << 21) | (rt << 16) |
+                       (vector_memory[rng() % vector_memory.size()] << 11) | (element << 7) |
+                       (rng() & 0x7F);
+            }
+            if (kind < 98)
+            {
+                // MFC0
+                return (0x10 << 26) | (rt << 16) | ((rng() % 8) << 11);
+            }
+            if (kind < 99)
+            {
+                // MTC0
+                return (0x10 << 26) | (4 << 21) | (rt << 16) |
+                       (cop0_writable[rng() % cop0_writable.size()] << 11);
+            }
+            return 0x0000'000D; // BREAK
+        }
+    };
+} // namespace hydra::N64
+
+using hydra::N64::HLETask;
+using hydra::N64::QA;
+using hydra::N64::RSPBackend;
+
+TEST(RSPJit, MatchesInterpreter)
+{
+    auto probe = QA::MakeRSP(0);
+    QA::SetBackend(*probe, RSPBackend::Dynarec);
+    if (!QA::HasJit(*probe))
+    {
+        GTEST_SKIP() << "Built without the recompiler";
+    }
+
+    for (uint32_t seed = 0; seed < QA::SEEDS; seed++)
+    {
+        auto expected = QA::MakeRSP(seed);
+        auto actual = QA::MakeRSP(seed);
+        QA::SetBackend(*actual, RSPBackend::Dynarec);
+        for (int step = 0; step < QA::STEPS; step++)
+        {
+            int executed = QA::StepRecompiled(*actual);
+            for (int i = 0; i < executed; i++)
+            {
+                expected->Tick();
+            }
+            ASSERT_TRUE(QA::SameState(*expected, *actual)) << "seed " << seed << " step " << step;
+            if (QA::IsHalted(*expected))
+            {
+                QA::Unhalt(*expected);
+                QA::Unhalt(*actual);
+            }
+        }
+    }
+}
+
+TEST(RSPJit, NewCodeAfterDMA)
+{
+    auto rsp = QA::MakeRSP(0);
+    QA::SetBackend(*rsp, RSPBackend::Dynarec);
+    if (!QA::HasJit(*rsp))
+    {
+        GTEST_SKIP() << "Built without the recompiler";
+    }
+
+    // addiu r1, r0, value followed by a break, first from the CPU side then over DMA
+    auto program = [](uint16_t value) {
+        return std::vector<uint32_t>{0x2401'0000u | value, 0x0000'000D};
+    };
+    QA::WriteIMEM(*rsp, 0x100, program(1));
+    QA::Jump(*rsp, 0x100);
+    rsp->Run(100);
+    ASSERT_TRUE(QA::IsHalted(*rsp));
+    ASSERT_EQ(QA::GPR(*rsp, 1), 1u);
+
+    std::vector<uint8_t> rdram(0x1000);
+    std::vector<uint32_t> replacement = program(2);
+    for (size_t i = 0; i < replacement.size(); i++)
+    {
+        uint32_t word = hydra::bswap32(replacement[i]);
+        std::memcpy(&rdram[0x800 + i * 4], &word, sizeof(word));
+    }
+    QA::DMAToIMEM(*rsp, rdram.data(), 0x800, 0x100, 8);
+    QA::Jump(*rsp, 0x100);
+    rsp->Run(100);
+    ASSERT_TRUE(QA::IsHalted(*rsp));
+    ASSERT_EQ(QA::GPR(*rsp, 1), 2u);
+}
+
+TEST(RSPDMA, RowsWrapAround)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    auto rsp = QA::MakeRSP(0);
+    rsp->InstallBuses(rdram.data(), nullptr);
+    std::vector<std::pair<uint32_t, uint32_t>> writes;
+    rsp->SetRDRAMWriteCallback(
+        [&writes](uint32_t address, uint32_t length) { writes.emplace_back(address, length); });
+    std::vector<uint8_t> dmem(QA::Memory(*rsp), QA::Memory(*rsp) + 0x1000);
+
+    // 3 rows of 0x18 bytes 0x10 apart, the second one wraps around the end of DMEM
+    constexpr uint32_t rdram_address = 0x2000;
+    QA::DMA(*rsp, true, 0xFE0, rdram_address, (0x10 << 20) | (2 << 12) | 0x17);
+    uint32_t sp = 0xFE0, ram = rdram_address;
+    for (int row = 0; row < 3; row++)
+    {
+        for (int i = 0; i < 0x18; i++)
+        {
+            ASSERT_EQ(rdram[ram++], dmem[sp++ & 0xFFF]) << "row " << row << " byte " << i;
+        }
+        ram += 0x10;
+    }
+    ASSERT_EQ(writes.size(), 3u);
+    ASSERT_EQ(writes[1], std::make_pair(rdram_address + 0x28, 0x18u));
+
+    // Back into IMEM in a single row, which is reported as one write on the way out
+    QA::DMA(*rsp, false, 0x1000, rdram_address, (0x10 << 20) | (2 << 12) | 0x17);
+    for (int i = 0; i < 0x18 * 3; i++)
+    {
+        ASSERT_EQ(QA::Memory(*rsp)[0x1000 + i], dmem[(0xFE0 + i) & 0xFFF]) << "byte " << i;
+    }
+    writes.clear();
+    QA::DMA(*rsp, true, 0x1000, 0x4000, 0x47);
+    ASSERT_EQ(writes.size(), 1u);
+    ASSERT_EQ(writes[0], std::make_pair(0x4000u, 0x48u));
+}
+
+TEST(RSPVectorUnit, SIMDMatchesScalar)
+{
+    if (!HYDRA_SIMD_AVAILABLE)
+    {
+        GTEST_SKIP() << "Built without SSE4.1";
+    }
+
+    auto scalar = QA::MakeRSP(0);
+    auto simd = QA::MakeRSP(0);
+    QA::SetVectorSIMD(*scalar, false);
+    QA::SetVectorSIMD(*simd, true);
+    std::mt19937 rng(0);
+    for (uint32_t func = 0; func < 64; func++)
+    {
+        for (uint32_t element = 0; element < 16; element++)
+        {
+            for (int i = 0; i < 64; i++)
+            {
+                QA::RandomizeVectorState(*scalar, rng);
+                QA::CopyVectorState(*scalar, *simd);
+                // A handful of registers so that vd, vs and vt overlap now and then
+                uint32_t vt = rng() % 4, vs = rng() % 4, vd = rng() % 4;
+                uint32_t instruction = (0x12 << 26) | (1 << 25) | (element << 21) | (vt << 16) |
+                                       (vs << 11) | (vd << 6) | func;
+                QA::ExecuteVector(*scalar, instruction);
+                QA::ExecuteVector(*simd, instruction);
+                ASSERT_TRUE(QA::SameVectorState(*scalar, *simd))
+                    << "func " << func << " element " << element << " iteration " << i;
+            }
+        }
+    }
+}
+
+TEST(RSPHLE, UnknownMicrocodeRunsOnRSP)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    auto rsp = QA::MakeRSP(0);
+    rsp->InstallBuses(rdram.data(), nullptr);
+    rsp->SetHLE(true);
+    // Audio task whose data segment is all zeroes
+    std::array<uint32_t, 16> task{};
+    task[0] = HLETask::AUDIO;
+    task[6] = 0x1000;
+    task[7] = 0x800;
+    QA::StartTask(*rsp, task);
+    ASSERT_FALSE(QA::Status(*rsp).halt);
+    ASSERT_FALSE(QA::Status(*rsp).broke);
+}
+
+TEST(RSPHLE, AudioMixAndSave)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    hydra::N64::MIInterrupt interrupt;
+    std::vector<std::pair<uint32_t, uint32_t>> written;
+    auto rsp = QA::MakeRSP(0);
+    rsp->InstallBuses(rdram.data(), nullptr);
+    rsp->SetMIPtr(&interrupt);
+    rsp->SetRDRAMWriteCallback(
+        [&written](uint32_t address, uint32_t length) { written.push_back({address, length}); });
+    rsp->SetHLE(true);
+
+    std::mt19937 rng(0);
+    QA::WriteABI1Data(rdram, 0x1000, QA::ResampleTable(rng));
+
+    std::array<int16_t, 16> input;
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        input[i] = static_cast<int16_t>(i * 2001 - 15000);
+        QA::WriteRDRAM16(rdram, 0x3000 + i * 2, input[i]);
+    }
+
+    const std::vector<std::pair<uint32_t, uint32_t>> alist = {
+        {0x0800'0000, 0x0100'0020}, // SETBUFF in 0, out 0x100, 32 bytes
+        {0x0400'0000, 0x0000'3000}, // LOADBUFF
+        {0x0200'0100, 0x0000'0020}, // CLEARBUFF out
+        {0x0C00'4000, 0x0000'0100}, // MIXER in into out at half volume
+        {0x0C00'7FFF, 0x0000'0100}, // MIXER in into out at full volume, clamps
+        {0x0600'0000, 0x0000'4000}, // SAVEBUFF
+    };
+    for (size_t i = 0; i < alist.size(); i++)
+    {
+        QA::WriteRDRAM32(rdram, 0x2000 + i * 8, alist[i].first);
+        QA::WriteRDRAM32(rdram, 0x2000 + i * 8 + 4, alist[i].second);
+    }
+
+    std::array<uint32_t, 16> task{};
+    task[0] = HLETask::AUDIO;
+    task[6] = 0x1000;
+    task[7] = 0x800;
+    task[12] = 0x2000;
+    task[13] = alist.size() * 8;
+    QA::StartTask(*rsp, task);
+
+    ASSERT_TRUE(QA::Status(*rsp).halt);
+    ASSERT_TRUE(QA::Status(*rsp).broke);
+    ASSERT_TRUE(QA::Status(*rsp).signal_2);
+    ASSERT_TRUE(interrupt.SP);
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        int32_t half = (input[i] * 0x4000 + 0x4000) >> 15;
+        int32_t full = (input[i] * 0x7FFF + 0x4000) >> 15;
+        int16_t expected = std::clamp(half + full, -32768, 32767);
+        ASSERT_EQ(static_cast<int16_t>(QA::ReadRDRAM16(rdram, 0x4000 + i * 2)), expected)
+            << "sample " << i;
+    }
+    ASSERT_EQ(written.size(), 1u);
+    ASSERT_EQ(written[0], std::make_pair(0x4000u, 0x20u));
+}
+
+namespace
+{
+    void write_commands(std::vector<uint8_t>& rdram, uint32_t address,
+                        const std::vector<std::pair<uint32_t, uint32_t>>& commands)
+    {
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            QA::WriteRDRAM32(rdram, address + i * 8, commands[i].first);
+            QA::WriteRDRAM32(rdram, address + i * 8 + 4, commands[i].second);
+        }
+    }
+
+    // Runs an ABI1 audio list at 0x2000 with the data segment at 0x1000
+    void run_audio(std::vector<uint8_t>& rdram,
+                   const std::vector<std::pair<uint32_t, uint32_t>>& alist)
+    {
+        hydra::N64::MIInterrupt interrupt;
+        auto rsp = QA::MakeRSP(0);
+        rsp->InstallBuses(rdram.data(), nullptr);
+        rsp->SetMIPtr(&interrupt);
+        rsp->SetHLE(true);
+        std::mt19937 rng(0);
+        QA::WriteABI1Data(rdram, 0x1000, QA::ResampleTable(rng));
+        write_commands(rdram, 0x2000, alist);
+
+        std::array<uint32_t, 16> task{};
+        task[0] = HLETask::AUDIO;
+        task[6] = 0x1000;
+        task[7] = 0x800;
+        task[12] = 0x2000;
+        task[13] = alist.size() * 8;
+        QA::StartTask(*rsp, task);
+        ASSERT_TRUE(QA::Status(*rsp).broke);
+    }
+
+    template <size_t N>
+    void expect_samples(const std::vector<uint8_t>& rdram, uint32_t address,
+                        const std::array<int16_t, N>& expected)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            EXPECT_EQ(static_cast<int16_t>(QA::ReadRDRAM16(rdram, address + i * 2)), expected[i])
+                << "sample " << i << " at " << std::hex << address;
+        }
+    }
+} // namespace
+
+TEST(RSPHLE, AudioADPCM)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    // Codebook 0 predicts each sample as the last one of the previous half plus the residuals
+    // so far, so the output is a running sum
+    for (int i = 0; i < 8; i++)
+    {
+        QA::WriteRDRAM16(rdram, 0x7000 + i * 2, 0);
+        QA::WriteRDRAM16(rdram, 0x7010 + i * 2, 0x800);
+    }
+    // Scale 8 leaves residuals of a nibble times 256
+    const std::array<uint8_t, 9> frame = {0x80, 0x12, 0x34, 0x7F, 0x88, 0x00, 0xF1, 0x21, 0x00};
+    std::copy(frame.begin(), frame.end(), rdram.begin() + 0x3000);
+
+    run_audio(rdram, {
+                         {0x0B00'0020, 0x0000'7000}, // LOADADPCM 16 entries
+                         {0x0800'0000, 0x0100'0020}, // SETBUFF in 0, out 0x100, 32 bytes
+                         {0x0400'0000, 0x0000'3000}, // LOADBUFF
+                         {0x0101'0000, 0x0000'5000}, // ADPCM, first frame
+                         {0x0800'0000, 0x0100'0040}, // SETBUFF out 0x100, 64 bytes
+                         {0x0600'0000, 0x0000'4000}, // SAVEBUFF
+                         {0x0800'0000, 0x0100'0020}, // SETBUFF in 0, out 0x100, 32 bytes
+                         {0x0100'0000, 0x0000'5000}, // ADPCM, continuing from the state
+                         {0x0800'0000, 0x0100'0040}, // SETBUFF out 0x100, 64 bytes
+                         {0x0600'0000, 0x0000'4040}, // SAVEBUFF
+                     });
+
+    // The previous frame comes first, all zeroes on the first one
+    const std::array<int16_t, 32> first = {
+        0,   0,   0,    0,    0,    0,    0,    0,   0,   0,   0,    0, 0,   0,   0,   0,
+        256, 768, 1536, 2560, 4352, 4096, 2048, 0,   0,   0,   -256, 0, 512, 768, 768, 768,
+    };
+    const std::array<int16_t, 32> second = {
+        256,  768,  1536, 2560, 4352, 4096, 2048, 0,   0,   0,   -256, 0,    512,  768,  768,  768,
+        1024, 1536, 2304, 3328, 5120, 4864, 2816, 768, 768, 768, 512,  768,  1280, 1536, 1536, 1536,
+    };
+    expect_samples(rdram, 0x4000, first);
+    expect_samples(rdram, 0x4040, second);
+    std::array<int16_t, 16> state;
+    std::copy(second.begin() + 16, second.end(), state.begin());
+    expect_samples(rdram, 0x5000, state);
+}
+
+TEST(RSPHLE, AudioEnvelopeMixer)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    for (int i = 0; i < 16; i++)
+    {
+        QA::WriteRDRAM16(rdram, 0x3000 + i * 2, i % 2 ? -0x4000 : 0x4000);
+    }
+
+    run_audio(rdram, {
+                         {0x0906'1000, 0x0000'0000}, // SETVOL left volume 0x1000
+                         {0x0902'4000, 0x0002'0000}, // SETVOL left target 0x4000, rate 2
+                         {0x0904'2000, 0x0000'0000}, // SETVOL right volume 0x2000
+                         {0x0900'2000, 0x0001'0000}, // SETVOL right target 0x2000, rate 1
+                         {0x0908'7FFF, 0x0000'0000}, // SETVOL dry 0x7FFF, wet 0
+                         {0x0808'0200, 0x0300'0400}, // SETBUFF dry right 0x200
+                         {0x0800'0000, 0x0100'0020}, // SETBUFF in 0, out 0x100, 32 bytes
+                         {0x0400'0000, 0x0000'3000}, // LOADBUFF
+                         {0x0200'0100, 0x0000'0020}, // CLEARBUFF dry left
+                         {0x0200'0200, 0x0000'0020}, // CLEARBUFF dry right
+                         {0x0301'0000, 0x0000'5000}, // ENVMIXER
+                         {0x0600'0000, 0x0000'4000}, // SAVEBUFF dry left
+                         {0x0800'0000, 0x0200'0020}, // SETBUFF out 0x200
+                         {0x0600'0000, 0x0000'4020}, // SAVEBUFF dry right
+                     });
+
+    // The left volume ramps up from 0x1000 in steps of 0x600 and stops at 0x4000, the right one
+    // stays put. At full dry gain a volume of 0x4000 halves the input
+    const std::array<int16_t, 16> left = {
+        0x0B00, -0x0E00, 0x1100, -0x1400, 0x1700, -0x1A00, 0x1D00, -0x2000,
+        0x2000, -0x2000, 0x2000, -0x2000, 0x2000, -0x2000, 0x2000, -0x2000,
+    };
+    const std::array<int16_t, 16> right = {
+        0x1000, -0x1000, 0x1000, -0x1000, 0x1000, -0x1000, 0x1000, -0x1000,
+        0x1000, -0x1000, 0x1000, -0x1000, 0x1000, -0x1000, 0x1000, -0x1000,
+    };
+    expect_samples(rdram, 0x4000, left);
+    expect_samples(rdram, 0x4020, right);
+}
+
+TEST(RSPHLE, AudioInterleave)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    for (int i = 0; i < 8; i++)
+    {
+        QA::WriteRDRAM16(rdram, 0x3000 + i * 2, i + 1);
+        QA::WriteRDRAM16(rdram, 0x3010 + i * 2, -(i + 1));
+    }
+
+    run_audio(rdram, {
+                         {0x0800'0000, 0x0100'0020}, // SETBUFF in 0, out 0x100, 32 bytes
+                         {0x0400'0000, 0x0000'3000}, // LOADBUFF left and right
+                         {0x0800'0000, 0x0100'0010}, // SETBUFF out 0x100, 16 bytes a side
+                         {0x0D00'0000, 0x0000'0010}, // INTERLEAVE left 0, right 0x10
+                         {0x0800'0000, 0x0100'0020}, // SETBUFF out 0x100, 32 bytes
+                         {0x0600'0000, 0x0000'4000}, // SAVEBUFF
+                     });
+
+    const std::array<int16_t, 16> expected = {1, -1, 2, -2, 3, -3, 4, -4,
+                                              5, -5, 6, -6, 7, -7, 8, -8};
+    expect_samples(rdram, 0x4000, expected);
+}
+
+TEST(RSPHLE, AudioWithoutResampleTableRunsOnRSP)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    auto rsp = QA::MakeRSP(0);
+    rsp->InstallBuses(rdram.data(), nullptr);
+    rsp->SetHLE(true);
+    // The words that identify ABI1 but no table to resample with
+    QA::WriteRDRAM32(rdram, 0x1000, 0x0000'0001);
+    QA::WriteRDRAM32(rdram, 0x1028, 0x1E24'138C);
+    QA::WriteRDRAM32(rdram, 0x1030, 0xF000'0F00);
+    std::array<uint32_t, 16> task{};
+    task[0] = HLETask::AUDIO;
+    task[6] = 0x1000;
+    task[7] = 0x800;
+    QA::StartTask(*rsp, task);
+    ASSERT_FALSE(QA::Status(*rsp).halt);
+    ASSERT_FALSE(QA::Status(*rsp).broke);
+}
+
+TEST(RSPHLE, AudioResampleUsesMicrocodeTable)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    hydra::N64::MIInterrupt interrupt;
+    auto rsp = QA::MakeRSP(0);
+    rsp->InstallBuses(rdram.data(), nullptr);
+    rsp->SetMIPtr(&interrupt);
+    rsp->SetHLE(true);
+
+    std::mt19937 rng(1);
+    auto table = QA::ResampleTable(rng);
+    QA::WriteABI1Data(rdram, 0x1000, table);
+
+    // Four samples of history from a previous task, then the input
+    std::array<int16_t, 4 + 32> samples;
+    for (auto& sample : samples)
+    {
+        sample = static_cast<int16_t>(rng());
+    }
+    for (size_t i = 0; i < 4; i++)
+    {
+        QA::WriteRDRAM16(rdram, 0x5000 + i * 2, samples[i]);
+    }
+    constexpr uint16_t start = 0x1234;
+    QA::WriteRDRAM16(rdram, 0x5008, start);
+    for (size_t i = 4; i < samples.size(); i++)
+    {
+        QA::WriteRDRAM16(rdram, 0x3000 + (i - 4) * 2, samples[i]);
+    }
+
+    // 1.375 input samples for every output sample, 16 out of 22 in
+    constexpr uint32_t pitch = 0xB000;
+    const std::vector<std::pair<uint32_t, uint32_t>> alist = {
+        {0x0800'0010, 0x0000'0040}, // SETBUFF in 0x10, 64 bytes
+        {0x0400'0000, 0x0000'3000}, // LOADBUFF
+        {0x0800'0010, 0x0100'0020}, // SETBUFF in 0x10, out 0x100, 32 bytes
+        {0x0500'0000 | pitch, 0x0000'5000}, // RESAMPLE from the saved state
+        {0x0600'0000, 0x0000'4000}, // SAVEBUFF
+    };
+    for (size_t i = 0; i < alist.size(); i++)
+    {
+        QA::WriteRDRAM32(rdram, 0x2000 + i * 8, alist[i].first);
+        QA::WriteRDRAM32(rdram, 0x2000 + i * 8 + 4, alist[i].second);
+    }
+
+    std::array<uint32_t, 16> task{};
+    task[0] = HLETask::AUDIO;
+    task[6] = 0x1000;
+    task[7] = 0x800;
+    task[12] = 0x2000;
+    task[13] = alist.size() * 8;
+    QA::StartTask(*rsp, task);
+    ASSERT_TRUE(QA::Status(*rsp).broke);
+
+    uint32_t accumulator = start;
+    size_t position = 0;
+    for (size_t i = 0; i < 16; i++)
+    {
+        const int16_t* taps = &table[(accumulator >> 10) * 4];
+        int32_t value = 0;
+        for (size_t k = 0; k < 4; k++)
+        {
+            value += samples[position + k] * taps[k];
+        }
+        int16_t expected = std::clamp(value >> 15, -32768, 32767);
+        ASSERT_EQ(static_cast<int16_t>(QA::ReadRDRAM16(rdram, 0x4000 + i * 2)), expected)
+            << "sample " << i;
+        accumulator += pitch << 1;
+        position += accumulator >> 16;
+        accumulator &= 0xFFFF;
+    }
+    for (size_t k = 0; k < 4; k++)
+    {
+        ASSERT_EQ(static_cast<int16_t>(QA::ReadRDRAM16(rdram, 0x5000 + k * 2)),
+                  samples[position + k])
+            << "history " << k;
+    }
+    ASSERT_EQ(QA::ReadRDRAM16(rdram, 0x5008), accumulator);
+}
+
+TEST(RSPHLE, AudioResampleMatchesMicrocode)
+{
+    // The microcode can't be redistributed, dump the text and data segments of a game's ABI1
+    // audio microcode to run this
+    std::ifstream text_file("n64/qa/data/abi1_ucode.bin", std::ios::binary);
+    std::ifstream data_file("n64/qa/data/abi1_ucode_data.bin", std::ios::binary);
+    if (!text_file || !data_file)
+    {
+        GTEST_SKIP() << "No ABI1 microcode in n64/qa/data";
+    }
+    std::vector<uint8_t> text(std::istreambuf_iterator<char>(text_file), {});
+    std::vector<uint8_t> data(std::istreambuf_iterator<char>(data_file), {});
+
+    std::vector<uint8_t> initial(hydra::N64::RDRAM_EXPANSION_SIZE);
+    std::copy(text.begin(), text.end(), initial.begin() + 0x10000);
+    std::copy(data.begin(), data.end(), initial.begin() + 0x20000);
+    std::mt19937 rng(2);
+    for (uint32_t i = 0; i < 0x100; i += 2)
+    {
+        QA::WriteRDRAM16(initial, 0x3000 + i, static_cast<int16_t>(rng()));
+    }
+    for (uint32_t i = 0; i < 10; i += 2)
+    {
+        QA::WriteRDRAM16(initial, 0x5000 + i, static_cast<int16_t>(rng()));
+    }
+
+    // A fresh start and a continued one for each pitch, below and above 1
+    std::vector<std::pair<uint32_t, uint32_t>> alist = {
+        {0x0800'0000, 0x0000'0100}, // SETBUFF in 0, 256 bytes
+        {0x0400'0000, 0x0000'3000}, // LOADBUFF
+    };
+    uint32_t state = 0x5000, out = 0x4000;
+    for (uint32_t pitch : {0x4000u, 0x5555u, 0x8000u, 0xB000u, 0xFFFFu})
+    {
+        for (uint32_t flags : {0x01u, 0x00u})
+        {
+            alist.push_back({0x0800'0010, 0x0200'0040}); // SETBUFF in 0x10, out 0x200, 64 bytes
+            alist.push_back({0x0500'0000 | (flags << 16) | pitch, state});
+            alist.push_back({0x0800'0200, 0x0000'0040}); // SETBUFF in 0x200, 64 bytes
+            alist.push_back({0x0600'0000, out});         // SAVEBUFF
+            out += 0x40;
+        }
+    }
+    for (size_t i = 0; i < alist.size(); i++)
+    {
+        QA::WriteRDRAM32(initial, 0x2000 + i * 8, alist[i].first);
+        QA::WriteRDRAM32(initial, 0x2000 + i * 8 + 4, alist[i].second);
+    }
+
+    std::array<uint32_t, 16> task{};
+    task[0] = HLETask::AUDIO;
+    task[4] = 0x10000;
+    task[5] = text.size();
+    task[6] = 0x20000;
+    task[7] = data.size();
+    task[12] = 0x2000;
+    task[13] = alist.size() * 8;
+
+    auto run = [&](bool hle) {
+        std::vector<uint8_t> rdram = initial;
+        hydra::N64::MIInterrupt interrupt;
+        auto rsp = QA::MakeRSP(0);
+        rsp->InstallBuses(rdram.data(), nullptr);
+        rsp->SetMIPtr(&interrupt);
+        rsp->SetHLE(hle);
+        if (hle)
+        {
+            QA::StartTask(*rsp, task);
+        }
+        else
+        {
+            QA::BootMicrocode(*rsp, text, data, task);
+            for (int i = 0; i < 1000 && !QA::IsHalted(*rsp); i++)
+            {
+                rsp->Run(10000);
+            }
+        }
+        EXPECT_TRUE(QA::IsHalted(*rsp)) << (hle ? "HLE" : "LLE");
+        return rdram;
+    };
+    std::vector<uint8_t> hle = run(true);
+    std::vector<uint8_t> lle = run(false);
+    for (uint32_t i = 0x4000; i < out; i += 2)
+    {
+        ASSERT_EQ(QA::ReadRDRAM16(hle, i), QA::ReadRDRAM16(lle, i))
+            << "output sample " << (i - 0x4000) / 2;
+    }
+    for (uint32_t i = 0; i < 10; i += 2)
+    {
+        ASSERT_EQ(QA::ReadRDRAM16(hle, 0x5000 + i), QA::ReadRDRAM16(lle, 0x5000 + i))
+            << "state " << i / 2;
+    }
+}
+
+namespace
+{
+    using Positions = std::vector<std::array<int16_t, 2>>;
+
+    // Scale on the diagonal but for w, in s15.16 with the integer halves first
+    void write_matrix(std::vector<uint8_t>& rdram, uint32_t address, uint32_t scale)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            uint32_t value = i == 3 ? 0x1'0000 : scale;
+            QA::WriteRDRAM16(rdram, address + i * 10, value >> 16);
+            QA::WriteRDRAM16(rdram, address + 32 + i * 10, value);
+        }
+    }
+
+    void write_vertices(std::vector<uint8_t>& rdram, uint32_t address,
+                        const Positions& positions)
+    {
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            QA::WriteRDRAM16(rdram, address + i * 16, positions[i][0]);
+            QA::WriteRDRAM16(rdram, address + i * 16 + 2, positions[i][1]);
+        }
+    }
+
+    // Runs the display list at 0x6000 with the microcode named by version, drawing into a 32x32
+    // framebuffer at 0x10000. The identity matrix is at 0x5000 and a viewport mapping clip
+    // space to the framebuffer at 0x5100
+    void render(std::vector<uint8_t>& rdram, std::string_view version,
+                const std::vector<std::pair<uint32_t, uint32_t>>& dl)
+    {
+        hydra::N64::MIInterrupt interrupt;
+        auto rdp = std::make_unique<hydra::N64::RDP>();
+        rdp->InstallBuses(rdram.data(), nullptr);
+        rdp->SetMIPtr(&interrupt);
+        auto rsp = QA::MakeRSP(0);
+        rsp->InstallBuses(rdram.data(), rdp.get());
+        rsp->SetMIPtr(&interrupt);
+        rsp->SetHLE(true);
+
+        std::copy(version.begin(), version.end(), rdram.begin() + 0x1100);
+        write_matrix(rdram, 0x5000, 0x1'0000);
+        const std::array<uint16_t, 8> viewport = {64, 64, 0x1FF, 0, 64, 64, 0x1FF, 0};
+        for (size_t i = 0; i < viewport.size(); i++)
+        {
+            QA::WriteRDRAM16(rdram, 0x5100 + i * 2, viewport[i]);
+        }
+        write_commands(rdram, 0x6000, dl);
+
+        std::array<uint32_t, 16> task{};
+        task[0] = HLETask::GRAPHICS;
+        task[6] = 0x1000;
+        task[7] = 0x800;
+        task[12] = 0x6000;
+        task[13] = dl.size() * 8;
+        QA::StartTask(*rsp, task);
+
+        ASSERT_TRUE(QA::Status(*rsp).halt);
+        ASSERT_TRUE(QA::Status(*rsp).signal_2);
+        ASSERT_TRUE(interrupt.SP);
+        ASSERT_TRUE(interrupt.DP);
+    }
+
+    uint16_t pixel(const std::vector<uint8_t>& rdram, int x, int y)
+    {
+        return QA::ReadRDRAM16(rdram, 0x10000 + (y * 32 + x) * 2);
+    }
+
+    // Segment 1 at the framebuffer, which is filled with white
+    const std::vector<std::pair<uint32_t, uint32_t>> fill_setup = {
+        {0xFF10'001F, 0x0100'0000}, // G_SETCIMG rgba16, 32 wide, segment 1
+        {0xED00'0000, 0x0008'0080}, // G_SETSCISSOR 32x32
+        {0xEF30'0000, 0x0000'0000}, // G_RDPSETOTHERMODE fill
+        {0xF700'0000, 0xFFFF'FFFF}, // G_SETFILLCOLOR
+    };
+
+    // Top left and bottom right halves of the screen, clockwise in clip space so the first
+    // one is a back face once y is flipped, and three vertices right of the screen
+    const Positions top_left = {{-1, 1}, {1, 1}, {-1, -1}};
+    const Positions bottom_right = {{1, -1}, {1, 1}, {-1, -1}};
+    const Positions offscreen = {{4, 1}, {4, -1}, {5, 0}};
+} // namespace
+
+TEST(RSPHLE, F3DEX2Triangle)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    write_vertices(rdram, 0x5200, top_left);
+
+    std::vector<std::pair<uint32_t, uint32_t>> dl = {
+        {0xDB06'0004, 0x0001'0000}, // G_MOVEWORD segment 1
+    };
+    dl.insert(dl.end(), fill_setup.begin(), fill_setup.end());
+    dl.insert(dl.end(), {
+                            {0xDA38'0007, 0x0000'5000}, // G_MTX projection load
+                            {0xDA38'0003, 0x0000'5000}, // G_MTX modelview load
+                            {0xDC08'0008, 0x0000'5100}, // G_MOVEMEM viewport
+                            {0x0100'3006, 0x0000'5200}, // G_VTX 3 at 0
+                            {0x0500'0204, 0x0000'0000}, // G_TRI1 0 1 2
+                            {0xE900'0000, 0x0000'0000}, // G_RDPFULLSYNC
+                            {0xDF00'0000, 0x0000'0000}, // G_ENDDL
+                        });
+    render(rdram, "RSP Gfx ucode F3DEX       fifo 2.08  Yoshitaka Yasumoto 1999 Nintendo.", dl);
+
+    // The triangle covers the top left half of the framebuffer
+    ASSERT_NE(pixel(rdram, 4, 4), 0);
+    ASSERT_NE(pixel(rdram, 24, 4), 0);
+    ASSERT_NE(pixel(rdram, 4, 24), 0);
+    ASSERT_EQ(pixel(rdram, 24, 24), 0);
+    ASSERT_EQ(pixel(rdram, 20, 20), 0);
+}
+
+TEST(RSPHLE, Fast3DMatrixAndCull)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    write_matrix(rdram, 0x5040, 0x8000);
+    write_vertices(rdram, 0x5200, top_left);
+    write_vertices(rdram, 0x5240, offscreen);
+    write_vertices(rdram, 0x5280, bottom_right);
+
+    std::vector<std::pair<uint32_t, uint32_t>> dl = {
+        {0xBC00'0406, 0x0001'0000}, // G_MOVEWORD segment 1
+    };
+    dl.insert(dl.end(), fill_setup.begin(), fill_setup.end());
+    dl.insert(dl.end(), {
+                            {0x0103'0040, 0x0000'5000}, // G_MTX projection load
+                            {0x0102'0040, 0x0000'5000}, // G_MTX modelview load
+                            {0x0104'0040, 0x0000'5040}, // G_MTX modelview push, times 0.5
+                            {0x0380'0010, 0x0000'5100}, // G_MOVEMEM viewport
+                            {0x0420'0030, 0x0000'5200}, // G_VTX 3 at 0
+                            {0xBF00'0000, 0x0000'0A14}, // G_TRI1 0 1 2
+                            {0xBD00'0000, 0x0000'0000}, // G_POPMTX
+                            {0x0600'0000, 0x0000'6200}, // G_DL
+                            {0xE900'0000, 0x0000'0000}, // G_RDPFULLSYNC
+                            {0xB800'0000, 0x0000'0000}, // G_ENDDL
+                        });
+    write_commands(rdram, 0x6200, {
+                                      {0x0423'0030, 0x0000'5240}, // G_VTX 3 at 3
+                                      {0xBE00'0078, 0x0000'00F0}, // G_CULLDL 3 to 5
+                                      {0x0420'0030, 0x0000'5280}, // G_VTX 3 at 0
+                                      {0xBF00'0000, 0x0000'0A14}, // G_TRI1 0 1 2
+                                      {0xB800'0000, 0x0000'0000}, // G_ENDDL
+                                  });
+    render(rdram, "RSP SW Version: 2.0D, 04-01-96", dl);
+
+    // The first triangle is scaled to cover the top left of the middle of the screen
+    ASSERT_NE(pixel(rdram, 10, 10), 0);
+    ASSERT_NE(pixel(rdram, 20, 10), 0);
+    ASSERT_EQ(pixel(rdram, 4, 4), 0);
+    ASSERT_EQ(pixel(rdram, 4, 24), 0);
+    // The vertices it checks are all right of the screen, so G_CULLDL ends the called list
+    // before the second triangle
+    ASSERT_EQ(pixel(rdram, 20, 20), 0);
+    ASSERT_EQ(pixel(rdram, 28, 28), 0);
+}
+
+TEST(RSPHLE, F3DEXBackFaceAndCull)
+{
+    std::vector<uint8_t> rdram(hydra::N64::RDRAM_EXPANSION_SIZE);
+    Positions positions = top_left;
+    positions.insert(positions.end(), bottom_right.begin(), bottom_right.end());
+    positions.insert(positions.end(), offscreen.begin(), offscreen.end());
+    write_vertices(rdram, 0x5200, positions);
+
+    std::vector<std::pair<uint32_t, uint32_t>> dl = {
+        {0xBC00'0406, 0x0001'0000}, // G_MOVEWORD segment 1
+    };
+    dl.insert(dl.end(), fill_setup.begin(), fill_setup.end());
+    dl.insert(dl.end(), {
+                            {0xB700'0000, 0x0000'2000}, // G_SETGEOMETRYMODE G_CULL_BACK
+                            {0x0103'0040, 0x0000'5000}, // G_MTX projection load
+                            {0x0102'0040, 0x0000'5000}, // G_MTX modelview load
+                            {0x0380'0010, 0x0000'5100}, // G_MOVEMEM viewport
+                            {0x0400'248F, 0x0000'5200}, // G_VTX 9 at 0
+                            {0xB100'0204, 0x0006'080A}, // G_TRI2 0 1 2, 3 4 5
+                            {0x0600'0000, 0x0000'6200}, // G_DL
+                            {0xE900'0000, 0x0000'0000}, // G_RDPFULLSYNC
+                            {0xB800'0000, 0x0000'0000}, // G_ENDDL
+                        });
+    write_commands(rdram, 0x6200, {
+                                      {0xBE00'000C, 0x0000'0010}, // G_CULLDL 6 to 8
+                                      {0xBF00'0000, 0x0000'0402}, // G_TRI1 0 2 1
+                                      {0xB800'0000, 0x0000'0000}, // G_ENDDL
+                                  });
+    render(rdram, "RSP Gfx ucode F3DEX       fifo 1.23 Yoshitaka Yasumoto 1998 Nintendo.", dl);
+
+    // Only the front facing bottom right triangle of the pair is drawn, and the front facing
+    // top left one after G_CULLDL is never reached
+    ASSERT_EQ(pixel(rdram, 4, 4), 0);
+    ASSERT_EQ(pixel(rdram, 8, 16), 0);
+    ASSERT_NE(pixel(rdram, 24, 24), 0);
+    ASSERT_NE(pixel(rdram, 28, 8), 0);
+}
+
+TEST(RSPSlice, OnlyScheduledWhileRunning)
+{
+    // Takes a few slices and halts
+    const std::vector<uint32_t> program = {
+        0x2401'0064, // addiu r1, r0, 100
+        0x2421'FFFF, // addiu r1, r1, -1
+        0x1420'FFFE, // bne r1, r0, -2
+        0x0000'0000, // nop
+        0x0000'000D, // break
+    };
+
+    bool should_draw = false;
+    hydra::N64::N64 n64(should_draw);
+    n64.Reset();
+    hydra::N64::RSP& rsp = QA::GetRSP(n64);
+    QA::WriteIMEM(rsp, 0, program);
+    ASSERT_FALSE(QA::IsSliceScheduled(n64));
+
+    // Started by the CPU like a game would
+    QA::CPUStoreWord(n64, 0xFFFF'FFFF'A408'0000, 0);
+    hydra::N64::RSPStatusWrite write;
+    write.full = 0;
+    write.clear_halt = true;
+    write.clear_broke = true;
+    QA::CPUStoreWord(n64, 0xFFFF'FFFF'A404'0010, write.full);
+    ASSERT_TRUE(QA::IsSliceScheduled(n64));
+
+    int slices = 0;
+    while (QA::IsSliceScheduled(n64))
+    {
+        ASSERT_LT(slices, 100);
+        QA::RunSlice(n64);
+        slices++;
+    }
+    ASSERT_TRUE(QA::IsHalted(rsp));
+    ASSERT_GT(slices, 1);
+}
+
+TEST(RSPThread, MatchesInline)
+{
+    // Fills DMEM with a running sum, DMAs it to RDRAM and breaks, over a few dozen slices
+    const std::vector<uint32_t> program = {
+        0x2401'0400, // addiu r1, r0, 0x400
+        0x2402'0000, // addiu r2, r0, 0
+        0x2403'0000, // addiu r3, r0, 0
+        0x2442'0003, // addiu r2, r2, 3
+        0xAC62'0000, // sw r2, 0(r3)
+        0x2463'0004, // addiu r3, r3, 4
+        0x3063'07FC, // andi r3, r3, 0x7FC
+        0x2421'FFFF, // addiu r1, r1, -1
+        0x1420'FFFA, // bne r1, r0, -6
+        0x0000'0000, // nop
+        0x2404'0000, // addiu r4, r0, 0
+        0x2405'1000, // addiu r5, r0, 0x1000
+        0x2406'07FF, // addiu r6, r0, 0x7FF
+        0x4084'0000, // mtc0 r4, SP_MEM_ADDR
+        0x4085'0800, // mtc0 r5, SP_DRAM_ADDR
+        0x4086'1800, // mtc0 r6, SP_WR_LEN
+        0x0000'000D, // break
+    };
+
+    struct Instance
+    {
+        std::unique_ptr<hydra::N64::RSP> rsp = QA::MakeRSP(0);
+        std::vector<uint8_t> rdram = std::vector<uint8_t>(hydra::N64::RDRAM_EXPANSION_SIZE);
+        hydra::N64::MIInterrupt mi_interrupt{};
+        uint32_t written = 0;
+
+        Instance()
+        {
+            rsp->InstallBuses(rdram.data(), nullptr);
+            rsp->SetMIPtr(&mi_interrupt);
+            rsp->SetRDRAMWriteCallback(
+                [this](uint32_t, uint32_t length) { written += length; });
+        }
+    };
+
+    Instance inline_run, threaded_run;
+    threaded_run.rsp->SetThread(true);
+    for (Instance* instance : {&inline_run, &threaded_run})
+    {
+        QA::WriteIMEM(*instance->rsp, 0, program);
+        QA::Start(*instance->rsp, 0);
+    }
+
+    for (int slice = 0; slice < 1000 && !QA::IsHalted(*inline_run.rsp); slice++)
+    {
+        inline_run.rsp->Run(64);
+    }
+    for (int slice = 0; slice < 1000; slice++)
+    {
+        threaded_run.rsp->RunAsync(64);
+        threaded_run.rsp->Sync();
+        if (QA::IsHalted(*threaded_run.rsp))
+        {
+            break;
+        }
+    }
+
+    ASSERT_TRUE(QA::IsHalted(*inline_run.rsp));
+    ASSERT_TRUE(QA::SameState(*inline_run.rsp, *threaded_run.rsp));
+    ASSERT_TRUE(inline_run.rdram == threaded_run.rdram);
+    ASSERT_EQ(inline_run.written, 0x800u);
+    ASSERT_EQ(threaded_run.written, 0x800u);
+    ASSERT_TRUE(threaded_run.mi_interrupt.SP);
+}
+
+TEST(RSPThread, CPUWaitsForSPMemory)
+{
+    // Counts for a while and only then writes the result to DMEM, so the CPU gets there first
+    // if it doesn't wait for the slice
+    const std::vector<uint32_t> program = {
+        0x3C01'0001, // lui r1, 1
+        0x2402'0000, // addiu r2, r0, 0
+        0x2442'0003, // addiu r2, r2, 3
+        0x2421'FFFF, // addiu r1, r1, -1
+        0x1420'FFFD, // bne r1, r0, -3
+        0x0000'0000, // nop
+        0xAC02'0010, // sw r2, 0x10(r0)
+        0x8C03'0020, // lw r3, 0x20(r0)
+        0xAC03'0024, // sw r3, 0x24(r0)
+        0x0000'000D, // break
+    };
+
+    bool should_draw = false;
+    hydra::N64::N64 n64(should_draw);
+    n64.Reset();
+    n64.SetRSPThread(true);
+    hydra::N64::RSP& rsp = QA::GetRSP(n64);
+    for (int run = 0; run < 2; run++)
+    {
+        QA::WriteIMEM(rsp, 0, program);
+        std::memset(QA::Memory(rsp), 0, 0x100);
+        QA::Start(rsp, 0);
+        rsp.RunAsync(0x50000);
+        if (run == 0)
+        {
+            ASSERT_EQ(QA::CPULoadWord(n64, 0xFFFF'FFFF'A400'0010), 0x30000u);
+        }
+        else
+        {
+            // A store while the slice runs lands after it, the RSP already read the word
+            QA::CPUStoreWord(n64, 0xFFFF'FFFF'A400'0020, 0x1234'5678);
+            ASSERT_EQ(QA::CPULoadWord(n64, 0xFFFF'FFFF'A400'0024), 0u);
+            ASSERT_EQ(QA::CPULoadWord(n64, 0xFFFF'FFFF'A400'0020), 0x1234'5678u);
+        }
+        ASSERT_TRUE(QA::IsHalted(rsp));
+    }
+}
+
+TEST(RSPThread, CPUWaitsForRDRAMWrittenBySlice)
+{
+    // DMAs 2KB of DMEM to RDRAM and then counts for a while, so the slice is still running
+    // when the CPU reads what it wrote
+    const std::vector<uint32_t> program = {
+        0x2404'0000, // addiu r4, r0, 0
+        0x3C05'0001, // lui r5, 1
+        0x2406'07FF, // addiu r6, r0, 0x7FF
+        0x4084'0000, // mtc0 r4, SP_MEM_ADDR
+        0x4085'0800, // mtc0 r5, SP_DRAM_ADDR
+        0x4086'1800, // mtc0 r6, SP_WR_LEN
+        0x3C01'0001, // lui r1, 1
+        0x2421'FFFF, // addiu r1, r1, -1
+        0x1420'FFFE, // bne r1, r0, -2
+        0x0000'0000, // nop
+        0x0000'000D, // break
+    };
+
+    bool should_draw = false;
+    hydra::N64::N64 n64(should_draw);
+    n64.Reset();
+    n64.SetRSPThread(true);
+    hydra::N64::RSP& rsp = QA::GetRSP(n64);
+    QA::WriteIMEM(rsp, 0, program);
+    std::memset(QA::Memory(rsp), 0xAB, 0x800);
+    QA::Start(rsp, 0);
+    rsp.RunAsync(0x50000);
+    ASSERT_EQ(QA::CPULoadWord(n64, 0xFFFF'FFFF'A001'07FC), 0xABAB'ABABu);
+    ASSERT_TRUE(QA::IsHalted(rsp));
+}
+
+TEST(RSPThread, CPUAndDMAsOnSamePage)
+{
+    // Bumps a counter in DMEM, DMAs DMEM 0-0xFF to RDRAM 0x10000 and RDRAM 0x10000-0x101FF
+    // back to DMEM 0x100, then copies the word the CPU stores at 0x10100 to DMEM 4, forever
+    const std::vector<uint32_t> program = {
+        0x2404'0000, // addiu r4, r0, 0
+        0x3C05'0001, // lui r5, 1
+        0x2406'01FF, // addiu r6, r0, 0x1FF
+        0x2407'0100, // addiu r7, r0, 0x100
+        0x2408'00FF, // addiu r8, r0, 0xFF
+        0x8C02'0000, // lw r2, 0(r0)
+        0x2442'0001, // addiu r2, r2, 1
+        0xAC02'0000, // sw r2, 0(r0)
+        0x4084'0000, // mtc0 r4, SP_MEM_ADDR
+        0x4085'0800, // mtc0 r5, SP_DRAM_ADDR
+        0x4088'1800, // mtc0 r8, SP_WR_LEN
+        0x4087'0000, // mtc0 r7, SP_MEM_ADDR
+        0x4085'0800, // mtc0 r5, SP_DRAM_ADDR
+        0x4086'1000, // mtc0 r6, SP_RD_LEN
+        0x8C03'0200, // lw r3, 0x200(r0)
+        0x0800'0005, // j 0x14
+        0xAC03'0004, // sw r3, 4(r0)
+    };
+
+    // The CPU stores to and loads from the page while slices of all lengths are in flight.
+    // Each access waits for the slice, so the threaded run has to see what the inline one does
+    auto run = [&program](bool threaded) {
+        bool should_draw = false;
+        auto n64 = std::make_unique<hydra::N64::N64>(should_draw);
+        n64->Reset();
+        n64->SetRSPThread(threaded);
+        hydra::N64::RSP& rsp = QA::GetRSP(*n64);
+        QA::WriteIMEM(rsp, 0, program);
+        std::memset(QA::Memory(rsp), 0, 0x1000);
+        QA::Start(rsp, 0);
+        std::vector<uint32_t> loads;
+        for (uint32_t i = 0; i < 2000; i++)
+        {
+            rsp.RunAsync(20 + i % 37);
+            QA::CPUStoreWord(*n64, 0xFFFF'FFFF'A001'0100, i * 3 + 1);
+            QA::CPUStoreWord(*n64, 0xFFFF'FFFF'A001'0000 + (i % 64) * 4, i);
+            loads.push_back(QA::CPULoadWord(*n64, 0xFFFF'FFFF'A001'0000));
+            loads.push_back(QA::CPULoadWord(*n64, 0xFFFF'FFFF'A001'0004));
+            loads.push_back(QA::CPULoadWord(*n64, 0xFFFF'FFFF'A001'0100 + (i % 128) * 4));
+        }
+        rsp.Sync();
+        std::vector<uint8_t> dmem(QA::Memory(rsp), QA::Memory(rsp) + 0x1000);
+        return std::make_pair(loads, dmem);
+    };
+
+    auto expected = run(false);
+    // The word the CPU stored made it through the RSP and back, so the DMAs did happen
+    bool copied = false;
+    for (size_t i = 1; i < expected.first.size(); i += 3)
+    {
+        copied |= expected.first[i] % 3 == 1;
+    }
+    ASSERT_TRUE(copied);
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        auto actual = run(true);
+        ASSERT_TRUE(actual.first == expected.first) << "attempt " << attempt;
+        ASSERT_TRUE(actual.second == expected.second) << "attempt " << attempt;
+    }
+}
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <nes/nes_apu.hxx>
+#include <nes/nes_cpu.hxx>
+#include <nes/nes_cpubus.hxx>
+#include <nes/nes_ppu.hxx>
+#include <vector>
+
+// Instructions per second of the NES interpreter, on a small loop of ALU, memory and branch
+// instructions run from a NROM cartridge written to a temporary file. Every bus cycle of the
+// CPU also steps the PPU and APU, so they are part of the numbers. Best of a few runs, as the
+// numbers are noisy
+
+namespace
+{
+    constexpr uint64_t INSTRUCTIONS = 20'000'000;
+    constexpr int RUNS = 3;
+
+    // clang-format off
+    constexpr std::array<uint8_t, 22> program = {
+        0xA2, 0x00,       // ldx #0
+        0xE8,             // inx
+        0x8A,             // txa
+        0x69, 0x03,       // adc #3
+        0x85, 0x10,       // sta $10
+        0xA5, 0x10,       // lda $10
+        0x29, 0x7F,       // and #$7F
+        0x9D, 0x00, 0x02, // sta $0200,x
+        0x4A,             // lsr a
+        0xD0, 0xF0,       // bne -16
+        0x4C, 0x02, 0x80, // jmp $8002
+        0xEA,             // nop
+    };
+    // clang-format on
+
+    bool write_cartridge(const std::filesystem::path& path)
+    {
+        // iNES header of a mapper 0 cartridge with 32KiB of PRG ROM and 8KiB of CHR ROM
+        std::vector<uint8_t> rom(16 + 0x8000 + 0x2000, 0xEA);
+        std::fill(rom.begin(), rom.begin() + 16, 0);
+        rom[0] = 'N';
+        rom[1] = 'E';
+        rom[2] = 'S';
+        rom[3] = '\032';
+        rom[4] = 2;
+        rom[5] = 1;
+        std::copy(program.begin(), program.end(), rom.begin() + 16);
+        // Reset vector
+        rom[16 + 0x7FFC] = 0x00;
+        rom[16 + 0x7FFD] = 0x80;
+        std::ofstream ofs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        ofs.write(reinterpret_cast<const char*>(rom.data()), rom.size());
+        return ofs.good();
+    }
+
+    double bench(const std::filesystem::path& path)
+    {
+        using namespace hydra::NES;
+        std::atomic_bool paused = false;
+        PPU ppu;
+        APU apu;
+        CPUBus bus(ppu, apu);
+        CPU cpu(bus, paused);
+        if (!bus.LoadCartridge(path.string()))
+        {
+            return 0;
+        }
+        cpu.Reset();
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < INSTRUCTIONS; i++)
+        {
+            cpu.Tick();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return INSTRUCTIONS / elapsed.count();
+    }
+} // namespace
+
+int main()
+{
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "hydra_nes_dispatch_bench.nes";
+    if (!write_cartridge(path))
+    {
+        printf("could not write %s\n", path.string().c_str());
+        return 1;
+    }
+    double best = 0;
+    for (int i = 0; i < RUNS; i++)
+    {
+        best = std::max(best, bench(path));
+    }
+    std::filesystem::remove(path);
+    printf("nes cpu %8.2f MIPS\n", best / 1e6);
+    return 0;
+}
@@ -480,6 +480,12 @@ void N64Debugger::create_Disassembler_tab()
         disassembler_text_->Goto(emulator_->n64_impl_.cpu_.pc_);
     });
     Disassembler_layout->addWidget(goto_pc_button, 0, 3, 1, 1);
+    QPushButton* dump_profile_button = new QPushButton("Dump profile");
+    connect(dump_profile_button, &QPushButton::clicked, this, [this]() {
+        std::shared_lock lock(emulator_->DataMutex);
+        emulator_->n64_impl_.DumpProfile("n64_profile");
+    });
+    Disassembler_layout->addWidget(dump_profile_button, 0, 4, 1, 1);
     Disassembler_layout->addItem(
         new QSpacerItem(0, 0, QSizePolicy::Minimum, QSizePolicy::Expanding), 100, 0, 1, 1);
 }